@@ -6,10 +6,15 @@
 #include "Decawave.hpp"
 #include "RJBaseUSBDevice.hpp"
 #include "SharedSPI.hpp"
+#include "heartbeat.hpp"
 #include "firmware-common/base2015/usb-interface.hpp"
+#include "firmware-common/common2015/utils/channel-manager.hpp"
+#include "firmware-common/common2015/utils/control-codec.hpp"
+#include "firmware-common/common2015/utils/forward-packet.hpp"
 #include "logger.hpp"
 #include "logger.hpp"
 #include "pins.hpp"
+#include "robot-links.hpp"
 #include "watchdog.hpp"
 
 #define RJ_WATCHDOG_TIMER_VALUE 2  // seconds
@@ -20,6 +25,15 @@ using namespace std;
 RJBaseUSBDevice usbLink(RJ_BASE2015_VENDOR_ID, RJ_BASE2015_PRODUCT_ID,
                         RJ_BASE2015_RELEASE);
 
+// link statistics and clock offsets for each robot
+RobotLinks robotLinks;
+
+// decides when to move everyone to another radio channel
+unique_ptr<ChannelPlanner> channelPlanner;
+
+// sends robots what changed in their control messages, when they can take it
+ControlEncoder controlEncoder;
+
 bool initRadio() {
     // setup SPI bus
     shared_ptr<SharedSPI> sharedSPI =
@@ -39,20 +53,70 @@ bool initRadio() {
     return global_radio->isConnected();
 }
 
+/**
+ * Measures the noise floor on the next channel in the planner's scan while
+ * no one is sending, between the last reply of a frame and the next forward
+ * packet, and comes back to the current channel.
+ */
+void scanNoiseFloor() {
+    // radios that can't measure noise (like the DW1000) say so right away
+    float dBm;
+    if (!global_radio->sampleNoise(&dBm)) return;
+
+    const uint8_t current = channelPlanner->channel();
+    const uint8_t channel = channelPlanner->scanChannel();
+    if (channel != current) {
+        global_radio->setChannel(channel);
+
+        // the reading takes a few symbols to settle after retuning
+        bool valid = false;
+        for (int i = 0; i < 10 && !valid; i++) {
+            wait_us(50);
+            valid = global_radio->sampleNoise(&dBm);
+        }
+        global_radio->setChannel(current);
+        if (!valid) return;
+    }
+    channelPlanner->noiseSample(channel, dBm);
+}
+
 void radioRxHandler(rtp::packet pkt) {
     LOG(INF3, "radioRxHandler()");
     // write packet content (including header) out to EPBULK_IN
     vector<uint8_t> buf;
     pkt.pack(&buf);
 
-    // drop the packet if it's the wrong size. Thsi will need to be changed if
-    // we have variable-sized reply packets
-    if (buf.size() != rtp::Reverse_Size) {
-        LOG(WARN, "Dropping packet, wrong size '%u', should be '%u'",
+    // drop the packet if it's too short to parse.  Robots with newer firmware
+    // may add fields to the end.  OTA status replies are forwarded as-is since
+    // they aren't the same size as a control reply.
+    if (pkt.header.port == rtp::Port::CONTROL &&
+        buf.size() < rtp::Reverse_Size) {
+        LOG(WARN, "Dropping packet, wrong size '%u', should be at least '%u'",
             buf.size(), rtp::Reverse_Size);
         return;
     }
 
+    if (pkt.header.port == rtp::Port::CONTROL) {
+        channelPlanner->replyReceived();
+
+        const uint8_t* payload = pkt.payload.data();
+        const auto status =
+            reinterpret_cast<const rtp::RobotStatusMessage*>(payload);
+        payload += sizeof(rtp::RobotStatusMessage);
+        const auto summary = reinterpret_cast<const rtp::LinkSummary*>(payload);
+        payload += sizeof(rtp::LinkSummary);
+        const auto stamps =
+            reinterpret_cast<const rtp::ReplyTimestamps*>(payload);
+
+        // it got the last forward packet, so it can decode changes from it
+        controlEncoder.acked(status->uid);
+
+        // the base station's last transmission was the forward packet that
+        // the robot is replying to
+        robotLinks.update(pkt, *status, *summary, *stamps,
+                          global_radio->lastTxTimestamp());
+    }
+
     bool success = usbLink.writeNB(EPBULK_IN, buf.data(), buf.size(),
                                    MAX_PACKET_SIZE_EPBULK);
 
@@ -83,7 +147,8 @@ int main() {
 
         // register handlers for any ports we might use
         for (rtp::Port port :
-             {rtp::Port::CONTROL, rtp::Port::PING, rtp::Port::LEGACY}) {
+             {rtp::Port::CONTROL, rtp::Port::PING, rtp::Port::LEGACY,
+              rtp::Port::OTA}) {
             CommModule::Instance->setRxHandler(&radioRxHandler, port);
             CommModule::Instance->setTxHandler((CommLink*)global_radio,
                                                &CommLink::sendPacket, port);
@@ -94,6 +159,9 @@ int main() {
 
     global_radio->setAddress(rtp::BASE_STATION_ADDRESS);
 
+    channelPlanner =
+        make_unique<ChannelPlanner>(global_radio->numChannels(), 0);
+
     DigitalOut radioStatusLed(LED4, global_radio->isConnected());
 
     // set callbacks for usb control transfers
@@ -110,9 +178,10 @@ int main() {
         [](uint8_t strobe) {  // global_radio->strobe(strobe);
             LOG(INIT, "trying to strobe");
         };
+    // the robots are told about the new channel before we move to it
     usbLink.setRadioChannelCallback = [](uint8_t chanNumber) {
-        // global_radio->setChannel(chanNumber);
-        LOG(INIT, "(Not) Set radio channel to %u", chanNumber);
+        channelPlanner->requestChannel(chanNumber);
+        LOG(INIT, "Moving to radio channel %u", chanNumber);
     };
 
     LOG(INIT, "Initializing USB interface...");
@@ -128,10 +197,20 @@ int main() {
     uint8_t buf[MAX_PACKET_SIZE_EPBULK];
     uint32_t bufSize;
 
+    uint8_t forwardSeq = 0;
+    bool starved = false;
+
     while (true) {
-        // make sure we can always reach back to main by renewing the watchdog
-        // timer periodically
-        Watchdog::Renew();
+        // renew the watchdog timer periodically, as long as main and the
+        // radio threads are still running.  The crash log's retained RAM is
+        // the USB stack's here, so there's no record kept of which one
+        // stopped.
+        if (Heartbeat::Check()) {
+            Watchdog::Renew();
+        } else if (!starved) {
+            starved = true;
+            LOG(FATAL, "A radio thread stopped running, resetting");
+        }
         // attempt to read data from EPBULK_OUT
         // if data is available, write it into @pkt and send it
         if (usbLink.readEP_NB(EPBULK_OUT, buf, &bufSize,
@@ -145,6 +224,72 @@ int main() {
             // send to all robots
             pkt.header.address = rtp::ROBOT_ADDRESS;
 
+            // control packets come over USB as just the control messages,
+            // however many robots there are.  Number them so the robots can
+            // tell what they missed, and tell them what channel to be on next.
+            //
+            // With the Trajectories type, there's a count byte first and a
+            // trajectories section (see rtp::TrajectoriesSize()) after them.
+            // Tuning packets go out as they are.
+            if (pkt.header.port == rtp::Port::CONTROL &&
+                pkt.header.type != rtp::header_data::Tuning) {
+                size_t start = 0;
+                size_t count = pkt.payload.size() / sizeof(rtp::ControlMessage);
+                size_t trajectoriesSize = 0;
+                if (pkt.header.type == rtp::header_data::Trajectories &&
+                    !pkt.payload.empty()) {
+                    start = 1;
+                    count = pkt.payload[0];
+                    const size_t end =
+                        start + count * sizeof(rtp::ControlMessage);
+                    if (end < pkt.payload.size()) {
+                        trajectoriesSize = rtp::TrajectoriesSize(
+                            pkt.payload.data() + end, pkt.payload.size() - end);
+                    }
+                    if (end + trajectoriesSize != pkt.payload.size()) {
+                        LOG(WARN, "Dropping malformed trajectories packet");
+                        continue;
+                    }
+                    pkt.header.type = rtp::header_data::Control;
+                } else if (pkt.payload.size() % sizeof(rtp::ControlMessage)) {
+                    count = rtp::MAX_FORWARD_ENTRIES + 1;
+                }
+                if (count > rtp::MAX_FORWARD_ENTRIES) {
+                    LOG(WARN,
+                        "Dropping control packet, %u bytes isn't up to %u "
+                        "control messages",
+                        pkt.payload.size(), rtp::MAX_FORWARD_ENTRIES);
+                    continue;
+                }
+
+                pkt.header.seq = forwardSeq++;
+
+                scanNoiseFloor();
+
+                rtp::ChannelSchedule schedule;
+                if (channelPlanner->startFrame(&schedule)) {
+                    global_radio->setChannel(channelPlanner->channel());
+                    LOG(INIT, "Moved to radio channel %u",
+                        channelPlanner->channel());
+                }
+
+                const std::vector<uint8_t> messages = std::move(pkt.payload);
+                const auto msgs = reinterpret_cast<const rtp::ControlMessage*>(
+                    messages.data() + start);
+                const uint8_t* trajectories =
+                    messages.data() + start + count * sizeof(*msgs);
+                pkt.payload.clear();
+
+                // the trajectories are extra, so if they don't fit, the
+                // robots can do without them
+                if (!controlEncoder.encode(schedule, msgs, count, &pkt.payload,
+                                           trajectories, trajectoriesSize)) {
+                    LOG(WARN, "Dropping %u bytes of trajectories, too big",
+                        trajectoriesSize);
+                    controlEncoder.encode(schedule, msgs, count, &pkt.payload);
+                }
+            }
+
             // transmit!
             CommModule::Instance->send(std::move(pkt));
         }
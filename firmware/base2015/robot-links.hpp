@@ -0,0 +1,116 @@
+#pragma once
+
+#include "firmware-common/common2015/utils/link-stats.hpp"
+#include "firmware-common/common2015/utils/rtp.hpp"
+#include "logger.hpp"
+
+/**
+ * Keeps track of the link to each robot: loss and signal quality of its
+ * replies, what it reports about the forward link, how quickly it replies,
+ * and the offset between its radio clock and the base station's.
+ */
+class RobotLinks {
+public:
+    /// Robots tracked at once.  Any beyond this are ignored.
+    static const size_t MAX_ROBOTS = 8;
+
+    /// Replies between log messages for a robot, about a second's worth
+    static const unsigned int LOG_INTERVAL = 60;
+
+    /**
+     * Handles a robot's reply.
+     *
+     * @param sent  When the forward packet it answers went out, on the base
+     *              station's radio clock
+     */
+    void update(const rtp::packet& reply, const rtp::RobotStatusMessage& status,
+                const rtp::LinkSummary& summary,
+                const rtp::ReplyTimestamps& stamps,
+                radio_time::Timestamp sent) {
+        Robot* r = find(status.uid);
+        if (!r) return;
+
+        r->replies.received(reply.header.seq, reply.rxQuality);
+        r->forward = summary;
+
+        // the robot has now told us when its previous reply went out, which
+        // completes the previous exchange
+        if (r->pending && radio_time::fromBytes(stamps.prevRx) == r->last.t2) {
+            r->last.t3 = radio_time::fromBytes(stamps.prevTx);
+            r->clock.add(r->last);
+        }
+
+        const radio_time::Timestamp received = reply.rxTimestamp;
+        r->last.t1 = sent;
+        r->last.t2 = radio_time::fromBytes(stamps.rx);
+        r->last.t4 = received;
+        r->pending = sent != radio_time::UNKNOWN &&
+                     r->last.t2 != radio_time::UNKNOWN &&
+                     received != radio_time::UNKNOWN;
+
+        const int64_t latency = radio_time::diff(received, sent);
+        if (r->pending && latency > 0) {
+            r->replies.addLatencyUs(radio_time::ticksToUs(latency));
+        }
+
+        if (r->replies.packets % LOG_INTERVAL == 0) log(*r);
+    }
+
+    /// The clock estimate for a robot, or nullptr if it isn't being tracked
+    const radio_time::OffsetEstimator* clock(uint8_t uid) const {
+        for (const Robot& r : _robots) {
+            if (r.uid == uid) return &r.clock;
+        }
+        return nullptr;
+    }
+
+private:
+    struct Robot {
+        uint8_t uid = rtp::INVALID_ROBOT_UID;
+        bool pending = false;
+
+        /// Replies from the robot, with their latency from the forward packet
+        LinkStats replies;
+
+        /// The robot's view of the forward link
+        rtp::LinkSummary forward = {};
+
+        /// The last exchange, which is missing t3 until the next reply
+        radio_time::Exchange last;
+        radio_time::OffsetEstimator clock;
+    };
+
+    static void log(const Robot& r) {
+        const LinkStats& s = r.replies;
+        LOG(INF1,
+            "Robot %u link:\r\n"
+            "    Forward: %u%% lost, %d dBm, LQI %u, up to %u in a row\r\n"
+            "    Replies: %.0f%% lost, %.0f dBm, LQI %.0f, up to %lu in a "
+            "row\r\n"
+            "    Replied after %.0f us (%.0f - %.0f), round trip %.3f us\r\n"
+            "    Clock offset %.3f us, %+.2f ppm (%u exchanges thrown out)",
+            r.uid, r.forward.loss, r.forward.rssi, r.forward.lqi,
+            r.forward.longestBurst, s.lossRate() * 100, s.rssi(), s.lqi(),
+            s.longestBurst, s.latencyUs(), s.minLatencyUs, s.maxLatencyUs,
+            r.clock.lastRttUs,
+            radio_time::ticksToUs(r.clock.offsetAt(r.last.t1)),
+            r.clock.ratePpm(), r.clock.rejected);
+    }
+
+    Robot* find(uint8_t uid) {
+        if (uid == rtp::INVALID_ROBOT_UID) return nullptr;
+
+        for (Robot& r : _robots) {
+            if (r.uid == uid) return &r;
+        }
+        for (Robot& r : _robots) {
+            if (r.uid == rtp::INVALID_ROBOT_UID) {
+                r.uid = uid;
+                return &r;
+            }
+        }
+        return nullptr;
+    }
+
+    Robot _robots[MAX_ROBOTS];
+};
@@ -84,6 +84,7 @@ int32_t CC1201::sendPacket(const rtp::packet* pkt) {
     }
 
     // Enter TX mode
+    stampTx();
     strobe(CC1201_STROBE_STX);
 
     // Wait until radio's TX buffer is emptied
@@ -164,7 +165,7 @@ void CC1201::setChannel(uint8_t chanNumber) {
     const uint32_t spacing = 13107;
     uint32_t freq = base + spacing * chanNumber;
 
-    if (freq > 0xFFFFFF) {
+    if (chanNumber >= NUM_CHANNELS) {
         LOG(SEVERE,
             "Attempt to set radio to invalid channel, setting back to channel "
             "0");
@@ -385,10 +386,31 @@ void CC1201::update_rssi() {
     // Only use the top MSB for simplicity. 1 dBm resolution.
     uint8_t offset = readReg(CC1201_RSSI1);
     _rssi = static_cast<float>((int8_t)twos_compliment(offset));
+
+    // the top bit is CRC_OK
+    _lqi = readReg(CC1201_LQI_VAL) & 0x7F;
 }
 
 float CC1201::rssi() { return _rssi; }
 
+bool CC1201::sampleNoise(float* dBm) {
+    // bit 0 of RSSI0 is RSSI_VALID, which is clear for a few symbols after
+    // entering RX, like right after a channel change
+    if (!(readReg(CC1201_RSSI0) & 0x01)) return false;
+
+    // RSSI1 holds the top 8 bits of the reading, already offset to dBm
+    *dBm = static_cast<int8_t>(readReg(CC1201_RSSI1));
+    return true;
+}
+
+rtp::packet::RxQuality CC1201::lastRxQuality() {
+    rtp::packet::RxQuality quality;
+    quality.valid = true;
+    quality.rssi = _rssi;
+    quality.lqi = _lqi;
+    return quality;
+}
+
 uint8_t CC1201::idle() {
     uint8_t status_byte = strobe(CC1201_STROBE_SIDLE);
 
@@ -58,6 +58,9 @@ public:
      */
     int32_t getData(std::vector<uint8_t>* buf);
 
+    /// RSSI and LQI of the last received packet
+    rtp::packet::RxQuality lastRxQuality();
+
     /**
      * Sets the address of the device. Any packet not addressed to this address
      * is filtered out. Packets addressed to the broadcast address 0x00 are
@@ -73,11 +76,18 @@ public:
      * The default value is channel 0.
      *
      * Channel 0 is 916MHz and subsequent channels are increments of 2MHz above
-     * it. For example, channel 1 is 918MHz.  For now, we're only using
-     * channels 0 and 1.
+     * it. For example, channel 1 is 918MHz.  The band ends at 928MHz, so there
+     * are NUM_CHANNELS of them.
      */
     void setChannel(uint8_t chanNumber);
 
+    uint8_t numChannels() const { return NUM_CHANNELS; }
+
+    /// Reads the RSSI while in RX with no packet coming in
+    bool sampleNoise(float* dBm);
+
+    static const uint8_t NUM_CHANNELS = 6;
+
     void reset();
 
     int32_t selfTest();
@@ -1,6 +1,9 @@
 // #include "deca_device_api.h"
 #include "Decawave.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 #include "assert.hpp"
 #include "logger.hpp"
 
@@ -66,6 +69,26 @@ static dwt_txconfig_t txconfig = {
     0x9A9A9A9A,  // TX power
 };
 
+/// Settings that change with the channel.  CommLink channel 0 is the one
+/// above, and the rest are the other channels the DW1000 supports, all at
+/// 64 MHz PRF with the preamble codes and transmit settings Decawave
+/// recommends for them.
+struct ChannelSettings {
+    uint8_t chan;
+    uint8_t preambleCode;
+    uint8_t pgDelay;
+    uint32_t power;
+};
+
+static const ChannelSettings channels[] = {
+    {4, 17, 0x95, 0x9A9A9A9A}, {2, 10, 0xC2, 0x67676767},
+    {5, 12, 0xC0, 0x85858585}, {3, 11, 0xC5, 0x8B8B8B8B},
+    {1, 9, 0xC9, 0x67676767},  {7, 18, 0x93, 0xD1D1D1D1},
+};
+
+// dBm offset in the received signal level calculation at 64 MHz PRF
+#define RSSI_CONSTANT_PRF64 121.74f
+
 #define TX_TO_RX_DELAY_UUS 60
 #define RX_RESP_TO_UUS 5000
 
@@ -112,6 +135,14 @@ Decawave::Decawave(shared_ptr<SharedSPI> sharedSPI, PinName nCs, PinName intPin)
 int32_t Decawave::sendPacket(const rtp::packet* pkt) {
     // Return failutre if not initialized
     if (!_isInit) return COMM_FAILURE;
+
+    // MAC header, our header, the payload, and the CRC
+    if (9 + sizeof(pkt->header) + pkt->payload.size() + 2 > FRAME_LEN_MAX) {
+        LOG(WARN, "Packet too large to send: %u byte payload",
+            pkt->payload.size());
+        return COMM_DEV_BUF_ERR;
+    }
+
     dwt_rxreset();
     dwt_forcetrxoff();
 
@@ -191,6 +222,46 @@ int32_t Decawave::getData(std::vector<uint8_t>* buf) {
     return rx_status;
 }
 
+// The DW1000 stamps frames itself when their SFD goes over the air, which is
+// the same point for the sender and the receiver
+
+radio_time::Timestamp Decawave::lastRxTimestamp() { return _rxTimestamp; }
+
+rtp::packet::RxQuality Decawave::lastRxQuality() { return _rxQuality; }
+
+radio_time::Timestamp Decawave::lastTxTimestamp() {
+    if (!_isInit) return radio_time::UNKNOWN;
+
+    uint8_t stamp[radio_time::TIMESTAMP_SIZE];
+    dwt_readtxtimestamp(stamp);
+    return radio_time::fromBytes(stamp);
+}
+
+uint8_t Decawave::numChannels() const {
+    return sizeof(channels) / sizeof(channels[0]);
+}
+
+void Decawave::setChannel(uint8_t channel) {
+    if (!_isInit) return;
+    if (channel >= numChannels()) {
+        LOG(SEVERE, "Attempt to set radio to invalid channel %u", channel);
+        return;
+    }
+
+    const ChannelSettings& settings = channels[channel];
+    config.chan = settings.chan;
+    config.txCode = settings.preambleCode;
+    config.rxCode = settings.preambleCode;
+    txconfig.PGdly = settings.pgDelay;
+    txconfig.power = settings.power;
+
+    dwt_forcetrxoff();
+    dwt_configure(&config);
+    dwt_configuretxrf(&txconfig);
+    dwt_rxreset();
+    dwt_rxenable(DWT_START_RX_IMMEDIATE);
+}
+
 void Decawave::reset() { dwt_softreset(); }
 
 int32_t Decawave::selfTest() {
@@ -263,11 +334,32 @@ void Decawave::getData_success(const dwt_cb_data_t* cb_data) {
             cb_data->datalength, FRAME_LEN_MAX);
 
         rx_status = COMM_DEV_BUF_ERR;
+        return;
     }
 
     // Read recived data to rx_buffer array
     dwt_readrxdata(rx_buffer, cb_data->datalength, 0);
 
+    // the timestamp stays valid until the next frame comes in, which could
+    // be before getData() returns, so grab it with the data
+    uint8_t stamp[radio_time::TIMESTAMP_SIZE];
+    dwt_readrxtimestamp(stamp);
+    _rxTimestamp = radio_time::fromBytes(stamp);
+
+    // Received signal level, from section 4.7.2 of the DW1000 user manual.
+    // There's no LQI, so use the ratio of the first path's amplitude to the
+    // noise, which drops off quickly without line of sight.
+    dwt_rxdiag_t diag;
+    dwt_readdiagnostics(&diag);
+    if (diag.rxPreamCount && diag.stdNoise) {
+        const float n = diag.rxPreamCount;
+        _rxQuality.valid = true;
+        _rxQuality.rssi =
+            10 * log10f(diag.maxGrowthCIR * 131072.0f / (n * n)) -
+            RSSI_CONSTANT_PRF64;
+        _rxQuality.lqi = std::min(diag.firstPathAmp2 / diag.stdNoise, 255);
+    }
+
     rx_len = cb_data->datalength;
     rx_status = COMM_SUCCESS;
 }
@@ -15,6 +15,11 @@ public:
 
     int32_t sendPacket(const rtp::packet* pkt);
     int32_t getData(std::vector<uint8_t>* buf);
+    radio_time::Timestamp lastRxTimestamp();
+    radio_time::Timestamp lastTxTimestamp();
+    rtp::packet::RxQuality lastRxQuality();
+    uint8_t numChannels() const;
+    void setChannel(uint8_t channel);
     void reset();
     int32_t selfTest();
     bool isConnected() const;
@@ -36,12 +41,14 @@ public:
 
 private:
     uint32_t _chip_version;
-    uint8 rx_buffer[100];  // TODO: better tx and rx buffer
-    uint8 tx_buffer[100];
+    uint8 rx_buffer[FRAME_LEN_MAX];
+    uint8 tx_buffer[FRAME_LEN_MAX];
     bool _isInit;
 
     uint32_t rx_status;
     uint8_t rx_len;
+    radio_time::Timestamp _rxTimestamp = radio_time::UNKNOWN;
+    rtp::packet::RxQuality _rxQuality;
     uint8_t _addr = rtp::INVALID_ROBOT_UID;
 
     void getData_success(const dwt_cb_data_t* cb_data);
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Helpers for loading a bitstream into the Spartan-3E in slave serial mode.
+ *
+ * These are templated on the pin types so that the exact code that runs on the
+ * mbed can also be run against a fake FPGA in the unit tests.
+ */
+
+/// Result of streaming a bitstream out to the FPGA
+enum FpgaConfigResult {
+    FPGA_CONFIG_OK = 0,
+    FPGA_CONFIG_READ_ERROR,  // the bitstream couldn't be read
+    FPGA_CONFIG_INIT_ERROR,  // INIT_B went low, the FPGA saw a CRC error
+};
+
+/**
+ * Clocks bytes out to the FPGA's DIN and CCLK pins, MSB first.  The FPGA
+ * samples DIN on the rising edge of CCLK.
+ *
+ * The bit loop is unrolled and doesn't read anything back, which makes it
+ * several times faster than clocking each byte through SoftwareSPI.
+ */
+template <class DIGITAL_OUT>
+class SlaveSerialPort {
+public:
+    SlaveSerialPort(DIGITAL_OUT& din, DIGITAL_OUT& cclk)
+        : _din(din), _cclk(cclk) {}
+
+    void write(const uint8_t* buf, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            const uint8_t b = buf[i];
+            bit(b & 0x80);
+            bit(b & 0x40);
+            bit(b & 0x20);
+            bit(b & 0x10);
+            bit(b & 0x08);
+            bit(b & 0x04);
+            bit(b & 0x02);
+            bit(b & 0x01);
+        }
+    }
+
+private:
+    void bit(int value) {
+        _din.write(value != 0);
+        _cclk.write(1);
+        _cclk.write(0);
+    }
+
+    DIGITAL_OUT& _din;
+    DIGITAL_OUT& _cclk;
+};
+
+/**
+ * Stream a bitstream to the FPGA one block at a time.
+ *
+ * INIT_B and DONE are only checked between blocks, not after every byte.  If
+ * INIT_B goes low partway through a block, the FPGA simply ignores the rest of
+ * it, so the only cost is clocking out up to one block of extra data.
+ *
+ * @param read      Called as read(buf, bufSize) to fill @buf with the next
+ *                  part of the bitstream.  Returns the number of bytes read,
+ *                  which is 0 at the end of the file.
+ * @param port      Where to send the bitstream, see SlaveSerialPort
+ * @param initB     The FPGA's INIT_B pin
+ * @param done      The FPGA's DONE pin
+ * @param buf       Scratch space for each block
+ * @param bufSize   Size of @buf
+ * @param bytesSent If not null, set to the number of bytes sent
+ */
+template <class READ_FUNC, class PORT, class DIGITAL_IN>
+FpgaConfigResult streamBitstream(READ_FUNC read, PORT& port, DIGITAL_IN& initB,
+                                 DIGITAL_IN& done, uint8_t* buf,
+                                 size_t bufSize, size_t* bytesSent = nullptr) {
+    size_t total = 0;
+    FpgaConfigResult result = FPGA_CONFIG_OK;
+
+    while (true) {
+        if (!initB.read()) {
+            result = FPGA_CONFIG_INIT_ERROR;
+            break;
+        }
+
+        // the FPGA has everything it needs, anything left is padding
+        if (done.read()) break;
+
+        const int n = read(buf, bufSize);
+        if (n < 0) {
+            result = FPGA_CONFIG_READ_ERROR;
+            break;
+        }
+        if (n == 0) break;
+
+        port.write(buf, n);
+        total += n;
+    }
+
+    if (bytesSent) *bytesSent = total;
+    return result;
+}
+
+inline int fpgaHexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c = tolower(c);
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/**
+ * Check whether a hash read back from the FPGA matches the one written out
+ * alongside the bitstream file at build time.
+ *
+ * @param hexHash  The hash from the file, as hex characters.  Anything after
+ *                 the hash (like a trailing newline) is ignored.
+ * @param fpgaHash The hash bytes read with FPGA::git_hash()
+ */
+inline bool fpgaHashMatches(const std::string& hexHash,
+                            const std::vector<uint8_t>& fpgaHash) {
+    if (fpgaHash.empty() || hexHash.size() < 2 * fpgaHash.size()) return false;
+
+    for (size_t i = 0; i < fpgaHash.size(); i++) {
+        const int hi = fpgaHexDigit(hexHash[2 * i]);
+        const int lo = fpgaHexDigit(hexHash[2 * i + 1]);
+        if (hi < 0 || lo < 0 || ((hi << 4) | lo) != fpgaHash[i]) return false;
+    }
+
+    // reject a longer hash that just starts out the same
+    return hexHash.size() == 2 * fpgaHash.size() ||
+           fpgaHexDigit(hexHash[2 * fpgaHash.size()]) < 0;
+}
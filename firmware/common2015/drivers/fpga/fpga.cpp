@@ -4,9 +4,9 @@
 
 #include <rtos.h>
 
+#include "fpga-config.hpp"
 #include "logger.hpp"
 #include "rj-macros.hpp"
-#include "software-spi.hpp"
 
 template <size_t SIGN_INDEX>
 uint16_t toSignMag(int16_t val) {
@@ -56,6 +56,16 @@ bool FPGA::configure(const std::string& filepath) {
     }
     fclose(fp);
 
+    // The FPGA keeps its configuration across an mbed reset, so there's no
+    // need to load it again if it's already running this bitstream
+    if (_done && isConfiguredWith(filepath)) {
+        LOG(INIT, "FPGA already configured with %s, skipping",
+            filepath.c_str());
+        _isInit = true;
+
+        return true;
+    }
+
     // toggle PROG_B to clear out anything prior
     _progB = 0;
     Thread::wait(1);
@@ -109,64 +119,90 @@ bool FPGA::configure(const std::string& filepath) {
     return false;
 }
 
+bool FPGA::isConfiguredWith(const std::string& filepath) {
+    // the build puts the bitstream's git hash in a file next to it, with the
+    // same name but a .hsh extension
+    const std::string hashPath =
+        filepath.substr(0, filepath.find_last_of('.')) + ".hsh";
+
+    FILE* fp = fopen(hashPath.c_str(), "r");
+    if (fp == nullptr) return false;
+
+    char buf[64] = {0};
+    const size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+
+    std::vector<uint8_t> hash;
+    const bool dirty = git_hash(hash);
+
+    // a dirty build could be anything, so it can't be matched to a file
+    return !dirty && fpgaHashMatches(std::string(buf, n), hash);
+}
+
 TODO(remove this hack once issue number 590 is closed)
 #include "../../robot2015/src-ctrl/config/pins-ctrl-2015.hpp"
 
 bool FPGA::send_config(const std::string& filepath) {
-    const uint8_t bufSize = 50;
+    // Reading from the local filesystem has a lot of overhead per call, so
+    // read in large blocks
+    static uint8_t buf[1024];
 
     // open the bitstream file
     FILE* fp = fopen(filepath.c_str(), "r");
 
-    // send it out if successfully opened
-    if (fp != nullptr) {
-        size_t filesize;
-        char buf[bufSize];
+    if (fp == nullptr) {
+        LOG(INIT, "FPGA configuration failed\r\n    Unable to open %s",
+            filepath.c_str());
 
-        chipSelect();
+        return false;
+    }
 
-// MISO & MOSI are intentionally switched here
-// defaults to 8 bit field size with CPOL = 0 & CPHA = 0
-#warning FPGA configuration pins currently flipped due to PCB design errors, the final revision requires firmware updates.
-        SoftwareSPI softSpi(RJ_SPI_MISO, RJ_SPI_MOSI, RJ_SPI_SCK);
+    fseek(fp, 0, SEEK_END);
+    const size_t filesize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
 
-        fseek(fp, 0, SEEK_END);
-        filesize = ftell(fp);
-        fseek(fp, 0, SEEK_SET);
+    LOG(INF1, "Sending %s (%u bytes) out to the FPGA", filepath.c_str(),
+        filesize);
 
-        LOG(INF1, "Sending %s (%u bytes) out to the FPGA", filepath.c_str(),
-            filesize);
+    chipSelect();
 
-        for (size_t i = 0; i < filesize; i++) {
-            bool breakOut = false;
-            size_t readSize = fread(buf, 1, bufSize, fp);
+    // MISO & MOSI are intentionally switched here, so the bitstream can't go
+    // through the SPI peripheral and has to be clocked out by hand
+#warning FPGA configuration pins currently flipped due to PCB design errors, the final revision requires firmware updates.
+    DigitalOut din(RJ_SPI_MISO, 0);
+    DigitalOut cclk(RJ_SPI_SCK, 0);
+    SlaveSerialPort<DigitalOut> port(din, cclk);
 
-            if (!readSize) break;
+    Timer t;
+    t.start();
 
-            for (size_t j = 0; j < bufSize; j++) {
-                if (!_initB || _done) {
-                    breakOut = true;
-                    break;
-                }
+    size_t sent = 0;
+    const FpgaConfigResult result = streamBitstream(
+        [fp](uint8_t* b, size_t len) {
+            const size_t n = fread(b, 1, len, fp);
+            return ferror(fp) ? -1 : static_cast<int>(n);
+        },
+        port, _initB, _done, buf, sizeof(buf), &sent);
 
-                softSpi.write(buf[j]);
-            }
+    t.stop();
 
-            if (breakOut) break;
-        }
+    // give the pins back to the SPI peripheral
+    SPI dummySPI(RJ_SPI_MOSI, RJ_SPI_MISO, RJ_SPI_SCK);
 
-        SPI dummySPI(RJ_SPI_MOSI, RJ_SPI_MISO, RJ_SPI_SCK);
+    chipDeselect();
+    fclose(fp);
 
-        chipDeselect();
-        fclose(fp);
+    LOG(INF1, "Sent %u of %u bytes to the FPGA in %d ms", sent, filesize,
+        t.read_ms());
 
-        return true;
+    if (result != FPGA_CONFIG_OK) {
+        LOG(FATAL, "FPGA configuration failed\r\n    %s",
+            result == FPGA_CONFIG_INIT_ERROR ? "INIT_B went low (CRC error)"
+                                             : "Error reading bitstream");
+        return false;
     }
 
-    LOG(INIT, "FPGA configuration failed\r\n    Unable to open %s",
-        filepath.c_str());
-
-    return false;
+    return true;
 }
 
 uint8_t FPGA::read_halls(uint8_t* halls, size_t size) {
@@ -242,10 +278,14 @@ uint8_t FPGA::set_duty_cycles(int16_t* duty_cycles, size_t size) {
 }
 
 uint8_t FPGA::set_duty_get_enc(int16_t* duty_cycles, size_t size_dut,
-                               int16_t* enc_deltas, size_t size_enc) {
+                               int16_t* enc_deltas, size_t size_enc,
+                               int8_t* hall_deltas, size_t size_halls,
+                               uint8_t* currents, size_t size_currents,
+                               uint16_t* enc_ages, size_t size_ages) {
     uint8_t status;
 
-    if (size_dut != 5 || size_enc != 5) {
+    if (size_dut != 5 || size_enc != 5 || (hall_deltas && size_halls != 5) ||
+        (currents && size_currents != 5) || (enc_ages && size_ages != 4)) {
         LOG(WARN, "set_duty_get_enc() requires input buffers to be of size 5");
     }
 
@@ -265,6 +305,28 @@ uint8_t FPGA::set_duty_get_enc(int16_t* duty_cycles, size_t size_dut,
         enc_deltas[i] = static_cast<int16_t>(enc);
     }
 
+    // the fpga only takes the duty cycles if it gets all of the hall counts,
+    // and the currents come after them, then the encoder edge times
+    if (hall_deltas || currents || enc_ages) {
+        for (size_t i = 0; i < 5; i++) {
+            const int8_t halls = static_cast<int8_t>(_spi->write(0x00));
+            if (hall_deltas) hall_deltas[i] = halls;
+        }
+    }
+    if (currents || enc_ages) {
+        for (size_t i = 0; i < 5; i++) {
+            const uint8_t current = _spi->write(0x00);
+            if (currents) currents[i] = current;
+        }
+    }
+    if (enc_ages) {
+        for (size_t i = 0; i < 4; i++) {
+            uint16_t age = _spi->write(0x00) << 8;
+            age |= _spi->write(0x00);
+            enc_ages[i] = age;
+        }
+    }
+
     chipDeselect();
 
     return status;
@@ -23,8 +23,20 @@ public:
     bool configure(const std::string& filepath);
 
     bool isReady();
+    /// Sets the duty cycles and reads the encoder deltas since the last call.
+    /// If @hall_deltas is given, the hall counts since the last call are read
+    /// in the same transfer, and if @currents is given, the filtered motor
+    /// currents.  See Current_Sampler.v for their scale.  If @enc_ages is
+    /// given, the time since each encoder's last edge is read too, in
+    /// ENC_AGE_TICK_US units.
     uint8_t set_duty_get_enc(int16_t* duty_cycles, size_t size_dut,
-                             int16_t* enc_deltas, size_t size_enc);
+                             int16_t* enc_deltas, size_t size_enc,
+                             int8_t* hall_deltas = nullptr,
+                             size_t size_halls = 0,
+                             uint8_t* currents = nullptr,
+                             size_t size_currents = 0,
+                             uint16_t* enc_ages = nullptr,
+                             size_t size_ages = 0);
     uint8_t set_duty_cycles(int16_t* duty_cycles, size_t size);
     uint8_t read_duty_cycles(int16_t* duty_cycles, size_t size);
     uint8_t read_encs(int16_t* enc_counts, size_t size);
@@ -37,7 +49,15 @@ public:
 
     static const int16_t MAX_DUTY_CYCLE = 511;
 
+    /// The encoder edge timers count every 16 clocks of the FPGA's 18.432 MHz
+    /// clock, and stop at 0xFFFF
+    static constexpr float ENC_AGE_TICK_US = 16 / 18.432;
+
 private:
+    /// Check if the FPGA is running the bitstream at the given path by
+    /// comparing its git hash with the one saved next to the bitstream
+    bool isConfiguredWith(const std::string& filepath);
+
     bool _isInit = false;
 
     DigitalIn _initB;
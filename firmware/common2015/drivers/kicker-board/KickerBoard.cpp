@@ -7,7 +7,9 @@ std::shared_ptr<KickerBoard> KickerBoard::Instance;
 
 KickerBoard::KickerBoard(shared_ptr<SharedSPI> sharedSPI, PinName nCs,
                          PinName nReset, const string& progFilename)
-    : AVR910(sharedSPI, nCs, nReset), _filename(progFilename) {}
+    : AVR910(sharedSPI, nCs, nReset), _filename(progFilename), _status() {
+    kicker_master_init(&_master);
+}
 
 bool KickerBoard::verify_param(const char* name, char expected,
                                int (AVR910::*paramMethod)(), char mask,
@@ -82,61 +84,78 @@ bool KickerBoard::flash(bool onlyIfDifferent, bool verbose) {
     return true;
 }
 
-bool KickerBoard::send_to_kicker(uint8_t cmd, uint8_t arg, uint8_t* ret_val) {
-    LOG(INF2, "Sending: CMD:%02X, ARG:%02X", cmd, arg);
+bool KickerBoard::queue_command(uint8_t cmd, uint8_t arg) {
+    return kicker_master_queue(&_master, cmd, arg);
+}
+
+bool KickerBoard::update() {
+    uint8_t tx[KICKER_MAX_TRANSFER_SIZE];
+    uint8_t rx[KICKER_MAX_TRANSFER_SIZE];
+    const uint8_t len = kicker_master_begin(&_master, tx);
+
     chipSelect();
-    // Returns state (charging, not charging), but we don't care about that
-    uint8_t charge_resp = _spi->write(cmd);
-    // Should return the command we just sent
-    uint8_t command_resp = _spi->write(arg);
-    // Should return final response to full cmd, arg pair
-    uint8_t ret = _spi->write(BLANK);
+    for (uint8_t i = 0; i < len; i++) {
+        rx[i] = _spi->write(tx[i]);
+        wait_us(BYTE_GAP_US);
+    }
     chipDeselect();
 
-    if (ret_val != nullptr) {
-        *ret_val = ret;
+    const bool valid = kicker_master_end(&_master, rx, &_status);
+    if (!valid) {
+        if (rx[0] != KICKER_FRAME_START) {
+            LOG(WARN,
+                "Kicker sent 0x%02X instead of 0x%02X, is it running the "
+                "current firmware?",
+                rx[0], KICKER_FRAME_START);
+        } else {
+            LOG(WARN, "Kicker status failed its checksum");
+        }
+    } else if (_status.faults) {
+        LOG(WARN, "Kicker faults: %02X", _status.faults);
+    }
+    if (_master.ack == KICKER_ACK_LOST) {
+        LOG(WARN, "Kicker didn't acknowledge the last commands");
     }
 
-    bool command_acked = command_resp == cmd;
-    LOG(INF2, "ACK?:%s, CHG:%02X, CMD:%02X, RET:%02X",
-        command_acked ? "true" : "false", charge_resp, command_resp, ret);
+    LOG(INF2, "Kicker: V:%u, FLAGS:%02X, KICK AGE:%u ms, SEQ:%u",
+        _status.voltage, _status.flags, _status.kick_age_ms, _status.last_seq);
 
-    return command_acked;
+    return valid;
 }
 
-bool KickerBoard::kick(uint8_t time) {
-    return send_to_kicker(KICK_CMD, time, nullptr);
-}
+bool KickerBoard::send_to_kicker(uint8_t cmd, uint8_t arg) {
+    LOG(INF2, "Sending: CMD:%02X, ARG:%02X", cmd, arg);
 
-bool KickerBoard::chip(uint8_t time) {
-    return send_to_kicker(CHIP_CMD, time, nullptr);
+    // make room if other commands are waiting
+    if (!queue_command(cmd, arg)) {
+        update();
+        queue_command(cmd, arg);
+    }
+
+    // the second transfer's status acknowledges the first one's commands
+    update();
+    update();
+    return _master.ack == KICKER_ACK_OK;
 }
 
+bool KickerBoard::kick(uint8_t time) { return send_to_kicker(KICK_CMD, time); }
+
+bool KickerBoard::chip(uint8_t time) { return send_to_kicker(CHIP_CMD, time); }
+
 bool KickerBoard::read_voltage(uint8_t* voltage) {
-    return send_to_kicker(GET_VOLTAGE_CMD, BLANK, voltage);
+    if (!update()) return false;
+    *voltage = _status.voltage;
+    return true;
 }
 
-bool KickerBoard::charge() {
-    return send_to_kicker(SET_CHARGE_CMD, ON_ARG, nullptr);
-}
+bool KickerBoard::charge() { return send_to_kicker(SET_CHARGE_CMD, ON_ARG); }
 
 bool KickerBoard::stop_charging() {
-    return send_to_kicker(SET_CHARGE_CMD, OFF_ARG, nullptr);
+    return send_to_kicker(SET_CHARGE_CMD, OFF_ARG);
 }
 
-bool KickerBoard::is_pingable() {
-    return send_to_kicker(PING_CMD, BLANK, nullptr);
-}
+bool KickerBoard::is_pingable() { return send_to_kicker(PING_CMD, BLANK); }
 
 bool KickerBoard::is_charge_enabled() {
-    uint8_t ret = 0;
-
-    chipSelect();
-    ret = _spi->write(PING_CMD);
-    _spi->write(BLANK);
-    _spi->write(BLANK);
-    chipDeselect();
-
-    // boolean determined by MSB of 2nd byte
-    return ret == ISCHARGING;
+    return update() && (_status.flags & KICKER_STATUS_CHARGE_ALLOWED);
 }
@@ -5,10 +5,15 @@
 #include <string>
 #include "AVR910.hpp"
 #include "kicker_commands.h"
+#include "kicker_protocol.h"
 
 /**
  * @brief A class for interfacing with the kicker board, which is based on an
  * AVR chip.
+ *
+ * Commands are queued and sent to the kicker in a single framed SPI transfer
+ * by update(), which also reads back the kicker's whole status.  See
+ * kicker_protocol.h for the details.
  */
 class KickerBoard : public AVR910 {
 public:
@@ -37,6 +42,33 @@ public:
      */
     bool flash(bool onlyIfDifferent = true, bool verbose = false);
 
+    /**
+     * @brief Queues a command to go out with the next update()
+     *
+     * @return False if a full frame of commands is already queued
+     */
+    bool queue_command(uint8_t cmd, uint8_t arg);
+
+    /**
+     * @brief Sends any queued commands and reads the kicker's status, all in
+     *     one SPI transfer.
+     *
+     * The commands are acknowledged by the status block of the next
+     * update(), see last_ack().
+     *
+     * @return True if a valid status block came back
+     */
+    bool update();
+
+    /// The status from the last successful update()
+    const kicker_status& status() const { return _status; }
+
+    /**
+     * @return What happened to the commands sent in the update() before the
+     *     last one, one of KICKER_ACK_*
+     */
+    uint8_t last_ack() const { return _master.ack; }
+
     /**
      * @brief Sends the KickerBoard a command to kick for the allotted time in
      *     in milliseconds. This roughly corresponds to kick strength.
@@ -57,7 +89,7 @@ public:
     /**
      * @brief Reads the charge voltage back from the KickerBoard.
      * @param voltage Output voltage 0 (GND) to 255 (Vd)
-     * @return If the read_voltage command was acknowledged
+     * @return If the kicker's status was read
      */
     bool read_voltage(uint8_t* voltage);
 
@@ -74,7 +106,7 @@ public:
     bool stop_charging();
 
     /**
-     * @brief Sends a ping command and checks that we get the correct resposne
+     * @brief Sends a ping command and checks that it's acknowledged
      * @return If the ping command was acknowledged
      */
     bool is_pingable();
@@ -101,17 +133,18 @@ private:
 
     std::string _filename;
 
+    /// The ATtiny loads each byte it sends from an interrupt after the
+    /// previous byte, running at 1 MHz that needs a gap between bytes.
+    static const int BYTE_GAP_US = 200;
+
+    kicker_master _master;
+    kicker_status _status;
+
     /**
-     * This function enforces the design choice that each cmd must have an arg
-     * and return a value
-     * @brief Send a command to the kicker.
+     * @brief Sends a single command right away and waits for the kicker to
+     *     acknowledge it, which takes two transfers.
      *
-     * @param cmd Command to send
-     * @param arg Command argument, ignored by kicker if command doesn't require
-     * it.
-     * @param ret_val Value returned by kicker
-     * @param verbose Whether or not to print debug messages
      * @return Whether the command was acknowledged by the kickerboard.
      */
-    bool send_to_kicker(const uint8_t cmd, const uint8_t arg, uint8_t* ret_val);
+    bool send_to_kicker(uint8_t cmd, uint8_t arg);
 };
@@ -1,33 +1,19 @@
 #pragma once
 
 /*
- * In order to command the KickerBoard, a command byte must be sent,
- * followed by an argument byte. The command byte will not be executed without
- * the argument, even if that argument is not really needed like in the
- * get_voltage command.
+ * Commands for the KickerBoard.  Each command takes an argument byte, even if
+ * it isn't needed, like for the ping command.
  *
- * If getting a varible, it will be returned on the spi write after the
- * command write and the argument write.
- */
-
-/*
- * KickerBoard SPI protocol.
- * Each conversation begins with chip selecting the kickerboard.
- *
- * SPI Conversation Initiated.
- * Byte  |  Control Board   |   Kickerboard
- * ----------------------------------------------
- * 0     |    command       |   charging state
- * 1     |    argument      |   command (ack)
- * 2     |    NOP           |   command response
- * ----------------------------------------------
+ * See kicker_protocol.h for how they're sent over SPI.  The kicker's state,
+ * including the capacitor voltage, comes back in a status block on every
+ * transfer, so there are no commands for reading it.
  */
 
 /* Commands */
 #define KICK_CMD 0x01
 #define CHIP_CMD 0x02
 #define SET_CHARGE_CMD 0x03
-#define GET_VOLTAGE_CMD 0x04
+// 0x04 was GET_VOLTAGE_CMD, don't reuse it
 #define PING_CMD 0x05
 
 /* Arguments */
@@ -39,8 +25,3 @@
 // Charge command arguments
 #define ON_ARG 0x38   // Used for setting charge high
 #define OFF_ARG 0x1A  // Used for setting charge low
-
-/* Response Codes, charging/not charging */
-// Charging state
-#define ISCHARGING 0x80
-#define NOTCHARGING 0x84
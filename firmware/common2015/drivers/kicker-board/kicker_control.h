@@ -0,0 +1,251 @@
+#pragma once
+
+/*
+ * Charge, kick, and SPI frame handling for the kicker board's ATtiny.
+ *
+ * Everything here is plain C with no AVR registers, so the exact same logic
+ * runs on the kicker and in the host unit tests.  The firmware feeds it ADC
+ * samples, millisecond ticks, and SPI bytes from its interrupts, then copies
+ * the outputs (kick, chip, charge) to the pins.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "kicker_commands.h"
+#include "kicker_protocol.h"
+
+// Charging stops once the filtered voltage reaches this, in ADC counts
+#define KICKER_VOLTAGE_CUTOFF 100
+
+// Charging resumes once the voltage falls this far below the cutoff.  Without
+// this, noise around the cutoff would toggle the charger at the ADC rate.
+#define KICKER_VOLTAGE_HYSTERESIS 3
+
+// The voltage filter is an exponentially weighted average with a weight of
+// 1 / 2^KICKER_FILTER_SHIFT on each new sample.  With a sample every 416 us,
+// a shift of 1 keeps the lag well under a millisecond while still averaging
+// out single count noise.
+#define KICKER_FILTER_SHIFT 1
+
+// The status block flags an overvoltage once the voltage is this far past the
+// cutoff, which means the charger isn't turning off
+#define KICKER_OVERVOLTAGE_MARGIN 10
+
+// Bits in kicker_state.outputs
+#define KICKER_OUT_KICK (1 << 0)
+#define KICKER_OUT_CHIP (1 << 1)
+#define KICKER_OUT_CHARGE (1 << 2)
+
+typedef struct {
+    // filtered capacitor voltage in ADC counts, 8.8 fixed point
+    uint16_t voltage_q8;
+
+    // whether the control board has asked us to charge
+    bool charge_allowed;
+
+    // KICKER_OUT_* bits that should currently be driven high
+    uint8_t outputs;
+
+    // time left on the current kick or chip, in milliseconds
+    uint8_t kick_ms_left;
+
+    // set when a kick or chip starts, so the firmware can line the
+    // millisecond timer up with it.  Cleared by the firmware.
+    bool kick_started;
+
+    // time since the last kick or chip started, saturating
+    uint16_t kick_age_ms;
+
+    // sequence number of the last frame accepted from the control board
+    uint8_t last_seq;
+
+    // KICKER_FAULT_* bits from the last frame
+    uint8_t faults;
+
+    // SPI transfer state, see kicker_protocol.h for the protocol
+    kicker_frame_rx spi_rx;
+    kicker_status_tx spi_tx;
+} kicker_state;
+
+static inline void kicker_init(kicker_state* s) {
+    s->voltage_q8 = 0;
+    s->charge_allowed = false;
+    s->outputs = 0;
+    s->kick_ms_left = 0;
+    s->kick_started = false;
+    s->kick_age_ms = 0xFFFF;
+    s->last_seq = 0;
+    s->faults = 0;
+    kicker_frame_rx_reset(&s->spi_rx);
+}
+
+/*
+ * Returns the filtered capacitor voltage, rounded to the nearest ADC count
+ */
+static inline uint8_t kicker_voltage(const kicker_state* s) {
+    uint16_t v = (s->voltage_q8 + 0x80) >> 8;
+    return v > 0xFF ? 0xFF : (uint8_t)v;
+}
+
+static inline bool kicker_is_kicking(const kicker_state* s) {
+    return s->kick_ms_left != 0;
+}
+
+/*
+ * Turns the charger on or off based on the current voltage.  The charger is
+ * never on during a kick, so the flyback isn't fighting the solenoid.
+ */
+static inline void kicker_update_charge(kicker_state* s) {
+    const uint8_t v = kicker_voltage(s);
+    bool charging = s->outputs & KICKER_OUT_CHARGE;
+
+    if (!s->charge_allowed || kicker_is_kicking(s) ||
+        v >= KICKER_VOLTAGE_CUTOFF) {
+        charging = false;
+    } else if (v < KICKER_VOLTAGE_CUTOFF - KICKER_VOLTAGE_HYSTERESIS) {
+        charging = true;
+    }
+
+    if (charging) {
+        s->outputs |= KICKER_OUT_CHARGE;
+    } else {
+        s->outputs &= ~KICKER_OUT_CHARGE;
+    }
+}
+
+/*
+ * Feeds a new 8-bit ADC reading of the capacitor voltage into the filter and
+ * updates the charger.  Called for every conversion.
+ */
+static inline void kicker_adc_sample(kicker_state* s, uint8_t raw) {
+    const uint16_t target = (uint16_t)raw << 8;
+
+    // Only 16-bit shifts here, this runs in an interrupt a few hundred cycles
+    // apart.  Steps round away from zero so the filter always reaches the
+    // target exactly.
+    if (target > s->voltage_q8) {
+        const uint16_t step = (target - s->voltage_q8) >> KICKER_FILTER_SHIFT;
+        s->voltage_q8 += step ? step : 1;
+    } else if (target < s->voltage_q8) {
+        const uint16_t step = (s->voltage_q8 - target) >> KICKER_FILTER_SHIFT;
+        s->voltage_q8 -= step ? step : 1;
+    }
+
+    kicker_update_charge(s);
+}
+
+/*
+ * Called once a millisecond to time kicks and chips
+ */
+static inline void kicker_tick_ms(kicker_state* s) {
+    if (s->kick_age_ms != 0xFFFF) s->kick_age_ms++;
+
+    if (s->kick_ms_left && --s->kick_ms_left == 0) {
+        s->outputs &= ~(KICKER_OUT_KICK | KICKER_OUT_CHIP);
+        kicker_update_charge(s);
+    }
+}
+
+/*
+ * Executes a command from the control board.  Returns false if the command
+ * isn't recognized.
+ */
+static inline bool kicker_execute(kicker_state* s, uint8_t cmd, uint8_t arg) {
+    switch (cmd) {
+        case KICK_CMD:
+        case CHIP_CMD:
+            // a zero length kick would never be turned off by the timer
+            if (arg == 0) break;
+            s->kick_ms_left = arg;
+            s->kick_age_ms = 0;
+            s->outputs &= ~(KICKER_OUT_KICK | KICKER_OUT_CHIP);
+            s->outputs |= cmd == KICK_CMD ? KICKER_OUT_KICK : KICKER_OUT_CHIP;
+            s->kick_started = true;
+            kicker_update_charge(s);
+            break;
+
+        case SET_CHARGE_CMD:
+            // set state based on argument
+            if (arg == ON_ARG) {
+                s->charge_allowed = true;
+            } else if (arg == OFF_ARG) {
+                s->charge_allowed = false;
+            }
+            kicker_update_charge(s);
+            break;
+
+        case PING_CMD:
+            // do nothing, a ping is just a frame that has to be acknowledged
+            break;
+
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+static inline void kicker_get_status(const kicker_state* s,
+                                     kicker_status* status) {
+    status->voltage = kicker_voltage(s);
+
+    status->flags = 0;
+    if (s->outputs & KICKER_OUT_CHARGE) status->flags |= KICKER_STATUS_CHARGING;
+    if (s->charge_allowed) status->flags |= KICKER_STATUS_CHARGE_ALLOWED;
+    if (kicker_is_kicking(s)) status->flags |= KICKER_STATUS_KICKING;
+
+    status->kick_age_ms = s->kick_age_ms;
+    status->last_seq = s->last_seq;
+
+    status->faults = s->faults;
+    if (status->voltage >= KICKER_VOLTAGE_CUTOFF + KICKER_OVERVOLTAGE_MARGIN) {
+        status->faults |= KICKER_FAULT_OVERVOLTAGE;
+    }
+}
+
+/*
+ * Called when chip select goes low, at the start of a transfer.  Latches the
+ * status block that gets sent back.
+ */
+static inline void kicker_spi_select(kicker_state* s) {
+    kicker_status status;
+    kicker_get_status(s, &status);
+    kicker_status_tx_start(&s->spi_tx, &status);
+}
+
+/*
+ * Called when chip select goes high.  Returns the byte to load for the first
+ * byte of the next transfer.
+ */
+static inline uint8_t kicker_spi_deselect(kicker_state* s) {
+    if (kicker_frame_rx_end(&s->spi_rx) == KICKER_RX_BAD) {
+        s->faults |= KICKER_FAULT_BAD_FRAME;
+    }
+    return KICKER_FRAME_START;
+}
+
+/*
+ * Handles a byte received over SPI.  Returns the byte to send back during the
+ * next byte of the transfer.
+ *
+ * The commands in a frame are run as soon as its checksum byte comes in.
+ */
+static inline uint8_t kicker_spi_byte(kicker_state* s, uint8_t rx) {
+    const uint8_t result = kicker_frame_rx_byte(&s->spi_rx, rx);
+
+    if (result == KICKER_RX_OK) {
+        s->faults = 0;
+        for (uint8_t i = 0; i < s->spi_rx.count; i++) {
+            const uint8_t* cmd = &s->spi_rx.cmds[2 * i];
+            if (!kicker_execute(s, cmd[0], cmd[1])) {
+                s->faults |= KICKER_FAULT_UNKNOWN_CMD;
+            }
+        }
+        s->last_seq = s->spi_rx.seq;
+    } else if (result == KICKER_RX_BAD) {
+        s->faults |= KICKER_FAULT_BAD_FRAME;
+    }
+
+    return kicker_status_tx_next(&s->spi_tx);
+}
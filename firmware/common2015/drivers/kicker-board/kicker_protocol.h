@@ -0,0 +1,308 @@
+#pragma once
+
+/*
+ * Framed SPI protocol between the control board (master) and the kicker
+ * board's ATtiny (slave).
+ *
+ * Both ends are built from this header so they can't drift apart.  It's plain
+ * C with no hardware access, the firmware feeds it bytes from its SPI
+ * interrupt and KickerBoard feeds it bytes from the mbed's SPI.
+ *
+ * Every chip select is one full-duplex transfer.  While the master clocks out
+ * a frame of queued commands, the kicker clocks out a status block that it
+ * latched when it was selected:
+ *
+ * Byte  |  Control Board       |   Kickerboard
+ * -------------------------------------------------------
+ * 0     |  KICKER_FRAME_START  |   KICKER_FRAME_START
+ * 1     |  sequence number     |   voltage
+ * 2     |  command count (n)   |   KICKER_STATUS_* flags
+ * 3     |  command 0           |   ms since last kick, low
+ * 4     |  argument 0          |   ms since last kick, high
+ * 5     |  ...                 |   last accepted sequence number
+ * 6     |  ...                 |   KICKER_FAULT_* flags
+ * 7     |  ...                 |   CRC-8 of bytes 0-6
+ * 3+2n  |  CRC-8 of 0 to 2+2n  |   KICKER_SPI_FILL
+ * -------------------------------------------------------
+ *
+ * The master pads short frames with zeros so that the whole status block gets
+ * clocked out.  The kicker only runs the commands once the frame's checksum
+ * checks out, and reports the frame's sequence number in the next status
+ * block as an acknowledgement.
+ *
+ * The version is part of the start byte, so a kicker running an older
+ * protocol, which answers with its charging state (0x80 or 0x84), is
+ * rejected.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "kicker_commands.h"
+
+#define KICKER_PROTOCOL_VERSION 1
+#define KICKER_FRAME_START (0xB0 | KICKER_PROTOCOL_VERSION)
+
+// Most commands that fit in one frame
+#define KICKER_MAX_CMDS 4
+
+// Bytes in a frame with @n commands, and in the status block
+#define KICKER_FRAME_SIZE(n) (4 + 2 * (n))
+#define KICKER_STATUS_SIZE 8
+
+// Longest transfer, with a full frame of commands
+#define KICKER_MAX_TRANSFER_SIZE KICKER_FRAME_SIZE(KICKER_MAX_CMDS)
+
+// Sent by the kicker once the status block is done
+#define KICKER_SPI_FILL 0x11
+
+// Bits in kicker_status.flags
+#define KICKER_STATUS_CHARGING (1 << 0)
+#define KICKER_STATUS_CHARGE_ALLOWED (1 << 1)
+#define KICKER_STATUS_KICKING (1 << 2)
+
+// Bits in kicker_status.faults
+#define KICKER_FAULT_BAD_FRAME (1 << 0)    // last frame was rejected
+#define KICKER_FAULT_UNKNOWN_CMD (1 << 1)  // last frame had a bad command
+#define KICKER_FAULT_OVERVOLTAGE (1 << 2)  // voltage is well past the cutoff
+
+typedef struct {
+    uint8_t voltage;
+    uint8_t flags;
+    // saturates at 0xFFFF, which is also what it reads before the first kick
+    uint16_t kick_age_ms;
+    uint8_t last_seq;
+    uint8_t faults;
+} kicker_status;
+
+/*
+ * CRC-8 (poly 0x07, init 0) of one more byte.  This goes a nibble at a time
+ * with a 16 entry table, the ATtiny runs it twice per byte from its SPI
+ * interrupt and a bitwise loop would take most of the time between bytes.
+ */
+static inline uint8_t kicker_crc8(uint8_t crc, uint8_t byte) {
+    static const uint8_t table[16] = {0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B,
+                                      0x12, 0x15, 0x38, 0x3F, 0x36, 0x31,
+                                      0x24, 0x23, 0x2A, 0x2D};
+    crc ^= byte;
+    crc = (uint8_t)(crc << 4) ^ table[crc >> 4];
+    crc = (uint8_t)(crc << 4) ^ table[crc >> 4];
+    return crc;
+}
+
+/*
+ * Kicker side
+ */
+
+// Results of kicker_frame_rx_byte()
+#define KICKER_RX_PENDING 0
+#define KICKER_RX_OK 1
+#define KICKER_RX_BAD 2
+
+typedef struct {
+    uint8_t index;  // bytes received this transfer
+    uint8_t result;
+    uint8_t crc;
+    uint8_t seq;
+    uint8_t count;
+    uint8_t cmds[2 * KICKER_MAX_CMDS];  // command, argument pairs
+} kicker_frame_rx;
+
+static inline void kicker_frame_rx_reset(kicker_frame_rx* rx) {
+    rx->index = 0;
+    rx->result = KICKER_RX_PENDING;
+    rx->crc = 0;
+    rx->count = 0;
+}
+
+/*
+ * Handles a byte of the master's frame.  Returns KICKER_RX_OK or
+ * KICKER_RX_BAD on the byte that finishes the frame, and KICKER_RX_PENDING
+ * otherwise, including for the padding after it.
+ */
+static inline uint8_t kicker_frame_rx_byte(kicker_frame_rx* rx, uint8_t b) {
+    if (rx->result != KICKER_RX_PENDING) return KICKER_RX_PENDING;
+
+    const uint8_t i = rx->index++;
+    if (i == 0) {
+        if (b != KICKER_FRAME_START) return rx->result = KICKER_RX_BAD;
+    } else if (i == 1) {
+        rx->seq = b;
+    } else if (i == 2) {
+        if (b > KICKER_MAX_CMDS) return rx->result = KICKER_RX_BAD;
+        rx->count = b;
+    } else if (i < KICKER_FRAME_SIZE(rx->count) - 1) {
+        rx->cmds[i - 3] = b;
+    } else {
+        return rx->result = b == rx->crc ? KICKER_RX_OK : KICKER_RX_BAD;
+    }
+
+    rx->crc = kicker_crc8(rx->crc, b);
+    return KICKER_RX_PENDING;
+}
+
+/*
+ * Called when chip select goes high.  Returns KICKER_RX_BAD if the master
+ * stopped partway through a frame.
+ */
+static inline uint8_t kicker_frame_rx_end(kicker_frame_rx* rx) {
+    const bool cut_short = rx->index != 0 && rx->result == KICKER_RX_PENDING;
+    kicker_frame_rx_reset(rx);
+    return cut_short ? KICKER_RX_BAD : KICKER_RX_PENDING;
+}
+
+typedef struct {
+    uint8_t bytes[KICKER_STATUS_SIZE - 1];  // everything but the CRC
+    uint8_t index;                          // next byte to send
+    uint8_t crc;
+} kicker_status_tx;
+
+/*
+ * Latches a status block to send.  Byte 0 is always KICKER_FRAME_START, which
+ * the firmware preloads before the master selects it, so this only has to be
+ * fast enough to be done before the second byte.
+ */
+static inline void kicker_status_tx_start(kicker_status_tx* tx,
+                                          const kicker_status* status) {
+    tx->bytes[0] = KICKER_FRAME_START;
+    tx->bytes[1] = status->voltage;
+    tx->bytes[2] = status->flags;
+    tx->bytes[3] = status->kick_age_ms & 0xFF;
+    tx->bytes[4] = status->kick_age_ms >> 8;
+    tx->bytes[5] = status->last_seq;
+    tx->bytes[6] = status->faults;
+    tx->index = 1;
+    tx->crc = kicker_crc8(0, KICKER_FRAME_START);
+}
+
+/*
+ * Returns the next status byte to send, with the CRC computed as it goes so
+ * the work is spread across the transfer.
+ */
+static inline uint8_t kicker_status_tx_next(kicker_status_tx* tx) {
+    if (tx->index < KICKER_STATUS_SIZE - 1) {
+        const uint8_t b = tx->bytes[tx->index++];
+        tx->crc = kicker_crc8(tx->crc, b);
+        return b;
+    } else if (tx->index == KICKER_STATUS_SIZE - 1) {
+        tx->index++;
+        return tx->crc;
+    }
+    return KICKER_SPI_FILL;
+}
+
+/*
+ * Control board side
+ */
+
+// What happened to the last frame of commands, see kicker_master.ack
+#define KICKER_ACK_NONE 0  // nothing was waiting on an acknowledgement
+#define KICKER_ACK_OK 1
+// the kicker never accepted it, or its status block was garbled
+#define KICKER_ACK_LOST 2
+
+typedef struct {
+    // commands waiting for the next transfer
+    uint8_t queue[2 * KICKER_MAX_CMDS];
+    uint8_t queued;
+
+    uint8_t next_seq;
+
+    // the frame sent in the current transfer, and the one before it which is
+    // acknowledged by this transfer's status block
+    bool in_flight;
+    uint8_t in_flight_seq;
+    bool unacked;
+    uint8_t unacked_seq;
+
+    uint8_t ack;
+} kicker_master;
+
+static inline void kicker_master_init(kicker_master* m) {
+    m->queued = 0;
+    // a freshly reset kicker reports 0, don't let the first frame match it
+    m->next_seq = 1;
+    m->in_flight = false;
+    m->unacked = false;
+    m->ack = KICKER_ACK_NONE;
+}
+
+/*
+ * Queues a command for the next transfer.  Returns false if a frame's worth
+ * is already queued.
+ */
+static inline bool kicker_master_queue(kicker_master* m, uint8_t cmd,
+                                       uint8_t arg) {
+    if (m->queued == KICKER_MAX_CMDS) return false;
+    m->queue[2 * m->queued] = cmd;
+    m->queue[2 * m->queued + 1] = arg;
+    m->queued++;
+    return true;
+}
+
+/*
+ * Builds the next transfer into @buf, which must hold
+ * KICKER_MAX_TRANSFER_SIZE bytes, moving all queued commands into it.
+ * Returns the number of bytes to clock out.
+ */
+static inline uint8_t kicker_master_begin(kicker_master* m, uint8_t* buf) {
+    const uint8_t n = m->queued;
+    uint8_t len = 0;
+
+    buf[len++] = KICKER_FRAME_START;
+    buf[len++] = m->next_seq;
+    buf[len++] = n;
+    for (uint8_t i = 0; i < 2 * n; i++) buf[len++] = m->queue[i];
+
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < len; i++) crc = kicker_crc8(crc, buf[i]);
+    buf[len++] = crc;
+
+    while (len < KICKER_STATUS_SIZE) buf[len++] = 0;
+
+    // a frame without commands doesn't need acknowledging, so it doesn't use
+    // up a sequence number
+    m->in_flight = n != 0;
+    if (m->in_flight) {
+        m->in_flight_seq = m->next_seq++;
+        if (m->next_seq == 0) m->next_seq = 1;
+    }
+    m->queued = 0;
+
+    return len;
+}
+
+/*
+ * Parses what the kicker sent back during a transfer.  Returns false if the
+ * status block was garbled or from another protocol version, in which case
+ * @status is left alone.  Sets m->ack for the frame sent in the transfer
+ * before this one.
+ */
+static inline bool kicker_master_end(kicker_master* m, const uint8_t* rx,
+                                     kicker_status* status) {
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < KICKER_STATUS_SIZE - 1; i++) {
+        crc = kicker_crc8(crc, rx[i]);
+    }
+    const bool valid =
+        rx[0] == KICKER_FRAME_START && rx[KICKER_STATUS_SIZE - 1] == crc;
+
+    if (valid) {
+        status->voltage = rx[1];
+        status->flags = rx[2];
+        status->kick_age_ms = rx[3] | (rx[4] << 8);
+        status->last_seq = rx[5];
+        status->faults = rx[6];
+    }
+
+    m->ack = KICKER_ACK_NONE;
+    if (m->unacked) {
+        m->ack = valid && status->last_seq == m->unacked_seq ? KICKER_ACK_OK
+                                                             : KICKER_ACK_LOST;
+    }
+    m->unacked = m->in_flight;
+    m->unacked_seq = m->in_flight_seq;
+    m->in_flight = false;
+
+    return valid;
+}
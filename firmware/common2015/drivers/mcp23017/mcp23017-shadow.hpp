@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Shadow copy of one of the MCP23017's 16-bit registers (a port A/B pair).
+ *
+ * Keeping track of what the chip already has lets the driver skip writes that
+ * wouldn't change anything, which is most of them since the main loop sets
+ * the error LEDs on every iteration whether they changed or not.
+ */
+class MCP23017Shadow {
+public:
+    /**
+     * Set the bits in @mask to the matching bits of @data.
+     *
+     * @return true if this changed what's on the chip, so it needs writing
+     */
+    bool update(uint16_t data, uint16_t mask = 0xFFFF) {
+        const uint16_t value = (_value & ~mask) | (data & mask);
+        const bool changed = !_valid || value != _value;
+        _value = value;
+        _valid = true;
+        return changed;
+    }
+
+    uint16_t value() const { return _value; }
+
+    /// Forget what the chip has, so the next update() is always written
+    void invalidate() { _valid = false; }
+
+private:
+    uint16_t _value = 0;
+    bool _valid = false;
+};
+
+/**
+ * The last reading of the MCP23017's GPIO inputs.
+ *
+ * The reading is only refreshed once it has gone stale.  With the chip's
+ * interrupt-on-change output hooked up, that only happens when an input
+ * actually changes, so the switches are never polled.
+ */
+class MCP23017Inputs {
+public:
+    /// Mark the reading as out of date.  Safe to call from an ISR.
+    void markStale() { _stale = true; }
+
+    bool stale() const { return _stale; }
+
+    void update(uint16_t gpio) {
+        _value = gpio;
+        _stale = false;
+    }
+
+    uint16_t value() const { return _value; }
+
+    int pin(int pin) const { return (_value >> pin) & 1; }
+
+private:
+    uint16_t _value = 0;
+    volatile bool _stale = true;
+};
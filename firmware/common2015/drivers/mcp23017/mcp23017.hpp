@@ -3,10 +3,15 @@
 #include <mbed.h>
 #include <memory>
 
-#include "I2CMasterRtos.hpp"
+#include "I2CAsyncMaster.hpp"
+#include "mcp23017-shadow.hpp"
 
 /**
  * Allow access to an I2C-connected MCP23017 16-bit I/O extender chip
+ *
+ * Outputs and configuration registers are shadowed, and only written when
+ * they actually change.  Inputs are read all 16 at a time and cached until
+ * they go stale, see refresh().
  */
 class MCP23017 {
 public:
@@ -47,7 +52,12 @@ public:
         PinB7 = 15
     } ExpPinName;
 
-    MCP23017(PinName sda, PinName scl, int i2cAddress);
+    /**
+     * @param intPin The pin the chip's INTA output is connected to.  If given,
+     *     interrupt-on-change is enabled for all of the input pins and the
+     *     inputs are only read again after one of them changes.
+     */
+    MCP23017(PinName sda, PinName scl, int i2cAddress, PinName intPin = NC);
 
     /** Reset MCP23017 device to its power-on state
      */
@@ -68,12 +78,23 @@ public:
     void writeMask(uint16_t data, uint16_t mask);
 
     /** Read a 0/1 value from an input bit
+     *
+     * The value comes from the cached GPIO reading, which is only read again
+     * if it's stale.
      *
      * @param   bit_number    bit number range 0 --> 15
      * @return                0/1 value read
      */
     uint8_t readPin(MCP23017::ExpPinName pin);
 
+    /** Bring the cached GPIO reading up to date
+     *
+     * Call this once before reading a group of pins.  With an interrupt pin,
+     * the chip is only read if an input has changed since the last read.
+     * Without one, this always does a single 16-bit read.
+     */
+    void refresh();
+
     /** Configure an MCP23017 device
      *
      * @param   dir_config         data direction value (1 = input, 0 = output)
@@ -114,9 +135,22 @@ public:
     void internalPullupMask(uint16_t mask);
 
 private:
-    I2CMasterRtos _i2c;
+    I2CAsyncMaster* _i2c;
     int _i2cAddress;  // physical I2C address
 
-    // Cached copies of the register values
-    uint16_t _cachedGPIO, _cachedIODIR, _cachedGPPU, _cachedIPOL;
+    /// Read all of the inputs into the cache
+    void readInputs();
+
+    /// Write @reg if the update changed its shadow copy
+    void updateRegister(MCP23017::Register reg, MCP23017Shadow& shadow,
+                        uint16_t data, uint16_t mask = 0xFFFF);
+
+    /// Called when INTA goes low
+    void inputsChanged() { _inputs.markStale(); }
+
+    std::unique_ptr<InterruptIn> _intIn;
+
+    // Shadow copies of the register values
+    MCP23017Shadow _olat, _iodir, _gppu, _ipol, _gpinten;
+    MCP23017Inputs _inputs;
 };
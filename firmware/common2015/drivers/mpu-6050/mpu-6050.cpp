@@ -10,7 +10,7 @@
 #include <logger.hpp>
 
 MPU6050::MPU6050(PinName sda, PinName scl, int freq)
-    : connection(sda, scl, freq) {
+    : connection(I2CAsyncMaster::forPins(sda, scl, freq)) {
     setSleepMode(false);
     // Initializations:
     currentGyroRange = 0;
@@ -21,19 +21,19 @@ void MPU6050::write(uint8_t address, uint8_t data) {
     uint8_t temp[2];
     temp[0] = address;
     temp[1] = data;
-    connection.write(MPU6050_ADDRESS * 2, (char*)temp, 2);
+    connection->write(MPU6050_ADDRESS * 2, temp, 2, i2c::PRIORITY_HIGH);
 }
 
 uint8_t MPU6050::read(uint8_t address) {
-    uint8_t retval;
-    connection.write(MPU6050_ADDRESS * 2, (char*)&address, 1, true);
-    connection.read(MPU6050_ADDRESS * 2, (char*)&retval, 1);
+    uint8_t retval = 0;
+    connection->readRegister(MPU6050_ADDRESS * 2, address, &retval, 1,
+                             i2c::PRIORITY_HIGH);
     return retval;
 }
 
 void MPU6050::read(uint8_t address, uint8_t* data, int length) {
-    connection.write(MPU6050_ADDRESS * 2, (char*)&address, 1, true);
-    connection.read(MPU6050_ADDRESS * 2, (char*)data, length);
+    connection->readRegister(MPU6050_ADDRESS * 2, address, data, length,
+                             i2c::PRIORITY_HIGH);
 }
 
 void MPU6050::setSleepMode(bool state) {
@@ -7,7 +7,7 @@
 #include <mbed.h>
 
 #include "mpu-6050-defines.hpp"
-#include "I2CMasterRtos.hpp"
+#include "I2CAsyncMaster.hpp"
 
 /**
  * Defines
@@ -246,7 +246,7 @@ public:
     void calibrate(float* dest1, float* dest2);
 
 private:
-    I2CMasterRtos connection;
+    I2CAsyncMaster* connection;
     uint8_t currentAcceleroRange;
     uint8_t currentGyroRange;
 
@@ -0,0 +1,100 @@
+#include "I2CAsyncMaster.hpp"
+
+#include <assert.hpp>
+#include <logger.hpp>
+
+namespace {
+// Tells the I2C thread there's something in the queue
+const int32_t WORK_SIGNAL = 1 << 0;
+}
+
+I2CAsyncMaster* I2CAsyncMaster::s_channels[2] = {nullptr, nullptr};
+
+I2CAsyncMaster* I2CAsyncMaster::forPins(PinName sda, PinName scl, int freq) {
+    static rtos::Mutex mtx;
+    mtx.lock();
+
+    // same channel numbering as I2CDriver
+    const int channel = (sda == p9 && scl == p10) ? 0 : 1;
+    if (!s_channels[channel]) {
+        s_channels[channel] = new I2CAsyncMaster(sda, scl, freq);
+    }
+
+    mtx.unlock();
+    return s_channels[channel];
+}
+
+I2CAsyncMaster::I2CAsyncMaster(PinName sda, PinName scl, int freq)
+    : _bus(sda, scl, freq),
+      _queue(_bus),
+      _thread(&I2CAsyncMaster::threadHelper, this, osPriorityHigh,
+              DEFAULT_STACK_SIZE / 2) {}
+
+void I2CAsyncMaster::threadHelper(void const* inst) {
+    const_cast<I2CAsyncMaster*>(static_cast<const I2CAsyncMaster*>(inst))
+        ->thread();
+}
+
+void I2CAsyncMaster::thread() {
+    LOG(INIT, "I2C thread ready!\r\n    Thread ID: %u, Priority: %d",
+        ((P_TCB)_thread.gettid())->task_id, _thread.get_priority());
+
+    while (true) {
+        rtos::Thread::signal_wait(WORK_SIGNAL);
+        _queue.runAll();
+    }
+}
+
+bool I2CAsyncMaster::submit(const i2c::Transaction& t, bool wait) {
+    return submit(&t, 1, wait);
+}
+
+bool I2CAsyncMaster::submit(const i2c::Transaction* batch, size_t count,
+                            bool wait) {
+    while (!_queue.submit(batch, count)) {
+        if (!wait) {
+            LOG(WARN, "I2C queue full, dropped %u transaction(s)", count);
+            return false;
+        }
+        rtos::Thread::wait(1);
+    }
+
+    _thread.signal_set(WORK_SIGNAL);
+    return true;
+}
+
+void I2CAsyncMaster::signalWaiter(const i2c::Transaction& t,
+                                  i2c::Status status, void* context) {
+    Waiter* waiter = static_cast<Waiter*>(context);
+    waiter->status = status;
+    osSignalSet(waiter->thread, DONE_SIGNAL);
+}
+
+i2c::Status I2CAsyncMaster::transfer(i2c::Transaction t) {
+    // waiting on ourselves would never finish
+    ASSERT(osThreadGetId() != _thread.gettid());
+
+    Waiter waiter = {osThreadGetId(), i2c::STATUS_ABORTED};
+    t.setCallback(&I2CAsyncMaster::signalWaiter, &waiter);
+
+    submit(t);
+    rtos::Thread::signal_wait(DONE_SIGNAL);
+
+    return waiter.status;
+}
+
+i2c::Status I2CAsyncMaster::write(uint8_t address, const uint8_t* data,
+                                  size_t len, i2c::Priority priority) {
+    i2c::Transaction t(address, priority);
+    if (!t.setWrite(data, len)) return i2c::STATUS_ABORTED;
+    return transfer(t);
+}
+
+i2c::Status I2CAsyncMaster::readRegister(uint8_t address, uint8_t reg,
+                                         uint8_t* data, size_t len,
+                                         i2c::Priority priority) {
+    i2c::Transaction t(address, priority);
+    t.setWrite(&reg, 1);
+    t.setRead(data, len);
+    return transfer(t);
+}
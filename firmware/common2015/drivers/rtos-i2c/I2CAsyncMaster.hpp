@@ -0,0 +1,88 @@
+#pragma once
+
+#include <mbed.h>
+#include <rtos.h>
+
+#include "I2CMasterRtos.hpp"
+#include "I2CQueue.hpp"
+
+/**
+ * Asynchronous, prioritized I2C master.
+ *
+ * Instead of every driver locking the bus and blocking for the whole
+ * transfer, transactions are queued and run by a dedicated thread that owns
+ * the bus.  Callers either carry on and get a callback when the transaction
+ * is done, or use transfer() to wait for it.  Either way, a high priority
+ * transaction (like an IMU read) never has to wait behind more than the one
+ * transaction that's already on the bus.
+ *
+ * There's one of these per I2C channel, shared by every driver on that bus.
+ * Use forPins() to get it.
+ */
+class I2CAsyncMaster {
+public:
+    /// Thread signal used by transfer() to wait for its transaction
+    static const int32_t DONE_SIGNAL = 1 << 12;
+
+    /**
+     * Get the master for the I2C channel on the given pins, creating it and
+     * its thread the first time.
+     *
+     * @note Has to be called in a thread context, like I2CMasterRtos
+     */
+    static I2CAsyncMaster* forPins(PinName sda, PinName scl,
+                                   int freq = 400000);
+
+    /**
+     * Queue a transaction without waiting for it.  Its callback, if any, is
+     * called on the I2C thread once it's done.
+     *
+     * @param wait If the queue is full, wait for room instead of giving up
+     * @return false if the transaction couldn't be queued
+     */
+    bool submit(const i2c::Transaction& t, bool wait = true);
+
+    /// Queue a batch of transactions to run without releasing the bus
+    bool submit(const i2c::Transaction* batch, size_t count, bool wait = true);
+
+    /**
+     * Queue a transaction and wait for it to finish.  Any callback it already
+     * has is replaced.
+     *
+     * @note Must not be called from a transaction's callback
+     * @return The transaction's status
+     */
+    i2c::Status transfer(i2c::Transaction t);
+
+    /// Write @len bytes to a slave, then wait for it to finish
+    i2c::Status write(uint8_t address, const uint8_t* data, size_t len,
+                      i2c::Priority priority = i2c::PRIORITY_NORMAL);
+
+    /// Write @reg to a slave, then read @len bytes back with a repeated start
+    i2c::Status readRegister(uint8_t address, uint8_t reg, uint8_t* data,
+                             size_t len,
+                             i2c::Priority priority = i2c::PRIORITY_NORMAL);
+
+private:
+    typedef i2c::Queue<I2CMasterRtos, rtos::Mutex> Queue;
+
+    /// A thread blocked in transfer()
+    struct Waiter {
+        osThreadId thread;
+        i2c::Status status;
+    };
+
+    I2CAsyncMaster(PinName sda, PinName scl, int freq);
+
+    static void threadHelper(void const* inst);
+    void thread();
+
+    static void signalWaiter(const i2c::Transaction& t, i2c::Status status,
+                             void* context);
+
+    I2CMasterRtos _bus;
+    Queue _queue;
+    rtos::Thread _thread;
+
+    static I2CAsyncMaster* s_channels[2];
+};
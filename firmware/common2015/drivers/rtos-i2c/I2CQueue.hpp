@@ -0,0 +1,272 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace i2c {
+
+/// Higher priority transactions are always started first.  Within a priority,
+/// transactions run in the order they were submitted, so a driver that reads
+/// back from a slave it writes to has to use the same priority for both.
+enum Priority {
+    PRIORITY_LOW = 0,  // things nobody waits on, on slaves that aren't read
+    PRIORITY_NORMAL,
+    PRIORITY_HIGH,  // sensor reads on the control loop's critical path
+    NUM_PRIORITIES
+};
+
+/// Status of a transaction, passed to its completion callback
+enum Status {
+    STATUS_OK = 0,
+    STATUS_NACK,     // the slave didn't acknowledge
+    STATUS_ABORTED,  // an earlier transaction in the same batch failed
+};
+
+struct Transaction;
+
+/// Called on the I2C thread when a transaction finishes
+typedef void (*Callback)(const Transaction& t, Status status, void* context);
+
+/**
+ * Describes one complete I2C transfer: an optional write, followed by an
+ * optional read from the same slave.  When both are present, the read is
+ * started with a repeated start so that no other master can get in between,
+ * which is what register reads on the MPU-6050 and MCP23017 need.
+ *
+ * The write data is copied into the transaction, so the caller's buffer can
+ * go away as soon as it has been submitted.  The read buffer is not, and has
+ * to stay valid until the callback has been called.
+ */
+struct Transaction {
+    static const size_t MAX_WRITE_SIZE = 8;
+
+    Transaction() = default;
+
+    Transaction(uint8_t addr, Priority prio) : address(addr), priority(prio) {}
+
+    /// Set the bytes to write, returns false if there are too many of them
+    bool setWrite(const uint8_t* data, size_t len) {
+        if (len > MAX_WRITE_SIZE) return false;
+        memcpy(writeData, data, len);
+        writeLength = len;
+        return true;
+    }
+
+    void setRead(uint8_t* data, size_t len) {
+        readData = data;
+        readLength = len;
+    }
+
+    void setCallback(Callback cb, void* ctx) {
+        callback = cb;
+        context = ctx;
+    }
+
+    /// 8-bit slave address, the R/W bit is filled in by the bus
+    uint8_t address = 0;
+    Priority priority = PRIORITY_NORMAL;
+
+    uint8_t writeData[MAX_WRITE_SIZE];
+    size_t writeLength = 0;
+
+    uint8_t* readData = nullptr;
+    size_t readLength = 0;
+
+    Callback callback = nullptr;
+    void* context = nullptr;
+};
+
+/// Mutex that does nothing, for when only one thread uses the queue
+struct NullMutex {
+    void lock() {}
+    void unlock() {}
+};
+
+/**
+ * A priority queue of I2C transactions and the code to run them on a bus.
+ *
+ * Callers submit() transactions and carry on; whoever owns the bus (a
+ * dedicated thread on the mbed) calls runNext() whenever there's work.  A
+ * batch of transactions submitted together runs back to back using repeated
+ * starts, so the bus isn't released and nothing else can be slipped in
+ * between them.
+ *
+ * The BUS type must provide the same master interface as I2CMasterRtos:
+ *  - int write(int address, const char* data, int length, bool repeated)
+ *  - int read(int address, char* data, int length, bool repeated)
+ *  - bool stop()
+ * where read() and write() return 0 on success.
+ *
+ * MUTEX must provide lock() and unlock().  It guards the queue itself and is
+ * never held while the bus is busy.
+ */
+template <class BUS, class MUTEX = NullMutex, size_t QUEUE_SIZE = 8>
+class Queue {
+public:
+    /// Number of transactions submitted, completed, and failed
+    struct Stats {
+        uint32_t submitted = 0;
+        uint32_t completed = 0;
+        uint32_t failed = 0;
+        uint32_t rejected = 0;  // the queue was full
+        uint32_t maxPending = 0;
+    };
+
+    explicit Queue(BUS& bus) : _bus(bus) {}
+
+    /**
+     * Add a transaction to the queue.
+     *
+     * @return false if the queue is full, in which case it was not added
+     */
+    bool submit(const Transaction& t) { return submit(&t, 1); }
+
+    /**
+     * Add a batch of transactions that should run back to back without
+     * releasing the bus.  The whole batch runs at the priority of its first
+     * transaction.  Either all of the batch is queued, or none of it is.
+     *
+     * @return false if there isn't room for the whole batch
+     */
+    bool submit(const Transaction* batch, size_t count) {
+        if (count == 0) return true;
+
+        const Priority prio = clampPriority(batch[0].priority);
+
+        _mutex.lock();
+        if (_pending + count > QUEUE_SIZE) {
+            _stats.rejected += count;
+            _mutex.unlock();
+            return false;
+        }
+
+        Ring& ring = _rings[prio];
+        for (size_t i = 0; i < count; i++) {
+            Entry& e = ring.entries[(ring.head + ring.count) % QUEUE_SIZE];
+            e.t = batch[i];
+            e.t.priority = prio;
+            e.batchRemaining = count - 1 - i;
+            ring.count++;
+        }
+
+        _pending += count;
+        _stats.submitted += count;
+        if (_pending > _stats.maxPending) _stats.maxPending = _pending;
+        _mutex.unlock();
+
+        return true;
+    }
+
+    /**
+     * Run the highest priority transaction in the queue, along with the rest
+     * of its batch, then call their callbacks.
+     *
+     * @return false if the queue was empty
+     */
+    bool runNext() {
+        Entry batch[QUEUE_SIZE];
+        size_t count = 0;
+
+        _mutex.lock();
+        for (int p = NUM_PRIORITIES - 1; p >= 0 && count == 0; p--) {
+            Ring& ring = _rings[p];
+            while (ring.count > 0) {
+                batch[count++] = ring.entries[ring.head];
+                ring.head = (ring.head + 1) % QUEUE_SIZE;
+                ring.count--;
+                if (batch[count - 1].batchRemaining == 0) break;
+            }
+        }
+        _pending -= count;
+        _mutex.unlock();
+
+        if (count == 0) return false;
+
+        Status status = STATUS_OK;
+        for (size_t i = 0; i < count; i++) {
+            const Transaction& t = batch[i].t;
+            if (status == STATUS_OK) {
+                status = execute(t, i == count - 1);
+                // the bus was left held if this wasn't the end of the batch
+                if (status != STATUS_OK && i != count - 1) _bus.stop();
+                finish(t, status);
+            } else {
+                finish(t, STATUS_ABORTED);
+            }
+        }
+
+        return true;
+    }
+
+    /// Run everything in the queue, returns the number of batches run
+    size_t runAll() {
+        size_t n = 0;
+        while (runNext()) n++;
+        return n;
+    }
+
+    size_t pending() const { return _pending; }
+
+    const Stats& stats() const { return _stats; }
+
+    void resetStats() { _stats = Stats(); }
+
+private:
+    struct Entry {
+        Transaction t;
+        size_t batchRemaining;
+    };
+
+    struct Ring {
+        Entry entries[QUEUE_SIZE];
+        size_t head = 0;
+        size_t count = 0;
+    };
+
+    static Priority clampPriority(Priority p) {
+        return p >= NUM_PRIORITIES ? PRIORITY_HIGH : p;
+    }
+
+    /// @param last If false, the bus is held with a repeated start afterwards
+    Status execute(const Transaction& t, bool last) {
+        const bool hasRead = t.readLength > 0;
+
+        if (t.writeLength > 0) {
+            const bool repeated = hasRead || !last;
+            if (_bus.write(t.address & ~1, (const char*)t.writeData,
+                           t.writeLength, repeated) != 0) {
+                return STATUS_NACK;
+            }
+        }
+
+        if (hasRead) {
+            if (_bus.read(t.address | 1, (char*)t.readData, t.readLength,
+                          !last) != 0) {
+                return STATUS_NACK;
+            }
+        }
+
+        return STATUS_OK;
+    }
+
+    void finish(const Transaction& t, Status status) {
+        if (status == STATUS_OK) {
+            _stats.completed++;
+        } else {
+            _stats.failed++;
+        }
+
+        if (t.callback) t.callback(t, status, t.context);
+    }
+
+    BUS& _bus;
+    MUTEX _mutex;
+
+    Ring _rings[NUM_PRIORITIES];
+    size_t _pending = 0;
+
+    Stats _stats;
+};
+
+}  // namespace i2c
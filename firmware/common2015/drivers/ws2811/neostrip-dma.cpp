@@ -0,0 +1,95 @@
+#include "neostrip-dma.hpp"
+
+#include <us_ticker_api.h>
+
+#include "ws2811-encoding.hpp"
+
+namespace {
+// The DMA controller can't reach the main SRAM that the heap and stacks are
+// in, so everything it reads goes in the AHB SRAM.
+__attribute__((section("AHBSRAM0"), aligned(16)))
+ws2811::Descriptor chain[ws2811::chainLength(NeoStripDma::MAX_PIXELS * 3)];
+__attribute__((section("AHBSRAM0"), aligned(4))) uint32_t words[3];
+
+uint8_t slots[ws2811::encodedSize(NeoStripDma::MAX_PIXELS * 3)];
+
+// GPDMA request line for MAT2.0, once it's selected in DMAREQSEL
+const uint32_t DMA_REQ_MAT2_0 = 12;
+const uint32_t DMAREQSEL_MAT2_0 = 1 << 4;
+
+// DMACCConfig fields
+const uint32_t DMA_ENABLE = 1 << 0;
+const uint32_t DMA_MEMORY_TO_PERIPHERAL = 1 << 11;
+const uint32_t DMA_TC_INTERRUPT_MASK = 1 << 15;
+
+const uint32_t DMA_CHANNEL = 7;
+}  // namespace
+
+volatile bool NeoStripDma::_busy = false;
+volatile uint32_t NeoStripDma::_doneUs = 0;
+uint32_t NeoStripDma::_mask;
+uintptr_t NeoStripDma::_setReg;
+uintptr_t NeoStripDma::_clrReg;
+
+void NeoStripDma::init(const gpio_t& pin) {
+    _mask = pin.mask;
+    _setReg = reinterpret_cast<uintptr_t>(pin.reg_set);
+    _clrReg = reinterpret_cast<uintptr_t>(pin.reg_clr);
+
+    // power up the DMA controller and TIMER2, and run the timer from the
+    // full core clock so a slot is a whole number of ticks
+    LPC_SC->PCONP |= (1 << 29) | (1 << 22);
+    LPC_SC->PCLKSEL1 = (LPC_SC->PCLKSEL1 & ~(3 << 12)) | (1 << 12);
+    LPC_SC->DMAREQSEL |= DMAREQSEL_MAT2_0;
+    LPC_GPDMA->DMACConfig = 1;
+
+    // reset the timer on every MR0 match, which is also the DMA request
+    LPC_TIM2->TCR = 2;
+    LPC_TIM2->PR = 0;
+    LPC_TIM2->MR0 = SystemCoreClock / ws2811::SLOTS_PER_SECOND - 1;
+    LPC_TIM2->MCR = 1 << 1;
+
+    NVIC_SetVector(DMA_IRQn, reinterpret_cast<uint32_t>(&NeoStripDma::dmaIrq));
+    NVIC_EnableIRQ(DMA_IRQn);
+}
+
+bool NeoStripDma::start(const uint8_t* data, size_t len) {
+    if (_busy || len > MAX_PIXELS * 3) return false;
+
+    // the last frame doesn't show until the line has been low for a while
+    if (us_ticker_read() - _doneUs < ws2811::RESET_US) return false;
+
+    ws2811::encode(data, len, slots);
+    ws2811::buildChain(slots, len * 8, words, chain, _mask, _setReg, _clrReg);
+
+    _busy = true;
+
+    // stop the timer where it'll make a request on its first match, and drop
+    // any request left over from the last frame
+    LPC_TIM2->TCR = 2;
+    LPC_TIM2->IR = 0x3F;
+
+    LPC_GPDMACH7->DMACCSrcAddr = chain[0].src;
+    LPC_GPDMACH7->DMACCDestAddr = chain[0].dst;
+    LPC_GPDMACH7->DMACCLLI = chain[0].next;
+    LPC_GPDMACH7->DMACCControl = chain[0].control;
+    LPC_GPDMA->DMACIntTCClear = 1 << DMA_CHANNEL;
+    LPC_GPDMA->DMACIntErrClr = 1 << DMA_CHANNEL;
+    LPC_GPDMACH7->DMACCConfig = DMA_ENABLE | (DMA_REQ_MAT2_0 << 6) |
+                                DMA_MEMORY_TO_PERIPHERAL |
+                                DMA_TC_INTERRUPT_MASK;
+
+    LPC_TIM2->TCR = 1;
+    return true;
+}
+
+void NeoStripDma::dmaIrq() {
+    if (!(LPC_GPDMA->DMACIntTCStat & (1 << DMA_CHANNEL))) return;
+    LPC_GPDMA->DMACIntTCClear = 1 << DMA_CHANNEL;
+
+    LPC_TIM2->TCR = 0;
+    LPC_GPDMACH7->DMACCConfig = 0;
+
+    _doneUs = us_ticker_read();
+    _busy = false;
+}
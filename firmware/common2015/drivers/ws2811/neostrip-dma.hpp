@@ -0,0 +1,51 @@
+#pragma once
+
+#include <mbed.h>
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Sends WS2811 data out of any GPIO pin without holding off interrupts.
+ *
+ * The pixel data is encoded ahead of time into a GPDMA linked list (see
+ * ws2811-encoding.hpp).  TIMER2 fires a DMA request every third of a bit
+ * time and each request moves one word into the pin's FIOSET or FIOCLR
+ * register, so the waveform's timing comes from the timer instead of from a
+ * delay loop that can't be interrupted.
+ *
+ * This uses TIMER2 and the lowest priority DMA channel, and there's only one
+ * of it since there's only one NeoStrip.
+ */
+class NeoStripDma {
+public:
+    /// Longest strip the DMA buffers have room for
+    static const size_t MAX_PIXELS = 4;
+
+    /// Set up the timer and DMA controller to drive @pin
+    static void init(const gpio_t& pin);
+
+    /**
+     * Start sending @len bytes of pixel data.  The data is encoded before
+     * this returns, so the caller can change it right away.
+     *
+     * @return false if the last frame hasn't finished sending and latching
+     *     yet, or if @len is more than MAX_PIXELS worth
+     */
+    static bool start(const uint8_t* data, size_t len);
+
+    /// true while a frame is being sent
+    static bool busy() { return _busy; }
+
+private:
+    static void dmaIrq();
+
+    static volatile bool _busy;
+
+    /// us_ticker time that the last frame finished
+    static volatile uint32_t _doneUs;
+
+    static uint32_t _mask;
+    static uintptr_t _setReg;
+    static uintptr_t _clrReg;
+};
@@ -18,6 +18,9 @@
 #include "neostrip.hpp"
 
 #include <algorithm>
+#include <cstring>
+
+#include "neostrip-dma.hpp"
 
 /*
  * This function is defined in the assembly code and is declared
@@ -38,6 +41,8 @@ NeoColor* NeoStrip::_default_color;
 
 NeoStrip::NeoStrip(PinName pin, unsigned int N) : _n(N) {
     _strip = new NeoColor[_n];
+    _sent = new NeoColor[_n];
+    _sentValid = false;
     _neopin = new gpio_t;
     _objs++;
 
@@ -54,10 +59,15 @@ NeoStrip::NeoStrip(PinName pin, unsigned int N) : _n(N) {
     // set registers and bitmask for pin registers
     neo_fio_reg = static_cast<volatile uint32_t*>(_neopin->reg_dir);
     neo_bitmask = static_cast<volatile uint32_t>(_neopin->mask);
+
+    // the DMA backend, like the bit-banging one, can only drive one strip
+    _useDma = _objs == 1 && _n <= NeoStripDma::MAX_PIXELS;
+    if (_useDma) NeoStripDma::init(*_neopin);
 }
 
 NeoStrip::~NeoStrip() {
     delete _neopin;
+    delete[] _sent;
     delete[] _strip;
     _objs--;
 }
@@ -106,10 +116,23 @@ void NeoStrip::clear() {
 }
 
 void NeoStrip::write() {
-    __disable_irq();          // disable interrupts
-    neo_out(_strip, _n * 3);  // output to the strip
-    __enable_irq();           // enable interrupts
-    wait_us(50);              // wait 50us for the reset pulse
+    const size_t nBytes = _n * sizeof(NeoColor);
+    if (_sentValid && memcmp(_strip, _sent, nBytes) == 0) return;
+
+    if (_useDma) {
+        // try again next time if the last frame is still going
+        if (!NeoStripDma::start(reinterpret_cast<uint8_t*>(_strip), nBytes)) {
+            return;
+        }
+    } else {
+        __disable_irq();          // disable interrupts
+        neo_out(_strip, nBytes);  // output to the strip
+        __enable_irq();           // enable interrupts
+        wait_us(50);              // wait 50us for the reset pulse
+    }
+
+    memcpy(_sent, _strip, nBytes);
+    _sentValid = true;
 }
 
 void NeoStrip::setFromDefaultColor() {
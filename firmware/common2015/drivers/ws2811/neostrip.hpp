@@ -116,9 +116,14 @@ public:
      * Write the colors out to the strip; this method must be called
      * to see any hardware effect.
      *
-     * This function disables interrupts while the strip data is being sent,
-     * each pixel takes approximately 30us to send, plus a 50us reset pulse
-     * at the end.
+     * Frames that are the same as the last one sent are skipped.  Strips of
+     * up to NeoStripDma::MAX_PIXELS are sent by DMA in the background.  If
+     * the last frame is still going out, the new one is sent by the next call
+     * to write() instead.
+     *
+     * Longer strips are bit-banged, which disables interrupts while the strip
+     * data is being sent, each pixel takes approximately 30us to send, plus a
+     * 50us reset pulse at the end.
      */
     void write();
 
@@ -129,6 +134,12 @@ public:
 protected:
     // pixel data used in setPixel() and neo_out()
     NeoColor* _strip;
+    // what the strip is currently showing
+    NeoColor* _sent;
+    // false until the first frame has been sent
+    bool _sentValid;
+    // true if the strip is sent by NeoStripDma
+    bool _useDma;
     // gpio struct for pin setup, should really be static
     gpio_t* _neopin;
     // the number of pixels in the strip
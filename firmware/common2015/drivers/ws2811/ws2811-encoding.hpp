@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * WS2811/WS2812 waveform encoding, shared by the DMA backend of NeoStrip and
+ * the host tests.
+ *
+ * Each data bit is sent as three equal slots of 1/3 of the 1.25 us bit time:
+ *
+ *     0 bit:  1 0 0    (high 417 ns, low 833 ns)
+ *     1 bit:  1 1 0    (high 833 ns, low 417 ns)
+ *
+ * which lands inside the datasheet's timing windows for both bit values.
+ */
+namespace ws2811 {
+
+/// WS2812B datasheet timing, in nanoseconds
+const int T0H_NS = 400;
+const int T1H_NS = 800;
+const int T0L_NS = 850;
+const int T1L_NS = 450;
+const int TOLERANCE_NS = 150;
+
+/// How long the line has to stay low for the LEDs to latch a frame
+const int RESET_US = 50;
+
+const int SLOTS_PER_BIT = 3;
+const int BIT_NS = 1250;
+const int SLOTS_PER_SECOND = SLOTS_PER_BIT * (1000000000 / BIT_NS);
+
+/// Bytes of packed slots needed for @len bytes of pixel data
+constexpr size_t encodedSize(size_t len) { return len * SLOTS_PER_BIT; }
+
+/**
+ * Encodes @len bytes of pixel data, in the order they go out on the wire, as
+ * a packed stream of slots, most significant bit first.  @out must hold
+ * encodedSize(len) bytes.
+ */
+inline void encode(const uint8_t* data, size_t len, uint8_t* out) {
+    uint32_t slot = 0;
+    for (size_t i = 0; i < len; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            const bool one = (data[i] >> bit) & 1;
+            const bool levels[SLOTS_PER_BIT] = {true, one, false};
+            for (int s = 0; s < SLOTS_PER_BIT; s++, slot++) {
+                uint8_t& b = out[slot / 8];
+                const uint8_t mask = 0x80 >> (slot % 8);
+                b = levels[s] ? (b | mask) : (b & ~mask);
+            }
+        }
+    }
+}
+
+/// Level of slot @i in an encoded stream
+inline bool slotLevel(const uint8_t* slots, size_t i) {
+    return (slots[i / 8] >> (7 - i % 8)) & 1;
+}
+
+/**
+ * One link of a GPDMA linked list, in the layout the LPC1768's DMA
+ * controller reads.  On the mbed, uintptr_t is 32 bits so this is exactly
+ * the controller's four words.
+ */
+struct Descriptor {
+    uintptr_t src;
+    uintptr_t dst;
+    uintptr_t next;
+    uint32_t control;
+};
+
+/// GPDMA channel control bits used by the chain
+const uint32_t DMA_TRANSFER_SIZE_MASK = 0xFFF;
+const uint32_t DMA_SWIDTH_WORD = 2 << 18;
+const uint32_t DMA_DWIDTH_WORD = 2 << 21;
+const uint32_t DMA_SRC_INCREMENT = 1 << 26;
+const uint32_t DMA_TC_INTERRUPT = 1u << 31;
+
+/// Links in the chain for @len bytes of pixel data
+constexpr size_t chainLength(size_t len) { return len * 8 * 2; }
+
+/**
+ * Builds a DMA chain that plays back an encoded slot stream on a GPIO pin
+ * with one word transfer per slot.
+ *
+ * The GPIO set and clear registers only act on the bits written as 1, so
+ * every bit is a link that writes the pin's mask to the set register,
+ * followed by a link that writes two words to the clear register: nothing
+ * and then the mask for a 1, or the mask twice for a 0.
+ *
+ * @param slots   Output of encode()
+ * @param bits    Number of data bits in @slots
+ * @param words   Three words that the chain reads from, which are filled in
+ *                here: {0, mask, mask}
+ * @param chain   chainLength() links
+ * @param mask    The pin's bit in its port
+ * @param setReg  Address of the port's FIOSET register
+ * @param clrReg  Address of the port's FIOCLR register
+ */
+inline void buildChain(const uint8_t* slots, size_t bits, uint32_t* words,
+                       Descriptor* chain, uint32_t mask, uintptr_t setReg,
+                       uintptr_t clrReg) {
+    words[0] = 0;
+    words[1] = mask;
+    words[2] = mask;
+
+    const uint32_t control =
+        DMA_SWIDTH_WORD | DMA_DWIDTH_WORD | DMA_SRC_INCREMENT;
+
+    for (size_t i = 0; i < bits; i++) {
+        Descriptor& set = chain[2 * i];
+        Descriptor& clr = chain[2 * i + 1];
+
+        set.src = reinterpret_cast<uintptr_t>(&words[1]);
+        set.dst = setReg;
+        set.next = reinterpret_cast<uintptr_t>(&clr);
+        set.control = control | 1;
+
+        const bool one = slotLevel(slots, i * SLOTS_PER_BIT + 1);
+        clr.src = reinterpret_cast<uintptr_t>(one ? &words[0] : &words[1]);
+        clr.dst = clrReg;
+        clr.next = reinterpret_cast<uintptr_t>(&chain[2 * i + 2]);
+        clr.control = control | 2;
+    }
+
+    // interrupt once the last bit is out
+    if (bits) {
+        chain[2 * bits - 1].next = 0;
+        chain[2 * bits - 1].control |= DMA_TC_INTERRUPT;
+    }
+}
+
+}  // namespace ws2811
@@ -2,11 +2,20 @@
 #include "Decawave.hpp"
 
 #include "assert.hpp"
+#include "heartbeat.hpp"
 #include "logger.hpp"
 
 #define COMM_LINK_SIGNAL_START_THREAD (1 << 0)
 #define COMM_LINK_SIGNAL_RX_TRIGGER (1 << 1)
 
+// The RX thread waits this long at most for an interrupt, so that it checks in
+// with the watchdog supervisor even when nothing's coming in
+#define COMM_LINK_HEARTBEAT_MS 100
+
+// How long reading a packet out of the radio can take before the supervisor
+// gives up on it
+#define COMM_LINK_HEARTBEAT_DEADLINE_MS 1000
+
 const char* COMM_ERR_STRING[] = {FOREACH_COMM_ERR(GENERATE_STRING)};
 
 CommLink::CommLink(shared_ptr<SharedSPI> sharedSPI, PinName nCs,
@@ -36,11 +45,18 @@ void CommLink::rxThread() {
     LOG(INIT, "RX communication link ready!\r\n    Thread ID: %u, Priority: %d",
         ((P_TCB)_rxThread.gettid())->task_id, threadPriority);
 
+    const int heartbeat =
+        Heartbeat::Register("comm-link", COMM_LINK_HEARTBEAT_DEADLINE_MS);
+
     while (true) {
+        Heartbeat::CheckIn(heartbeat);
+
         // Wait until new data has arrived
         // this is triggered by CommLink::ISR()
         Thread::yield();
-        Thread::signal_wait(COMM_LINK_SIGNAL_RX_TRIGGER);
+        const osEvent evt = Thread::signal_wait(COMM_LINK_SIGNAL_RX_TRIGGER,
+                                                COMM_LINK_HEARTBEAT_MS);
+        if (evt.status != osEventSignal) continue;
 
         LOG(INF3, "RX interrupt triggered");
 
@@ -53,6 +69,8 @@ void CommLink::rxThread() {
             // Write the data to the CommModule object's rxQueue
             rtp::packet p;
             p.recv(buf);
+            p.rxTimestamp = lastRxTimestamp();
+            p.rxQuality = lastRxQuality();
             CommModule::Instance->receive(std::move(p));
         }
     }
@@ -61,4 +79,10 @@ void CommLink::rxThread() {
 // Called by the derived class to begin thread operations
 void CommLink::ready() { _rxThread.signal_set(COMM_LINK_SIGNAL_START_THREAD); }
 
-void CommLink::ISR() { _rxThread.signal_set(COMM_LINK_SIGNAL_RX_TRIGGER); }
+void CommLink::ISR() {
+    // the microsecond ticker wraps every 71 minutes, which isn't a multiple
+    // of the timestamp's period, so one exchange an hour comes out wrong and
+    // gets thrown out by the offset estimator
+    _isrTimestamp = radio_time::fromUs(us_ticker_read());
+    _rxThread.signal_set(COMM_LINK_SIGNAL_RX_TRIGGER);
+}
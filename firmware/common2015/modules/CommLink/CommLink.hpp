@@ -2,6 +2,7 @@
 
 #include <mbed.h>
 #include <rtos.h>
+#include <us_ticker_api.h>
 
 #include "CommModule.hpp"
 #include "SharedSPI.hpp"
@@ -53,6 +54,36 @@ public:
     /// Send & Receive through the rtp structure
     virtual int32_t sendPacket(const rtp::packet* pkt) = 0;
 
+    /**
+     * When the last received frame arrived, on this link's radio clock.
+     * Links without hardware timestamps use the time their interrupt fired,
+     * which is off by the interrupt latency.
+     */
+    virtual radio_time::Timestamp lastRxTimestamp() { return _isrTimestamp; }
+
+    /// When the last frame was sent, on the same clock as lastRxTimestamp()
+    virtual radio_time::Timestamp lastTxTimestamp() { return _txTimestamp; }
+
+    /// Signal quality of the last received frame, for radios that report it
+    virtual rtp::packet::RxQuality lastRxQuality() {
+        return rtp::packet::RxQuality();
+    }
+
+    /// How many channels setChannel() accepts, numbered from 0
+    virtual uint8_t numChannels() const { return 1; }
+
+    /// Moves the radio to @channel, which is one of this link's own channel
+    /// numbers rather than a frequency
+    virtual void setChannel(uint8_t channel) {}
+
+    /**
+     * Measures the noise floor on the current channel, for radios that can.
+     * Only meaningful while nothing is being sent.
+     *
+     * @return false if the radio can't measure it, or the reading wasn't ready
+     */
+    virtual bool sampleNoise(float* dBm) { return false; }
+
 protected:
     /**
      * @brief Read data from the radio's RX buffer
@@ -75,6 +106,10 @@ protected:
     // Always call CommLink::ready() after derived class is ready
     void ready();
 
+    /// For links without hardware timestamps: call right before starting a
+    /// transmission to record its time for lastTxTimestamp()
+    void stampTx() { _txTimestamp = radio_time::fromUs(us_ticker_read()); }
+
     template <typename T>
     T twos_compliment(T val) {
         return ~val + 1;
@@ -85,6 +120,9 @@ protected:
 private:
     Thread _rxThread;
 
+    volatile radio_time::Timestamp _isrTimestamp = radio_time::UNKNOWN;
+    radio_time::Timestamp _txTimestamp = radio_time::UNKNOWN;
+
     // The working thread for handling RX data queue operations
     void rxThread();
 
@@ -1,6 +1,8 @@
 #include "CommModule.hpp"
 #include "CommPort.hpp"
 #include "assert.hpp"
+#include "heap-monitor.hpp"
+#include "heartbeat.hpp"
 #include "helper-funcs.hpp"
 #include "logger.hpp"
 
@@ -10,6 +12,13 @@ using namespace std;
 
 #define COMM_MODULE_SIGNAL_START_THREAD (1 << 0)
 
+// The threads wait this long at most for a packet, so that they check in with
+// the watchdog supervisor even when there's no traffic
+#define COMM_MODULE_HEARTBEAT_MS 100
+
+// How long a port callback can take before the supervisor gives up on it
+#define COMM_MODULE_HEARTBEAT_DEADLINE_MS 1000
+
 std::shared_ptr<CommModule> CommModule::Instance;
 
 CommModule::~CommModule() {
@@ -54,12 +63,22 @@ void CommModule::txThread() {
     // Signal to the RX thread that it can begin
     _rxThread.signal_set(COMM_MODULE_SIGNAL_START_THREAD);
 
+    const int heartbeat =
+        Heartbeat::Register("comm-tx", COMM_MODULE_HEARTBEAT_DEADLINE_MS);
+
+    // what the port callbacks allocate, see the 'heap' command
+    const uint8_t txTag = HeapMonitor::tag("comm-tx");
+
     while (true) {
+        Heartbeat::CheckIn(heartbeat);
+
         // When a new rtp::packet is put in the TX queue, begin operations (does
         // nothing if no new data in queue)
-        osEvent evt = osMailGet(_txQueue, osWaitForever);
+        osEvent evt = osMailGet(_txQueue, COMM_MODULE_HEARTBEAT_MS);
 
         if (evt.status == osEventMail) {
+            HeapTag heapTag(txTag);
+
             // Get a pointer to the packet's memory location
             rtp::packet* p = (rtp::packet*)evt.value.p;
 
@@ -76,7 +95,11 @@ void CommModule::txThread() {
             // Call the user callback function
             if (_ports.find(p->header.port) != _ports.end() &&
                 _ports[p->header.port].txCallback() != nullptr) {
-                _ports[p->header.port].txCallback()(p);
+                // links return COMM_SUCCESS, which is zero, once the packet
+                // is on its way
+                if (_ports[p->header.port].txCallback()(p) != 0) {
+                    _ports[p->header.port].txErrors++;
+                }
                 _ports[p->header.port].txCount++;
 
                 // LOG(INF2, "Transmission:\r\n    Port:\t%u\r\n",
@@ -107,14 +130,24 @@ void CommModule::rxThread() {
         "RX communication module ready!\r\n    Thread ID: %u, Priority: %d",
         ((P_TCB)_rxThread.gettid())->task_id, threadPriority);
 
+    const int heartbeat =
+        Heartbeat::Register("comm-rx", COMM_MODULE_HEARTBEAT_DEADLINE_MS);
+
+    // what the port callbacks allocate, see the 'heap' command
+    const uint8_t rxTag = HeapMonitor::tag("comm-rx");
+
     while (true) {
+        Heartbeat::CheckIn(heartbeat);
+
         // Wait until new data is placed in the class's RX queue from a CommLink
         // class
-        osEvent evt = osMailGet(_rxQueue, osWaitForever);
+        osEvent evt = osMailGet(_rxQueue, COMM_MODULE_HEARTBEAT_MS);
 
         // wait_ms(25);
 
         if (evt.status == osEventMail) {
+            HeapTag heapTag(rxTag);
+
             // get a pointer to where the data is stored
             rtp::packet* p = (rtp::packet*)evt.value.p;
 
@@ -235,12 +268,13 @@ unsigned int CommModule::numTxPackets() const {
 }
 
 void CommModule::printInfo() const {
-    printf("PORT\t\tIN\tOUT\tRX CBCK\t\tTX CBCK\r\n");
+    printf("PORT\t\tIN\tOUT\tTX ERR\tRX CBCK\t\tTX CBCK\r\n");
 
     for (const auto& kvpair : _ports) {
         const CommPort_t& p = kvpair.second;
-        printf("%d\t\t%u\t%u\t%s\t\t%s\r\n", kvpair.first, p.rxCount, p.txCount,
-               p.rxCallback() ? "YES" : "NO", p.txCallback() ? "YES" : "NO");
+        printf("%d\t\t%u\t%u\t%u\t%s\t\t%s\r\n", kvpair.first, p.rxCount,
+               p.txCount, p.txErrors, p.rxCallback() ? "YES" : "NO",
+               p.txCallback() ? "YES" : "NO");
     }
 
     printf(
@@ -19,6 +19,9 @@ public:
     /// Counters for the number of packets sent/received via this port
     unsigned int rxCount = 0, txCount = 0;
 
+    /// Number of packets the link failed to send
+    unsigned int txErrors = 0;
+
     // Set functions for each RX/TX callback.
     void setRxCallback(const std::function<RX_CALLBACK>& func) {
         _rxCallback = func;
@@ -37,6 +40,7 @@ public:
     void resetPacketCount() {
         rxCount = 0;
         txCount = 0;
+        txErrors = 0;
     }
 
 private:
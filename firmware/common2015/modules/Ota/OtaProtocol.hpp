@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "../../utils/crc.hpp"
+
+/**
+ * Over-the-air firmware update protocol, carried on rtp::Port::OTA.
+ *
+ * The sender (soccer, through the base station) transfers an image to one or
+ * more robots at once.  DATA messages are broadcast so every robot being
+ * updated picks up each chunk from a single transmission.  The sender then
+ * polls each robot in turn with a QUERY, and the robot replies with a STATUS
+ * that holds its first missing chunk and a bitmap of the chunks after it that
+ * it already has.  Only chunks missing on at least one robot are sent again.
+ *
+ *  sender                         robot(s)
+ *    | --- BEGIN (broadcast) -------> |  open staging area
+ *    | --- DATA x window (bcast) ---> |  check chunk CRC, store
+ *    | --- QUERY uid ---------------> |
+ *    | <-------------------- STATUS - |  nextMissing + bitmap
+ *    |        ... repeat until every robot has every chunk ...
+ *    | --- COMMIT uid --------------> |  verify image CRC, swap in image
+ *    | <-------------------- STATUS - |  COMMITTED, then reboot
+ *
+ * Everything here is plain data so the same definitions can be used by the
+ * robot, a host-side sender, and the unit tests.
+ */
+namespace ota {
+
+/// Image bytes carried by each DATA message
+static const size_t CHUNK_SIZE = 96;
+
+/// Number of chunks after the first missing one that a STATUS can report
+static const size_t WINDOW_SIZE = 32;
+
+/// Largest image we'll accept, the size of the LPC1768's flash
+static const uint32_t MAX_IMAGE_SIZE = 512 * 1024;
+
+enum MsgType : uint8_t {
+    MSG_BEGIN = 1,
+    MSG_DATA,
+    MSG_QUERY,
+    MSG_STATUS,
+    MSG_COMMIT,
+    MSG_ABORT,
+};
+
+/// The receiver's state, as reported in each STATUS message
+enum State : uint8_t {
+    STATE_IDLE = 0,
+    STATE_RECEIVING,
+    STATE_COMPLETE,   // every chunk received, waiting for COMMIT
+    STATE_COMMITTED,  // image verified and swapped in, about to reboot
+    STATE_ERROR,      // staging or verification failed, needs a new BEGIN
+};
+
+static const char* const STATE_STRING[] = {"IDLE", "RECEIVING", "COMPLETE",
+                                           "COMMITTED", "ERROR"};
+
+struct BeginMsg {
+    uint8_t type;
+    uint16_t session;
+    uint32_t imageSize;
+    uint32_t imageCrc;  // crc::crc32() of the whole image
+} __attribute__((packed));
+
+/// Followed by the chunk's data, which is CHUNK_SIZE bytes except for the
+/// last chunk of the image
+struct DataHeader {
+    uint8_t type;
+    uint16_t session;
+    uint16_t chunk;
+    uint16_t crc;  // crc::crc16() of the chunk's data
+} __attribute__((packed));
+
+/// Used for MSG_QUERY, MSG_COMMIT, and MSG_ABORT
+struct AddressedMsg {
+    uint8_t type;
+    uint16_t session;
+    uint8_t uid;
+} __attribute__((packed));
+
+struct StatusMsg {
+    uint8_t type;
+    uint16_t session;
+    uint8_t uid;
+    uint8_t state;
+    uint16_t nextMissing;  // equals the chunk count once all are received
+    uint32_t bitmap;       // bit i set = chunk (nextMissing + 1 + i) received
+} __attribute__((packed));
+
+/// Number of chunks an image of the given size is split into
+inline size_t numChunks(uint32_t imageSize) {
+    return (imageSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+}
+
+/// Number of bytes in the given chunk of an image
+inline size_t chunkLength(uint32_t imageSize, size_t chunk) {
+    const size_t offset = chunk * CHUNK_SIZE;
+    if (offset >= imageSize) return 0;
+    return imageSize - offset < CHUNK_SIZE ? imageSize - offset : CHUNK_SIZE;
+}
+
+/// Append a packed message struct to a payload buffer
+template <class MSG>
+void append(const MSG& msg, std::vector<uint8_t>* buf) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&msg);
+    buf->insert(buf->end(), bytes, bytes + sizeof(MSG));
+}
+
+/// Copy a packed message struct out of a payload buffer
+template <class MSG>
+bool parse(const uint8_t* data, size_t len, MSG* msg) {
+    if (len < sizeof(MSG)) return false;
+    memcpy(msg, data, sizeof(MSG));
+    return true;
+}
+
+}  // namespace ota
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "OtaProtocol.hpp"
+
+namespace ota {
+
+/**
+ * Robot side of an OTA transfer.
+ *
+ * Chunks are written to the staging area as they arrive, in whatever order
+ * they arrive in.  Once every chunk is in, a COMMIT reads the whole image back
+ * to check its CRC before asking the staging area to swap it in.
+ *
+ * The STAGING type must provide:
+ *  - bool begin(uint32_t imageSize)
+ *  - bool write(uint32_t offset, const uint8_t* data, size_t len)
+ *  - bool read(uint32_t offset, uint8_t* data, size_t len)
+ *  - bool commit()    // make the staged image the one that boots next
+ *  - void abort()
+ */
+template <class STAGING>
+class Receiver {
+public:
+    Receiver(STAGING& staging, uint8_t uid) : _staging(staging), _uid(uid) {}
+
+    void setUID(uint8_t uid) { _uid = uid; }
+
+    /**
+     * Handle the payload of a packet received on the OTA port.
+     *
+     * @param data  The packet's payload
+     * @param len   Length of @data
+     * @param reply Filled in with a STATUS payload if one should be sent
+     * @return true if @reply should be sent back to the base station
+     */
+    bool handle(const uint8_t* data, size_t len, std::vector<uint8_t>* reply) {
+        if (len == 0) return false;
+
+        switch (data[0]) {
+            case MSG_BEGIN: {
+                BeginMsg msg;
+                if (parse(data, len, &msg)) begin(msg);
+                return false;
+            }
+
+            case MSG_DATA: {
+                DataHeader hdr;
+                if (parse(data, len, &hdr)) {
+                    chunk(hdr, data + sizeof(hdr), len - sizeof(hdr));
+                }
+                return false;
+            }
+
+            case MSG_QUERY:
+            case MSG_COMMIT:
+            case MSG_ABORT: {
+                AddressedMsg msg;
+                if (!parse(data, len, &msg) || msg.uid != _uid) return false;
+                if (msg.session != _session) {
+                    // it's for a transfer we don't know about, so tell the
+                    // sender where we're at and let it start over
+                    status(reply);
+                    return true;
+                }
+
+                if (data[0] == MSG_COMMIT) {
+                    commit();
+                } else if (data[0] == MSG_ABORT) {
+                    if (_state != STATE_COMMITTED) {
+                        _staging.abort();
+                        _state = STATE_IDLE;
+                    }
+                }
+
+                status(reply);
+                return true;
+            }
+
+            default:
+                return false;
+        }
+    }
+
+    State state() const { return _state; }
+    uint16_t session() const { return _session; }
+    uint32_t imageSize() const { return _imageSize; }
+    size_t chunksReceived() const { return _numReceived; }
+    size_t totalChunks() const { return _received.size(); }
+
+    /// Number of DATA messages dropped because their CRC didn't match
+    unsigned int badChunks() const { return _badChunks; }
+
+private:
+    void begin(const BeginMsg& msg) {
+        // BEGIN is rebroadcast for robots that missed it, so don't throw
+        // away the progress we've made on the current transfer
+        if (msg.session == _session && _state != STATE_IDLE) return;
+
+        _session = msg.session;
+        _imageSize = msg.imageSize;
+        _imageCrc = msg.imageCrc;
+        _numReceived = 0;
+        _badChunks = 0;
+        _received.assign(numChunks(_imageSize), false);
+
+        if (_imageSize == 0 || _imageSize > MAX_IMAGE_SIZE ||
+            !_staging.begin(_imageSize)) {
+            _received.clear();
+            _state = STATE_ERROR;
+            return;
+        }
+
+        _state = STATE_RECEIVING;
+    }
+
+    void chunk(const DataHeader& hdr, const uint8_t* data, size_t len) {
+        if (_state != STATE_RECEIVING || hdr.session != _session) return;
+        if (hdr.chunk >= _received.size() || _received[hdr.chunk]) return;
+
+        if (len != chunkLength(_imageSize, hdr.chunk) ||
+            crc::crc16(data, len) != hdr.crc) {
+            _badChunks++;
+            return;
+        }
+
+        if (!_staging.write(hdr.chunk * CHUNK_SIZE, data, len)) {
+            _state = STATE_ERROR;
+            return;
+        }
+
+        _received[hdr.chunk] = true;
+        _numReceived++;
+        if (_numReceived == _received.size()) _state = STATE_COMPLETE;
+    }
+
+    void commit() {
+        if (_state != STATE_COMPLETE) return;
+
+        // read the image back rather than trusting the chunk CRCs so that we
+        // also catch anything that went wrong while writing it out
+        uint8_t buf[CHUNK_SIZE];
+        uint32_t crc = 0;
+        for (uint32_t offset = 0; offset < _imageSize; offset += CHUNK_SIZE) {
+            const size_t len = chunkLength(_imageSize, offset / CHUNK_SIZE);
+            if (!_staging.read(offset, buf, len)) {
+                _state = STATE_ERROR;
+                return;
+            }
+            crc = crc::crc32(buf, len, crc);
+        }
+
+        if (crc != _imageCrc || !_staging.commit()) {
+            _staging.abort();
+            _state = STATE_ERROR;
+            return;
+        }
+
+        _state = STATE_COMMITTED;
+    }
+
+    size_t nextMissing() const {
+        size_t i = 0;
+        while (i < _received.size() && _received[i]) i++;
+        return i;
+    }
+
+    void status(std::vector<uint8_t>* reply) const {
+        StatusMsg msg;
+        msg.type = MSG_STATUS;
+        msg.session = _session;
+        msg.uid = _uid;
+        msg.state = _state;
+        msg.nextMissing = nextMissing();
+        msg.bitmap = 0;
+        for (size_t i = 0; i < WINDOW_SIZE; i++) {
+            const size_t c = msg.nextMissing + 1 + i;
+            if (c < _received.size() && _received[c]) msg.bitmap |= 1ul << i;
+        }
+
+        reply->clear();
+        append(msg, reply);
+    }
+
+    STAGING& _staging;
+    uint8_t _uid;
+
+    State _state = STATE_IDLE;
+    uint16_t _session = 0;
+    uint32_t _imageSize = 0;
+    uint32_t _imageCrc = 0;
+
+    std::vector<bool> _received;
+    size_t _numReceived = 0;
+    unsigned int _badChunks = 0;
+};
+
+}  // namespace ota
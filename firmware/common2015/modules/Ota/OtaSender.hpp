@@ -0,0 +1,272 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+
+#include "OtaProtocol.hpp"
+
+namespace ota {
+
+/**
+ * Sender side of an OTA transfer to one or more robots.
+ *
+ * This doesn't do any I/O itself so that it can be driven by whatever is on
+ * the other end of the base station (or by a simulation).  Call poll() each
+ * time the link is ready for another packet, and pass every payload received
+ * on the OTA port to handleReply().
+ *
+ * Each round broadcasts the chunks in the current window that at least one
+ * robot is missing, then queries every robot for its status.  The window
+ * starts at the earliest chunk that any robot is still missing.  A robot that
+ * doesn't answer MAX_QUERY_ATTEMPTS queries in a row is dropped so that it
+ * can't hold up the rest.
+ */
+class Sender {
+public:
+    /// Number of times a robot is queried without a reply before giving up
+    static const int MAX_QUERY_ATTEMPTS = 10;
+
+    /// How long to wait for a STATUS after sending a QUERY or COMMIT
+    static const uint32_t REPLY_TIMEOUT_MS = 20;
+
+    struct Target {
+        uint8_t uid;
+        State state = STATE_IDLE;
+        bool inSession = false;
+        size_t nextMissing = 0;
+        uint32_t bitmap = 0;
+        int missedReplies = 0;
+        bool failed = false;
+
+        explicit Target(uint8_t id) : uid(id) {}
+
+        bool hasChunk(size_t c) const {
+            if (c < nextMissing) return true;
+            if (c == nextMissing || c > nextMissing + WINDOW_SIZE) return false;
+            return bitmap & (1ul << (c - nextMissing - 1));
+        }
+
+        bool finished() const { return failed || state == STATE_COMMITTED; }
+    };
+
+    /**
+     * @param image   The firmware image, which must outlive the Sender
+     * @param size    Size of @image in bytes
+     * @param session Identifies this transfer.  Use a new value each time.
+     * @param uids    The robots to update
+     * @param send    Called with each payload to transmit on the OTA port
+     */
+    Sender(const uint8_t* image, uint32_t size, uint16_t session,
+           const std::vector<uint8_t>& uids,
+           std::function<void(std::vector<uint8_t>)> send)
+        : _image(image),
+          _size(size),
+          _session(session),
+          _numChunks(numChunks(size)),
+          _imageCrc(crc::crc32(image, size)),
+          _send(send) {
+        for (uint8_t uid : uids) _targets.emplace_back(uid);
+    }
+
+    /**
+     * Send the next packet of the transfer, if any.
+     *
+     * @param nowMs The current time in milliseconds
+     * @return false once every robot has either committed the image or been
+     *     given up on
+     */
+    bool poll(uint32_t nowMs) {
+        if (finished()) return false;
+
+        // waiting on a reply to a query or commit
+        if (_awaiting >= 0) {
+            if (nowMs - _sentAt < REPLY_TIMEOUT_MS) return true;
+
+            Target& t = _targets[_awaiting];
+            if (++t.missedReplies >= MAX_QUERY_ATTEMPTS) t.failed = true;
+            _awaiting = -1;
+            _queryIdx++;
+        }
+
+        switch (_phase) {
+            case PHASE_BEGIN:
+                sendBegin();
+                _phase = PHASE_QUERY;
+                _queryIdx = 0;
+                break;
+
+            case PHASE_DATA:
+                if (!sendNextChunk()) {
+                    _phase = PHASE_QUERY;
+                    _queryIdx = 0;
+                    return poll(nowMs);
+                }
+                break;
+
+            case PHASE_QUERY:
+                while (_queryIdx < _targets.size() &&
+                       _targets[_queryIdx].finished()) {
+                    _queryIdx++;
+                }
+                if (_queryIdx >= _targets.size()) {
+                    startRound();
+                    return poll(nowMs);
+                }
+                sendAddressed(_targets[_queryIdx].state == STATE_COMPLETE
+                                  ? MSG_COMMIT
+                                  : MSG_QUERY,
+                              _targets[_queryIdx].uid);
+                _awaiting = _queryIdx;
+                _sentAt = nowMs;
+                break;
+        }
+
+        return true;
+    }
+
+    /// Handle a payload received on the OTA port
+    void handleReply(const uint8_t* data, size_t len) {
+        StatusMsg msg;
+        if (len == 0 || data[0] != MSG_STATUS || !parse(data, len, &msg))
+            return;
+
+        for (size_t i = 0; i < _targets.size(); i++) {
+            Target& t = _targets[i];
+            if (t.uid != msg.uid || t.failed) continue;
+
+            t.missedReplies = 0;
+            t.inSession = msg.session == _session;
+            if (t.inSession) {
+                t.state = static_cast<State>(msg.state);
+                t.nextMissing = msg.nextMissing;
+                t.bitmap = msg.bitmap;
+                if (t.state == STATE_ERROR) t.failed = true;
+            } else {
+                t.state = STATE_IDLE;
+                t.nextMissing = 0;
+                t.bitmap = 0;
+            }
+
+            if (_awaiting == static_cast<int>(i)) {
+                _awaiting = -1;
+                _queryIdx++;
+            }
+        }
+    }
+
+    bool finished() const {
+        for (const Target& t : _targets)
+            if (!t.finished()) return false;
+        return true;
+    }
+
+    const std::vector<Target>& targets() const { return _targets; }
+
+    /// Number of DATA messages sent so far, including retransmissions
+    unsigned int chunksSent() const { return _chunksSent; }
+
+    size_t totalChunks() const { return _numChunks; }
+
+private:
+    enum Phase { PHASE_BEGIN, PHASE_DATA, PHASE_QUERY };
+
+    /// Decide what to send after every robot has been queried
+    void startRound() {
+        // robots that missed the BEGIN (or rebooted) need it again
+        for (const Target& t : _targets) {
+            if (!t.finished() && !t.inSession) {
+                _phase = PHASE_BEGIN;
+                return;
+            }
+        }
+
+        _windowStart = _numChunks;
+        for (const Target& t : _targets) {
+            if (t.finished() || t.state != STATE_RECEIVING) continue;
+            if (t.nextMissing < _windowStart) _windowStart = t.nextMissing;
+        }
+
+        _nextChunk = _windowStart;
+        _phase = PHASE_DATA;
+        _queryIdx = 0;
+    }
+
+    bool missingAnywhere(size_t c) const {
+        for (const Target& t : _targets) {
+            if (t.finished() || t.state != STATE_RECEIVING) continue;
+            if (!t.hasChunk(c)) return true;
+        }
+        return false;
+    }
+
+    /// Send the next chunk in the window that someone needs
+    bool sendNextChunk() {
+        const size_t windowEnd =
+            std::min(_windowStart + WINDOW_SIZE, _numChunks);
+        while (_nextChunk < windowEnd && !missingAnywhere(_nextChunk))
+            _nextChunk++;
+        if (_nextChunk >= windowEnd) return false;
+
+        const size_t len = chunkLength(_size, _nextChunk);
+        const uint8_t* data = _image + _nextChunk * CHUNK_SIZE;
+
+        DataHeader hdr;
+        hdr.type = MSG_DATA;
+        hdr.session = _session;
+        hdr.chunk = _nextChunk;
+        hdr.crc = crc::crc16(data, len);
+
+        std::vector<uint8_t> buf;
+        append(hdr, &buf);
+        buf.insert(buf.end(), data, data + len);
+        _send(std::move(buf));
+
+        _nextChunk++;
+        _chunksSent++;
+        return true;
+    }
+
+    void sendBegin() {
+        BeginMsg msg;
+        msg.type = MSG_BEGIN;
+        msg.session = _session;
+        msg.imageSize = _size;
+        msg.imageCrc = _imageCrc;
+
+        std::vector<uint8_t> buf;
+        append(msg, &buf);
+        _send(std::move(buf));
+    }
+
+    void sendAddressed(MsgType type, uint8_t uid) {
+        AddressedMsg msg;
+        msg.type = type;
+        msg.session = _session;
+        msg.uid = uid;
+
+        std::vector<uint8_t> buf;
+        append(msg, &buf);
+        _send(std::move(buf));
+    }
+
+    const uint8_t* _image;
+    const uint32_t _size;
+    const uint16_t _session;
+    const size_t _numChunks;
+    const uint32_t _imageCrc;
+    std::function<void(std::vector<uint8_t>)> _send;
+
+    std::vector<Target> _targets;
+
+    Phase _phase = PHASE_BEGIN;
+    size_t _windowStart = 0;
+    size_t _nextChunk = 0;
+    size_t _queryIdx = 0;
+
+    int _awaiting = -1;
+    uint32_t _sentAt = 0;
+
+    unsigned int _chunksSent = 0;
+};
+
+}  // namespace ota
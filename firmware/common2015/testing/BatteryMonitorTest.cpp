@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "../utils/battery-monitor.hpp"
+#include "../utils/current-controller.hpp"
+
+namespace {
+const float DT = 0.005;  // the control loop's period, in s
+const float VOLTS_PER_COUNT = 0.09884 / 256;  // RobotStatusMessage's scale
+
+/**
+ * Four drive motors on a battery with internal resistance.  The current loop
+ * is taken to be perfect, so each motor draws what it's asked for unless the
+ * battery can't get it there, and the battery gives that times the duty
+ * cycle.  Speeds are in volts of back EMF.
+ */
+struct Robot {
+    double openVolts;
+    double resistance;  // ohms
+    const double winding = 1.2;  // ohms
+    const double accel = 4.5;    // back EMF V/s per A, from the inertia
+    const double nominalVolts = 18;
+
+    double speed[4] = {};
+    double volts = 0;
+    double batteryAmps = 0;
+
+    Robot(double open, double r) : openVolts(open), resistance(r) {
+        volts = open;
+    }
+
+    /// Draws @amps on each motor for @dt, and returns the lowest voltage
+    double drive(const float amps[4], double dt) {
+        // the terminal voltage depends on the draw, which depends on the
+        // duty cycle it takes at that voltage
+        double power = 0;
+        double current[4];
+        for (int iter = 0; iter < 4; iter++) {
+            power = 0;
+            for (int i = 0; i < 4; i++) {
+                // as much as the battery can push through
+                const double most = (volts - speed[i]) / winding;
+                current[i] = std::min<double>(amps[i], std::max(0.0, most));
+                power += (speed[i] + current[i] * winding) * current[i];
+            }
+            const double disc =
+                openVolts * openVolts - 4 * resistance * power;
+            // past the peak power the battery can give, it collapses
+            volts = disc < 0 ? openVolts / 2
+                             : (openVolts + std::sqrt(disc)) / 2;
+        }
+        batteryAmps = power / volts;
+        for (int i = 0; i < 4; i++) speed[i] += current[i] * accel * dt;
+        return volts;
+    }
+
+    /// What the battery sense pin reads, with a bit of noise
+    uint16_t sense() const {
+        const int noise = std::rand() % 129 - 64;
+        return std::min(65535.0, volts / VOLTS_PER_COUNT + noise);
+    }
+};
+
+struct Sprint {
+    double minVolts = 1e9;
+    double timeToSpeed = -1;  // s, or never
+};
+
+/// Floors it from standing still to 9 V of back EMF after a rest, with the
+/// power limiting or without
+Sprint accelerate(Robot robot, BatteryMonitor* monitor, bool limited) {
+    CurrentController current;
+    Sprint run;
+    const double physicsDt = 1e-4;
+    int step = 0;
+    for (int tick = 0; tick < 600; tick++) {
+        const bool resting = tick < 60;
+        const double time = (tick - 60) * DT;
+
+        // what the current loop would ask for with the velocity loop pinned
+        float request[4];
+        float draw = 0;
+        for (int i = 0; i < 4; i++) {
+            const float backEmf = robot.speed[i] / robot.nominalVolts *
+                                  CurrentController::MAX_DUTY *
+                                  monitor->supplyScale();
+            request[i] = resting ? 0 : current.request(511, backEmf);
+            const float duty = std::min<float>(
+                CurrentController::MAX_DUTY,
+                std::abs(current.dutyFor(request[i], backEmf)));
+            draw += duty / CurrentController::MAX_DUTY * std::abs(request[i]);
+        }
+        const float scale = limited ? monitor->powerScale(draw) : 1;
+        float amps[4];
+        for (int i = 0; i < 4; i++) amps[i] = request[i] * scale;
+
+        for (double t = 0; t < DT - physicsDt / 2; t += physicsDt) {
+            const double v = robot.drive(amps, physicsDt);
+            if (!resting) run.minVolts = std::min(run.minVolts, v);
+            if (++step % 10 == 0) monitor->sample(robot.sense());
+        }
+        monitor->update(robot.batteryAmps);
+
+        if (run.timeToSpeed < 0 && robot.speed[0] >= 9) {
+            run.timeToSpeed = time;
+        }
+    }
+    return run;
+}
+}  // namespace
+
+TEST(BatteryMonitor, filtersNoise) {
+    BatteryMonitor monitor(VOLTS_PER_COUNT);
+    Robot robot(16.5, 0.1);
+    for (int i = 0; i < 100; i++) monitor.sample(robot.sense());
+    EXPECT_NEAR(16.5, monitor.volts(), 0.01);
+    EXPECT_EQ(uint8_t(16.5 / 0.09884), monitor.reading());
+
+    // and follows a step within a few ms
+    robot.volts = 14;
+    for (int i = 0; i < 20; i++) monitor.sample(robot.sense());
+    EXPECT_NEAR(14, monitor.volts(), 0.2);
+}
+
+TEST(BatteryMonitor, scalesFeedforward) {
+    BatteryMonitor monitor(VOLTS_PER_COUNT);
+
+    // no battery, no scaling
+    EXPECT_FLOAT_EQ(1, monitor.supplyScale());
+    monitor.update(0);
+    EXPECT_FLOAT_EQ(1, monitor.powerScale(100));
+
+    Robot robot(15, 0.1);
+    for (int i = 0; i < 100; i++) monitor.sample(robot.sense());
+    EXPECT_NEAR(18 / 15.0, monitor.supplyScale(), 0.01);
+
+    // which gets the same speed out of the same command as a full battery
+    const double duty = 0.5 * monitor.supplyScale();
+    EXPECT_NEAR(0.5 * 18, duty * robot.volts, 0.1);
+
+    // but it doesn't chase a battery that's sagged below the minimum
+    robot.volts = 10;
+    for (int i = 0; i < 100; i++) monitor.sample(robot.sense());
+    EXPECT_FLOAT_EQ(18 / monitor.params().minVolts, monitor.supplyScale());
+}
+
+TEST(BatteryMonitor, preventsBrownout) {
+    printf("  battery              min V (free)   min V (limited)   "
+           "time to speed (limited)\n");
+    struct Case {
+        const char* name;
+        double openVolts;
+        double resistance;
+    };
+    const Case cases[] = {
+        {"fresh", 18.5, 0.08},
+        {"drained", 15.5, 0.15},
+        {"drained and old", 15.5, 0.3},
+    };
+    for (const Case& c : cases) {
+        std::srand(1);
+        BatteryMonitor openMonitor(VOLTS_PER_COUNT);
+        const Sprint open = accelerate(Robot(c.openVolts, c.resistance),
+                                       &openMonitor, false);
+        BatteryMonitor monitor(VOLTS_PER_COUNT);
+        const Sprint limited =
+            accelerate(Robot(c.openVolts, c.resistance), &monitor, true);
+        printf("  %-18s   %12.1f   %15.1f   %21.2f s\n", c.name,
+               open.minVolts, limited.minVolts, limited.timeToSpeed);
+
+        const float min = monitor.params().minVolts;
+        EXPECT_GT(limited.minVolts, min - 0.3) << c.name;
+        EXPECT_NEAR(c.resistance, monitor.resistance(), c.resistance * 0.3)
+            << c.name;
+        if (open.minVolts > min) {
+            // it stays out of the way when there's nothing to prevent
+            EXPECT_GT(limited.timeToSpeed, 0) << c.name;
+            EXPECT_LT(limited.timeToSpeed, open.timeToSpeed * 1.15)
+                << c.name;
+        }
+    }
+
+    // without it, the drained packs brown out
+    std::srand(1);
+    BatteryMonitor monitor(VOLTS_PER_COUNT);
+    EXPECT_LT(accelerate(Robot(15.5, 0.15), &monitor, false).minVolts, 13);
+}
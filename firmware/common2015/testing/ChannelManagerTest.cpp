@@ -0,0 +1,303 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../utils/channel-manager.hpp"
+
+namespace {
+const uint8_t CHANNELS = 6;
+const uint32_t FRAME_MS = ChannelFollower::FRAME_PERIOD_MS;
+
+/// Something else on the air, for a while
+struct Interferer {
+    uint8_t channel;
+    int start, end;  // frames
+    double loss;     // chance of a packet on the channel being lost
+    float noiseDbm;
+
+    // only near the robots, so the base station can't hear it or lose
+    // replies to it
+    bool atRobots;
+
+    bool active(int frame) const { return frame >= start && frame < end; }
+};
+
+/**
+ * A base station and a few robots passing forward packets and replies over
+ * six channels, with interference coming and going.
+ */
+class Field {
+public:
+    Field(int robots, bool measureNoise)
+        : planner(CHANNELS, 0), _measureNoise(measureNoise), _rng(36) {
+        for (int i = 0; i < robots; i++) {
+            followers.emplace_back(CHANNELS, 0, 0);
+            deaf.push_back({0, 0});
+        }
+    }
+
+    /// Runs a frame and returns how many robots got their forward packet
+    /// through and their reply back
+    int frame() {
+        const int f = _frame++;
+        const uint32_t now = f * FRAME_MS;
+
+        rtp::ChannelSchedule schedule;
+        planner.startFrame(&schedule);
+        const uint8_t channel = planner.channel();
+
+        if (_measureNoise) {
+            const uint8_t c = planner.scanChannel();
+            planner.noiseSample(c, noise(c, f) + _gauss(_rng));
+        }
+
+        int delivered = 0;
+        for (size_t r = 0; r < followers.size(); r++) {
+            ChannelFollower& robot = followers[r];
+            robot.update(now);
+
+            const bool isDeaf = f >= deaf[r].first && f < deaf[r].second;
+            if (robot.channel() == channel && !isDeaf &&
+                !lost(channel, f, true)) {
+                robot.received(schedule, now + 1);
+
+                // the reply goes out in the robot's slot
+                if (!lost(channel, f, false)) {
+                    planner.replyReceived();
+                    delivered++;
+                }
+                robot.replied();
+                robot.update(now + 2 + 2 * r);
+            }
+            robot.update(now + ChannelFollower::REPLY_WINDOW_MS + 1);
+        }
+        return delivered;
+    }
+
+    /// Fraction of the possible replies that made it over @frames frames
+    double run(int frames) {
+        int delivered = 0;
+        for (int i = 0; i < frames; i++) delivered += frame();
+        return double(delivered) / (frames * followers.size());
+    }
+
+    /// Frames until every robot is on the base station's channel and
+    /// replying, up to @limit
+    int framesUntilAllReply(int limit) {
+        for (int i = 0; i < limit; i++) {
+            if (frame() == int(followers.size())) return i;
+        }
+        return limit;
+    }
+
+    int frameNumber() const { return _frame; }
+
+    std::vector<Interferer> interference;
+    ChannelPlanner planner;
+    std::vector<ChannelFollower> followers;
+    std::vector<std::pair<int, int>> deaf;  // frames a robot hears nothing
+
+private:
+    float noise(uint8_t channel, int f) const {
+        float n = -100;
+        for (const Interferer& i : interference) {
+            if (i.channel == channel && i.active(f) && !i.atRobots &&
+                i.noiseDbm > n) {
+                n = i.noiseDbm;
+            }
+        }
+        return n;
+    }
+
+    bool lost(uint8_t channel, int f, bool atRobot) {
+        double pass = 0.98;
+        for (const Interferer& i : interference) {
+            if (i.channel == channel && i.active(f) &&
+                (atRobot || !i.atRobots)) {
+                pass *= 1 - i.loss;
+            }
+        }
+        return _uniform(_rng) > pass;
+    }
+
+    bool _measureNoise;
+    int _frame = 0;
+    std::mt19937 _rng;
+    std::uniform_real_distribution<double> _uniform{0, 1};
+    std::normal_distribution<float> _gauss{0, 2};
+};
+
+void printResult(const char* name, const Field& field, double before,
+                 int recoveryFrames, double after) {
+    printf("  %-28s %5.1f%%   %5u ms   %5.1f%%   %2u / %u\n", name,
+           before * 100, recoveryFrames * FRAME_MS, after * 100,
+           field.planner.switches, field.planner.fallbacks);
+}
+}  // namespace
+
+TEST(ChannelManager, simulation) {
+    printf(
+        "  scenario                     before   recovery   after  "
+        "switches / fallbacks\n");
+
+    {
+        // a jammer shows up on the channel everyone is on, and the base
+        // station can hear it
+        Field field(6, true);
+        const double before = field.run(300);
+        field.interference.push_back({0, 300, 100000, 0.9, -50, false});
+        const int recovery = field.framesUntilAllReply(600);
+        const double after = field.run(600);
+        printResult("jammed, noise measured", field, before, recovery, after);
+
+        EXPECT_GT(before, 0.9);
+        EXPECT_LT(recovery, 90);
+        EXPECT_GT(after, 0.9);
+        EXPECT_NE(0, field.planner.channel());
+        EXPECT_EQ(1u, field.planner.switches);
+        EXPECT_GT(field.planner.noiseFloor(0), -60);
+    }
+
+    {
+        // the DW1000 can't measure noise, so only the loss gives it away
+        Field field(6, false);
+        const double before = field.run(300);
+        field.interference.push_back({0, 300, 100000, 0.9, -50, false});
+        const int recovery = field.framesUntilAllReply(600);
+        const double after = field.run(600);
+        printResult("jammed, loss only", field, before, recovery, after);
+
+        EXPECT_LT(recovery, 120);
+        EXPECT_GT(after, 0.9);
+        EXPECT_EQ(1u, field.planner.switches);
+    }
+
+    {
+        // the channel the base station picks is jammed where the robots are,
+        // so nobody replies there and it has to come back and try another
+        Field field(6, true);
+        const double before = field.run(300);
+        field.interference.push_back({0, 300, 100000, 0.9, -50, false});
+        field.interference.push_back({1, 300, 100000, 1.0, -50, true});
+        const int recovery = field.framesUntilAllReply(1200);
+        const double after = field.run(600);
+        printResult("next channel jammed at robots", field, before, recovery,
+                    after);
+
+        EXPECT_LT(recovery, 600);
+        EXPECT_GT(after, 0.9);
+        EXPECT_EQ(1u, field.planner.fallbacks);
+        EXPECT_NE(0, field.planner.channel());
+        EXPECT_NE(1, field.planner.channel());
+    }
+
+    {
+        // one robot misses the whole announcement of a requested switch
+        Field field(6, true);
+        const double before = field.run(300);
+        field.planner.requestChannel(3);
+        field.deaf[0] = {300, 300 + ChannelPlanner::SWITCH_NOTICE_FRAMES + 1};
+
+        // everyone else moves in step with the base station
+        int missed = 0;
+        for (int i = 0; i <= ChannelPlanner::SWITCH_NOTICE_FRAMES + 1; i++) {
+            missed += 5 - std::min(5, field.frame());
+        }
+        EXPECT_LE(missed, 3);
+        EXPECT_EQ(3, field.planner.channel());
+        EXPECT_EQ(0, field.followers[0].channel());
+
+        const int recovery = field.framesUntilAllReply(600);
+        const double after = field.run(600);
+        printResult("robot missed the switch", field, before, recovery, after);
+
+        // it gives up on the old channel and looks through the others
+        EXPECT_LT(recovery * FRAME_MS,
+                  ChannelFollower::LOST_SYNC_MS +
+                      4 * ChannelFollower::HUNT_DWELL_MS);
+        EXPECT_GT(after, 0.95);
+        EXPECT_EQ(3, field.followers[0].channel());
+    }
+}
+
+TEST(ChannelManager, followerCountdown) {
+    ChannelFollower robot(CHANNELS, 2, 0);
+    EXPECT_EQ(2, robot.channel());
+
+    // counting down from 3, and it hears all of them
+    uint32_t now = 0;
+    for (uint8_t countdown = 3; countdown > 0; countdown--) {
+        robot.received({2, 4, countdown}, now);
+        EXPECT_FALSE(robot.update(now + 1));
+        robot.replied();
+        EXPECT_EQ(countdown == 1, robot.update(now + 5));
+        now += FRAME_MS;
+    }
+    EXPECT_EQ(4, robot.channel());
+    EXPECT_EQ(2, robot.lastGood());
+
+    // a switch that was called off
+    robot.received({4, 1, 5}, now);
+    robot.received({4, 4, 0}, now + FRAME_MS);
+    EXPECT_FALSE(robot.update(now + 10 * FRAME_MS));
+    EXPECT_EQ(4, robot.channel());
+}
+
+TEST(ChannelManager, followerMovesOnTimeWithoutTheLastPackets) {
+    ChannelFollower robot(CHANNELS, 0, 0);
+    robot.received({0, 5, 4}, 0);
+
+    // it hears nothing else, but moves when the base station does
+    const uint32_t due = 3 * FRAME_MS + ChannelFollower::REPLY_WINDOW_MS;
+    EXPECT_FALSE(robot.update(due - 1));
+    EXPECT_TRUE(robot.update(due));
+    EXPECT_EQ(5, robot.channel());
+
+    // the base station isn't there, so it goes back to where it last was
+    EXPECT_FALSE(robot.update(due + ChannelFollower::LOST_SYNC_MS));
+    EXPECT_TRUE(robot.update(due + ChannelFollower::LOST_SYNC_MS + 1));
+    EXPECT_TRUE(robot.hunting());
+    EXPECT_EQ(0, robot.channel());
+}
+
+TEST(ChannelManager, plannerFallsBackWhenNobodyFollows) {
+    ChannelPlanner planner(CHANNELS, 0);
+    rtp::ChannelSchedule s;
+
+    for (int i = 0; i < 10; i++) {
+        planner.startFrame(&s);
+        planner.replyReceived();
+    }
+
+    planner.requestChannel(2);
+    for (int i = ChannelPlanner::SWITCH_NOTICE_FRAMES; i > 0; i--) {
+        EXPECT_FALSE(planner.startFrame(&s));
+        EXPECT_EQ(0, s.channel);
+        EXPECT_EQ(2, s.next);
+        EXPECT_EQ(i, s.countdown);
+        planner.replyReceived();
+    }
+    EXPECT_TRUE(planner.startFrame(&s));
+    EXPECT_EQ(2, planner.channel());
+
+    // nothing comes back on the new channel
+    for (unsigned int i = 1; i < ChannelPlanner::FALLBACK_FRAMES; i++) {
+        EXPECT_FALSE(planner.startFrame(&s));
+        EXPECT_EQ(0, s.countdown);
+    }
+    EXPECT_FALSE(planner.startFrame(&s));
+    EXPECT_EQ(0, s.next);
+    EXPECT_EQ(1, s.countdown);
+    EXPECT_TRUE(planner.startFrame(&s));
+    EXPECT_EQ(0, planner.channel());
+    EXPECT_EQ(1u, planner.fallbacks);
+
+    // and it doesn't bounce back and forth if they're gone
+    for (unsigned int i = 0; i < 2 * ChannelPlanner::FALLBACK_FRAMES; i++) {
+        EXPECT_FALSE(planner.startFrame(&s));
+    }
+    EXPECT_EQ(1u, planner.fallbacks);
+}
@@ -0,0 +1,328 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../utils/control-codec.hpp"
+
+namespace {
+/// How the commands in a stream change from frame to frame
+enum class Play {
+    // everyone stopped, like during a timeout
+    Idle,
+    // robots ramping between velocity targets with a little planner jitter,
+    // and the odd kick, like in a match
+    Match,
+    // unrelated commands every frame, the worst case for deltas
+    Random,
+};
+
+/**
+ * Commands for a team of robots over a number of frames, standing in for a
+ * recording of what soccer sends.
+ */
+class CommandStream {
+public:
+    CommandStream(Play play, size_t robots, unsigned int seed)
+        : _play(play), _rng(seed), _robots(robots) {
+        for (size_t i = 0; i < robots; i++) {
+            State& robot = _robots[i];
+            memset(&robot.msg, 0, sizeof(robot.msg));
+            robot.msg.uid = i;
+        }
+    }
+
+    /// Commands for the next frame
+    std::vector<rtp::ControlMessage> next() {
+        std::vector<rtp::ControlMessage> msgs;
+        for (State& robot : _robots) {
+            step(&robot);
+            msgs.push_back(robot.msg);
+        }
+        return msgs;
+    }
+
+private:
+    struct State {
+        rtp::ControlMessage msg;
+        double velocity[3] = {};
+        double target[3] = {};
+    };
+
+    void step(State* robot) {
+        rtp::ControlMessage& msg = robot->msg;
+        if (_play == Play::Idle) return;
+
+        std::uniform_real_distribution<double> unit(0, 1);
+        if (_play == Play::Random) {
+            std::uniform_int_distribution<int> any(-32768, 32767);
+            msg.bodyX = any(_rng);
+            msg.bodyY = any(_rng);
+            msg.bodyW = any(_rng);
+            msg.dribbler = any(_rng);
+            msg.kickStrength = any(_rng);
+            msg.triggerMode = any(_rng) & 0x3;
+            return;
+        }
+
+        // about once a second, somewhere new to go.  Velocities are in
+        // mm/s and mrad/s, and change by at most 4 m/s^2.
+        std::normal_distribution<double> jitter(0, 2);
+        for (int i = 0; i < 3; i++) {
+            if (unit(_rng) < 1.0 / 60) {
+                robot->target[i] = (unit(_rng) * 2 - 1) * 3000;
+            }
+            const double maxStep = 4000.0 / 60;
+            const double step = std::max(
+                -maxStep, std::min(maxStep, robot->target[i] -
+                                                robot->velocity[i]));
+            robot->velocity[i] += step;
+        }
+        msg.bodyX = std::lround(robot->velocity[0] + jitter(_rng));
+        msg.bodyY = std::lround(robot->velocity[1] + jitter(_rng));
+        msg.bodyW = std::lround(robot->velocity[2] + jitter(_rng));
+
+        msg.triggerMode = 0;
+        if (unit(_rng) < 0.01) {
+            msg.kickStrength = unit(_rng) * 255;
+            msg.triggerMode = 1;
+        }
+        if (unit(_rng) < 0.005) msg.dribbler = msg.dribbler ? 0 : 100;
+    }
+
+    Play _play;
+    std::mt19937 _rng;
+    std::vector<State> _robots;
+};
+
+/// DW1000 airtime for a frame with @payload bytes at 6.8 Mbps with a
+/// 128 symbol preamble, counting the MAC header, our header, and the CRC
+double airtimeUs(size_t payload) {
+    const double preambleUs = (128 + 8) * 1.0256;
+    const double phrUs = 21 * 1.0256;
+    const double usPerByte = 8 / 6.8 * (1 + 48.0 / 330);  // Reed-Solomon
+    return preambleUs + phrUs + usPerByte * (9 + 3 + payload + 2);
+}
+
+struct LinkResult {
+    double fullBytes = 0;
+    double compactBytes = 0;
+    unsigned int decoded = 0;
+    unsigned int needKeyframe = 0;
+    unsigned int wrong = 0;
+    unsigned int received = 0;
+};
+
+/**
+ * Sends @frames frames of @stream from an encoder to a decoder on each robot,
+ * losing each forward packet and reply with the given chance, and checks
+ * every message a robot decodes against what was sent.
+ */
+LinkResult runLink(CommandStream* stream, size_t robots, int frames,
+                   double forwardLoss, double replyLoss,
+                   ControlEncoder* encoder, unsigned int seed = 38) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit(0, 1);
+    std::vector<ControlDecoder> decoders(robots);
+
+    LinkResult result;
+    for (int f = 0; f < frames; f++) {
+        const auto msgs = stream->next();
+        std::vector<uint8_t> payload;
+        EXPECT_TRUE(encoder->encode({0, 0, 0}, msgs.data(), msgs.size(),
+                                    &payload));
+        result.fullBytes += rtp::ForwardPayloadSize(msgs.size());
+        result.compactBytes += payload.size();
+
+        rtp::ForwardPayload forward;
+        EXPECT_TRUE(forward.parse(payload.data(), payload.size()));
+
+        for (size_t r = 0; r < robots; r++) {
+            if (unit(rng) < forwardLoss) continue;
+            result.received++;
+
+            rtp::ControlMessage msg;
+            int entry;
+            const auto decoded =
+                decoders[r].decode(forward, f, msgs[r].uid, &msg, &entry);
+            if (decoded == ControlDecoder::DECODED) {
+                result.decoded++;
+                if (memcmp(&msg, &msgs[r], sizeof(msg))) result.wrong++;
+            } else if (decoded == ControlDecoder::NEED_KEYFRAME) {
+                result.needKeyframe++;
+                continue;  // no reply
+            }
+
+            if (unit(rng) >= replyLoss) encoder->acked(msgs[r].uid);
+        }
+    }
+
+    result.fullBytes /= frames;
+    result.compactBytes /= frames;
+    return result;
+}
+}  // namespace
+
+TEST(ControlCodec, roundTripWithoutLoss) {
+    for (Play play : {Play::Idle, Play::Match, Play::Random}) {
+        CommandStream stream(play, 6, 38);
+        ControlEncoder encoder;
+        const LinkResult r = runLink(&stream, 6, 600, 0, 0, &encoder);
+        EXPECT_EQ(0u, r.wrong);
+        EXPECT_EQ(0u, r.needKeyframe);
+        EXPECT_EQ(r.received, r.decoded);
+    }
+}
+
+TEST(ControlCodec, recoversFromLoss) {
+    printf("  forward loss  reply loss  decoded  keyframes   compact\n");
+    for (double loss : {0.02, 0.1, 0.3}) {
+        CommandStream stream(Play::Match, 6, 38);
+        ControlEncoder encoder;
+        const LinkResult r = runLink(&stream, 6, 3000, loss, loss, &encoder);
+        const double keyframes =
+            double(encoder.keyframes) / (encoder.keyframes + encoder.deltas);
+        printf("  %11.0f%%  %9.0f%%  %6.1f%%  %8.1f%%  %6.1f B\n", loss * 100,
+               loss * 100, 100.0 * r.decoded / r.received, keyframes * 100,
+               r.compactBytes);
+
+        // a robot never acts on a message it got wrong
+        EXPECT_EQ(0u, r.wrong);
+
+        // and a robot that missed a packet didn't reply to it, so the next
+        // one it gets brings a keyframe and it never has to wait
+        EXPECT_EQ(0u, r.needKeyframe);
+        EXPECT_EQ(r.received, r.decoded);
+
+        // the keyframes cost more as the link gets worse
+        EXPECT_LT(r.compactBytes, r.fullBytes);
+    }
+}
+
+TEST(ControlCodec, keyframesForNewRobots) {
+    ControlEncoder encoder;
+    ControlDecoder decoder;
+
+    rtp::ControlMessage a;
+    memset(&a, 0, sizeof(a));
+    a.uid = 3;
+    a.bodyX = 100;
+    std::vector<uint8_t> payload;
+    ASSERT_TRUE(encoder.encode({}, &a, 1, &payload));
+
+    rtp::ForwardPayload forward;
+    ASSERT_TRUE(forward.parse(payload.data(), payload.size()));
+
+    // a keyframe is bigger than the whole message, so it goes out whole
+    EXPECT_FALSE(forward.compact());
+
+    rtp::ControlMessage out;
+    int entry;
+    ASSERT_EQ(ControlDecoder::DECODED,
+              decoder.decode(forward, 0, 3, &out, &entry));
+    EXPECT_EQ(0, entry);
+    EXPECT_EQ(100, out.bodyX);
+    encoder.acked(3);
+
+    // then it's just the change
+    a.bodyX = 90;
+    payload.clear();
+    ASSERT_TRUE(encoder.encode({}, &a, 1, &payload));
+    ASSERT_TRUE(forward.parse(payload.data(), payload.size()));
+    EXPECT_TRUE(forward.compact());
+    EXPECT_EQ(rtp::ForwardPayloadSize(0) + 3, payload.size());
+    ASSERT_EQ(ControlDecoder::DECODED,
+              decoder.decode(forward, 1, 3, &out, &entry));
+    EXPECT_EQ(90, out.bodyX);
+
+    // a robot that missed the last packet waits for a keyframe
+    ControlDecoder late;
+    EXPECT_EQ(ControlDecoder::NEED_KEYFRAME,
+              late.decode(forward, 1, 3, &out, &entry));
+    EXPECT_EQ(ControlDecoder::NOT_ADDRESSED,
+              late.decode(forward, 2, 4, &out, &entry));
+}
+
+TEST(ControlCodec, compression) {
+    printf(
+        "  stream   robots   whole      compact    airtime (whole / compact)"
+        "   encode   decode\n");
+    for (Play play : {Play::Idle, Play::Match, Play::Random}) {
+        for (size_t robots : {6, 10}) {
+            CommandStream stream(play, robots, 38);
+            ControlEncoder encoder;
+
+            const auto start = std::chrono::steady_clock::now();
+            const LinkResult r =
+                runLink(&stream, robots, 6000, 0.02, 0.02, &encoder);
+            const double us = std::chrono::duration<double, std::micro>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count() /
+                              6000;
+
+            static const char* names[] = {"idle", "match", "random"};
+            printf(
+                "  %-6s   %6zu   %5.1f B   %5.1f B   %6.1f us / %6.1f us   "
+                "%6.2f us per frame, both ends\n",
+                names[int(play)], robots, r.fullBytes, r.compactBytes,
+                airtimeUs(r.fullBytes), airtimeUs(r.compactBytes), us);
+
+            EXPECT_EQ(0u, r.wrong);
+
+            // never worse than whole messages
+            EXPECT_LE(r.compactBytes, r.fullBytes);
+            if (play == Play::Match) {
+                EXPECT_LT(r.compactBytes, r.fullBytes * 0.6);
+            }
+            if (play == Play::Idle) {
+                EXPECT_LT(r.compactBytes, r.fullBytes * 0.4);
+            }
+        }
+    }
+}
+
+TEST(ControlCodec, fuzzDecoder) {
+    // the decoder only sees compact entries that parse, but their contents
+    // can be anything
+    std::mt19937 rng(38);
+    std::uniform_int_distribution<int> byte(0, 255);
+    ControlDecoder decoder;
+    unsigned int decoded = 0;
+    for (int i = 0; i < 100000; i++) {
+        std::vector<uint8_t> data(rtp::ForwardPayloadSize(0));
+        const size_t count = 1 + byte(rng) % rtp::MAX_FORWARD_ENTRIES;
+        data[sizeof(rtp::ChannelSchedule)] = count | rtp::COMPACT_ENTRIES;
+        for (size_t e = 0; e < count; e++) {
+            uint8_t flags = byte(rng);
+            // no field code 3
+            for (int f = 0; f < 3; f++) {
+                if (((flags >> (2 * f)) & 3) == 3) flags &= ~(1 << (2 * f));
+            }
+            data.push_back(byte(rng) % 4);
+            data.push_back(flags);
+            for (size_t b = 2; b < rtp::CompactEntrySize(flags); b++) {
+                data.push_back(byte(rng));
+            }
+        }
+
+        rtp::ForwardPayload forward;
+        ASSERT_TRUE(forward.parse(data.data(), data.size()));
+
+        rtp::ControlMessage msg;
+        int entry;
+        if (decoder.decode(forward, i, 1, &msg, &entry) ==
+            ControlDecoder::DECODED) {
+            decoded++;
+            EXPECT_EQ(1, msg.uid);
+        }
+
+        // and cutting any of them short makes the packet invalid
+        data.pop_back();
+        EXPECT_FALSE(forward.parse(data.data(), data.size()));
+    }
+    EXPECT_GT(decoded, 0u);
+}
@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "../utils/crash-log/CrashRecord.hpp"
+
+using namespace crash;
+
+namespace {
+// RAM-backed stand-in for the flash sector used by IapCrashStorage
+class FakeStorage {
+public:
+    static const size_t SLOT_SIZE = 512;
+
+    explicit FakeStorage(size_t slots) : mem(slots * SLOT_SIZE, 0xFF) {}
+
+    size_t numSlots() const { return mem.size() / SLOT_SIZE; }
+    const uint8_t* slot(size_t i) const { return &mem[i * SLOT_SIZE]; }
+
+    bool program(size_t i, const uint8_t* data) {
+        // like flash, programming can only clear bits
+        for (size_t j = 0; j < SLOT_SIZE; j++)
+            mem[i * SLOT_SIZE + j] &= data[j];
+        return true;
+    }
+
+    bool erase() {
+        std::fill(mem.begin(), mem.end(), 0xFF);
+        eraseCount++;
+        return true;
+    }
+
+    std::vector<uint8_t> mem;
+    int eraseCount = 0;
+};
+
+Record makeFault() {
+    Record rec;
+    rec.reason = RESET_HARD_FAULT;
+    rec.uptimeMs = 123456;
+    rec.threadId = 3;
+    rec.regs.pc = 0x00001234;
+    rec.regs.lr = 0xFFFFFFF9;
+    rec.regs.cfsr = 0x00008200;
+    rec.regs.bfar = 0xDEADBEEF;
+    rec.numStackWords = 5;
+    for (size_t i = 0; i < rec.numStackWords; i++) rec.stack[i] = 0x1000 + i;
+    rec.numLogLines = 2;
+    strcpy(rec.logLines[0], "INFO main.cpp:42 hello");
+    strcpy(rec.logLines[1], "SEVERE fpga.cpp:10 oops");
+    return rec;
+}
+}  // namespace
+
+TEST(CrashRecord, roundTrip) {
+    Record in = makeFault();
+    in.seq = 7;
+    uint8_t buf[MAX_ENCODED_SIZE];
+
+    size_t len = encode(in, buf, sizeof(buf));
+    ASSERT_GT(len, 0u);
+
+    Record out;
+    ASSERT_TRUE(decode(buf, len, &out));
+    EXPECT_EQ(7u, out.seq);
+    EXPECT_EQ(RESET_HARD_FAULT, out.reason);
+    EXPECT_EQ(123456u, out.uptimeMs);
+    EXPECT_EQ(3, out.threadId);
+    EXPECT_EQ(0x00001234u, out.regs.pc);
+    EXPECT_EQ(0xFFFFFFF9u, out.regs.lr);
+    EXPECT_EQ(0x00008200u, out.regs.cfsr);
+    EXPECT_EQ(0xDEADBEEFu, out.regs.bfar);
+    ASSERT_EQ(5, out.numStackWords);
+    EXPECT_EQ(0x1004u, out.stack[4]);
+    ASSERT_EQ(2, out.numLogLines);
+    EXPECT_STREQ("INFO main.cpp:42 hello", out.logLines[0]);
+    EXPECT_STREQ("SEVERE fpga.cpp:10 oops", out.logLines[1]);
+}
+
+TEST(CrashRecord, rejectsCorruption) {
+    uint8_t buf[MAX_ENCODED_SIZE];
+    size_t len = encode(makeFault(), buf, sizeof(buf));
+    Record out;
+
+    buf[HEADER_SIZE + 20] ^= 0x01;
+    EXPECT_FALSE(decode(buf, len, &out));
+}
+
+TEST(CrashRecord, rejectsTruncated) {
+    uint8_t buf[MAX_ENCODED_SIZE];
+    size_t len = encode(makeFault(), buf, sizeof(buf));
+    Record out;
+
+    EXPECT_FALSE(decode(buf, len - 1, &out));
+    EXPECT_EQ(0u, encode(makeFault(), buf, len - 1));
+}
+
+TEST(CrashRecord, rejectsErased) {
+    uint8_t buf[MAX_ENCODED_SIZE];
+    memset(buf, 0xFF, sizeof(buf));
+    Record out;
+    EXPECT_FALSE(decode(buf, sizeof(buf), &out));
+}
+
+TEST(CrashRing, appendAssignsSequence) {
+    FakeStorage storage(4);
+    CrashRing<FakeStorage> ring(storage);
+
+    EXPECT_EQ(0u, ring.count());
+    ASSERT_TRUE(ring.append(makeFault()));
+    Record wd;
+    wd.reason = RESET_WATCHDOG;
+    ASSERT_TRUE(ring.append(wd));
+    EXPECT_EQ(2u, ring.count());
+
+    std::vector<Record> recs;
+    ring.forEach([&recs](const Record& r) { recs.push_back(r); });
+    ASSERT_EQ(2u, recs.size());
+    EXPECT_EQ(1u, recs[0].seq);
+    EXPECT_EQ(RESET_HARD_FAULT, recs[0].reason);
+    EXPECT_EQ(2u, recs[1].seq);
+    EXPECT_EQ(RESET_WATCHDOG, recs[1].reason);
+}
+
+TEST(CrashRing, wrapsWhenFull) {
+    FakeStorage storage(3);
+    CrashRing<FakeStorage> ring(storage);
+
+    for (int i = 0; i < 3; i++) ASSERT_TRUE(ring.append(makeFault()));
+    EXPECT_EQ(3u, ring.count());
+    EXPECT_EQ(0, storage.eraseCount);
+
+    // the sector is full, so it's erased and the new record starts over in
+    // the first slot, keeping its place in the sequence
+    ASSERT_TRUE(ring.append(makeFault()));
+    EXPECT_EQ(1, storage.eraseCount);
+    EXPECT_EQ(1u, ring.count());
+
+    Record out;
+    ASSERT_TRUE(ring.read(0, &out));
+    EXPECT_EQ(4u, out.seq);
+}
+
+TEST(CrashRing, clear) {
+    FakeStorage storage(4);
+    CrashRing<FakeStorage> ring(storage);
+
+    ring.append(makeFault());
+    ring.append(makeFault());
+    ASSERT_TRUE(ring.clear());
+    EXPECT_EQ(0u, ring.count());
+
+    ring.append(makeFault());
+    Record out;
+    ASSERT_TRUE(ring.read(0, &out));
+    EXPECT_EQ(1u, out.seq);
+}
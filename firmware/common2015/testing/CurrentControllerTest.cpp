@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "../utils/current-controller.hpp"
+
+namespace {
+const float DT = 0.005;  // the control loop's period, in s
+
+/**
+ * A drive motor on a dynamometer: it turns at whatever speed it's held at, and
+ * draws current from what's left of the supply after back EMF, through the
+ * winding's resistance.  The FPGA's view of the current is the magnitude,
+ * through a first-order filter with a 4 ms time constant, 8 bits at 0.08 A per
+ * count, and it's read once per tick.
+ */
+struct Dyno {
+    // what the controller assumes: 15 A at full duty from 18 V
+    double supply = 18;
+    double resistance = 1.2;
+    const double nominalSupply = 18;
+
+    double speed = 0;  // as the duty cycle that balances back EMF
+    double filtered = 0;
+
+    double current(double duty) const {
+        const double volts = duty / 511 * supply;
+        const double backEmf = speed / 511 * nominalSupply;
+        return (volts - backEmf) / resistance;
+    }
+
+    /// Drives at @duty for a tick and returns what the FPGA reports, in A
+    float drive(double duty) {
+        const double physicsDt = 1e-5;
+        for (double t = 0; t < DT; t += physicsDt) {
+            filtered += (std::abs(current(duty)) - filtered) * physicsDt / 4e-3;
+        }
+        return std::min(255.0, std::floor(filtered / 0.08)) * 0.08;
+    }
+};
+
+struct Hold {
+    float current = 0;  // A, at the end
+    float peak = 0;
+    float overshoot = 0;  // past the final value
+};
+
+/// Asks for @duty on the dyno for @ticks, through the current loop or not
+Hold hold(Dyno dyno, float duty, int ticks, bool looped) {
+    CurrentController controller;
+    Hold result;
+    float measured = 0;
+    for (int i = 0; i < ticks; i++) {
+        const float out =
+            looped ? controller.run(0, duty, dyno.speed, measured, DT) : duty;
+        measured = dyno.drive(out);
+        result.current = dyno.current(out);
+        result.peak = std::max(result.peak, std::abs(result.current));
+    }
+    result.overshoot = result.peak - std::abs(result.current);
+    return result;
+}
+}  // namespace
+
+TEST(CurrentController, passesThroughWhenModelIsRight) {
+    // asking for 4 A at standstill gets 4 A either way
+    const float duty = 4 / 15.0f * 511;
+    const Hold open = hold(Dyno(), duty, 200, false);
+    const Hold looped = hold(Dyno(), duty, 200, true);
+    EXPECT_NEAR(4, open.current, 0.05);
+    EXPECT_NEAR(4, looped.current, 0.1);
+    EXPECT_LT(looped.overshoot, 0.4);
+}
+
+TEST(CurrentController, correctsForHeatAndSag) {
+    printf("  motor               asked   open loop   current loop\n");
+    struct Case {
+        const char* name;
+        double supply;
+        double resistance;
+        double speed;
+    };
+    const Case cases[] = {
+        {"nominal", 18, 1.2, 200},
+        {"hot windings", 18, 1.2 * 1.4, 200},
+        {"sagging battery", 15, 1.2, 200},
+        {"both, at standstill", 15, 1.2 * 1.4, 0},
+    };
+    for (const Case& c : cases) {
+        Dyno dyno;
+        dyno.supply = c.supply;
+        dyno.resistance = c.resistance;
+        dyno.speed = c.speed;
+
+        // 5 A of torque on top of the back EMF
+        const float asked = 5;
+        const float duty = c.speed + asked / 15 * 511;
+        const Hold open = hold(dyno, duty, 400, false);
+        const Hold looped = hold(dyno, duty, 400, true);
+        printf("  %-19s  %4.1f A   %7.2f A   %10.2f A\n", c.name, asked,
+               open.current, looped.current);
+
+        EXPECT_NEAR(asked, looped.current, asked * 0.05) << c.name;
+        EXPECT_LE(std::abs(looped.current - asked),
+                  std::abs(open.current - asked) + 0.05)
+            << c.name;
+    }
+}
+
+TEST(CurrentController, limitsCurrent) {
+    // full duty into a stalled motor
+    Dyno dyno;
+    const Hold open = hold(dyno, 511, 400, false);
+    const Hold looped = hold(dyno, 511, 400, true);
+    printf("  stalled at full duty: %.1f A open loop, %.1f A limited\n",
+           open.current, looped.current);
+
+    const float limit = CurrentController().params().limit;
+    EXPECT_NEAR(15, open.current, 0.1);
+    EXPECT_NEAR(limit, looped.current, limit * 0.05);
+    EXPECT_LT(looped.peak, limit * 1.1);
+
+    // and reversing at speed brakes at the limit too, rather than with the
+    // full supply behind the back EMF
+    dyno.speed = 400;
+    const Hold reversing = hold(dyno, -511, 400, true);
+    EXPECT_NEAR(-limit, reversing.current, limit * 0.05);
+    EXPECT_LT(reversing.peak, limit * 1.1);
+}
+
+TEST(CurrentController, settlesWithoutRinging) {
+    // a hot motor, so the loop has something to do, stepping between loads
+    Dyno dyno;
+    dyno.resistance = 1.2 * 1.4;
+    CurrentController controller;
+    float measured = 0;
+    for (int step = 0; step < 4; step++) {
+        const float asked = step % 2 ? 2 : 6;
+        const float duty = asked / 15 * 511;
+
+        // count the times the error crosses over, ignoring small wobbles
+        int crossings = 0;
+        int lastSign = 0;
+        float current = 0;
+        for (int i = 0; i < 200; i++) {
+            const float out = controller.run(0, duty, 0, measured, DT);
+            measured = dyno.drive(out);
+            current = dyno.current(out);
+
+            const float err = asked - current;
+            const int sign = err > 0.1f ? 1 : err < -0.1f ? -1 : 0;
+            if (sign != 0 && lastSign != 0 && sign != lastSign) crossings++;
+            if (sign != 0) lastSign = sign;
+        }
+        EXPECT_NEAR(asked, current, asked * 0.05) << step;
+        EXPECT_LE(crossings, 1) << step;
+    }
+}
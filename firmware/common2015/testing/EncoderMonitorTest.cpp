@@ -0,0 +1,261 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "../utils/encoder-monitor.hpp"
+
+namespace {
+const float DT = 0.005;  // the control loop's period, in s
+
+// 2048 encoder ticks and 24 hall counts (4 pole pairs) per turn
+const float ENC_PER_HALL = 2048 / 24.0f;
+
+/// What the FPGA hands the control loop for one wheel, every tick
+struct Sample {
+    int16_t enc;
+    int8_t halls;
+};
+
+/**
+ * Records the deltas a wheel turning at @speed (rad/s) produces, counting
+ * whole encoder ticks and hall counts like the FPGA does.  The hall sensors
+ * switch at slightly uneven angles, and the encoder can be mangled on the
+ * way by @fault.
+ */
+std::vector<Sample> record(float seconds, std::function<float(float t)> speed,
+                           std::function<int16_t(float t, int16_t enc)> fault =
+                               [](float, int16_t enc) { return enc; }) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> jitter(-0.15, 0.15);
+    float offsets[6];
+    for (float& o : offsets) o = jitter(rng);
+
+    std::vector<Sample> trace;
+    double angle = 0;  // rad
+    int32_t lastEnc = 0, lastHall = 0;
+    for (float t = 0; t < seconds; t += DT) {
+        angle += speed(t) * DT;
+        const double turns = angle / (2 * M_PI);
+
+        const int32_t enc = std::floor(turns * 2048);
+        const double hallPos = turns * 24;
+        const int32_t step = std::floor(hallPos);
+        const int32_t hall =
+            std::floor(hallPos - offsets[((step % 6) + 6) % 6]);
+
+        trace.push_back({fault(t, enc - lastEnc),
+                         static_cast<int8_t>(hall - lastHall)});
+        lastEnc = enc;
+        lastHall = hall;
+    }
+    return trace;
+}
+
+struct Replay {
+    float firstFault = -1;  // s
+    float faultedTime = 0;
+    float recovered = -1;
+};
+
+/// Runs a trace through the monitor on wheel 0
+Replay replay(const std::vector<Sample>& trace, EncoderMonitor* monitor) {
+    Replay result;
+    for (size_t i = 0; i < trace.size(); i++) {
+        const int16_t enc[4] = {trace[i].enc};
+        const int8_t halls[4] = {trace[i].halls};
+        monitor->update(enc, halls);
+
+        const float t = i * DT;
+        if (monitor->faulted(0)) {
+            if (result.firstFault < 0) result.firstFault = t;
+            result.faultedTime += DT;
+        } else if (result.firstFault >= 0 && result.recovered < 0) {
+            result.recovered = t;
+        }
+    }
+    return result;
+}
+
+/// Speeding up, cruising, reversing, creeping, and stopping
+float driving(float t) {
+    if (t < 0.5) return 80 * t;
+    if (t < 2) return 40;
+    if (t < 2.5) return 40 - 160 * (t - 2);
+    if (t < 4) return -40;
+    if (t < 6) return 1.5;
+    return 0;
+}
+}  // namespace
+
+TEST(EncoderMonitor, goodTracesPass) {
+    const std::vector<std::pair<const char*, std::function<float(float)>>>
+        traces = {
+            {"driving", driving},
+            {"full speed", [](float) { return 57.0f; }},
+            {"creeping", [](float) { return 0.5f; }},
+            {"wiggling",
+             [](float t) { return 30 * std::sin(2 * float(M_PI) * 4 * t); }},
+        };
+    for (const auto& trace : traces) {
+        EncoderMonitor monitor(ENC_PER_HALL);
+        const Replay run = replay(record(8, trace.second), &monitor);
+        EXPECT_LT(run.firstFault, 0) << trace.first;
+        EXPECT_EQ(0u, monitor.faults) << trace.first;
+    }
+
+    // an encoder that misses some ticks now and then isn't worth flagging
+    EncoderMonitor monitor(ENC_PER_HALL);
+    const Replay glitchy =
+        replay(record(8, driving,
+                      [](float t, int16_t enc) {
+                          return std::fmod(t, 0.5f) < 0.01f ? int16_t(0)
+                                                            : enc;
+                      }),
+               &monitor);
+    EXPECT_LT(glitchy.firstFault, 0);
+}
+
+TEST(EncoderMonitor, faultedTracesAreFlagged) {
+    const float FAILS_AT = 1;
+    const std::vector<
+        std::pair<const char*, std::function<int16_t(float, int16_t)>>>
+        faults = {
+            {"unplugged",
+             [=](float t, int16_t enc) {
+                 return t < FAILS_AT ? enc : int16_t(0);
+             }},
+            {"reversed",
+             [=](float t, int16_t enc) {
+                 return t < FAILS_AT ? enc : int16_t(-enc);
+             }},
+            {"half the ticks",
+             [=](float t, int16_t enc) {
+                 return t < FAILS_AT ? enc : int16_t(enc / 2);
+             }},
+            {"noise",
+             [=](float t, int16_t enc) {
+                 return t < FAILS_AT ? enc
+                                     : int16_t(int(t * 7919) % 200 - 100);
+             }},
+        };
+
+    printf("  fault             flagged after   flagged for\n");
+    for (const auto& fault : faults) {
+        EncoderMonitor monitor(ENC_PER_HALL);
+        const Replay run =
+            replay(record(2, [](float) { return 40.0f; }, fault.second),
+                   &monitor);
+        printf("  %-16s  %9.0f ms   %8.0f ms\n", fault.first,
+               (run.firstFault - FAILS_AT) * 1000, run.faultedTime * 1000);
+
+        // within a window plus the hysteresis, and for good
+        const float latest = (EncoderMonitor::WINDOW +
+                              EncoderMonitor::FAULT_THRESHOLD /
+                                  EncoderMonitor::COUNT_BAD) *
+                             DT;
+        ASSERT_GE(run.firstFault, FAILS_AT) << fault.first;
+        EXPECT_LE(run.firstFault - FAILS_AT, latest + DT) << fault.first;
+        EXPECT_LT(run.recovered, 0) << fault.first;
+        EXPECT_EQ(1, monitor.faultMask()) << fault.first;
+    }
+
+    // an encoder that doesn't turn with a motor that isn't turning is fine
+    EncoderMonitor monitor(ENC_PER_HALL);
+    replay(record(2, [](float) { return 0.0f; },
+                  [](float, int16_t) { return int16_t(0); }),
+           &monitor);
+    EXPECT_EQ(0, monitor.faultMask());
+}
+
+TEST(EncoderMonitor, recoversWhenPluggedBackIn) {
+    EncoderMonitor monitor(ENC_PER_HALL);
+    const Replay run = replay(
+        record(6, [](float) { return 40.0f; },
+               [](float t, int16_t enc) {
+                   return t > 1 && t < 2 ? int16_t(0) : enc;
+               }),
+        &monitor);
+    ASSERT_GT(run.firstFault, 1);
+    ASSERT_GT(run.recovered, 2);
+
+    // after a full count down of good ticks
+    const float expected = 2 + EncoderMonitor::FAULT_THRESHOLD *
+                                   EncoderMonitor::COUNT_GOOD * DT;
+    EXPECT_NEAR(expected, run.recovered, EncoderMonitor::WINDOW * DT);
+    EXPECT_EQ(1u, monitor.faults);
+    EXPECT_EQ(0, monitor.counter(0));
+}
+
+TEST(EncoderMonitor, tracksEachWheel) {
+    EncoderMonitor monitor(ENC_PER_HALL);
+    const auto good = record(2, [](float) { return 40.0f; });
+    const auto bad =
+        record(2, [](float) { return 40.0f; },
+               [](float, int16_t enc) { return int16_t(-enc); });
+    for (size_t i = 0; i < good.size(); i++) {
+        const int16_t enc[4] = {good[i].enc, bad[i].enc, good[i].enc,
+                                bad[i].enc};
+        const int8_t halls[4] = {good[i].halls, bad[i].halls, good[i].halls,
+                                 bad[i].halls};
+        monitor.update(enc, halls);
+    }
+    EXPECT_EQ(0b1010, monitor.faultMask());
+    EXPECT_EQ(2u, monitor.faults);
+}
+
+TEST(EncoderMonitor, fallsBackToHalls) {
+    /*
+     * One wheel on the same feedforward + PI that the control loop runs, with
+     * a first-order motor, holding 20 rad/s when its encoder comes unplugged
+     * at 1 s.  Without the monitor, the PI sees the wheel stopped for good,
+     * pins its integrator, and pushes the wheel past its target.
+     */
+    const float target = 20;
+    printf("               speed   measured   integrator\n");
+    for (bool monitored : {false, true}) {
+        EncoderMonitor monitor(ENC_PER_HALL);
+        float speed = 0, integral = 0, duty = 0, measured = 0;
+        double angle = 0;
+        int32_t lastEnc = 0, lastHall = 0;
+        for (float t = 0; t < 3; t += DT) {
+            speed += (duty / 9 - speed) * DT / 0.05f;
+            angle += speed * DT;
+            const int32_t enc = std::floor(angle / (2 * M_PI) * 2048);
+            const int32_t hall = std::floor(angle / (2 * M_PI) * 24);
+
+            int16_t encs[4] = {int16_t(t < 1 ? enc - lastEnc : 0)};
+            const int8_t halls[4] = {int8_t(hall - lastHall)};
+            lastEnc = enc;
+            lastHall = hall;
+
+            monitor.update(encs, halls);
+            if (monitored && monitor.faulted(0)) {
+                encs[0] = monitor.hallEstimate(0);
+            }
+
+            measured = encs[0] * 2 * M_PI / 2048 / DT;
+            const float err = target - measured;
+            integral = std::max(-5.0f, std::min(5.0f, integral + err * DT));
+            duty = target * 9 + 0.8f * err + 0.05f * integral;
+            duty = std::max(-511.0f, std::min(511.0f, duty));
+        }
+        printf("  %-11s  %5.1f   %8.1f   %10.1f\n",
+               monitored ? "monitored" : "unmonitored", speed, measured,
+               integral);
+
+        if (monitored) {
+            EXPECT_NEAR(target, speed, 1);
+            EXPECT_NEAR(speed, measured, target * 0.1);
+            EXPECT_LT(std::abs(integral), 5);
+        } else {
+            EXPECT_GT(speed, target * 1.05);
+            EXPECT_EQ(0, measured);
+            EXPECT_EQ(5, integral);
+        }
+    }
+}
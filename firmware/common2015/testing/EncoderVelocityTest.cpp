@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+
+#include "../utils/encoder-velocity.hpp"
+
+namespace {
+const float DT = 0.005;                   // the control loop's period, in s
+const float AGE_TICK = 16 / 18.432e6;     // the FPGA's edge timer, in s
+const double PHASES[4] = {0, 0.22, 0.5, 0.78};  // a lopsided quadrature
+
+/**
+ * An encoder on a wheel, and the FPGA counting its edges and timing the last
+ * one.  Position is in encoder ticks, and the edges within each turn of the
+ * quadrature cycle aren't evenly spaced, like on a real codewheel.
+ */
+struct Wheel {
+    double position = 0;
+    double lastEdge = -1;  // s, or never
+    double time = 0;
+
+    /// The number of edges at or before @pos
+    static long edges(double pos) {
+        const long cycle = std::floor(pos / 4);
+        const double within = pos - cycle * 4;
+        long n = cycle * 4;
+        for (double phase : PHASES) {
+            if (within >= phase * 4) n++;
+        }
+        return n;
+    }
+
+    struct Reading {
+        int16_t ticks;
+        uint16_t age;
+    };
+
+    /// Turns at @speed ticks/s for @dt, and returns what the FPGA latches
+    Reading run(double speed, double dt) {
+        const int steps = std::lround(dt / 1e-6);
+        const double step = dt / steps;
+        int16_t count = 0;
+        for (int i = 1; i <= steps; i++) {
+            const long before = edges(position);
+            position += speed * step;
+            const long after = edges(position);
+            if (after != before) {
+                count += after - before;
+                lastEdge = time + i * step;
+            }
+        }
+        time += dt;
+
+        const double sinceEdge = lastEdge < 0 ? 1 : time - lastEdge;
+        const uint16_t age = std::min<double>(
+            EncoderVelocity::AGE_MAX, std::floor(sinceEdge / AGE_TICK));
+        return {count, age};
+    }
+};
+
+struct Errors {
+    double counted = 0;
+    double estimated = 0;
+};
+
+/// RMS errors of counting and of the estimator at @speed ticks/s
+Errors track(double speed) {
+    Wheel wheel;
+    EncoderVelocity estimator(AGE_TICK);
+    double counted = 0;
+    double estimated = 0;
+    int n = 0;
+    for (int i = 0; i < 200; i++) {
+        // the loop's period wanders a bit
+        const float dt = DT * (1 + 0.1 * std::sin(i * 0.7));
+        const Wheel::Reading r = wheel.run(speed, dt);
+        const float v = estimator.update(0, r.ticks, r.age, dt);
+        if (i >= 20) {
+            counted += std::pow(r.ticks / dt - speed, 2);
+            estimated += std::pow(v - speed, 2);
+            n++;
+        }
+    }
+    return {std::sqrt(counted / n), std::sqrt(estimated / n)};
+}
+}  // namespace
+
+TEST(EncoderVelocity, beatsCountingAtLowSpeed) {
+    printf("  speed (ticks/s)   counted RMS   estimated RMS\n");
+    for (double speed : {30.0, 120.0, 350.0, 900.0, -250.0}) {
+        const Errors errors = track(speed);
+        printf("  %15.0f   %11.1f   %13.1f\n", speed, errors.counted,
+               errors.estimated);
+
+        // within the quadrature's lopsidedness, which a few edges average out
+        EXPECT_LT(errors.estimated, std::abs(speed) * 0.25) << speed;
+        EXPECT_LT(errors.estimated, errors.counted * 0.5) << speed;
+    }
+}
+
+TEST(EncoderVelocity, countsAtHighSpeed) {
+    // past the hybrid switch it's exactly the count
+    Wheel wheel;
+    EncoderVelocity estimator(AGE_TICK);
+    for (int i = 0; i < 20; i++) {
+        const Wheel::Reading r = wheel.run(20000, DT);
+        ASSERT_GE(r.ticks, int(EncoderVelocity::HYBRID_TICKS));
+        EXPECT_FLOAT_EQ(r.ticks / DT, estimator.update(0, r.ticks, r.age, DT));
+    }
+
+    const Errors errors = track(20000);
+    EXPECT_LT(errors.estimated, 20000 * 0.02);
+}
+
+TEST(EncoderVelocity, decaysWhenStopped) {
+    Wheel wheel;
+    EncoderVelocity estimator(AGE_TICK);
+    for (int i = 0; i < 50; i++) {
+        const Wheel::Reading r = wheel.run(200, DT);
+        estimator.update(0, r.ticks, r.age, DT);
+    }
+    EXPECT_NEAR(200, estimator.velocity(0), 40);
+
+    // it can't be going faster than the next edge, and it drops off
+    // monotonically rather than all at once
+    float last = estimator.velocity(0);
+    for (int i = 0; i < 20; i++) {
+        const Wheel::Reading r = wheel.run(0, DT);
+        const float v = estimator.update(0, r.ticks, r.age, DT);
+        EXPECT_LE(v, last);
+        EXPECT_GE(v, 0);
+        last = v;
+    }
+    EXPECT_LT(last, 20);
+
+    // and it's zero once the timer saturates
+    EXPECT_EQ(0, estimator.update(0, 0, EncoderVelocity::AGE_MAX, DT));
+}
+
+TEST(EncoderVelocity, followsReversal) {
+    Wheel wheel;
+    EncoderVelocity estimator(AGE_TICK);
+    for (int i = 0; i < 50; i++) {
+        const Wheel::Reading r = wheel.run(300, DT);
+        estimator.update(0, r.ticks, r.age, DT);
+    }
+    EXPECT_GT(estimator.velocity(0), 0);
+    for (int i = 0; i < 50; i++) {
+        const Wheel::Reading r = wheel.run(-300, DT);
+        estimator.update(0, r.ticks, r.age, DT);
+    }
+    EXPECT_NEAR(-300, estimator.velocity(0), 60);
+
+    // and the wheels are kept apart
+    EXPECT_EQ(0, estimator.velocity(1));
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+/**
+ * A host-side stand-in for an I2C bus and the devices on it.  It implements
+ * the same master interface as I2CMasterRtos, and keeps track of how long each
+ * transfer would take on the wire so that tests can measure bus occupancy.
+ */
+namespace fake_i2c {
+
+/**
+ * A device with a bank of 8-bit registers and an auto-incrementing register
+ * pointer, which is how both the MPU-6050 and the MCP23017 (with IOCON.BANK =
+ * 0) behave.  The first byte of a write sets the pointer, the rest are written
+ * starting there.  Reads start at the pointer.
+ */
+class RegisterDevice {
+public:
+    virtual ~RegisterDevice() = default;
+
+    uint8_t regs[256] = {};
+    uint8_t pointer = 0;
+
+    /// Number of bytes written or read, not counting the register pointer
+    unsigned int bytesWritten = 0;
+    unsigned int bytesRead = 0;
+
+    virtual void write(const uint8_t* data, int len) {
+        if (len <= 0) return;
+        pointer = data[0];
+        for (int i = 1; i < len; i++) {
+            regs[pointer++] = data[i];
+            bytesWritten++;
+        }
+    }
+
+    virtual void read(uint8_t* data, int len) {
+        for (int i = 0; i < len; i++) {
+            data[i] = regs[pointer++];
+            bytesRead++;
+        }
+    }
+};
+
+class Bus {
+public:
+    explicit Bus(int hz = 400000) : _bitUs(1e6 / hz) {}
+
+    void attach(uint8_t address, RegisterDevice* dev) {
+        _devices[address & ~1] = dev;
+    }
+
+    int write(int address, const char* data, int length, bool repeated) {
+        RegisterDevice* dev = begin(address);
+        if (!dev) return 1;
+
+        dev->write(reinterpret_cast<const uint8_t*>(data), length);
+        end(length, repeated);
+        return 0;
+    }
+
+    int read(int address, char* data, int length, bool repeated) {
+        RegisterDevice* dev = begin(address);
+        if (!dev) return 1;
+
+        dev->read(reinterpret_cast<uint8_t*>(data), length);
+        end(length, repeated);
+        return 0;
+    }
+
+    bool stop() {
+        if (_held) {
+            _held = false;
+            busy(STOP_BITS);
+            stops++;
+        }
+        return true;
+    }
+
+    /// Let time pass with nothing on the bus
+    void idleUntil(double us) {
+        if (us > nowUs) nowUs = us;
+    }
+
+    /// Current time, in microseconds
+    double nowUs = 0;
+
+    /// Time spent with the bus busy, in microseconds
+    double busyUs = 0;
+
+    /// Number of start, repeated start, and stop conditions
+    unsigned int starts = 0;
+    unsigned int repeatedStarts = 0;
+    unsigned int stops = 0;
+
+    /// Slave addresses in the order they were addressed
+    std::vector<uint8_t> addressed;
+
+    bool held() const { return _held; }
+
+private:
+    // a start or stop condition takes about as long as a bit
+    static constexpr double START_BITS = 1;
+    static constexpr double STOP_BITS = 1;
+    // 8 data bits and an ACK
+    static constexpr double BYTE_BITS = 9;
+
+    RegisterDevice* begin(int address) {
+        if (_held) {
+            repeatedStarts++;
+        } else {
+            starts++;
+        }
+        busy(START_BITS + BYTE_BITS);
+        addressed.push_back(address & ~1);
+
+        auto it = _devices.find(address & ~1);
+        if (it == _devices.end()) {
+            // NACKed, the master sends a stop
+            _held = true;
+            stop();
+            return nullptr;
+        }
+        return it->second;
+    }
+
+    void end(int length, bool repeated) {
+        busy(BYTE_BITS * length);
+        _held = true;
+        if (!repeated) stop();
+    }
+
+    void busy(double bits) {
+        nowUs += bits * _bitUs;
+        busyUs += bits * _bitUs;
+    }
+
+    double _bitUs;
+    bool _held = false;
+    std::map<uint8_t, RegisterDevice*> _devices;
+};
+
+}  // namespace fake_i2c
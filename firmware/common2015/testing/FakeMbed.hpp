@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+
 /**
  * This file provides some helper classes for emulating an mbed's hardware.  It
  * is useful for unit-testing code on a computer when an mbed is not available
@@ -11,9 +13,45 @@ class DigitalIn {
 public:
     DigitalIn(int value) : _value(value) {}
 
+    int read() const {
+        numReads++;
+        return _value;
+    }
+    operator int() { return read(); }
+
+    /// Change the value seen on the pin
+    void set(int value) { _value = value; }
+
+    /// Number of times the pin has been read
+    mutable unsigned int numReads = 0;
+
+private:
+    int _value;
+};
+
+class DigitalOut {
+public:
+    DigitalOut(int value = 0) : _value(value) {}
+
+    void write(int value) {
+        _value = value;
+        numWrites++;
+        if (onWrite) onWrite(value);
+    }
     int read() const { return _value; }
+
+    DigitalOut& operator=(int value) {
+        write(value);
+        return *this;
+    }
     operator int() { return read(); }
 
+    /// Called with the new value each time the pin is written
+    std::function<void(int)> onWrite;
+
+    /// Number of times the pin has been written
+    unsigned int numWrites = 0;
+
 private:
     int _value;
 };
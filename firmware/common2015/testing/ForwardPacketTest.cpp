@@ -0,0 +1,305 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "../utils/forward-packet.hpp"
+
+using namespace rtp;
+
+namespace {
+/// Control messages for @count robots with shuffled uids
+std::vector<ControlMessage> randomEntries(size_t count, std::mt19937* rng) {
+    std::vector<uint8_t> uids(16);
+    for (size_t i = 0; i < uids.size(); i++) uids[i] = i;
+    std::shuffle(uids.begin(), uids.end(), *rng);
+
+    std::uniform_int_distribution<int> value(-30000, 30000);
+    std::vector<ControlMessage> entries(count);
+    for (size_t i = 0; i < count; i++) {
+        ControlMessage& msg = entries[i];
+        memset(&msg, 0, sizeof(msg));
+        msg.uid = uids[i];
+        msg.bodyX = value(*rng);
+        msg.bodyY = value(*rng);
+        msg.bodyW = value(*rng);
+        msg.kickStrength = i;
+    }
+    return entries;
+}
+
+std::vector<uint8_t> buildPayload(const std::vector<ControlMessage>& entries) {
+    std::vector<uint8_t> payload;
+    EXPECT_TRUE(ForwardPayload::build({1, 2, 3}, entries.data(),
+                                      entries.size(), &payload));
+    return payload;
+}
+}  // namespace
+
+TEST(ForwardPacket, roundTrip) {
+    std::mt19937 rng(37);
+    for (size_t count = 0; count <= MAX_FORWARD_ENTRIES; count++) {
+        const auto entries = randomEntries(count, &rng);
+        const auto payload = buildPayload(entries);
+        ASSERT_EQ(ForwardPayloadSize(count), payload.size());
+
+        ForwardPayload forward;
+        ASSERT_TRUE(forward.parse(payload.data(), payload.size()));
+        EXPECT_EQ(count, forward.count());
+        EXPECT_EQ(1, forward.schedule().channel);
+        EXPECT_EQ(2, forward.schedule().next);
+        EXPECT_EQ(3, forward.schedule().countdown);
+
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(int(i), forward.find(entries[i].uid));
+            EXPECT_EQ(entries[i].bodyY, forward.entry(i).bodyY);
+            EXPECT_EQ(i, forward.entry(i).kickStrength);
+        }
+        EXPECT_EQ(-1, forward.find(INVALID_ROBOT_UID));
+    }
+
+    // too many to fit in a frame
+    const auto entries = randomEntries(MAX_FORWARD_ENTRIES + 1, &rng);
+    std::vector<uint8_t> payload;
+    EXPECT_FALSE(ForwardPayload::build({}, entries.data(), entries.size(),
+                                       &payload));
+}
+
+TEST(ForwardPacket, findWithHint) {
+    std::mt19937 rng(37);
+    const auto entries = randomEntries(8, &rng);
+    const auto payload = buildPayload(entries);
+    ForwardPayload forward;
+    ASSERT_TRUE(forward.parse(payload.data(), payload.size()));
+
+    const uint8_t uid = entries[5].uid;
+    EXPECT_EQ(5, forward.find(uid, 5));
+
+    // stale or nonsense hints still find it
+    EXPECT_EQ(5, forward.find(uid, 2));
+    EXPECT_EQ(5, forward.find(uid, 100));
+    EXPECT_EQ(-1, forward.find(INVALID_ROBOT_UID, 5));
+}
+
+TEST(ForwardPacket, fuzz) {
+    std::mt19937 rng(37);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<size_t> length(0, MAX_DATA_SZ);
+
+    // random garbage only parses if the count happens to match the size, or
+    // the compact entries happen to add up to it, and then every entry is
+    // inside the buffer
+    unsigned int accepted = 0;
+    for (int i = 0; i < 100000; i++) {
+        std::vector<uint8_t> data(length(rng));
+        for (uint8_t& b : data) b = byte(rng);
+
+        // small counts, so some of them match
+        if (data.size() > sizeof(ChannelSchedule) && i % 2) {
+            data[sizeof(ChannelSchedule)] %= MAX_FORWARD_ENTRIES + 2;
+        }
+
+        ForwardPayload forward;
+        if (!forward.parse(data.data(), data.size())) {
+            EXPECT_FALSE(forward.valid());
+            EXPECT_EQ(0u, forward.count());
+            EXPECT_EQ(-1, forward.find(byte(rng), byte(rng)));
+            continue;
+        }
+
+        accepted++;
+        ASSERT_LE(forward.count(), MAX_FORWARD_ENTRIES);
+        const uint8_t* end = data.data() + data.size();
+        const uint8_t* entriesEnd =
+            forward.compact()
+                ? forward.compactEntry(forward.count())
+                : reinterpret_cast<const uint8_t*>(&forward.entry(0) +
+                                                   forward.count());
+        const bool hasTrajectories =
+            data[sizeof(ChannelSchedule)] & HAS_TRAJECTORIES;
+        const size_t trajectoriesSize =
+            hasTrajectories ? TrajectoriesSize(entriesEnd, end - entriesEnd)
+                            : 0;
+        ASSERT_EQ(hasTrajectories, trajectoriesSize > 0);
+        ASSERT_EQ(end, entriesEnd + trajectoriesSize);
+        const int found = forward.find(byte(rng), byte(rng) - 128);
+        EXPECT_LT(found, int(forward.count()));
+    }
+    EXPECT_GT(accepted, 0u);
+
+    // valid packets with bytes missing or extra are rejected
+    for (int i = 0; i < 10000; i++) {
+        const auto entries = randomEntries(i % (MAX_FORWARD_ENTRIES + 1), &rng);
+        auto payload = buildPayload(entries);
+
+        ForwardPayload forward;
+        if (i % 2) {
+            payload.resize(byte(rng) % payload.size());
+        } else {
+            payload.push_back(byte(rng));
+        }
+        EXPECT_FALSE(forward.parse(payload.data(), payload.size()));
+    }
+}
+
+TEST(ForwardPacket, trajectories) {
+    std::mt19937 rng(39);
+    const auto entries = randomEntries(4, &rng);
+
+    // robots 1 and 4 have 2 and 8 points, 10 ms apart
+    std::vector<uint8_t> section = {2};
+    for (const auto& t : {std::make_pair(1, 2), std::make_pair(4, 8)}) {
+        TrajectoryHeader header = {uint8_t(t.first), 10, uint8_t(t.second)};
+        SerializeToVector(header, &section);
+        for (int i = 0; i < t.second; i++) {
+            TrajectoryPoint point = {int16_t(t.first * 100 + i), 0, 0};
+            SerializeToVector(point, &section);
+        }
+    }
+    ASSERT_EQ(section.size(), TrajectoriesSize(section.data(), section.size()));
+
+    std::vector<uint8_t> payload;
+    ASSERT_TRUE(ForwardPayload::build({}, entries.data(), entries.size(),
+                                      &payload, section.data(),
+                                      section.size()));
+    ForwardPayload forward;
+    ASSERT_TRUE(forward.parse(payload.data(), payload.size()));
+    EXPECT_EQ(entries.size(), forward.count());
+    EXPECT_EQ(int(2), forward.find(entries[2].uid));
+
+    const TrajectoryHeader* header = forward.trajectory(4);
+    ASSERT_NE(nullptr, header);
+    EXPECT_EQ(10, header->stepMs);
+    ASSERT_EQ(8, header->points);
+    const auto points = reinterpret_cast<const TrajectoryPoint*>(header + 1);
+    EXPECT_EQ(407, points[7].bodyX);
+    ASSERT_NE(nullptr, forward.trajectory(1));
+    EXPECT_EQ(nullptr, forward.trajectory(2));
+
+    // a packet without them has none
+    const auto plain = buildPayload(entries);
+    ASSERT_TRUE(forward.parse(plain.data(), plain.size()));
+    EXPECT_EQ(nullptr, forward.trajectory(4));
+
+    // too many points, or cut short
+    section[3] = MAX_TRAJECTORY_POINTS + 1;
+    EXPECT_EQ(0u, TrajectoriesSize(section.data(), section.size()));
+    section[3] = 2;
+    EXPECT_EQ(0u, TrajectoriesSize(section.data(), section.size() - 1));
+
+    // and they have to fit in the frame with the entries
+    const auto full = randomEntries(MAX_FORWARD_ENTRIES, &rng);
+    payload.clear();
+    EXPECT_FALSE(ForwardPayload::build({}, full.data(), full.size(), &payload,
+                                       section.data(), section.size()));
+}
+
+TEST(ForwardPacket, replySlotsFitTheWindow) {
+    for (size_t count = 0; count <= MAX_FORWARD_ENTRIES; count++) {
+        std::vector<unsigned int> turns(count);
+        const size_t spares = count < REPLY_SLOTS ? REPLY_SLOTS - count : 0;
+        for (unsigned int seq = 0; seq < 256; seq++) {
+            // the spares go after every slot that an entry can be in
+            std::vector<int32_t> delays;
+            for (uint8_t uid = 0; uid < spares; uid++) {
+                delays.push_back(ReplyDelayMs(-1, count, uid, seq));
+            }
+            if (spares == 0) {
+                EXPECT_EQ(NO_REPLY, ReplyDelayMs(-1, count, 0, seq));
+            }
+            for (size_t i = 0; i < count; i++) {
+                const int32_t ms = ReplyDelayMs(i, count, 0, seq);
+                if (ms == NO_REPLY) continue;
+                turns[i]++;
+                if (spares > 0) {
+                    EXPECT_LT(ms, delays[0]);
+                }
+                delays.push_back(ms);
+            }
+
+            // every slot is the full width, ends inside the window, and has
+            // only one robot in it
+            std::sort(delays.begin(), delays.end());
+            for (size_t i = 0; i < delays.size(); i++) {
+                EXPECT_GE(delays[i], 1);
+                EXPECT_LE(delays[i] + REPLY_SLOT_MS, REPLY_WINDOW_MS)
+                    << count << " entries";
+                if (i > 0) {
+                    EXPECT_GE(uint32_t(delays[i] - delays[i - 1]),
+                              REPLY_SLOT_MS);
+                }
+            }
+        }
+
+        // up to REPLY_SLOTS robots reply every time, and past that they all
+        // get about the same number of turns
+        for (size_t i = 0; i < count; i++) {
+            if (count <= REPLY_SLOTS) {
+                EXPECT_EQ(256u, turns[i]);
+            } else {
+                EXPECT_NEAR(256.0 * REPLY_SLOTS / count, turns[i], 4)
+                    << "entry " << i << " of " << count;
+            }
+        }
+    }
+
+    // robots with entries reply in order, ahead of the spares
+    EXPECT_EQ(1, ReplyDelayMs(0, 3, 0, 7));
+    EXPECT_EQ(int32_t(1 + 2 * REPLY_SLOT_MS), ReplyDelayMs(2, 3, 0, 7));
+    EXPECT_EQ(int32_t(1 + 3 * REPLY_SLOT_MS), ReplyDelayMs(-1, 3, 0, 7));
+}
+
+TEST(ForwardPacket, sixRobotsAllReply) {
+    // a full field fills the window, with every robot in its own slot
+    const size_t count = 6;
+    ASSERT_EQ(count, REPLY_SLOTS);
+    for (unsigned int seq = 0; seq < 256; seq++) {
+        std::set<int32_t> delays;
+        for (size_t i = 0; i < count; i++) {
+            const int32_t ms = ReplyDelayMs(i, count, i, seq);
+            EXPECT_NE(NO_REPLY, ms);
+            EXPECT_EQ(int32_t(1 + i * REPLY_SLOT_MS), ms);
+            delays.insert(ms);
+        }
+        EXPECT_EQ(count, delays.size());
+    }
+}
+
+TEST(ForwardPacket, parseTime) {
+    std::mt19937 rng(37);
+    const int iterations = 200000;
+
+    printf("  robots   bytes   parse + find   with hint   no entry\n");
+    for (size_t count : {1, 2, 4, 6, 8, 10}) {
+        const auto entries = randomEntries(count, &rng);
+        const auto payload = buildPayload(entries);
+        const uint8_t uid = entries.back().uid;
+
+        // the worst case, our entry is the last one
+        auto run = [&](int hint, uint8_t lookFor) {
+            volatile int sink = 0;
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++) {
+                ForwardPayload forward;
+                forward.parse(payload.data(), payload.size());
+                sink = sink + forward.find(lookFor, hint);
+            }
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            return std::chrono::duration<double, std::nano>(elapsed).count() /
+                   iterations;
+        };
+
+        const double scan = run(-1, uid);
+        const double hinted = run(count - 1, uid);
+        const double missing = run(-1, INVALID_ROBOT_UID);
+        printf("  %6zu   %5zu   %9.1f ns   %6.1f ns   %5.1f ns\n", count,
+               payload.size(), scan, hinted, missing);
+
+        // it's a few compares either way, nowhere near a reply slot
+        EXPECT_LT(scan, 10000);
+    }
+}
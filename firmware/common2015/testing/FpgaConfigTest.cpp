@@ -0,0 +1,217 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "../drivers/fpga/fpga-config.hpp"
+#include "FakeMbed.hpp"
+
+using fake_mbed::DigitalIn;
+using fake_mbed::DigitalOut;
+
+namespace {
+// Size of an XC3S250E bitstream
+const size_t BITSTREAM_SIZE = 169216;
+
+const uint8_t SYNC_WORD[] = {0xAA, 0x99, 0x55, 0x66};
+
+/**
+ * Emulates the Spartan-3E's side of slave serial configuration.  DIN is
+ * sampled on each rising edge of CCLK, MSB first.  DONE goes high once
+ * @configLength bytes have been clocked in after the sync word, unless a CRC
+ * error is injected, in which case INIT_B goes low instead.
+ */
+class FakeSpartan {
+public:
+    explicit FakeSpartan(size_t configLength)
+        : din(0), cclk(0), initB(1), done(0), _configLength(configLength) {
+        cclk.onWrite = [this](int v) {
+            if (v && !_lastClk) clockIn(din.read());
+            _lastClk = v;
+        };
+    }
+
+    /// Make INIT_B go low after the given number of bytes
+    void injectCrcErrorAt(size_t byte) { _crcErrorAt = byte; }
+
+    DigitalOut din, cclk;
+    DigitalIn initB, done;
+
+    std::vector<uint8_t> received;
+    bool synced = false;
+
+private:
+    void clockIn(int bit) {
+        _shift = (_shift << 1) | (bit ? 1 : 0);
+        if (++_bits < 8) return;
+
+        received.push_back(_shift);
+        _shift = 0;
+        _bits = 0;
+
+        const size_t n = received.size();
+        if (!synced && n >= 4 &&
+            memcmp(&received[n - 4], SYNC_WORD, sizeof(SYNC_WORD)) == 0) {
+            synced = true;
+            _syncEnd = n;
+        }
+
+        if (n == _crcErrorAt) {
+            _crcError = true;
+            initB.set(0);
+        }
+        if (synced && !_crcError && n - _syncEnd >= _configLength)
+            done.set(1);
+    }
+
+    size_t _configLength;
+    size_t _crcErrorAt = SIZE_MAX;
+    bool _crcError = false;
+    int _lastClk = 0;
+    uint8_t _shift = 0;
+    int _bits = 0;
+    size_t _syncEnd = 0;
+};
+
+/// A bitstream with dummy words and the sync word up front, like promgen
+/// makes, and @padding bytes after the point where DONE goes high
+std::vector<uint8_t> makeBitstream(size_t configLength, size_t padding) {
+    std::vector<uint8_t> bits(16, 0xFF);
+    bits.insert(bits.end(), SYNC_WORD, SYNC_WORD + sizeof(SYNC_WORD));
+    for (size_t i = 0; i < configLength; i++) bits.push_back(i * 7 + 3);
+    bits.insert(bits.end(), padding, 0xFF);
+    return bits;
+}
+
+/// Reads from a buffer the way fread() reads from the bitstream file
+class BufferReader {
+public:
+    explicit BufferReader(const std::vector<uint8_t>& data) : _data(data) {}
+
+    int operator()(uint8_t* buf, size_t len) {
+        numReads++;
+        const size_t n = std::min(len, _data.size() - _pos);
+        memcpy(buf, _data.data() + _pos, n);
+        _pos += n;
+        return n;
+    }
+
+    unsigned int numReads = 0;
+
+private:
+    const std::vector<uint8_t>& _data;
+    size_t _pos = 0;
+};
+}  // namespace
+
+TEST(FpgaConfig, bytesSentInOrder) {
+    const size_t len = 1000;
+    std::vector<uint8_t> bits = makeBitstream(len, 0);
+    FakeSpartan fpga(len);
+    SlaveSerialPort<DigitalOut> port(fpga.din, fpga.cclk);
+    uint8_t buf[64];
+    size_t sent;
+
+    auto result = streamBitstream(BufferReader(bits), port, fpga.initB,
+                                  fpga.done, buf, sizeof(buf), &sent);
+
+    EXPECT_EQ(FPGA_CONFIG_OK, result);
+    EXPECT_TRUE(fpga.synced);
+    EXPECT_EQ(1, fpga.done.read());
+    EXPECT_EQ(bits.size(), sent);
+    EXPECT_EQ(bits, fpga.received);
+}
+
+TEST(FpgaConfig, stopsWhenDone) {
+    const size_t len = 1000;
+    std::vector<uint8_t> bits = makeBitstream(len, 4096);
+    FakeSpartan fpga(len);
+    SlaveSerialPort<DigitalOut> port(fpga.din, fpga.cclk);
+    uint8_t buf[256];
+    size_t sent;
+
+    auto result = streamBitstream(BufferReader(bits), port, fpga.initB,
+                                  fpga.done, buf, sizeof(buf), &sent);
+
+    // the padding after DONE goes high is skipped, except for whatever was
+    // left in the block that finished the configuration
+    EXPECT_EQ(FPGA_CONFIG_OK, result);
+    EXPECT_EQ(1, fpga.done.read());
+    EXPECT_LT(sent, len + 20 + sizeof(buf));
+}
+
+TEST(FpgaConfig, initErrorStopsTransfer) {
+    const size_t len = 10000;
+    std::vector<uint8_t> bits = makeBitstream(len, 0);
+    FakeSpartan fpga(len);
+    fpga.injectCrcErrorAt(3000);
+    SlaveSerialPort<DigitalOut> port(fpga.din, fpga.cclk);
+    uint8_t buf[512];
+    size_t sent;
+
+    auto result = streamBitstream(BufferReader(bits), port, fpga.initB,
+                                  fpga.done, buf, sizeof(buf), &sent);
+
+    EXPECT_EQ(FPGA_CONFIG_INIT_ERROR, result);
+    EXPECT_EQ(0, fpga.done.read());
+    EXPECT_LE(sent, 3000 + sizeof(buf));
+}
+
+TEST(FpgaConfig, readError) {
+    FakeSpartan fpga(100);
+    SlaveSerialPort<DigitalOut> port(fpga.din, fpga.cclk);
+    uint8_t buf[16];
+
+    auto result = streamBitstream([](uint8_t*, size_t) { return -1; }, port,
+                                  fpga.initB, fpga.done, buf, sizeof(buf));
+    EXPECT_EQ(FPGA_CONFIG_READ_ERROR, result);
+}
+
+TEST(FpgaConfig, hashMatches) {
+    std::vector<uint8_t> hash = {0x4c, 0x1f, 0x00, 0xAB};
+
+    EXPECT_TRUE(fpgaHashMatches("4c1f00ab", hash));
+    EXPECT_TRUE(fpgaHashMatches("4C1F00AB\n", hash));
+    EXPECT_FALSE(fpgaHashMatches("4c1f00ac", hash));
+    EXPECT_FALSE(fpgaHashMatches("4c1f00", hash));
+    EXPECT_FALSE(fpgaHashMatches("4c1f00ab12", hash));
+    EXPECT_FALSE(fpgaHashMatches("4c1f0zab", hash));
+    EXPECT_FALSE(fpgaHashMatches("", {}));
+}
+
+// Compares the pin and file accesses needed for a full size bitstream with
+// what the old per-byte SoftwareSPI loop needed.  On the mbed each pin access
+// is a few cycles, but each fread() from the local filesystem is a
+// semihosting call to the interface chip, which is far more expensive.
+TEST(FpgaConfig, configurationCost) {
+    std::vector<uint8_t> bits = makeBitstream(BITSTREAM_SIZE, 0);
+    FakeSpartan fpga(BITSTREAM_SIZE);
+    SlaveSerialPort<DigitalOut> port(fpga.din, fpga.cclk);
+    static uint8_t buf[1024];
+    BufferReader reader(bits);
+
+    auto result = streamBitstream(std::ref(reader), port, fpga.initB,
+                                  fpga.done, buf, sizeof(buf));
+    ASSERT_EQ(FPGA_CONFIG_OK, result);
+    ASSERT_EQ(bits, fpga.received);
+
+    const unsigned int pinWrites = fpga.din.numWrites + fpga.cclk.numWrites;
+    const unsigned int statusReads =
+        fpga.initB.numReads + fpga.done.numReads;
+
+    // SoftwareSPI did 3 writes and a MISO read per bit, INIT_B and DONE were
+    // read for every byte, and the file was read 50 bytes at a time
+    const size_t oldPinOps = bits.size() * (8 * 4 + 2);
+    const size_t oldReads = (bits.size() + 49) / 50;
+
+    printf("  %u byte bitstream\n", static_cast<unsigned int>(bits.size()));
+    printf("  pin accesses: %u (was %u)\n", pinWrites + statusReads,
+           static_cast<unsigned int>(oldPinOps));
+    printf("  file reads:   %u (was %u)\n", reader.numReads,
+           static_cast<unsigned int>(oldReads));
+
+    EXPECT_LT(pinWrites + statusReads, oldPinOps);
+    EXPECT_LT(reader.numReads * 10, oldReads);
+    EXPECT_LT(statusReads, bits.size() / 100);
+}
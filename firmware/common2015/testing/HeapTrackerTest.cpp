@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include "../utils/heap-tracker.hpp"
+
+namespace {
+const uint8_t CONTROL_THREAD = 1;
+const uint8_t RADIO_THREAD = 2;
+
+/// A made up newlib heap, built chunk by chunk
+struct Arena {
+    alignas(8) uint8_t bytes[512] = {};
+    size_t size = 0;
+
+    /// Adds a chunk of @chunkSize, and sets whether the one before it is used
+    void add(uint32_t chunkSize, bool prevInUse) {
+        const uint32_t field = chunkSize | (prevInUse ? 1 : 0);
+        memcpy(bytes + size + sizeof(uint32_t), &field, sizeof(field));
+        size += chunkSize;
+    }
+};
+}  // namespace
+
+TEST(HeapTracker, countsBytesInUse) {
+    HeapTracker tracker;
+    tracker.allocated(CONTROL_THREAD, 100);
+    tracker.allocated(RADIO_THREAD, 40);
+    tracker.freed(100);
+    tracker.allocated(RADIO_THREAD, 20);
+
+    EXPECT_EQ(60u, tracker.inUse());
+    EXPECT_EQ(140u, tracker.peak());
+    EXPECT_EQ(3u, tracker.allocs());
+    EXPECT_EQ(1u, tracker.frees());
+
+    tracker.resetPeak();
+    EXPECT_EQ(60u, tracker.peak());
+
+    // freeing what was allocated before it was tracking doesn't go negative
+    tracker.freed(1000);
+    EXPECT_EQ(0u, tracker.inUse());
+}
+
+TEST(HeapTracker, countsAgainstTags) {
+    HeapTracker tracker;
+    const uint8_t radio = tracker.tag("radio");
+    EXPECT_EQ(radio, tracker.tag("radio"));
+
+    // by contents, not by pointer
+    char name[] = "radio";
+    EXPECT_EQ(radio, tracker.tag(name));
+
+    const uint8_t previous = tracker.enter(RADIO_THREAD, radio);
+    EXPECT_EQ(uint8_t(HeapTracker::UNTAGGED), previous);
+    EXPECT_TRUE(tracker.allocated(RADIO_THREAD, 64));
+
+    // other threads aren't in it
+    tracker.allocated(CONTROL_THREAD, 8);
+    tracker.leave(RADIO_THREAD, previous);
+    tracker.allocated(RADIO_THREAD, 16);
+
+    EXPECT_EQ(1u, tracker.tagStats(radio).allocs);
+    EXPECT_EQ(64u, tracker.tagStats(radio).bytes);
+    EXPECT_EQ(2u, tracker.tagStats(HeapTracker::UNTAGGED).allocs);
+    EXPECT_EQ(24u, tracker.tagStats(HeapTracker::UNTAGGED).bytes);
+    EXPECT_STREQ("untagged", tracker.tagStats(HeapTracker::UNTAGGED).name);
+}
+
+TEST(HeapTracker, catchesAllocationsInNoAllocTags) {
+    HeapTracker tracker;
+    const uint8_t control = tracker.tag("control", true);
+    const uint8_t log = tracker.tag("log");
+
+    const uint8_t outer = tracker.enter(CONTROL_THREAD, control);
+    EXPECT_FALSE(tracker.allocated(CONTROL_THREAD, 32));
+
+    // an inner tag that's allowed to allocate takes over
+    const uint8_t inner = tracker.enter(CONTROL_THREAD, log);
+    EXPECT_TRUE(tracker.allocated(CONTROL_THREAD, 32));
+    tracker.leave(CONTROL_THREAD, inner);
+    EXPECT_EQ(control, tracker.current(CONTROL_THREAD));
+
+    EXPECT_FALSE(tracker.allocated(CONTROL_THREAD, 32));
+    tracker.leave(CONTROL_THREAD, outer);
+    EXPECT_TRUE(tracker.allocated(CONTROL_THREAD, 32));
+
+    EXPECT_EQ(2u, tracker.tagStats(control).violations);
+    EXPECT_EQ(0u, tracker.tagStats(log).violations);
+    EXPECT_EQ(2u, tracker.violations());
+    EXPECT_EQ(4u, tracker.allocs());
+}
+
+TEST(HeapTracker, runsOutOfTags) {
+    HeapTracker tracker;
+    static char names[HeapTracker::MAX_TAGS][8];
+    for (size_t i = 1; i < HeapTracker::MAX_TAGS; i++) {
+        snprintf(names[i], sizeof(names[i]), "tag%zu", i);
+        EXPECT_EQ(i, tracker.tag(names[i]));
+    }
+    EXPECT_EQ(uint8_t(HeapTracker::UNTAGGED),
+              tracker.tag("one too many", true));
+    EXPECT_EQ(size_t(HeapTracker::MAX_TAGS), tracker.tagCount());
+
+    // so it's counted as untagged
+    tracker.enter(CONTROL_THREAD, tracker.tag("one too many"));
+    EXPECT_TRUE(tracker.allocated(CONTROL_THREAD, 8));
+    EXPECT_EQ(1u, tracker.tagStats(HeapTracker::UNTAGGED).allocs);
+}
+
+TEST(HeapTracker, measuresRates) {
+    HeapTracker tracker;
+    const uint32_t start = UINT32_MAX - 100000;
+    tracker.allocated(CONTROL_THREAD, 1000);
+    tracker.startWindow(start);
+    for (int i = 0; i < 50; i++) tracker.allocated(RADIO_THREAD, 24);
+
+    // half a second later, across the timer wrapping
+    const uint32_t now = start + 500000;
+    EXPECT_EQ(500000u, tracker.windowUs(now));
+    EXPECT_FLOAT_EQ(100, tracker.allocRate(now));
+    EXPECT_FLOAT_EQ(2400, tracker.byteRate(now));
+    EXPECT_FLOAT_EQ(0, tracker.allocRate(start));
+}
+
+TEST(HeapLayout, walksChunks) {
+    Arena arena;
+    arena.add(32, true);    // used
+    arena.add(48, true);    // free
+    arena.add(16, false);   // used
+    arena.add(64, true);    // free
+    arena.add(128, false);  // top
+
+    const HeapLayout layout = walkHeap(arena.bytes, arena.bytes + arena.size);
+    EXPECT_FALSE(layout.corrupt);
+    EXPECT_EQ(2u, layout.usedChunks);
+    EXPECT_EQ(48u, layout.usedBytes);
+    EXPECT_EQ(3u, layout.freeChunks);
+    EXPECT_EQ(240u, layout.freeBytes);
+    EXPECT_EQ(128u, layout.largestFree);
+    EXPECT_EQ(128u, layout.topBytes);
+    EXPECT_FLOAT_EQ(1 - 128.0f / 240, layout.fragmentation());
+}
+
+TEST(HeapLayout, alignsFirstChunk) {
+    // the heap can start anywhere, but malloc lines the first chunk up
+    Arena arena;
+    arena.size = 8;
+    arena.add(24, true);
+    arena.add(40, true);
+
+    const HeapLayout layout =
+        walkHeap(arena.bytes + 4, arena.bytes + arena.size);
+    EXPECT_FALSE(layout.corrupt);
+    EXPECT_EQ(1u, layout.usedChunks);
+    EXPECT_EQ(24u, layout.usedBytes);
+    EXPECT_EQ(40u, layout.topBytes);
+
+    // nothing's been allocated yet
+    const HeapLayout empty = walkHeap(arena.bytes, arena.bytes);
+    EXPECT_EQ(0u, empty.freeChunks + empty.usedChunks);
+    EXPECT_FLOAT_EQ(0, empty.fragmentation());
+
+    // all of the free space is in one piece
+    Arena top;
+    top.add(256, true);
+    const HeapLayout fresh = walkHeap(top.bytes, top.bytes + top.size);
+    EXPECT_EQ(256u, fresh.topBytes);
+    EXPECT_FLOAT_EQ(0, fresh.fragmentation());
+}
+
+TEST(HeapLayout, stopsAtCorruption) {
+    Arena arena;
+    arena.add(32, true);
+    arena.add(48, true);
+    const size_t overwritten = arena.size;
+    arena.add(64, false);
+    arena.add(128, true);
+
+    // something wrote past the end of the second chunk, which makes it look
+    // used, and the walk can't go past the third
+    memset(arena.bytes + overwritten, 0x55, 8);
+    const HeapLayout layout = walkHeap(arena.bytes, arena.bytes + arena.size);
+    EXPECT_TRUE(layout.corrupt);
+    EXPECT_EQ(2u, layout.usedChunks);
+    EXPECT_EQ(0u, layout.freeChunks);
+    EXPECT_EQ(0u, layout.topBytes);
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+#include "../utils/heartbeat-supervisor.hpp"
+
+namespace {
+const uint8_t CONTROL_THREAD = 1;
+const uint8_t RADIO_THREAD = 2;
+}  // namespace
+
+TEST(HeartbeatSupervisor, healthyWhileCheckingIn) {
+    HeartbeatSupervisor supervisor;
+    const int control = supervisor.add("control", CONTROL_THREAD, 250, 0);
+    const int radio = supervisor.add("radio", RADIO_THREAD, 1000, 0);
+    EXPECT_EQ(0, control);
+    EXPECT_EQ(1, radio);
+
+    for (uint32_t ms = 5; ms <= 5000; ms += 5) {
+        supervisor.checkIn(control, ms);
+        if (ms % 100 == 0) supervisor.checkIn(radio, ms);
+        ASSERT_TRUE(supervisor.check(ms));
+    }
+    EXPECT_EQ(int(HeartbeatSupervisor::NONE), supervisor.starved());
+    EXPECT_EQ(5u, supervisor.entry(control).worstMs);
+    EXPECT_EQ(100u, supervisor.entry(radio).worstMs);
+}
+
+TEST(HeartbeatSupervisor, catchesMissedDeadline) {
+    HeartbeatSupervisor supervisor;
+    const int control = supervisor.add("control", CONTROL_THREAD, 250, 0);
+    const int radio = supervisor.add("radio", RADIO_THREAD, 1000, 0);
+
+    supervisor.checkIn(control, 200);
+    EXPECT_TRUE(supervisor.check(400));
+    EXPECT_EQ(200u, supervisor.sinceMs(control, 400));
+
+    // the deadline itself is still on time
+    supervisor.checkIn(control, 1000);
+    supervisor.checkIn(radio, 1000);
+    EXPECT_TRUE(supervisor.check(1250));
+    EXPECT_FALSE(supervisor.check(1260));
+    EXPECT_EQ(control, supervisor.starved());
+    EXPECT_EQ(260u, supervisor.starvedMs());
+    EXPECT_EQ(CONTROL_THREAD, supervisor.entry(control).threadId);
+}
+
+TEST(HeartbeatSupervisor, staysStarved) {
+    HeartbeatSupervisor supervisor;
+    const int control = supervisor.add("control", CONTROL_THREAD, 250, 0);
+
+    EXPECT_FALSE(supervisor.check(300));
+    supervisor.checkIn(control, 310);
+    EXPECT_FALSE(supervisor.check(320));
+    EXPECT_EQ(300u, supervisor.starvedMs());
+
+    // the gap still counts once it does check in
+    EXPECT_EQ(310u, supervisor.entry(control).worstMs);
+}
+
+TEST(HeartbeatSupervisor, firstStarvedIsKept) {
+    HeartbeatSupervisor supervisor;
+    supervisor.add("control", CONTROL_THREAD, 250, 0);
+    const int radio = supervisor.add("radio", RADIO_THREAD, 100, 0);
+
+    EXPECT_FALSE(supervisor.check(150));
+    EXPECT_EQ(radio, supervisor.starved());
+    EXPECT_FALSE(supervisor.check(400));
+    EXPECT_EQ(radio, supervisor.starved());
+    EXPECT_EQ(150u, supervisor.starvedMs());
+}
+
+TEST(HeartbeatSupervisor, fullAndBadIndexes) {
+    HeartbeatSupervisor supervisor;
+    for (size_t i = 0; i < HeartbeatSupervisor::MAX_THREADS; i++) {
+        EXPECT_EQ(int(i), supervisor.add("thread", i, 100, 0));
+    }
+    EXPECT_EQ(int(HeartbeatSupervisor::NONE),
+              supervisor.add("one too many", 9, 100, 0));
+    EXPECT_EQ(size_t(HeartbeatSupervisor::MAX_THREADS), supervisor.count());
+
+    // checking in with NONE or out of range doesn't do anything
+    supervisor.checkIn(HeartbeatSupervisor::NONE, 50);
+    supervisor.checkIn(HeartbeatSupervisor::MAX_THREADS, 50);
+    for (size_t i = 0; i < supervisor.count(); i++) {
+        EXPECT_EQ(0u, supervisor.entry(i).lastMs);
+    }
+    EXPECT_TRUE(supervisor.check(100));
+}
+
+TEST(HeartbeatSupervisor, nothingAddedIsHealthy) {
+    HeartbeatSupervisor supervisor;
+    EXPECT_TRUE(supervisor.check(1000000));
+    EXPECT_EQ(0u, supervisor.count());
+}
+
+TEST(HeartbeatSupervisor, timerWraps) {
+    HeartbeatSupervisor supervisor;
+    const uint32_t start = UINT32_MAX - 100;
+    const int control = supervisor.add("control", CONTROL_THREAD, 250, start);
+
+    supervisor.checkIn(control, start + 200);
+    EXPECT_TRUE(supervisor.check(start + 400));
+    EXPECT_EQ(200u, supervisor.entry(control).worstMs);
+    EXPECT_FALSE(supervisor.check(start + 500));
+    EXPECT_EQ(300u, supervisor.starvedMs());
+}
@@ -0,0 +1,296 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../drivers/rtos-i2c/I2CQueue.hpp"
+#include "FakeI2C.hpp"
+
+using namespace i2c;
+
+namespace {
+const uint8_t IMU_ADDR = 0x68 * 2;
+const uint8_t IO_EXPANDER_ADDR = 0x42;
+
+typedef Queue<fake_i2c::Bus> TestQueue;
+
+/// Records which transactions finished, and how
+struct Recorder {
+    struct Result {
+        int id;
+        Status status;
+    };
+    std::vector<Result> results;
+
+    static void callback(const Transaction& t, Status status, void* context) {
+        // the id rides along as the first byte written
+        static_cast<Recorder*>(context)->results.push_back(
+            {t.writeData[0], status});
+    }
+
+    std::vector<int> ids() const {
+        std::vector<int> v;
+        for (const auto& r : results) v.push_back(r.id);
+        return v;
+    }
+};
+
+Transaction makeWrite(uint8_t addr, Priority prio, uint8_t id,
+                      Recorder* rec) {
+    Transaction t(addr, prio);
+    const uint8_t data[] = {id, 0};
+    t.setWrite(data, sizeof(data));
+    t.setCallback(&Recorder::callback, rec);
+    return t;
+}
+}  // namespace
+
+TEST(I2CQueue, registerReadUsesRepeatedStart) {
+    fake_i2c::Bus bus;
+    fake_i2c::RegisterDevice imu;
+    imu.regs[0x3B] = 0x12;
+    imu.regs[0x3C] = 0x34;
+    bus.attach(IMU_ADDR, &imu);
+    TestQueue queue(bus);
+
+    uint8_t data[2] = {};
+    Transaction t(IMU_ADDR, PRIORITY_HIGH);
+    const uint8_t reg = 0x3B;
+    t.setWrite(&reg, 1);
+    t.setRead(data, sizeof(data));
+
+    ASSERT_TRUE(queue.submit(t));
+    EXPECT_EQ(1u, queue.pending());
+    EXPECT_TRUE(queue.runNext());
+    EXPECT_FALSE(queue.runNext());
+
+    EXPECT_EQ(0x12, data[0]);
+    EXPECT_EQ(0x34, data[1]);
+    EXPECT_EQ(1u, bus.starts);
+    EXPECT_EQ(1u, bus.repeatedStarts);
+    EXPECT_EQ(1u, bus.stops);
+    EXPECT_FALSE(bus.held());
+}
+
+TEST(I2CQueue, highestPriorityFirst) {
+    fake_i2c::Bus bus;
+    fake_i2c::RegisterDevice dev;
+    bus.attach(IO_EXPANDER_ADDR, &dev);
+    TestQueue queue(bus);
+    Recorder rec;
+
+    queue.submit(makeWrite(IO_EXPANDER_ADDR, PRIORITY_LOW, 1, &rec));
+    queue.submit(makeWrite(IO_EXPANDER_ADDR, PRIORITY_NORMAL, 2, &rec));
+    queue.submit(makeWrite(IO_EXPANDER_ADDR, PRIORITY_LOW, 3, &rec));
+    queue.submit(makeWrite(IO_EXPANDER_ADDR, PRIORITY_HIGH, 4, &rec));
+    queue.submit(makeWrite(IO_EXPANDER_ADDR, PRIORITY_NORMAL, 5, &rec));
+
+    EXPECT_EQ(5u, queue.runAll());
+    EXPECT_EQ(std::vector<int>({4, 2, 5, 1, 3}), rec.ids());
+    EXPECT_EQ(5u, queue.stats().completed);
+}
+
+TEST(I2CQueue, samePriorityKeepsOrder) {
+    fake_i2c::Bus bus;
+    fake_i2c::RegisterDevice dev;
+    dev.regs[0x0C] = 0x55;
+    bus.attach(IO_EXPANDER_ADDR, &dev);
+    TestQueue queue(bus);
+    Recorder rec;
+
+    // configuring a register and then reading it back, like the MCP23017
+    // driver does, with other traffic in between
+    queue.submit(makeWrite(IO_EXPANDER_ADDR, PRIORITY_NORMAL, 0x0C, &rec));
+    queue.submit(makeWrite(IO_EXPANDER_ADDR, PRIORITY_LOW, 0x20, &rec));
+
+    uint8_t data = 0xFF;
+    Transaction read(IO_EXPANDER_ADDR, PRIORITY_NORMAL);
+    const uint8_t reg = 0x0C;
+    read.setWrite(&reg, 1);
+    read.setRead(&data, 1);
+    queue.submit(read);
+
+    queue.runAll();
+    EXPECT_EQ(0, data);
+    EXPECT_EQ(std::vector<int>({0x0C, 0x20}), rec.ids());
+}
+
+TEST(I2CQueue, batchHoldsTheBus) {
+    fake_i2c::Bus bus;
+    fake_i2c::RegisterDevice dev;
+    bus.attach(IO_EXPANDER_ADDR, &dev);
+    TestQueue queue(bus);
+    Recorder rec;
+
+    Transaction batch[] = {
+        makeWrite(IO_EXPANDER_ADDR, PRIORITY_LOW, 1, &rec),
+        makeWrite(IO_EXPANDER_ADDR, PRIORITY_LOW, 2, &rec),
+        makeWrite(IO_EXPANDER_ADDR, PRIORITY_LOW, 3, &rec),
+    };
+    ASSERT_TRUE(queue.submit(batch, 3));
+    queue.submit(makeWrite(IO_EXPANDER_ADDR, PRIORITY_HIGH, 4, &rec));
+
+    // the high priority one jumps ahead of the batch, but not into it
+    EXPECT_TRUE(queue.runNext());
+    EXPECT_EQ(std::vector<int>({4}), rec.ids());
+    EXPECT_TRUE(queue.runNext());
+    EXPECT_EQ(std::vector<int>({4, 1, 2, 3}), rec.ids());
+
+    // one stop for the single transaction, one for the whole batch
+    EXPECT_EQ(2u, bus.starts);
+    EXPECT_EQ(2u, bus.repeatedStarts);
+    EXPECT_EQ(2u, bus.stops);
+}
+
+TEST(I2CQueue, nackAbortsRestOfBatch) {
+    fake_i2c::Bus bus;
+    fake_i2c::RegisterDevice dev;
+    bus.attach(IO_EXPANDER_ADDR, &dev);
+    TestQueue queue(bus);
+    Recorder rec;
+
+    Transaction batch[] = {
+        makeWrite(IO_EXPANDER_ADDR, PRIORITY_NORMAL, 1, &rec),
+        makeWrite(0x50, PRIORITY_NORMAL, 2, &rec),
+        makeWrite(IO_EXPANDER_ADDR, PRIORITY_NORMAL, 3, &rec),
+    };
+    queue.submit(batch, 3);
+    queue.submit(makeWrite(IO_EXPANDER_ADDR, PRIORITY_NORMAL, 4, &rec));
+    queue.runAll();
+
+    ASSERT_EQ(4u, rec.results.size());
+    EXPECT_EQ(STATUS_OK, rec.results[0].status);
+    EXPECT_EQ(STATUS_NACK, rec.results[1].status);
+    EXPECT_EQ(STATUS_ABORTED, rec.results[2].status);
+    EXPECT_EQ(STATUS_OK, rec.results[3].status);
+    EXPECT_EQ(2u, queue.stats().failed);
+    EXPECT_FALSE(bus.held());
+}
+
+TEST(I2CQueue, fullQueueRejects) {
+    fake_i2c::Bus bus;
+    Queue<fake_i2c::Bus, NullMutex, 4> queue(bus);
+    Recorder rec;
+
+    Transaction t = makeWrite(IO_EXPANDER_ADDR, PRIORITY_LOW, 1, &rec);
+    EXPECT_TRUE(queue.submit(t));
+    EXPECT_TRUE(queue.submit(t));
+
+    // all or nothing for batches
+    Transaction batch[] = {t, t, t};
+    EXPECT_FALSE(queue.submit(batch, 3));
+    EXPECT_EQ(2u, queue.pending());
+
+    EXPECT_TRUE(queue.submit(batch, 2));
+    EXPECT_FALSE(queue.submit(t));
+    EXPECT_EQ(4u, queue.stats().submitted);
+    EXPECT_EQ(4u, queue.stats().rejected);
+    EXPECT_EQ(4u, queue.stats().maxPending);
+}
+
+namespace {
+/// Latency of one transaction, from being submitted until it was finished
+struct Timing {
+    fake_i2c::Bus* bus;
+    double submittedUs;
+    double latencyUs;
+
+    static void callback(const Transaction&, Status, void* context) {
+        Timing* t = static_cast<Timing*>(context);
+        t->latencyUs = t->bus->nowUs - t->submittedUs;
+    }
+};
+
+struct Traffic {
+    double imuWorstUs;
+    double imuMeanUs;
+    double occupancy;
+};
+
+/**
+ * Runs one second of bus traffic like the robot's: a 14 byte IMU read every
+ * millisecond from the control loop, and every 10 ms a burst from the main
+ * loop that rewrites each of the 8 error LEDs on the IO expander and reads the
+ * rotary selector.
+ *
+ * With @prioritized false, everything is the same priority, which is how the
+ * mutex-based driver behaved: whoever asked first got the bus.
+ */
+Traffic simulate(bool prioritized) {
+    fake_i2c::Bus bus;
+    fake_i2c::RegisterDevice imu, ioExpander;
+    bus.attach(IMU_ADDR, &imu);
+    bus.attach(IO_EXPANDER_ADDR, &ioExpander);
+    Queue<fake_i2c::Bus, NullMutex, 32> queue(bus);
+
+    const double periodUs = 1000;
+    const int numPeriods = 1000;
+
+    std::vector<Timing> imuTimings(numPeriods);
+    uint8_t imuData[14], gpio[2];
+
+    for (int i = 0; i < numPeriods; i++) {
+        const double periodStart = i * periodUs;
+
+        // the main loop's burst lands just before the IMU read
+        if (i % 10 == 0) {
+            bus.idleUntil(periodStart);
+            const Priority prio = prioritized ? PRIORITY_LOW : PRIORITY_NORMAL;
+            for (int led = 0; led < 8; led++) {
+                Transaction t(IO_EXPANDER_ADDR, prio);
+                const uint8_t data[] = {0x12, 0xFF, uint8_t(~(1 << led))};
+                t.setWrite(data, sizeof(data));
+                queue.submit(t);
+            }
+            Transaction t(IO_EXPANDER_ADDR, PRIORITY_NORMAL);
+            const uint8_t reg = 0x12;
+            t.setWrite(&reg, 1);
+            t.setRead(gpio, sizeof(gpio));
+            queue.submit(t);
+
+            // the first LED write gets the bus right away
+            queue.runNext();
+        }
+
+        // by the time the IMU read comes in, part of the burst is still queued
+        bus.idleUntil(periodStart + 50);
+        Timing& timing = imuTimings[i];
+        timing = {&bus, bus.nowUs, 0};
+        Transaction t(IMU_ADDR, PRIORITY_HIGH);
+        const uint8_t reg = 0x3B;
+        t.setWrite(&reg, 1);
+        t.setRead(imuData, sizeof(imuData));
+        t.setCallback(&Timing::callback, &timing);
+        if (!prioritized) t.priority = PRIORITY_NORMAL;
+        queue.submit(t);
+
+        queue.runAll();
+    }
+
+    Traffic result = {0, 0, bus.busyUs / bus.nowUs};
+    for (const auto& t : imuTimings) {
+        result.imuWorstUs = std::max(result.imuWorstUs, t.latencyUs);
+        result.imuMeanUs += t.latencyUs / numPeriods;
+    }
+    return result;
+}
+}  // namespace
+
+TEST(I2CQueue, imuLatencyUnderLoad) {
+    const Traffic fifo = simulate(false);
+    const Traffic prio = simulate(true);
+
+    printf("               worst IMU    mean IMU    bus busy\n");
+    printf("  first come   %7.1f us  %7.1f us   %5.1f%%\n", fifo.imuWorstUs,
+           fifo.imuMeanUs, fifo.occupancy * 100);
+    printf("  prioritized  %7.1f us  %7.1f us   %5.1f%%\n", prio.imuWorstUs,
+           prio.imuMeanUs, prio.occupancy * 100);
+
+    // the same work gets done either way
+    EXPECT_NEAR(fifo.occupancy, prio.occupancy, 1e-3);
+
+    // with priorities, an IMU read waits for at most the one transfer that
+    // was already on the bus
+    EXPECT_LT(prio.imuWorstUs * 2, fifo.imuWorstUs);
+    EXPECT_LT(prio.imuMeanUs, fifo.imuMeanUs);
+}
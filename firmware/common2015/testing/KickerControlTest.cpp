@@ -0,0 +1,227 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "../drivers/kicker-board/kicker_control.h"
+
+namespace {
+// Timing of the kicker firmware's interrupts, in microseconds
+const int ADC_PERIOD_US = 416;
+const int TICK_PERIOD_US = 1000;
+
+// The old firmware's main loop: two blocking conversions then a 40 ms delay
+const int LEGACY_LOOP_US = 40000 + 2 * 104;
+
+/**
+ * A kicker capacitor, its flyback charger, and the solenoid, in ADC counts.
+ *
+ * The charger puts a constant power into the capacitor, so the voltage rises
+ * fastest when it's empty and slows down as it fills.  While kicking, the
+ * capacitor discharges through the solenoid.  The ADC reading has a little
+ * noise on it.
+ */
+class CapacitorSim {
+public:
+    // charger power over capacitance, in counts^2 per second.  With 1 count
+    // per volt, that's 20 W into 2200 uF.
+    static constexpr double POWER_OVER_C = 20.0 / 2200e-6;
+
+    // time constant of the capacitor discharging through the solenoid
+    static constexpr double KICK_TAU_S = 4.4e-3;
+
+    // the capacitor slowly leaks through its bleed resistor
+    static constexpr double LEAK_TAU_S = 60;
+
+    void step(double dtS, bool charging, bool kicking) {
+        if (charging) {
+            // d(V^2)/dt = 2P/C
+            volts = std::sqrt(volts * volts + 2 * POWER_OVER_C * dtS);
+        }
+        if (kicking) volts *= std::exp(-dtS / KICK_TAU_S);
+        volts *= std::exp(-dtS / LEAK_TAU_S);
+    }
+
+    uint8_t adc() {
+        // +/- 1 count of noise from a small LCG so runs are repeatable
+        _seed = _seed * 1103515245 + 12345;
+        const int noise = static_cast<int>((_seed >> 16) % 3) - 1;
+        const int v = static_cast<int>(std::lround(volts)) + noise;
+        return static_cast<uint8_t>(std::min(255, std::max(0, v)));
+    }
+
+    double volts = 0;
+
+private:
+    uint32_t _seed = 1;
+};
+
+/// Result of charging from empty until the charger shuts off
+struct ChargeResult {
+    double cutoffDelayUs;  // after the true voltage reached the cutoff
+    double chargeTimeMs;
+    double peakVolts;
+};
+
+/// Charges the capacitor with the interrupt-driven logic
+ChargeResult chargeWithInterrupts() {
+    kicker_state s;
+    kicker_init(&s);
+    kicker_execute(&s, SET_CHARGE_CMD, ON_ARG);
+
+    CapacitorSim cap;
+    double crossedUs = -1;
+    ChargeResult result = {0, 0, 0};
+
+    for (int t = 0; t < 5000000; t++) {
+        if (t % ADC_PERIOD_US == 0) kicker_adc_sample(&s, cap.adc());
+        if (t % TICK_PERIOD_US == 0) kicker_tick_ms(&s);
+
+        const bool charging = s.outputs & KICKER_OUT_CHARGE;
+        cap.step(1e-6, charging, false);
+        result.peakVolts = std::max(result.peakVolts, cap.volts);
+
+        if (crossedUs < 0 && cap.volts >= KICKER_VOLTAGE_CUTOFF) crossedUs = t;
+        if (!charging) {
+            // noise can make it stop a little early, which counts as no delay
+            if (crossedUs >= 0) result.cutoffDelayUs = t - crossedUs;
+            result.chargeTimeMs = t / 1000.0;
+            break;
+        }
+    }
+    return result;
+}
+
+/// Charges the capacitor the way the old polling main loop did
+ChargeResult chargeWithPolling() {
+    CapacitorSim cap;
+    double crossedUs = -1;
+    bool charging = true;
+    uint8_t lastVoltage = 0;
+    ChargeResult result = {0, 0, 0};
+
+    for (int t = 0; t < 5000000; t++) {
+        if (t % LEGACY_LOOP_US == 0) {
+            const int kalpha = 32;
+            lastVoltage = cap.adc();
+            const int accum = (255 - kalpha) * lastVoltage + kalpha * cap.adc();
+            lastVoltage = accum / 255;
+            charging = lastVoltage < KICKER_VOLTAGE_CUTOFF;
+        }
+
+        cap.step(1e-6, charging, false);
+        result.peakVolts = std::max(result.peakVolts, cap.volts);
+
+        if (crossedUs < 0 && cap.volts >= KICKER_VOLTAGE_CUTOFF) crossedUs = t;
+        if (!charging) {
+            // noise can make it stop a little early, which counts as no delay
+            if (crossedUs >= 0) result.cutoffDelayUs = t - crossedUs;
+            result.chargeTimeMs = t / 1000.0;
+            break;
+        }
+    }
+    return result;
+}
+
+}  // namespace
+
+TEST(KickerControl, filterTracksVoltage) {
+    kicker_state s;
+    kicker_init(&s);
+
+    // reaches a new value exactly, and quickly
+    int samples = 0;
+    while (kicker_voltage(&s) != 100) {
+        kicker_adc_sample(&s, 100);
+        samples++;
+        ASSERT_LT(samples, 20);
+    }
+    EXPECT_LE(samples * ADC_PERIOD_US, 5000);
+
+    for (int i = 0; i < 20; i++) kicker_adc_sample(&s, 100);
+    EXPECT_EQ(100 << 8, s.voltage_q8);
+
+    // a single noisy sample only moves it part of the way
+    kicker_adc_sample(&s, 101);
+    EXPECT_LT(s.voltage_q8, 101 << 8);
+    kicker_adc_sample(&s, 99);
+    EXPECT_GT(s.voltage_q8, 99 << 8);
+
+    // and it comes all the way back down
+    for (int i = 0; i < 30; i++) kicker_adc_sample(&s, 0);
+    EXPECT_EQ(0, s.voltage_q8);
+}
+
+TEST(KickerControl, chargeCutoff) {
+    const ChargeResult polled = chargeWithPolling();
+    const ChargeResult isr = chargeWithInterrupts();
+
+    printf("               charge time   cutoff delay   peak voltage\n");
+    printf("  40 ms loop   %8.1f ms   %8.0f us    %6.2f\n",
+           polled.chargeTimeMs, polled.cutoffDelayUs, polled.peakVolts);
+    printf("  ADC ISR      %8.1f ms   %8.0f us    %6.2f\n", isr.chargeTimeMs,
+           isr.cutoffDelayUs, isr.peakVolts);
+
+    EXPECT_LT(isr.cutoffDelayUs, 1000);
+    EXPECT_LT(isr.peakVolts, KICKER_VOLTAGE_CUTOFF + 1);
+    EXPECT_LT(isr.cutoffDelayUs, polled.cutoffDelayUs);
+}
+
+TEST(KickerControl, chargeHysteresis) {
+    kicker_state s;
+    kicker_init(&s);
+    kicker_execute(&s, SET_CHARGE_CMD, ON_ARG);
+
+    for (int i = 0; i < 30; i++) kicker_adc_sample(&s, KICKER_VOLTAGE_CUTOFF);
+    EXPECT_FALSE(s.outputs & KICKER_OUT_CHARGE);
+
+    // a little droop doesn't turn the charger back on
+    for (int i = 0; i < 30; i++) {
+        kicker_adc_sample(&s, KICKER_VOLTAGE_CUTOFF - 2);
+    }
+    EXPECT_FALSE(s.outputs & KICKER_OUT_CHARGE);
+
+    for (int i = 0; i < 30; i++) {
+        kicker_adc_sample(&s, KICKER_VOLTAGE_CUTOFF -
+                                  KICKER_VOLTAGE_HYSTERESIS - 1);
+    }
+    EXPECT_TRUE(s.outputs & KICKER_OUT_CHARGE);
+
+    // and it goes off right away when charging isn't allowed anymore
+    kicker_execute(&s, SET_CHARGE_CMD, OFF_ARG);
+    EXPECT_FALSE(s.outputs & KICKER_OUT_CHARGE);
+}
+
+TEST(KickerControl, kickTiming) {
+    kicker_state s;
+    kicker_init(&s);
+    kicker_execute(&s, SET_CHARGE_CMD, ON_ARG);
+    kicker_adc_sample(&s, 50);
+    ASSERT_TRUE(s.outputs & KICKER_OUT_CHARGE);
+
+    kicker_execute(&s, KICK_CMD, 10);
+    EXPECT_TRUE(s.kick_started);
+    EXPECT_EQ(KICKER_OUT_KICK, s.outputs);
+
+    // the charger stays off for the whole kick, even as the voltage drops
+    int ticks = 0;
+    while (s.outputs & KICKER_OUT_KICK) {
+        kicker_adc_sample(&s, 10);
+        EXPECT_FALSE(s.outputs & KICKER_OUT_CHARGE);
+        kicker_tick_ms(&s);
+        ticks++;
+        ASSERT_LT(ticks, 20);
+    }
+    EXPECT_EQ(10, ticks);
+    EXPECT_TRUE(s.outputs & KICKER_OUT_CHARGE);
+
+    kicker_execute(&s, CHIP_CMD, 3);
+    EXPECT_EQ(KICKER_OUT_CHIP, s.outputs);
+
+    // a zero length kick is ignored, it would never end
+    kicker_init(&s);
+    kicker_execute(&s, KICK_CMD, 0);
+    EXPECT_EQ(0, s.outputs);
+    EXPECT_FALSE(kicker_is_kicking(&s));
+}
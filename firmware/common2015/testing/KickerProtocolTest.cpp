@@ -0,0 +1,256 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include "../drivers/kicker-board/kicker_control.h"
+#include "../drivers/kicker-board/kicker_protocol.h"
+
+namespace {
+/**
+ * KickerBoard's end of the protocol wired straight to the kicker firmware's,
+ * the same way the SPI bus and the ATtiny's interrupts connect them.
+ */
+class Loopback {
+public:
+    Loopback() {
+        kicker_master_init(&master);
+        kicker_init(&kicker);
+        _preload = kicker_spi_deselect(&kicker);
+    }
+
+    /**
+     * Runs one chip select.  @mosiError and @misoError flip bits in the byte
+     * at that index going to and coming from the kicker.
+     */
+    bool transfer(int mosiError = -1, int misoError = -1,
+                  uint8_t errorBits = 0x10) {
+        uint8_t tx[KICKER_MAX_TRANSFER_SIZE];
+        uint8_t rx[KICKER_MAX_TRANSFER_SIZE];
+        lastLength = kicker_master_begin(&master, tx);
+
+        kicker_spi_select(&kicker);
+        uint8_t next = _preload;
+        for (int i = 0; i < lastLength; i++) {
+            rx[i] = next ^ (i == misoError ? errorBits : 0);
+            next = kicker_spi_byte(&kicker,
+                                   tx[i] ^ (i == mosiError ? errorBits : 0));
+        }
+        _preload = kicker_spi_deselect(&kicker);
+        chipSelects++;
+
+        return kicker_master_end(&master, rx, &status);
+    }
+
+    kicker_master master;
+    kicker_state kicker;
+    kicker_status status = {};
+
+    int lastLength = 0;
+    int chipSelects = 0;
+
+private:
+    uint8_t _preload;
+};
+
+/// Bitwise CRC-8 (poly 0x07) to check the table driven one against
+uint8_t referenceCrc8(const uint8_t* data, int len) {
+    uint8_t crc = 0;
+    for (int i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+        }
+    }
+    return crc;
+}
+}  // namespace
+
+TEST(KickerProtocol, crc8) {
+    // the standard check value for CRC-8
+    const char* check = "123456789";
+    uint8_t crc = 0;
+    for (int i = 0; i < 9; i++) crc = kicker_crc8(crc, check[i]);
+    EXPECT_EQ(0xF4, crc);
+
+    for (int b = 0; b < 256; b++) {
+        const uint8_t data[] = {0x5A, uint8_t(b)};
+        EXPECT_EQ(referenceCrc8(data, 2),
+                  kicker_crc8(kicker_crc8(0, data[0]), data[1]));
+    }
+}
+
+TEST(KickerProtocol, statusInOneTransfer) {
+    Loopback link;
+    for (int i = 0; i < 30; i++) kicker_adc_sample(&link.kicker, 42);
+    kicker_execute(&link.kicker, SET_CHARGE_CMD, ON_ARG);
+
+    // voltage, charging state and ping all used to be separate transfers
+    ASSERT_TRUE(link.transfer());
+    EXPECT_EQ(1, link.chipSelects);
+    EXPECT_EQ(KICKER_STATUS_SIZE, link.lastLength);
+
+    EXPECT_EQ(42, link.status.voltage);
+    EXPECT_EQ(KICKER_STATUS_CHARGING | KICKER_STATUS_CHARGE_ALLOWED,
+              link.status.flags);
+    EXPECT_EQ(0xFFFF, link.status.kick_age_ms);
+    EXPECT_EQ(0, link.status.faults);
+    EXPECT_EQ(KICKER_ACK_NONE, link.master.ack);
+}
+
+TEST(KickerProtocol, commandsAreAcknowledged) {
+    Loopback link;
+    for (int i = 0; i < 30; i++) kicker_adc_sample(&link.kicker, 42);
+
+    EXPECT_TRUE(kicker_master_queue(&link.master, SET_CHARGE_CMD, ON_ARG));
+    EXPECT_TRUE(kicker_master_queue(&link.master, KICK_CMD, 10));
+    ASSERT_TRUE(link.transfer());
+    EXPECT_EQ(KICKER_FRAME_SIZE(2), link.lastLength);
+
+    // the kicker runs them as soon as the frame is in, but the status block
+    // was latched before that
+    EXPECT_TRUE(link.kicker.charge_allowed);
+    EXPECT_TRUE(kicker_is_kicking(&link.kicker));
+    EXPECT_EQ(0, link.status.flags);
+    EXPECT_EQ(KICKER_ACK_NONE, link.master.ack);
+
+    for (int i = 0; i < 4; i++) kicker_tick_ms(&link.kicker);
+
+    ASSERT_TRUE(link.transfer());
+    EXPECT_EQ(KICKER_ACK_OK, link.master.ack);
+    EXPECT_EQ(KICKER_STATUS_KICKING | KICKER_STATUS_CHARGE_ALLOWED,
+              link.status.flags);
+    EXPECT_EQ(4, link.status.kick_age_ms);
+
+    // nothing new was sent, so there's nothing to acknowledge
+    ASSERT_TRUE(link.transfer());
+    EXPECT_EQ(KICKER_ACK_NONE, link.master.ack);
+}
+
+TEST(KickerProtocol, corruptedFrameIsRejected) {
+    Loopback link;
+
+    // flip a bit in the kick time
+    kicker_master_queue(&link.master, KICK_CMD, 10);
+    ASSERT_TRUE(link.transfer(4));
+    EXPECT_FALSE(kicker_is_kicking(&link.kicker));
+
+    ASSERT_TRUE(link.transfer());
+    EXPECT_EQ(KICKER_ACK_LOST, link.master.ack);
+    EXPECT_EQ(KICKER_FAULT_BAD_FRAME, link.status.faults);
+
+    // a good frame clears the fault
+    kicker_master_queue(&link.master, KICK_CMD, 10);
+    ASSERT_TRUE(link.transfer());
+    EXPECT_EQ(10, link.kicker.kick_ms_left);
+    ASSERT_TRUE(link.transfer());
+    EXPECT_EQ(KICKER_ACK_OK, link.master.ack);
+    EXPECT_EQ(0, link.status.faults);
+}
+
+TEST(KickerProtocol, corruptedStatusIsRejected) {
+    Loopback link;
+    for (int i = 0; i < 30; i++) kicker_adc_sample(&link.kicker, 42);
+    ASSERT_TRUE(link.transfer());
+
+    for (int i = 0; i < 30; i++) kicker_adc_sample(&link.kicker, 60);
+    EXPECT_FALSE(link.transfer(-1, 1));
+    EXPECT_EQ(42, link.status.voltage);
+
+    ASSERT_TRUE(link.transfer());
+    EXPECT_EQ(60, link.status.voltage);
+}
+
+TEST(KickerProtocol, otherVersionIsRejected) {
+    kicker_master master;
+    kicker_master_init(&master);
+    kicker_status status = {};
+
+    // what the old protocol sent back: charging state, command ack, response
+    const uint8_t legacy[KICKER_STATUS_SIZE] = {0x84, 0x05, 0x00};
+    EXPECT_FALSE(kicker_master_end(&master, legacy, &status));
+
+    // a frame from a kicker a version ahead, which has a valid checksum
+    uint8_t newer[KICKER_STATUS_SIZE] = {KICKER_FRAME_START + 1, 42};
+    newer[KICKER_STATUS_SIZE - 1] =
+        referenceCrc8(newer, KICKER_STATUS_SIZE - 1);
+    EXPECT_FALSE(kicker_master_end(&master, newer, &status));
+    EXPECT_EQ(0, status.voltage);
+}
+
+TEST(KickerProtocol, malformedFrames) {
+    Loopback link;
+
+    // too many commands
+    for (int i = 0; i < KICKER_MAX_CMDS; i++) {
+        EXPECT_TRUE(kicker_master_queue(&link.master, PING_CMD, BLANK));
+    }
+    EXPECT_FALSE(kicker_master_queue(&link.master, PING_CMD, BLANK));
+    ASSERT_TRUE(link.transfer());
+    EXPECT_EQ(KICKER_MAX_TRANSFER_SIZE, link.lastLength);
+
+    kicker_frame_rx rx;
+    kicker_frame_rx_reset(&rx);
+    EXPECT_EQ(KICKER_RX_PENDING, kicker_frame_rx_byte(&rx, KICKER_FRAME_START));
+    EXPECT_EQ(KICKER_RX_PENDING, kicker_frame_rx_byte(&rx, 7));
+    EXPECT_EQ(KICKER_RX_BAD, kicker_frame_rx_byte(&rx, KICKER_MAX_CMDS + 1));
+
+    // unknown command
+    kicker_master_queue(&link.master, 0x7E, BLANK);
+    ASSERT_TRUE(link.transfer());
+    ASSERT_TRUE(link.transfer());
+    EXPECT_EQ(KICKER_ACK_OK, link.master.ack);
+    EXPECT_EQ(KICKER_FAULT_UNKNOWN_CMD, link.status.faults);
+
+    // chip select released in the middle of a frame
+    kicker_spi_select(&link.kicker);
+    kicker_spi_byte(&link.kicker, KICKER_FRAME_START);
+    kicker_spi_byte(&link.kicker, 9);
+    kicker_spi_deselect(&link.kicker);
+    ASSERT_TRUE(link.transfer());
+    EXPECT_TRUE(link.status.faults & KICKER_FAULT_BAD_FRAME);
+}
+
+TEST(KickerProtocol, noisyLink) {
+    Loopback link;
+    srand(1);
+
+    int sent = 0, executed = 0, acked = 0, lost = 0, badStatus = 0;
+    for (int i = 0; i < 5000; i++) {
+        // corrupt about one transfer in ten, on either side
+        const int error = rand() % 10 == 0 ? rand() % KICKER_FRAME_SIZE(1) : -1;
+        const bool mosi = rand() % 2;
+        const uint8_t bits = 1 << (rand() % 8);
+
+        const uint8_t time = 1 + rand() % 200;
+        kicker_master_queue(&link.master, KICK_CMD, time);
+        sent++;
+
+        if (!link.transfer(mosi ? error : -1, mosi ? -1 : error, bits)) {
+            badStatus++;
+        }
+        if (link.master.ack == KICKER_ACK_OK) acked++;
+        if (link.master.ack == KICKER_ACK_LOST) lost++;
+
+        // a kick only ever happens with the time that was sent
+        if (link.kicker.kick_started) {
+            EXPECT_EQ(time, link.kicker.kick_ms_left);
+            link.kicker.kick_started = false;
+            executed++;
+        }
+
+        // end the kick so the next one is visible
+        link.kicker.kick_ms_left = 1;
+        kicker_tick_ms(&link.kicker);
+    }
+
+    printf("  sent %d, executed %d, acked %d, lost %d, bad status %d\n", sent,
+           executed, acked, lost, badStatus);
+
+    // every kick that got through was executed once, and every one that
+    // didn't was reported
+    EXPECT_GT(executed, sent * 8 / 10);
+    EXPECT_LT(executed, sent);
+    EXPECT_LE(acked, executed);
+    EXPECT_EQ(sent - 1, acked + lost);
+}
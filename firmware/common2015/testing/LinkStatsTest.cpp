@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../utils/link-stats.hpp"
+
+namespace {
+/**
+ * A link that drops packets in bursts, using the usual two-state model: in
+ * the good state packets are rarely lost, in the bad state they mostly are.
+ * It keeps its own count of what it dropped to check LinkStats against.
+ */
+class FakeLossyLink {
+public:
+    FakeLossyLink(double goodLoss, double badLoss, double toBad, double toGood)
+        : _goodLoss(goodLoss),
+          _badLoss(badLoss),
+          _toBad(toBad),
+          _toGood(toGood),
+          _rng(35) {}
+
+    /// Sends the next packet through the link, and hands it to @stats if it
+    /// makes it
+    void send(LinkStats* stats) {
+        const uint8_t seq = _seq++;
+
+        _bad = _bad ? !chance(_toGood) : chance(_toBad);
+        if (chance(_bad ? _badLoss : _goodLoss)) {
+            lost++;
+            _burst++;
+            _recent.push_back(true);
+            return;
+        }
+
+        if (_burst) {
+            bursts.push_back(_burst);
+            _burst = 0;
+        }
+        _recent.push_back(false);
+
+        rtp::packet::RxQuality quality;
+        quality.valid = true;
+        quality.rssi = -60 + _noise(_rng);
+        quality.lqi = 100;
+        stats->received(seq, quality);
+    }
+
+    /// Fraction lost of the last @n packets, up to the last one received
+    double recentLoss(size_t n) const {
+        // LinkStats can't know about packets lost after the last one it got
+        size_t end = _recent.size();
+        while (end && _recent[end - 1]) end--;
+
+        size_t count = 0, total = 0;
+        for (size_t i = end; i > 0 && total < n; i--, total++) {
+            count += _recent[i - 1];
+        }
+        return total ? double(count) / total : 0;
+    }
+
+    unsigned int lost = 0;
+    std::vector<unsigned int> bursts;
+
+private:
+    bool chance(double p) { return _uniform(_rng) < p; }
+
+    double _goodLoss, _badLoss, _toBad, _toGood;
+    bool _bad = false;
+    unsigned int _burst = 0;
+    uint8_t _seq = 0;
+    std::vector<bool> _recent;
+
+    std::mt19937 _rng;
+    std::uniform_real_distribution<double> _uniform{0, 1};
+    std::normal_distribution<double> _noise{0, 3};
+};
+}  // namespace
+
+TEST(LinkStats, countsLossAndBursts) {
+    printf("  good loss  bad loss  lost (link / stats)  loss rate  bursts\n");
+    const double goodLoss = 0.02;
+    for (double badLoss : {0.0, 0.5, 0.9}) {
+        FakeLossyLink link(goodLoss, badLoss, 0.01, 0.2);
+        LinkStats stats;
+        for (int i = 0; i < 20000; i++) link.send(&stats);
+
+        // a run still going when the trace ended hasn't been seen yet
+        unsigned int seen = 0;
+        for (unsigned int b : link.bursts) seen += b;
+
+        EXPECT_EQ(seen, stats.lost);
+        EXPECT_EQ(0u, stats.resyncs);
+        EXPECT_EQ(0u, stats.duplicates);
+
+        // every run of lost packets lands in the right bucket
+        uint32_t expected[LinkStats::BURST_BUCKETS] = {};
+        unsigned int longest = 0;
+        for (unsigned int b : link.bursts) {
+            size_t i = 0;
+            while (i + 1 < LinkStats::BURST_BUCKETS &&
+                   b >= LinkStats::bucketStart(i + 1)) {
+                i++;
+            }
+            expected[i]++;
+            longest = std::max(longest, b);
+        }
+        for (size_t i = 0; i < LinkStats::BURST_BUCKETS; i++) {
+            EXPECT_EQ(expected[i], stats.bursts[i]) << "bucket " << i;
+        }
+        EXPECT_EQ(longest, stats.longestBurst);
+
+        EXPECT_NEAR(link.recentLoss(LinkStats::HISTORY), stats.lossRate(),
+                    1e-6);
+
+        printf("  %8.0f%%  %7.0f%%  %8u / %-8u  %8.1f%%  ", goodLoss * 100,
+               badLoss * 100, link.lost, stats.lost, stats.lossRate() * 100);
+        for (size_t i = 0; i < LinkStats::BURST_BUCKETS; i++) {
+            printf(" %u", stats.bursts[i]);
+        }
+        printf("\n");
+    }
+}
+
+TEST(LinkStats, sequenceWraps) {
+    LinkStats stats;
+    for (int seq = 250; seq < 256; seq++) stats.received(seq);
+    stats.received(1);  // lost 0
+    stats.received(2);
+
+    EXPECT_EQ(8u, stats.packets);
+    EXPECT_EQ(1u, stats.lost);
+    EXPECT_EQ(1u, stats.bursts[0]);
+}
+
+TEST(LinkStats, restartsAndDuplicates) {
+    LinkStats stats;
+    stats.received(40);
+    stats.received(41);
+    stats.received(41);
+
+    // the sender rebooted and started over
+    stats.received(0);
+    stats.received(1);
+
+    EXPECT_EQ(0u, stats.lost);
+    EXPECT_EQ(1u, stats.duplicates);
+    EXPECT_EQ(1u, stats.resyncs);
+    EXPECT_EQ(0, stats.lossRate());
+}
+
+TEST(LinkStats, averagesAndSummary) {
+    FakeLossyLink link(0.1, 0.1, 0, 0);
+    LinkStats stats;
+    for (int i = 0; i < 1000; i++) link.send(&stats);
+
+    ASSERT_TRUE(stats.hasQuality());
+    EXPECT_NEAR(-60, stats.rssi(), 3);
+    EXPECT_FLOAT_EQ(100, stats.lqi());
+
+    EXPECT_FALSE(stats.hasLatency());
+    for (float us : {3000.f, 5000.f, 1000.f}) stats.addLatencyUs(us);
+    EXPECT_TRUE(stats.hasLatency());
+    EXPECT_EQ(1000, stats.minLatencyUs);
+    EXPECT_EQ(5000, stats.maxLatencyUs);
+    EXPECT_GT(stats.latencyUs(), 1000);
+    EXPECT_LT(stats.latencyUs(), 5000);
+
+    const rtp::LinkSummary summary = stats.summary();
+    EXPECT_NEAR(stats.lossRate() * 100, summary.loss, 0.5);
+    EXPECT_NEAR(stats.rssi(), summary.rssi, 0.5);
+    EXPECT_EQ(100, summary.lqi);
+    EXPECT_EQ(stats.longestBurst, summary.longestBurst);
+
+    stats.reset();
+    EXPECT_EQ(0u, stats.packets);
+    EXPECT_FALSE(stats.hasQuality());
+}
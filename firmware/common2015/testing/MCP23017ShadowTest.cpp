@@ -0,0 +1,286 @@
+#include <gtest/gtest.h>
+
+#include "../drivers/mcp23017/mcp23017-shadow.hpp"
+#include "../drivers/rtos-i2c/I2CQueue.hpp"
+#include "FakeI2C.hpp"
+
+namespace {
+const uint8_t ADDR = 0x42;
+
+// Register addresses with IOCON.BANK = 0
+const uint8_t GPINTEN = 0x04;
+const uint8_t GPIO = 0x12;
+const uint8_t OLAT = 0x14;
+
+// Same as the robot: port A is inputs, port B is the error LEDs
+const uint16_t ERROR_LED_MASK = 0xFF00;
+const int ROTARY_PINS[] = {6, 4, 7, 5};
+const int DIP_SWITCH_PIN = 3;
+
+typedef i2c::Queue<fake_i2c::Bus, i2c::NullMutex, 32> Queue;
+
+/**
+ * An MCP23017 with working interrupt-on-change: INTA goes low when an input
+ * enabled in GPINTEN changes, and goes back high when GPIO is read.
+ */
+class FakeMCP23017 : public fake_i2c::RegisterDevice {
+public:
+    void setInputs(uint16_t value) {
+        const uint16_t old = gpio();
+        regs[GPIO] = value & 0xFF;
+        regs[GPIO + 1] = value >> 8;
+
+        const uint16_t enabled = regs[GPINTEN] | (regs[GPINTEN + 1] << 8);
+        if ((old ^ value) & enabled) intA = 0;
+    }
+
+    uint16_t gpio() const { return regs[GPIO] | (regs[GPIO + 1] << 8); }
+    uint16_t olat() const { return regs[OLAT] | (regs[OLAT + 1] << 8); }
+
+    void read(uint8_t* data, int len) override {
+        if (pointer == GPIO || pointer == GPIO + 1) intA = 1;
+        fake_i2c::RegisterDevice::read(data, len);
+    }
+
+    int intA = 1;
+};
+
+/// How the driver used to work: every pin read and every write went to the
+/// chip
+class PollingExpander {
+public:
+    explicit PollingExpander(Queue& queue) : _queue(queue) {}
+
+    int readPin(int pin) {
+        uint8_t data[2];
+        i2c::Transaction t(ADDR, i2c::PRIORITY_NORMAL);
+        t.setWrite(&GPIO, 1);
+        t.setRead(data, sizeof(data));
+        _queue.submit(t);
+        _queue.runAll();
+        return ((data[0] | (data[1] << 8)) >> pin) & 1;
+    }
+
+    void writeMask(uint16_t data, uint16_t mask) {
+        _gpio = (_gpio & ~mask) | data;
+        write(OLAT, _gpio);
+    }
+
+private:
+    void write(uint8_t reg, uint16_t value) {
+        i2c::Transaction t(ADDR, i2c::PRIORITY_LOW);
+        const uint8_t buf[] = {reg, uint8_t(value), uint8_t(value >> 8)};
+        t.setWrite(buf, sizeof(buf));
+        _queue.submit(t);
+        _queue.runAll();
+    }
+
+    Queue& _queue;
+    uint16_t _gpio = 0;
+};
+
+/// The register handling from MCP23017, against the fake bus
+class ShadowedExpander {
+public:
+    ShadowedExpander(Queue& queue, FakeMCP23017* chip)
+        : _queue(queue), _chip(chip) {
+        if (_chip) update(GPINTEN, _gpinten, 0x00FF);
+    }
+
+    void refresh() {
+        if (!_chip || _inputs.stale()) readInputs();
+    }
+
+    int readPin(int pin) {
+        if (_inputs.stale()) readInputs();
+        return _inputs.pin(pin);
+    }
+
+    void writeMask(uint16_t data, uint16_t mask) {
+        update(OLAT, _olat, data, mask);
+    }
+
+    /// Called when INTA falls
+    void inputsChanged() { _inputs.markStale(); }
+
+private:
+    void readInputs() {
+        uint8_t data[2];
+        i2c::Transaction t(ADDR, i2c::PRIORITY_NORMAL);
+        t.setWrite(&GPIO, 1);
+        t.setRead(data, sizeof(data));
+        _queue.submit(t);
+        _queue.runAll();
+        _inputs.update(data[0] | (data[1] << 8));
+
+        if (_chip && _chip->intA == 0) _inputs.markStale();
+    }
+
+    void update(uint8_t reg, MCP23017Shadow& shadow, uint16_t data,
+                uint16_t mask = 0xFFFF) {
+        if (!shadow.update(data, mask)) return;
+
+        const uint16_t value = shadow.value();
+        i2c::Transaction t(ADDR, i2c::PRIORITY_LOW);
+        const uint8_t buf[] = {reg, uint8_t(value), uint8_t(value >> 8)};
+        t.setWrite(buf, sizeof(buf));
+        _queue.submit(t);
+        _queue.runAll();
+    }
+
+    Queue& _queue;
+    FakeMCP23017* _chip;
+    MCP23017Shadow _olat, _gpinten;
+    MCP23017Inputs _inputs;
+};
+
+/// Switch positions, as seen on the GPIO inputs, for a shell ID and channel
+uint16_t switchInputs(int shellID, int channel) {
+    uint16_t gpio = channel << DIP_SWITCH_PIN;
+    for (int i = 0; i < 4; i++) gpio |= ((shellID >> i) & 1) << ROTARY_PINS[i];
+    return gpio;
+}
+
+struct LoopResult {
+    double transactionsPerLoop;
+    double busyUsPerLoop;
+    bool correct;
+};
+
+/**
+ * Runs the main loop's IO expander accesses for @iterations: the shell ID
+ * from the rotary selector, the radio channel from the DIP switch, and the
+ * error LEDs.  A few times during the run, the switches get flipped or the
+ * errors change.
+ */
+template <class EXPANDER>
+LoopResult runMainLoop(EXPANDER& expander, Queue& queue, fake_i2c::Bus& bus,
+                       FakeMCP23017& chip, int iterations,
+                       bool callRefresh) {
+    const double loopUs = 100;
+    uint16_t errors = 0;
+    bool correct = true;
+
+    queue.resetStats();
+    const double startBusyUs = bus.busyUs;
+
+    for (int i = 0; i < iterations; i++) {
+        // the switches get changed, and an error comes and goes
+        if (i == iterations / 4) chip.setInputs(switchInputs(0xA, 1));
+        if (i == iterations / 2) chip.setInputs(switchInputs(0x3, 0));
+        if (i == iterations / 3) errors = 1 << 2;
+        if (i == 2 * iterations / 3) errors = 0;
+
+        // INTA is wired to an InterruptIn
+        if (chip.intA == 0) expander.inputsChanged();
+
+        if (callRefresh) expander.refresh();
+
+        uint8_t shellID = 0;
+        for (int b = 0; b < 4; b++) {
+            shellID |= expander.readPin(ROTARY_PINS[b]) << b;
+        }
+        const int channel = expander.readPin(DIP_SWITCH_PIN);
+
+        expander.writeMask(~errors << 8, ERROR_LED_MASK);
+
+        const uint16_t expected = chip.gpio();
+        correct &= switchInputs(shellID, channel) == expected;
+        correct &= (chip.olat() >> 8) == uint8_t(~errors);
+
+        bus.idleUntil(bus.nowUs + loopUs);
+    }
+
+    LoopResult result;
+    result.transactionsPerLoop =
+        double(queue.stats().completed) / iterations;
+    result.busyUsPerLoop = (bus.busyUs - startBusyUs) / iterations;
+    result.correct = correct;
+    return result;
+}
+
+/// Dummy refresh/inputsChanged for the old driver, which had neither
+class PollingLoopExpander : public PollingExpander {
+public:
+    using PollingExpander::PollingExpander;
+    void refresh() {}
+    void inputsChanged() {}
+};
+}  // namespace
+
+TEST(MCP23017Shadow, onlyChangesAreWritten) {
+    MCP23017Shadow reg;
+
+    // the chip's value isn't known until it has been written once
+    EXPECT_TRUE(reg.update(0x0000));
+    EXPECT_FALSE(reg.update(0x0000));
+
+    EXPECT_TRUE(reg.update(0x1200, 0xFF00));
+    EXPECT_EQ(0x1200, reg.value());
+
+    // bits outside the mask are left alone
+    EXPECT_FALSE(reg.update(0x12FF, 0xFF00));
+    EXPECT_EQ(0x1200, reg.value());
+    EXPECT_TRUE(reg.update(0x0034, 0x00FF));
+    EXPECT_EQ(0x1234, reg.value());
+
+    reg.invalidate();
+    EXPECT_TRUE(reg.update(0x1234));
+}
+
+TEST(MCP23017Shadow, inputsStayCachedUntilStale) {
+    MCP23017Inputs inputs;
+    EXPECT_TRUE(inputs.stale());
+
+    inputs.update(0x0050);
+    EXPECT_FALSE(inputs.stale());
+    EXPECT_EQ(1, inputs.pin(4));
+    EXPECT_EQ(0, inputs.pin(5));
+    EXPECT_EQ(1, inputs.pin(6));
+
+    inputs.markStale();
+    EXPECT_TRUE(inputs.stale());
+    EXPECT_EQ(0x0050, inputs.value());
+}
+
+TEST(MCP23017Shadow, mainLoopTransactions) {
+    const int iterations = 1000;
+
+    fake_i2c::Bus bus;
+    FakeMCP23017 chip;
+    bus.attach(ADDR, &chip);
+    Queue queue(bus);
+
+    chip.setInputs(switchInputs(0x5, 0));
+    PollingLoopExpander polling(queue);
+    const LoopResult before =
+        runMainLoop(polling, queue, bus, chip, iterations, false);
+
+    // without INTA hooked up, refresh() reads all the inputs at once
+    chip.setInputs(switchInputs(0x5, 0));
+    ShadowedExpander noInterrupt(queue, nullptr);
+    const LoopResult refreshed =
+        runMainLoop(noInterrupt, queue, bus, chip, iterations, true);
+
+    chip.setInputs(switchInputs(0x5, 0));
+    ShadowedExpander interrupt(queue, &chip);
+    const LoopResult interruptDriven =
+        runMainLoop(interrupt, queue, bus, chip, iterations, true);
+
+    printf("                       transactions/loop   bus time/loop\n");
+    printf("  per pin reads        %6.3f              %6.1f us\n",
+           before.transactionsPerLoop, before.busyUsPerLoop);
+    printf("  one read per loop    %6.3f              %6.1f us\n",
+           refreshed.transactionsPerLoop, refreshed.busyUsPerLoop);
+    printf("  interrupt-on-change  %6.3f              %6.1f us\n",
+           interruptDriven.transactionsPerLoop, interruptDriven.busyUsPerLoop);
+
+    EXPECT_TRUE(before.correct);
+    EXPECT_TRUE(refreshed.correct);
+    EXPECT_TRUE(interruptDriven.correct);
+
+    // five pin reads and an LED write each time around
+    EXPECT_DOUBLE_EQ(6, before.transactionsPerLoop);
+    EXPECT_LT(refreshed.transactionsPerLoop, 1.01);
+    EXPECT_LT(interruptDriven.transactionsPerLoop, 0.02);
+}
@@ -0,0 +1,244 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../utils/motion-profiler.hpp"
+
+namespace {
+const float DT = 0.005;  // the control loop's period, in s
+
+/// Profiles a step on the x axis from 0 to @target
+std::vector<float> stepResponse(const MotionProfiler::Limits& limits,
+                                float target, int ticks) {
+    MotionProfiler profiler;
+    profiler.setLimits(limits);
+    std::vector<float> vels;
+    const float targets[3] = {target, 0, 0};
+    for (int i = 0; i < ticks; i++) {
+        float out[3];
+        profiler.update(targets, DT, out);
+        vels.push_back(out[0]);
+    }
+    return vels;
+}
+}  // namespace
+
+TEST(MotionProfiler, passesThroughWithoutLimits) {
+    MotionProfiler profiler;
+    const float target[3] = {2, -1, 6};
+    float out[3];
+    profiler.update(target, DT, out);
+    EXPECT_EQ(2, out[0]);
+    EXPECT_EQ(-1, out[1]);
+    EXPECT_EQ(6, out[2]);
+}
+
+TEST(MotionProfiler, limitsAcceleration) {
+    const auto vels = stepResponse({{4, 0, 0}, {0, 0, 0}}, 2, 200);
+
+    // 2 m/s at 4 m/s^2 takes 0.5 s, at the limit the whole way
+    float last = 0;
+    for (size_t i = 0; i < vels.size(); i++) {
+        EXPECT_LE(vels[i] - last, 4 * DT + 1e-5) << i;
+        EXPECT_LE(vels[i], 2);
+        last = vels[i];
+    }
+    EXPECT_NEAR(1, vels[49], 1e-4);
+    EXPECT_NEAR(2, vels[99], 1e-4);
+    EXPECT_EQ(2, vels[100]);
+}
+
+TEST(MotionProfiler, limitsJerk) {
+    const float accel = 4, jerk = 80;
+    const auto vels = stepResponse({{accel, 0, 0}, {jerk, 0, 0}}, 2, 400);
+
+    float lastVel = 0, lastAccel = 0;
+    for (size_t i = 0; i < vels.size(); i++) {
+        const float a = (vels[i] - lastVel) / DT;
+        EXPECT_LE(a, accel + 1e-3) << i;
+        EXPECT_GE(a, -1e-3) << i;
+
+        // the acceleration ramps, except for the last little bit where it
+        // lands on the target
+        if (vels[i] != 2) {
+            EXPECT_LE(std::abs(a - lastAccel), jerk * DT + 1e-2) << i;
+        }
+        EXPECT_LE(vels[i], 2);
+        lastVel = vels[i];
+        lastAccel = a;
+    }
+
+    // ramping up and down takes accel / jerk more than accel alone
+    const auto reached = std::find(vels.begin(), vels.end(), 2.0f);
+    ASSERT_NE(vels.end(), reached);
+    const float seconds = (reached - vels.begin() + 1) * DT;
+    EXPECT_NEAR(2 / accel + accel / jerk, seconds, 4 * DT);
+}
+
+TEST(MotionProfiler, reversesSmoothly) {
+    MotionProfiler profiler;
+    profiler.setLimits({{4, 4, 30}, {80, 80, 600}});
+
+    // targets flipping around faster than the profile can follow
+    std::mt19937 rng(40);
+    std::uniform_real_distribution<float> any(-3, 3);
+    float target[3] = {};
+    float last[3] = {};
+    for (int i = 0; i < 20000; i++) {
+        if (i % 7 == 0) {
+            for (float& t : target) t = any(rng);
+        }
+        float out[3];
+        profiler.update(target, DT, out);
+        for (int axis = 0; axis < 3; axis++) {
+            const float a = (out[axis] - last[axis]) / DT;
+            const float maxAccel = axis == 2 ? 30 : 4;
+            ASSERT_LE(std::abs(a), maxAccel + 1e-2);
+            last[axis] = out[axis];
+        }
+    }
+
+    // and it settles when the target does
+    for (int i = 0; i < 400; i++) {
+        float out[3];
+        profiler.update(target, DT, out);
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        EXPECT_EQ(target[axis], profiler.velocity(axis));
+        EXPECT_EQ(0, profiler.acceleration(axis));
+    }
+}
+
+namespace {
+/**
+ * One drive wheel pushing a quarter of the robot along its axis, with a
+ * simple DC motor model and a traction limit.  The controller is the same
+ * feedforward + PI that PidMotionController runs, every 5 ms, on the wheel
+ * velocity it measures from the encoder.
+ */
+struct WheelSim {
+    // quarter of a 2.5 kg robot on carpet
+    const double mass = 2.5 / 4;
+    const double traction = 0.8 * mass * 9.81;
+    const double slipStiffness = 200;  // N per m/s of slip
+
+    // motor, as seen from the wheel, with the back EMF the feedforward in
+    // RobotModel2015 expects
+    const double radius = 0.02856;
+    const double inertia = 2e-5;    // kg m^2
+    const double resistance = 1.2;  // ohms
+    const double supply = 18;       // V
+    const double dutyPerRadS = 9;   // RobotModel2015.DutyCycleMultiplier
+    const double ke = supply / 511 * dutyPerRadS;  // V s/rad, and Nm/A
+
+    double wheelVel = 0;  // rad/s
+    double bodyVel = 0;   // m/s
+    double measured = 0;  // average wheelVel over the last tick
+    double integral = 0;
+
+    struct Result {
+        double rmsError = 0;    // body velocity vs the command, m/s
+        double peakCurrent = 0;
+        double slipTime = 0;    // s
+        double windupTime = 0;  // s with the integrator at its limit
+        double settleTime = 0;  // average time to get within 5%, s
+    };
+
+    Result run(bool profiled) {
+        MotionProfiler profiler;
+        profiler.setLimits({{4, 4, 30}, {80, 80, 600}});
+
+        const double physicsDt = 1e-5;
+        const int physicsSteps = DT / physicsDt;
+        const float commands[] = {0, 2, 2, -2, -1, 1.5, 0, 0};
+        const int ticksPerCommand = 200;
+
+        Result result;
+        int ticks = 0;
+        float last = 0;
+        int changes = 0;
+        for (float command : commands) {
+            bool settled = command == last;
+            if (!settled) changes++;
+            last = command;
+            for (int t = 0; t < ticksPerCommand; t++) {
+                const float target[3] = {command, 0, 0};
+                float out[3] = {command, 0, 0};
+                if (profiled) profiler.update(target, DT, out);
+
+                // controller, on the last tick's average wheel speed
+                const double targetWheel = out[0] / radius;
+                double duty = targetWheel * dutyPerRadS;
+                const double err = targetWheel - measured;
+                integral = std::max(-5.0, std::min(5.0, integral + err * DT));
+                duty += 0.8 * err + 0.05 * integral;
+                duty = std::max(-511.0, std::min(511.0, duty));
+
+                double travelled = 0;
+                for (int s = 0; s < physicsSteps; s++) {
+                    const double volts = duty / 511 * supply;
+                    const double current =
+                        (volts - ke * wheelVel) / resistance;
+                    result.peakCurrent =
+                        std::max(result.peakCurrent, std::abs(current));
+
+                    const double slip = wheelVel * radius - bodyVel;
+                    const double ground =
+                        std::max(-traction,
+                                 std::min(traction, slipStiffness * slip));
+                    if (std::abs(slip) > 0.05) result.slipTime += physicsDt;
+
+                    wheelVel += (ke * current - ground * radius) / inertia *
+                                physicsDt;
+                    bodyVel += ground / mass * physicsDt;
+                    travelled += wheelVel * physicsDt;
+                }
+                measured = travelled / DT;
+
+                const double error = bodyVel - command;
+                result.rmsError += error * error;
+                if (std::abs(integral) >= 5) result.windupTime += DT;
+                if (!settled) {
+                    result.settleTime += DT;
+                    settled = std::abs(bodyVel - command) <
+                              0.05 * std::max(1.0f, std::abs(command));
+                }
+                ticks++;
+            }
+        }
+        result.rmsError = std::sqrt(result.rmsError / ticks);
+        result.settleTime /= changes;
+        return result;
+    }
+};
+}  // namespace
+
+TEST(MotionProfiler, wheelSimulation) {
+    const auto raw = WheelSim().run(false);
+    const auto profiled = WheelSim().run(true);
+
+    printf(
+        "             rms error   peak current   wheel slip   windup   "
+        "settling\n");
+    for (const auto& r : {std::make_pair("steps", raw),
+                          std::make_pair("profiled", profiled)}) {
+        printf(
+            "  %-8s   %5.3f m/s   %10.1f A   %7.0f ms   %3.0f ms   %5.0f ms\n",
+            r.first, r.second.rmsError, r.second.peakCurrent,
+            r.second.slipTime * 1000, r.second.windupTime * 1000,
+            r.second.settleTime * 1000);
+    }
+
+    // stepping the command slams the motors, spins the wheels, and winds up
+    // the wheel PIDs.  Profiled, the robot gets there a little later, at the
+    // acceleration limit rather than the traction limit, but the wheels keep
+    // their grip.
+    EXPECT_LT(profiled.peakCurrent, raw.peakCurrent * 0.5);
+    EXPECT_LT(profiled.slipTime, raw.slipTime * 0.1);
+    EXPECT_LE(profiled.windupTime, raw.windupTime);
+    EXPECT_LT(profiled.settleTime, raw.settleTime * 1.5);
+}
@@ -0,0 +1,198 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+
+#include "../utils/motor-protection.hpp"
+
+namespace {
+const float DT = 0.005;  // the control loop's period, in s
+
+/**
+ * Drives motor 0 with a duty cycle profile, through the protection, for
+ * @seconds.  @load gives how much of its no-load speed the motor loses at a
+ * point in time, from 0 for free running to 1 for jammed, and the motor
+ * approaches its loaded speed with a 20 ms time constant.
+ */
+struct StallRun {
+    float firstStall = -1;  // s
+    float heatAtStall = 0;
+    float firstDerate = -1;
+    float offTime = 0;
+    float maxHeat = 0;
+    float peakCurrent = 0;
+};
+
+StallRun simulate(MotorProtection* protection, float seconds,
+                  std::function<float(float t)> duty,
+                  std::function<float(float t)> load) {
+    StallRun run;
+    float speed = 0;
+    int16_t applied[MotorProtection::NUM_MOTORS] = {};
+    for (float t = 0; t < seconds; t += DT) {
+        int16_t cmd[MotorProtection::NUM_MOTORS] = {};
+        cmd[0] = duty(t) * MotorProtection::MAX_DUTY;
+        protection->limit(cmd);
+
+        const float d = cmd[0] / float(MotorProtection::MAX_DUTY);
+        const float loaded = d * (1 - load(t));
+        speed += (loaded - speed) * DT / 0.02f;
+
+        // what actually flows, the same way the model estimates it
+        run.peakCurrent = std::max(run.peakCurrent,
+                                   15 * std::max(0.0f, std::fabs(d) -
+                                                           std::fabs(speed)));
+
+        float speeds[MotorProtection::NUM_MOTORS] = {speed};
+        std::copy(cmd, cmd + MotorProtection::NUM_MOTORS, applied);
+        protection->update(applied, speeds, DT);
+
+        const auto state = protection->state(0);
+        if (state == MotorProtection::STALLED && run.firstStall < 0) {
+            run.firstStall = t;
+            run.heatAtStall = protection->heat(0);
+        }
+        if (state == MotorProtection::DERATED && run.firstDerate < 0) {
+            run.firstDerate = t;
+        }
+        if (cmd[0] == 0 && duty(t) != 0) run.offTime += DT;
+        run.maxHeat = std::max(run.maxHeat, protection->heat(0));
+    }
+    return run;
+}
+
+std::function<float(float)> constant(float value) {
+    return [value](float) { return value; };
+}
+}  // namespace
+
+TEST(MotorProtection, freeRunningNeverTrips) {
+    MotorProtection protection;
+    const StallRun run = simulate(&protection, 60, constant(1), constant(0.05));
+    EXPECT_LT(run.firstStall, 0);
+    EXPECT_LT(run.firstDerate, 0);
+    EXPECT_EQ(0, run.offTime);
+    EXPECT_EQ(0u, protection.stalls);
+}
+
+TEST(MotorProtection, accelerationDoesntTrip) {
+    // full reversals every half second, with the motor spinning up each time
+    MotorProtection protection;
+    const StallRun run = simulate(
+        &protection, 60,
+        [](float t) { return std::fmod(t, 1) < 0.5 ? 1.0f : -1.0f; },
+        constant(0.2));
+    EXPECT_LT(run.firstStall, 0);
+    EXPECT_EQ(0u, protection.stalls);
+}
+
+TEST(MotorProtection, detectsJams) {
+    printf("  duty   jammed at   stalled at   heat   peak current\n");
+    for (float duty : {0.3f, 0.5f, 1.0f}) {
+        MotorProtection protection;
+        const StallRun run =
+            simulate(&protection, 3, constant(duty),
+                     [](float t) { return t > 1 ? 1.0f : 0.0f; });
+        printf("  %3.0f%%   %7.2f s   %8.2f s   %3.0f%%   %9.1f A\n",
+               duty * 100, 1.0, run.firstStall, run.heatAtStall * 100,
+               run.peakCurrent);
+
+        // quickly, and sooner the harder it's pushed
+        ASSERT_GT(run.firstStall, 1);
+        const float expected = MotorProtection::STALL_THRESHOLD /
+                               (duty - MotorProtection::STALL_DECAY);
+        EXPECT_LT(run.firstStall - 1, expected + 0.1);
+
+        // and before it starts to get hot
+        EXPECT_LT(run.heatAtStall, float(MotorProtection::DERATE_START));
+    }
+
+    // too gentle to count
+    MotorProtection protection;
+    const StallRun gentle =
+        simulate(&protection, 10, constant(0.1), constant(1));
+    EXPECT_EQ(0u, protection.stalls);
+    EXPECT_LT(gentle.firstStall, 0);
+}
+
+TEST(MotorProtection, retriesAfterStall) {
+    MotorProtection protection;
+
+    // jammed for 2.5 s, then freed
+    const StallRun run =
+        simulate(&protection, 8, constant(1),
+                 [](float t) { return t < 2.5 ? 1.0f : 0.0f; });
+
+    // it's tried again each cooldown while jammed, and then stays on
+    EXPECT_EQ(2u, protection.stalls);
+    EXPECT_EQ(MotorProtection::OK, protection.state(0));
+    EXPECT_EQ(0, protection.stalledMask());
+    EXPECT_GT(run.offTime, 1.5);
+    EXPECT_LT(run.offTime, 3.5);
+}
+
+TEST(MotorProtection, deratesUnderSustainedLoad) {
+    // pushing hard against something that gives a little, like another robot
+    MotorProtection protection;
+    const StallRun run =
+        simulate(&protection, 60, constant(1), constant(0.5));
+    printf("  derated after %.1f s, peak heat %.0f%%, stalls %u\n",
+           run.firstDerate, run.maxHeat * 100, protection.stalls);
+
+    // it settles at a duty cycle it can keep up
+    ASSERT_GT(run.firstDerate, 0);
+    EXPECT_LT(run.maxHeat, 1.0f);
+    EXPECT_EQ(0u, protection.stalls);
+    EXPECT_EQ(MotorProtection::DERATED, protection.state(0));
+    EXPECT_EQ(1, protection.hotMask());
+
+    // and recovers when it backs off
+    simulate(&protection, 120, constant(0.3), constant(0));
+    EXPECT_EQ(MotorProtection::OK, protection.state(0));
+    EXPECT_LT(protection.heat(0), 0.1);
+}
+
+TEST(MotorProtection, overheatsFasterThanItCanDerate) {
+    // a motor that heats up faster than derating can keep up with is shut off
+    // until it cools, and then comes back
+    MotorProtection protection;
+    protection.setParams(0, {15, 2, 0.05});
+    bool overheated = false;
+    bool recovered = false;
+    simulate(&protection, 60, constant(1), [&](float) {
+        if (protection.state(0) == MotorProtection::OVERHEATED) {
+            overheated = true;
+        } else if (overheated) {
+            recovered = true;
+        }
+        return 0.6f;
+    });
+    EXPECT_TRUE(overheated);
+    EXPECT_TRUE(recovered);
+}
+
+TEST(MotorProtection, limitStallsOnlyCutsStalls) {
+    const int16_t maxDuty = MotorProtection::MAX_DUTY;
+    int16_t full[MotorProtection::NUM_MOTORS];
+    std::fill(full, full + MotorProtection::NUM_MOTORS, maxDuty);
+
+    // a derated motor keeps its duty cycle
+    MotorProtection hot;
+    simulate(&hot, 60, constant(1), constant(0.5));
+    ASSERT_EQ(MotorProtection::DERATED, hot.state(0));
+    int16_t duty[MotorProtection::NUM_MOTORS];
+    std::copy(full, full + MotorProtection::NUM_MOTORS, duty);
+    hot.limitStalls(duty);
+    EXPECT_EQ(maxDuty, duty[0]);
+
+    // and a jammed one is shut off
+    MotorProtection jammed;
+    simulate(&jammed, 1, constant(1), constant(1));
+    ASSERT_EQ(MotorProtection::STALLED, jammed.state(0));
+    std::copy(full, full + MotorProtection::NUM_MOTORS, duty);
+    jammed.limitStalls(duty);
+    EXPECT_EQ(0, duty[0]);
+    EXPECT_EQ(maxDuty, duty[1]);
+}
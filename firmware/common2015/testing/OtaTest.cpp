@@ -0,0 +1,361 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <random>
+
+#include "../modules/Ota/OtaReceiver.hpp"
+#include "../modules/Ota/OtaSender.hpp"
+#include "../utils/heartbeat-supervisor.hpp"
+
+using namespace ota;
+
+namespace {
+// RAM-backed staging area
+class FakeStaging {
+public:
+    bool begin(uint32_t size) {
+        data.assign(size, 0);
+        committed = false;
+        return true;
+    }
+
+    bool write(uint32_t offset, const uint8_t* buf, size_t len) {
+        if (offset + len > data.size()) return false;
+        memcpy(&data[offset], buf, len);
+        return true;
+    }
+
+    bool read(uint32_t offset, uint8_t* buf, size_t len) {
+        if (offset + len > data.size()) return false;
+        memcpy(buf, &data[offset], len);
+        return true;
+    }
+
+    bool commit() {
+        committed = true;
+        return true;
+    }
+
+    void abort() { data.clear(); }
+
+    std::vector<uint8_t> data;
+    bool committed = false;
+};
+
+/**
+ * Staging on a slow filesystem, like the mbed's, in CommModule's RX thread
+ * under a watchdog supervisor.  Every chunk read or written takes @msPerChunk,
+ * and checks in like LocalFileStaging does, and the main loop checks on the
+ * supervisor in between.
+ */
+class SupervisedStaging : public FakeStaging {
+public:
+    static const uint8_t RX_THREAD = 4;
+    static const uint32_t DEADLINE_MS = 1000;
+
+    explicit SupervisedStaging(uint32_t msPerChunk) : _msPerChunk(msPerChunk) {
+        supervisor.add("comm-rx", RX_THREAD, DEADLINE_MS, 0);
+    }
+
+    bool read(uint32_t offset, uint8_t* buf, size_t len) {
+        step();
+        return FakeStaging::read(offset, buf, len);
+    }
+
+    /// Copies the image out, and reads it back, a chunk at a time
+    bool commit() {
+        for (size_t i = 0; i < 2 * numChunks(data.size()); i++) step();
+        return FakeStaging::commit();
+    }
+
+    HeartbeatSupervisor supervisor;
+    uint32_t nowMs = 0;
+    bool healthy = true;
+
+private:
+    void step() {
+        nowMs += _msPerChunk;
+        supervisor.checkIn(supervisor.find(RX_THREAD), nowMs);
+        healthy &= supervisor.check(nowMs);
+    }
+
+    uint32_t _msPerChunk;
+};
+
+std::vector<uint8_t> makeImage(size_t size, unsigned int seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> img(size);
+    for (auto& b : img) b = rng();
+    return img;
+}
+
+/**
+ * Stands in for the CommLink + radio between the base station and the
+ * robots.  Each robot independently drops a broadcast packet with the given
+ * probability, and replies are dropped with the same probability.
+ *
+ * Time is modeled as 1ms per call to Sender::poll(), which is about what it
+ * takes to get a full-sized packet through CommModule and the radio.
+ */
+class LossyLink {
+public:
+    struct Robot {
+        FakeStaging staging;
+        Receiver<FakeStaging> receiver;
+        explicit Robot(uint8_t uid) : receiver(staging, uid) {}
+    };
+
+    LossyLink(double lossRate, unsigned int seed)
+        : _rng(seed), _loss(lossRate) {}
+
+    void addRobot(uint8_t uid) { robots.emplace_back(new Robot(uid)); }
+
+    void transmit(const std::vector<uint8_t>& payload) {
+        packetsSent++;
+        for (auto& robot : robots) {
+            if (dropped()) continue;
+
+            std::vector<uint8_t> reply;
+            if (robot->receiver.handle(payload.data(), payload.size(),
+                                       &reply) &&
+                !dropped()) {
+                _replies.push_back(reply);
+            }
+        }
+    }
+
+    /// Run a transfer to completion, returning the simulated time in ms
+    uint32_t run(Sender& sender, uint32_t limitMs) {
+        uint32_t now = 0;
+        while (now < limitMs && sender.poll(now)) {
+            for (const auto& r : _replies)
+                sender.handleReply(r.data(), r.size());
+            _replies.clear();
+            now++;
+        }
+        return now;
+    }
+
+    std::vector<std::unique_ptr<Robot>> robots;
+    unsigned int packetsSent = 0;
+
+private:
+    bool dropped() { return _dist(_rng) < _loss; }
+
+    std::mt19937 _rng;
+    std::uniform_real_distribution<double> _dist{0.0, 1.0};
+    double _loss;
+    std::vector<std::vector<uint8_t>> _replies;
+};
+
+/// Send @img to @numRobots robots over a link that drops @loss of packets
+std::unique_ptr<LossyLink> simulate(double loss, size_t numRobots,
+                                    const std::vector<uint8_t>& img,
+                                    unsigned int seed, uint32_t* timeMs) {
+    std::unique_ptr<LossyLink> link(new LossyLink(loss, seed));
+
+    std::vector<uint8_t> uids;
+    for (size_t i = 0; i < numRobots; i++) {
+        link->addRobot(i);
+        uids.push_back(i);
+    }
+
+    LossyLink* l = link.get();
+    Sender sender(img.data(), img.size(), 0x1234, uids,
+                  [l](std::vector<uint8_t> p) { l->transmit(p); });
+    *timeMs = link->run(sender, 10 * 60 * 1000);
+
+    return link;
+}
+}  // namespace
+
+TEST(OtaReceiver, rejectsBadChunk) {
+    FakeStaging staging;
+    Receiver<FakeStaging> rx(staging, 3);
+    std::vector<uint8_t> img = makeImage(200, 1);
+    std::vector<uint8_t> buf, reply;
+
+    BeginMsg begin{MSG_BEGIN, 7, 200, crc::crc32(img.data(), img.size())};
+    append(begin, &buf);
+    rx.handle(buf.data(), buf.size(), &reply);
+    EXPECT_EQ(STATE_RECEIVING, rx.state());
+    EXPECT_EQ(3u, rx.totalChunks());
+
+    // chunk with a bad CRC is dropped
+    DataHeader hdr{MSG_DATA, 7, 1, 0};
+    hdr.crc = crc::crc16(&img[CHUNK_SIZE], CHUNK_SIZE) ^ 1;
+    buf.clear();
+    append(hdr, &buf);
+    buf.insert(buf.end(), &img[CHUNK_SIZE], &img[2 * CHUNK_SIZE]);
+    rx.handle(buf.data(), buf.size(), &reply);
+    EXPECT_EQ(0u, rx.chunksReceived());
+    EXPECT_EQ(1u, rx.badChunks());
+
+    // so is one from another session
+    hdr.crc ^= 1;
+    hdr.session = 8;
+    memcpy(buf.data(), &hdr, sizeof(hdr));
+    rx.handle(buf.data(), buf.size(), &reply);
+    EXPECT_EQ(0u, rx.chunksReceived());
+
+    // the right one is kept, and reported in the status bitmap
+    hdr.session = 7;
+    memcpy(buf.data(), &hdr, sizeof(hdr));
+    rx.handle(buf.data(), buf.size(), &reply);
+    EXPECT_EQ(1u, rx.chunksReceived());
+
+    buf.clear();
+    append(AddressedMsg{MSG_QUERY, 7, 3}, &buf);
+    ASSERT_TRUE(rx.handle(buf.data(), buf.size(), &reply));
+    StatusMsg status;
+    ASSERT_TRUE(parse(reply.data(), reply.size(), &status));
+    EXPECT_EQ(0, status.nextMissing);
+    EXPECT_EQ(1u, status.bitmap);
+    EXPECT_EQ(STATE_RECEIVING, status.state);
+
+    // queries for other robots are ignored
+    buf.clear();
+    append(AddressedMsg{MSG_QUERY, 7, 4}, &buf);
+    EXPECT_FALSE(rx.handle(buf.data(), buf.size(), &reply));
+}
+
+TEST(OtaReceiver, rejectsCorruptImage) {
+    FakeStaging staging;
+    Receiver<FakeStaging> rx(staging, 0);
+    std::vector<uint8_t> img = makeImage(150, 2);
+    std::vector<uint8_t> buf, reply;
+
+    // advertise the wrong image CRC
+    append(BeginMsg{MSG_BEGIN, 1, 150, 0xDEADBEEF}, &buf);
+    rx.handle(buf.data(), buf.size(), &reply);
+
+    for (uint16_t c = 0; c < 2; c++) {
+        const size_t len = chunkLength(150, c);
+        buf.clear();
+        const uint8_t* chunk = &img[c * CHUNK_SIZE];
+        append(DataHeader{MSG_DATA, 1, c, crc::crc16(chunk, len)}, &buf);
+        buf.insert(buf.end(), chunk, chunk + len);
+        rx.handle(buf.data(), buf.size(), &reply);
+    }
+    EXPECT_EQ(STATE_COMPLETE, rx.state());
+
+    buf.clear();
+    append(AddressedMsg{MSG_COMMIT, 1, 0}, &buf);
+    ASSERT_TRUE(rx.handle(buf.data(), buf.size(), &reply));
+    EXPECT_EQ(STATE_ERROR, rx.state());
+    EXPECT_FALSE(staging.committed);
+}
+
+TEST(OtaReceiver, repeatedBeginKeepsProgress) {
+    FakeStaging staging;
+    Receiver<FakeStaging> rx(staging, 0);
+    std::vector<uint8_t> img = makeImage(300, 3);
+    std::vector<uint8_t> begin, buf, reply;
+
+    append(BeginMsg{MSG_BEGIN, 5, 300, crc::crc32(img.data(), 300)}, &begin);
+    rx.handle(begin.data(), begin.size(), &reply);
+
+    append(DataHeader{MSG_DATA, 5, 0, crc::crc16(img.data(), CHUNK_SIZE)},
+           &buf);
+    buf.insert(buf.end(), img.begin(), img.begin() + CHUNK_SIZE);
+    rx.handle(buf.data(), buf.size(), &reply);
+    ASSERT_EQ(1u, rx.chunksReceived());
+
+    rx.handle(begin.data(), begin.size(), &reply);
+    EXPECT_EQ(1u, rx.chunksReceived());
+
+    // a new session starts over
+    begin[1] = 6;
+    rx.handle(begin.data(), begin.size(), &reply);
+    EXPECT_EQ(0u, rx.chunksReceived());
+    EXPECT_EQ(6, rx.session());
+}
+
+TEST(OtaSender, broadcastToSixRobots) {
+    std::vector<uint8_t> img = makeImage(20 * 1024 + 17, 4);
+    uint32_t t;
+    auto link = simulate(0.1, 6, img, 42, &t);
+
+    for (const auto& robot : link->robots) {
+        EXPECT_EQ(STATE_COMMITTED, robot->receiver.state());
+        EXPECT_TRUE(robot->staging.committed);
+        EXPECT_EQ(img, robot->staging.data);
+    }
+    EXPECT_LT(t, 10u * 60 * 1000);
+}
+
+TEST(OtaSender, robotOffline) {
+    std::vector<uint8_t> img = makeImage(1000, 5);
+    LossyLink link(0, 1);
+    link.addRobot(0);
+
+    // robot 1 never answers, so it's given up on without stalling robot 0
+    Sender sender(img.data(), img.size(), 1, {0, 1},
+                  [&link](std::vector<uint8_t> p) { link.transmit(p); });
+    link.run(sender, 60 * 1000);
+
+    ASSERT_TRUE(sender.finished());
+    EXPECT_EQ(STATE_COMMITTED, link.robots[0]->receiver.state());
+    EXPECT_TRUE(sender.targets()[1].failed);
+    EXPECT_FALSE(sender.targets()[0].failed);
+}
+
+// Not really a test - prints how long a transfer takes as packet loss goes up
+TEST(OtaSender, transferTimeVsLoss) {
+    std::vector<uint8_t> img = makeImage(64 * 1024, 6);
+
+    printf("  image: %u bytes, %u chunks, 6 robots\n",
+           static_cast<unsigned int>(img.size()),
+           static_cast<unsigned int>(numChunks(img.size())));
+    printf("  loss   time (s)   packets   committed\n");
+
+    for (double loss : {0.0, 0.05, 0.1, 0.2, 0.3}) {
+        uint32_t t;
+        auto link = simulate(loss, 6, img, 7, &t);
+
+        int committed = 0;
+        for (const auto& robot : link->robots) {
+            if (robot->receiver.state() == STATE_COMMITTED) {
+                EXPECT_EQ(img, robot->staging.data);
+                committed++;
+            }
+        }
+        if (loss <= 0.2) {
+            EXPECT_EQ(6, committed);
+        }
+
+        printf("  %3.0f%%   %8.2f   %7u   %d/6\n", loss * 100, t / 1000.0,
+               link->packetsSent, committed);
+    }
+}
+
+TEST(OtaReceiver, commitChecksInWithSupervisor) {
+    // about what the mbed's local filesystem does
+    SupervisedStaging staging(20);
+    Receiver<SupervisedStaging> rx(staging, 0);
+    const size_t size = 300 * CHUNK_SIZE;
+    std::vector<uint8_t> img = makeImage(size, 4);
+    std::vector<uint8_t> buf, reply;
+
+    append(BeginMsg{MSG_BEGIN, 2, size, crc::crc32(img.data(), size)}, &buf);
+    rx.handle(buf.data(), buf.size(), &reply);
+    for (uint16_t c = 0; c < rx.totalChunks(); c++) {
+        buf.clear();
+        const uint8_t* chunk = &img[c * CHUNK_SIZE];
+        append(DataHeader{MSG_DATA, 2, c, crc::crc16(chunk, CHUNK_SIZE)},
+               &buf);
+        buf.insert(buf.end(), chunk, chunk + CHUNK_SIZE);
+        rx.handle(buf.data(), buf.size(), &reply);
+    }
+    ASSERT_EQ(STATE_COMPLETE, rx.state());
+
+    buf.clear();
+    append(AddressedMsg{MSG_COMMIT, 2, 0}, &buf);
+    ASSERT_TRUE(rx.handle(buf.data(), buf.size(), &reply));
+    EXPECT_EQ(STATE_COMMITTED, rx.state());
+
+    // it took much longer than the deadline, but kept checking in
+    EXPECT_GT(staging.nowMs, 10 * SupervisedStaging::DEADLINE_MS);
+    EXPECT_TRUE(staging.healthy);
+    EXPECT_EQ(20u, staging.supervisor.entry(0).worstMs);
+}
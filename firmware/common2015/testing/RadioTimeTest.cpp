@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include "../utils/radio-time.hpp"
+
+using namespace radio_time;
+
+namespace {
+const double TICKS_PER_SECOND = TICKS_PER_10_US * 1e5;
+const double WRAP = double(Timestamp(1) << TIMESTAMP_BITS);
+
+/// A free running radio clock
+struct Clock {
+    double start;  // reading at t = 0, in ticks
+    double rate;   // 1 + error
+
+    double ticks(double t) const { return start + t * TICKS_PER_SECOND * rate; }
+
+    Timestamp read(double t) const {
+        return Timestamp(std::fmod(std::floor(ticks(t)), WRAP));
+    }
+};
+
+struct TraceOptions {
+    double robotPpm;
+    // how far a timestamp can be from when the frame was on the air, uniformly
+    // distributed up to this.  Software stamps outgoing frames before they go
+    // out and incoming ones after their interrupt fires.  Zero for the
+    // DW1000's hardware timestamps.
+    double stampLatencyUs;
+    // links without hardware timestamps only read a microsecond clock
+    bool usResolution;
+};
+
+/**
+ * Runs the 60 Hz forward packet / reply exchange between the base station and
+ * one robot, feeding @estimator, and returns the worst error in the
+ * estimator's prediction of the robot's clock at the time of the next
+ * forward packet, over the second half of the trace.
+ */
+double runTrace(const TraceOptions& opts, OffsetEstimator* estimator,
+                double* firstErrorNs = nullptr) {
+    // both clocks wrap partway through
+    const Clock base = {WRAP - 0.5 * TICKS_PER_SECOND, 1};
+    const Clock robot = {WRAP - 2.25 * TICKS_PER_SECOND,
+                         1 + opts.robotPpm * 1e-6};
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> latency(0, opts.stampLatencyUs);
+    std::uniform_int_distribution<int> slot(0, 5);
+
+    auto stamp = [&](const Clock& c, double t, bool rx) {
+        t += (rx ? 1 : -1) * latency(rng) * 1e-6;
+        if (opts.usResolution) {
+            // the microsecond clock runs off the same crystal as the radio
+            const double us = std::floor(c.ticks(t) / TICKS_PER_10_US * 10);
+            return fromUs(uint64_t(us));
+        }
+        return c.read(t);
+    };
+
+    // 3 m away
+    const double flight = 10e-9;
+
+    double worstNs = 0;
+    const int exchanges = 300;
+    for (int i = 0; i < exchanges; i++) {
+        const double sent = i / 60.0;
+
+        // check the prediction for this forward packet before adding it
+        if (estimator->valid() && i >= exchanges / 2) {
+            const double errorNs = ticksToNs(
+                diff(estimator->toRobot(base.read(sent)), robot.read(sent)));
+            worstNs = std::max(worstNs, std::fabs(errorNs));
+        }
+
+        // the robot replies in its slot, a few ms later
+        const double replied = sent + flight + (1 + 2 * slot(rng)) * 1e-3;
+
+        Exchange e;
+        e.t1 = stamp(base, sent, false);
+        e.t2 = stamp(robot, sent + flight, true);
+        e.t3 = stamp(robot, replied, false);
+        e.t4 = stamp(base, replied + flight, true);
+        estimator->add(e);
+
+        if (i == 0 && firstErrorNs) {
+            *firstErrorNs = ticksToNs(
+                diff(estimator->toRobot(base.read(sent)), robot.read(sent)));
+        }
+    }
+    return worstNs;
+}
+}  // namespace
+
+TEST(RadioTime, timestampArithmetic) {
+    EXPECT_EQ(5, diff(2, TIMESTAMP_MASK - 2));
+    EXPECT_EQ(-5, diff(TIMESTAMP_MASK - 2, 2));
+    EXPECT_EQ(2u, add(TIMESTAMP_MASK - 2, 5));
+    EXPECT_EQ(TIMESTAMP_MASK - 2, add(2, -5));
+
+    // 1 us is 63897.6 ticks
+    EXPECT_EQ(638976u, fromUs(10));
+    EXPECT_NEAR(1.0, ticksToUs(fromUs(1000000)) / 1e6, 1e-9);
+
+    // the DW1000 stores them little endian
+    const uint8_t bytes[] = {0x01, 0x02, 0x03, 0x04, 0xF5};
+    EXPECT_EQ(0xF504030201u, fromBytes(bytes));
+    uint8_t out[TIMESTAMP_SIZE];
+    toBytes(0xF504030201u, out);
+    EXPECT_EQ(0, memcmp(bytes, out, TIMESTAMP_SIZE));
+}
+
+TEST(RadioTime, hardwareTimestamps) {
+    printf("  robot clock   first estimate   worst error   rate estimate\n");
+    for (double ppm : {0.0, 20.0, -35.0}) {
+        OffsetEstimator estimator;
+        double firstNs = 0;
+        const double worstNs =
+            runTrace({ppm, 0, false}, &estimator, &firstNs);
+        printf("  %+6.1f ppm   %10.1f ns   %8.2f ns   %+8.3f ppm\n", ppm,
+               firstNs, worstNs, estimator.ratePpm());
+
+        // good to well under a nanosecond, which is 30 cm of flight time
+        EXPECT_LT(worstNs, 0.5);
+        EXPECT_NEAR(ppm, estimator.ratePpm(), 0.01);
+        EXPECT_NEAR(0.01, estimator.minRttUs() / 2, 0.001);
+        EXPECT_EQ(0u, estimator.rejected);
+    }
+}
+
+TEST(RadioTime, interruptTimestamps) {
+    // the CC1201 has no timestamp registers, so frames are stamped with the
+    // time its interrupt fired
+    OffsetEstimator estimator;
+    const double worstNs = runTrace({20, 30, true}, &estimator);
+    printf("  interrupt stamps: worst error %.2f us, rate %+.2f ppm\n",
+           worstNs / 1000, estimator.ratePpm());
+
+    // a quarter second of exchanges isn't enough to pin down the rate through
+    // that much jitter, but the offset stays about as good as the stamps are
+    EXPECT_LT(worstNs, 40000);
+    EXPECT_GT(estimator.minRttUs(), 0);
+    EXPECT_EQ(0u, estimator.rejected);
+}
+
+TEST(RadioTime, rejectsBadExchanges) {
+    OffsetEstimator estimator;
+    EXPECT_FALSE(estimator.valid());
+
+    // the reply seemingly arrived before the robot sent it
+    EXPECT_FALSE(estimator.add({1000, 5000, 100000, 90000}));
+
+    // a reply to a forward packet from the last cycle
+    const Timestamp late = fromUs(30000);
+    EXPECT_FALSE(estimator.add({0, 0, 100, late}));
+    EXPECT_EQ(2u, estimator.rejected);
+    EXPECT_FALSE(estimator.valid());
+}
@@ -0,0 +1,377 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#include "../utils/system-id.hpp"
+
+using namespace sysid;
+
+namespace {
+const float DT = 0.005;  // the control loop's period, in s
+
+/**
+ * A wheel on a stand, as a first order system with some friction to get past,
+ * and a bit of noise on what the encoders measure.  It's stepped forward
+ * exactly for a tick at a time.
+ */
+struct Wheel {
+    float gain = 0.12;    // rad/s per duty cycle count
+    float tau = 0.05;     // s
+    float offset = 20;    // counts
+    float noise = 0.2;    // rad/s, standard deviation
+
+    float speed = 0;
+    std::mt19937 rng{1};
+
+    /// Drives at @duty for @dt and returns the measured velocity
+    float drive(float duty, float dt = DT) {
+        const float push = std::fabs(duty) > offset
+                               ? duty - std::copysign(offset, duty)
+                               : 0;
+        const float decay = std::exp(-dt / tau);
+        speed = gain * push + (speed - gain * push) * decay;
+        return speed + std::normal_distribution<float>(0, noise)(rng);
+    }
+};
+
+/// Runs @wheel through @excitation and returns the log
+std::vector<Sample> excite(Wheel* wheel, const Excitation& excitation) {
+    std::vector<Sample> log;
+    for (float t = 0; t < excitation.duration(); t += DT) {
+        const int16_t duty = excitation.duty(t);
+        log.push_back({wheel->drive(duty), uint16_t(DT * 1e6f), duty});
+    }
+    return log;
+}
+
+/**
+ * How a PI loop with a feedforward, like PidMotionController, steps @wheel to
+ * @target rad/s from a standstill
+ */
+struct StepResponse {
+    float overshoot = 0;     // as a fraction of the target
+    float settleTime = -1;   // s, to within 5% for good
+    float finalError = 0;    // rad/s
+};
+
+StepResponse closedLoop(Wheel wheel, const WheelTuning& tuning, float target) {
+    StepResponse r;
+    wheel.noise = 0;
+    float integral = 0;
+    float measured = 0;
+    const float seconds = 1;
+    for (float t = 0; t < seconds; t += DT) {
+        const float err = target - measured;
+        integral += err;
+        float duty = target * tuning.dutyCycleMultiplier +
+                     tuning.pid.kp * err + tuning.pid.ki * integral;
+        duty = std::max(-511.0f, std::min(511.0f, duty));
+        measured = wheel.drive(duty);
+
+        r.overshoot = std::max(r.overshoot, (measured - target) / target);
+        if (std::fabs(measured - target) > 0.05f * target) {
+            r.settleTime = -1;
+        } else if (r.settleTime < 0) {
+            r.settleTime = t + DT;
+        }
+    }
+    r.finalError = target - measured;
+    return r;
+}
+}  // namespace
+
+TEST(SystemId, excitationStepsThenChirps) {
+    const Excitation excitation;
+    const Excitation::Params& p = excitation.params();
+    EXPECT_FLOAT_EQ(2 * p.stepSecs + p.chirpSecs, excitation.duration());
+
+    EXPECT_EQ(p.high, excitation.duty(0));
+    EXPECT_EQ(p.high, excitation.duty(p.stepSecs - 0.01));
+    EXPECT_EQ(p.low, excitation.duty(p.stepSecs + 0.01));
+    EXPECT_EQ(p.low, excitation.duty(2 * p.stepSecs - 0.01));
+
+    // the chirp starts from the middle, and stays within the steps
+    EXPECT_NEAR((p.high + p.low) / 2, excitation.duty(2 * p.stepSecs), 1);
+    int16_t lowest = INT16_MAX, highest = INT16_MIN;
+    for (float t = 2 * p.stepSecs; t < excitation.duration(); t += 0.001) {
+        lowest = std::min(lowest, excitation.duty(t));
+        highest = std::max(highest, excitation.duty(t));
+    }
+    EXPECT_GE(lowest, p.low);
+    EXPECT_LE(highest, p.high);
+    EXPECT_LT(lowest, p.low + 5);
+    EXPECT_GT(highest, p.high - 5);
+
+    EXPECT_EQ(0, excitation.duty(excitation.duration()));
+    EXPECT_EQ(0, excitation.duty(-0.1));
+}
+
+TEST(SystemId, chirpSpeedsUp) {
+    // count the times it crosses the middle in the first and last quarter
+    const Excitation excitation;
+    const Excitation::Params& p = excitation.params();
+    const float mid = (p.high + p.low) / 2.0f;
+    const float start = 2 * p.stepSecs, quarter = p.chirpSecs / 4;
+    auto crossings = [&](float from) {
+        int n = 0;
+        bool above = excitation.duty(from) > mid;
+        for (float t = from; t < from + quarter; t += 0.0002) {
+            const bool now = excitation.duty(t) > mid;
+            if (now != above) n++;
+            above = now;
+        }
+        return n;
+    };
+    EXPECT_GT(crossings(start + 3 * quarter), 2 * crossings(start));
+}
+
+TEST(SystemId, fitsFirstOrderPlant) {
+    Wheel wheel;
+    const std::vector<Sample> log = excite(&wheel, Excitation());
+    const FirstOrderModel model = fitFirstOrder(log.data(), log.size());
+
+    ASSERT_TRUE(model.valid);
+    EXPECT_NEAR(wheel.gain, model.gain, 0.05 * wheel.gain);
+    EXPECT_NEAR(wheel.tau, model.tau, 0.1 * wheel.tau);
+    EXPECT_NEAR(wheel.offset, model.offset, 5);
+    EXPECT_LT(model.rmsError, 2 * wheel.noise);
+    EXPECT_GT(model.samples, log.size() - 10);
+}
+
+TEST(SystemId, fitsSlowAndFastMotors) {
+    for (float tau : {0.015f, 0.03f, 0.1f}) {
+        Wheel wheel;
+        wheel.tau = tau;
+        const std::vector<Sample> log = excite(&wheel, Excitation());
+        const FirstOrderModel model = fitFirstOrder(log.data(), log.size());
+
+        ASSERT_TRUE(model.valid) << "tau " << tau;
+        EXPECT_NEAR(wheel.gain, model.gain, 0.05 * wheel.gain) << "tau " << tau;
+        EXPECT_NEAR(tau, model.tau, 0.15 * tau) << "tau " << tau;
+    }
+}
+
+TEST(SystemId, leavesOutStoppedWheel) {
+    // a wheel that only gets going partway through still fits
+    Wheel wheel;
+    wheel.offset = 200;
+    Excitation excitation(Excitation::Params{300, 230, 0.3, 1, 15, 1.5});
+    const std::vector<Sample> log = excite(&wheel, excitation);
+    const FirstOrderModel model = fitFirstOrder(log.data(), log.size());
+
+    ASSERT_TRUE(model.valid);
+    EXPECT_NEAR(wheel.gain, model.gain, 0.1 * wheel.gain);
+    EXPECT_NEAR(wheel.offset, model.offset, 10);
+}
+
+TEST(SystemId, rejectsBadFits) {
+    // too little to go on
+    Wheel wheel;
+    std::vector<Sample> log = excite(&wheel, Excitation());
+    EXPECT_FALSE(fitFirstOrder(log.data(), 5).valid);
+
+    // a wheel that never turns
+    for (Sample& s : log) s.velocity = 0;
+    EXPECT_FALSE(fitFirstOrder(log.data(), log.size()).valid);
+
+    // a motor wired backwards
+    Wheel backwards;
+    backwards.gain = -0.12;
+    log = excite(&backwards, Excitation());
+    EXPECT_FALSE(fitFirstOrder(log.data(), log.size()).valid);
+}
+
+TEST(SystemId, tunesWithSimc) {
+    FirstOrderModel model;
+    model.gain = 0.1;
+    model.tau = 0.04;
+    model.valid = true;
+
+    // lambda defaults to tau: kp = tau / (k (tau + dt)), ti = tau
+    const WheelTuning tuning = tune(model, DT);
+    EXPECT_FLOAT_EQ(10, tuning.dutyCycleMultiplier);
+    EXPECT_FLOAT_EQ(0.04 / (0.1 * 0.045), tuning.pid.kp);
+    EXPECT_FLOAT_EQ(tuning.pid.kp * DT / 0.04, tuning.pid.ki);
+    EXPECT_EQ(0, tuning.pid.kd);
+
+    // a slow motor's integral time is capped
+    model.tau = 1;
+    const WheelTuning slow = tune(model, DT, 1, 0.05);
+    EXPECT_FLOAT_EQ(slow.pid.kp * DT / (4 * 0.055), slow.pid.ki);
+
+    // a full battery makes the motor look stronger than it is at nominal
+    EXPECT_FLOAT_EQ(10 / 0.8, tune(model, DT, 0.8).dutyCycleMultiplier);
+
+    model.valid = false;
+    EXPECT_EQ(0, tune(model, DT).dutyCycleMultiplier);
+}
+
+TEST(SystemId, tunedLoopSettles) {
+    for (float tau : {0.02f, 0.05f, 0.15f}) {
+        Wheel wheel;
+        wheel.tau = tau;
+        const std::vector<Sample> log = excite(&wheel, Excitation());
+        const WheelTuning tuning =
+            tune(fitFirstOrder(log.data(), log.size()), DT);
+        ASSERT_TRUE(tuning.model.valid);
+
+        const StepResponse r = closedLoop(wheel, tuning, 25);
+        EXPECT_LT(r.overshoot, 0.1) << "tau " << tau;
+        EXPECT_GT(r.settleTime, 0) << "tau " << tau;
+        EXPECT_LT(r.settleTime, 4 * tau + 0.05) << "tau " << tau;
+        EXPECT_NEAR(0, r.finalError, 0.25) << "tau " << tau;
+    }
+}
+
+TEST(SystemId, runnerIdentifiesEachWheel) {
+    Wheel wheels[NUM_WHEELS];
+    const float gains[NUM_WHEELS] = {0.10, 0.12, 0.14, 0.16};
+    for (size_t i = 0; i < NUM_WHEELS; i++) {
+        wheels[i].gain = gains[i];
+        wheels[i].rng.seed(i + 1);
+    }
+
+    Runner runner;
+    runner.start(0b1011);
+    EXPECT_TRUE(runner.active());
+    EXPECT_EQ(0, runner.wheel());
+
+    int16_t duty[NUM_WHEELS] = {};
+    float velocities[NUM_WHEELS] = {};
+    int finishes = 0;
+    uint8_t ran = 0;
+    for (int tick = 0; tick < 2000; tick++) {
+        // only the wheel being identified gets driven
+        for (size_t i = 0; i < NUM_WHEELS; i++) {
+            if (duty[i] != 0) {
+                ran |= 1 << i;
+                EXPECT_EQ(int(i), runner.wheel());
+            }
+        }
+
+        int16_t applied[NUM_WHEELS];
+        std::copy(duty, duty + NUM_WHEELS, applied);
+        for (size_t i = 0; i < NUM_WHEELS; i++) {
+            velocities[i] = wheels[i].drive(applied[i]);
+        }
+        if (runner.update(velocities, applied, DT, duty)) finishes++;
+    }
+
+    EXPECT_EQ(1, finishes);
+    EXPECT_FALSE(runner.active());
+    EXPECT_EQ(0b1011, ran);
+    EXPECT_EQ(0b1011, runner.identified());
+    for (size_t i : {0, 1, 3}) {
+        EXPECT_NEAR(gains[i], runner.model(i).gain, 0.05 * gains[i]) << i;
+        EXPECT_NEAR(wheels[i].tau, runner.model(i).tau, 0.1 * wheels[i].tau)
+            << i;
+    }
+    EXPECT_FALSE(runner.model(2).valid);
+    EXPECT_NEAR(DT, runner.meanDt(), 1e-6);
+
+    // the log is from the last wheel
+    EXPECT_EQ(3, runner.logWheel());
+    EXPECT_GT(runner.logSize(), 0.9 * Excitation().duration() / DT);
+    EXPECT_LE(runner.logSize(), size_t(Runner::LOG_SIZE));
+}
+
+TEST(SystemId, runnerStops) {
+    Runner runner;
+    runner.start(0b0001);
+
+    int16_t duty[NUM_WHEELS] = {};
+    const float velocities[NUM_WHEELS] = {};
+    const int16_t applied[NUM_WHEELS] = {};
+    runner.update(velocities, applied, DT, duty);
+    EXPECT_NE(0, duty[0]);
+
+    runner.stop();
+    EXPECT_FALSE(runner.active());
+    EXPECT_FALSE(runner.update(velocities, applied, DT, duty));
+    EXPECT_EQ(0, duty[0]);
+
+    // nothing to do finishes right away
+    runner.start(0);
+    EXPECT_FALSE(runner.active());
+}
+
+TEST(SystemId, tuningRoundTrips) {
+    WheelTuning tunings[NUM_WHEELS];
+    for (size_t i = 0; i < NUM_WHEELS; i++) {
+        FirstOrderModel model;
+        model.gain = 0.1 + 0.01 * i;
+        model.tau = 0.04 + 0.005 * i;
+        model.valid = true;
+        tunings[i] = tune(model, DT, 0.95);
+    }
+
+    char text[MAX_TUNING_TEXT];
+    const int len = formatTuning(tunings, 0b0110, text, sizeof(text));
+    ASSERT_GT(len, 0);
+    ASSERT_LT(size_t(len), sizeof(text));
+
+    WheelTuning read[NUM_WHEELS];
+    EXPECT_EQ(0b0110, parseTuning(text, read));
+    EXPECT_EQ(0, read[0].dutyCycleMultiplier);
+    for (size_t i : {1, 2}) {
+        EXPECT_NEAR(tunings[i].pid.kp, read[i].pid.kp, 1e-3) << i;
+        EXPECT_NEAR(tunings[i].pid.ki, read[i].pid.ki, 1e-4) << i;
+        EXPECT_NEAR(tunings[i].dutyCycleMultiplier,
+                    read[i].dutyCycleMultiplier, 1e-3)
+            << i;
+        EXPECT_NEAR(tunings[i].model.tau, read[i].model.tau, 1e-4) << i;
+        EXPECT_TRUE(read[i].model.valid);
+    }
+
+    // a whole file fits, even with big numbers
+    for (WheelTuning& t : tunings) t.pid.kp = -123456.7;
+    const int full = formatTuning(tunings, 0b1111, text, sizeof(text));
+    EXPECT_GT(full, 0);
+    EXPECT_LT(size_t(full), sizeof(text));
+}
+
+TEST(SystemId, parsesHandEditedTuning) {
+    const char* text =
+        "# tuned by hand\n"
+        "\n"
+        "  3 ff=8.5 kp=1.5\r\n"
+        "7 kp=1 ff=1\n"       // no such wheel
+        "0 kp=2 ki=0.1\n"     // no feedforward
+        "1 kp=2 ff=9 foo=3";  // no newline, and something it doesn't know
+    WheelTuning tunings[NUM_WHEELS];
+    EXPECT_EQ(0b1010, parseTuning(text, tunings));
+    EXPECT_FLOAT_EQ(8.5, tunings[3].dutyCycleMultiplier);
+    EXPECT_FLOAT_EQ(1.5, tunings[3].pid.kp);
+    EXPECT_EQ(0, tunings[3].pid.ki);
+    EXPECT_FALSE(tunings[3].model.valid);
+    EXPECT_FLOAT_EQ(9, tunings[1].dutyCycleMultiplier);
+}
+
+TEST(SystemId, savesAndLoadsTuning) {
+    char path[] = "/tmp/system-id-test-XXXXXX";
+    const int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    WheelTuning tunings[NUM_WHEELS];
+    for (size_t i = 0; i < NUM_WHEELS; i++) {
+        tunings[i].dutyCycleMultiplier = 10 + i;
+        tunings[i].pid.kp = 1 + i;
+    }
+    EXPECT_TRUE(saveTuning(path, tunings, 0b1111));
+
+    WheelTuning read[NUM_WHEELS];
+    EXPECT_EQ(0b1111, loadTuning(path, read));
+    EXPECT_FLOAT_EQ(13, read[3].dutyCycleMultiplier);
+    EXPECT_FLOAT_EQ(4, read[3].pid.kp);
+
+    unlink(path);
+    EXPECT_EQ(0, loadTuning(path, read));
+}
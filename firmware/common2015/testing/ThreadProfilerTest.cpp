@@ -0,0 +1,217 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "../utils/thread-profiler.hpp"
+
+namespace {
+const uint8_t IDLE = 255;
+const uint8_t CONTROL = 1;
+const uint8_t RADIO = 2;
+const uint8_t CONSOLE = 3;
+
+ThreadProfiler::Stats find(const ThreadProfiler& profiler, uint32_t nowUs,
+                           uint8_t id) {
+    ThreadProfiler::Stats stats[ThreadProfiler::MAX_THREADS];
+    const size_t n =
+        profiler.stats(nowUs, stats, ThreadProfiler::MAX_THREADS);
+    for (size_t i = 0; i < n; i++) {
+        if (stats[i].id == id) return stats[i];
+    }
+    return ThreadProfiler::Stats();
+}
+
+/**
+ * A made up schedule, like the robot's: every 5 ms the control loop wakes up
+ * and runs for 1 ms, and every 2 ms the radio wakes up and runs for 300 us,
+ * but has to wait if the control loop is running.  The console soaks up
+ * whatever's left of the first 500 us of each 5 ms, and the rest is idle.
+ */
+struct Schedule {
+    /// Which thread runs at @us, and which others are ready then
+    uint8_t at(uint32_t us, std::vector<uint8_t>* ready) const {
+        const uint32_t inControl = us % 5000;
+        const uint32_t lastRadio = us / 2000 * 2000;
+
+        // the radio runs for 300 us once the control loop lets it
+        uint32_t radioStart = lastRadio;
+        if (lastRadio % 5000 < 1000) {
+            radioStart = lastRadio - lastRadio % 5000 + 1000;
+        }
+        const bool radioRuns = us >= radioStart && us < radioStart + 300;
+        const bool radioWaits = us >= lastRadio && us < radioStart;
+
+        ready->clear();
+        if (inControl < 1000) {
+            if (radioWaits) ready->push_back(RADIO);
+            return CONTROL;
+        }
+        if (radioRuns) return RADIO;
+        if (inControl < 1500) return CONSOLE;
+        return IDLE;
+    }
+};
+}  // namespace
+
+TEST(ThreadProfiler, countsRunTime) {
+    ThreadProfiler profiler;
+    profiler.reset(1000);
+    profiler.switchTo(CONTROL, 1000);
+    profiler.switchTo(IDLE, 1400);
+    profiler.switchTo(CONTROL, 2000);
+    profiler.switchTo(IDLE, 2100);
+
+    EXPECT_EQ(1500u, profiler.windowUs(2500));
+    EXPECT_EQ(500u, find(profiler, 2500, CONTROL).runUs);
+    EXPECT_EQ(2u, find(profiler, 2500, CONTROL).switches);
+
+    // the running thread's time counts up to now
+    EXPECT_EQ(600u + 400, find(profiler, 2500, IDLE).runUs);
+    EXPECT_EQ(IDLE, profiler.running());
+}
+
+TEST(ThreadProfiler, measuresWakeLatency) {
+    ThreadProfiler profiler;
+    profiler.switchTo(CONTROL, 0);
+
+    // the radio's signaled while the control loop is running
+    profiler.ready(RADIO, 100);
+    profiler.ready(RADIO, 200);  // again, which doesn't count
+    profiler.switchTo(RADIO, 350);
+    profiler.switchTo(IDLE, 400);
+
+    profiler.ready(RADIO, 1000);
+    profiler.switchTo(RADIO, 1050);
+
+    // switched to without being seen waiting isn't a measured wakeup
+    profiler.switchTo(CONSOLE, 1100);
+    profiler.switchTo(RADIO, 1200);
+
+    const ThreadProfiler::Stats radio = find(profiler, 1300, RADIO);
+    EXPECT_EQ(3u, radio.switches);
+    EXPECT_EQ(2u, radio.wakeups);
+    EXPECT_EQ(250u, radio.latencyMaxUs);
+    EXPECT_FLOAT_EQ(150, radio.meanLatencyUs());
+    EXPECT_EQ(0u, find(profiler, 1300, CONSOLE).wakeups);
+
+    // a running thread can't be waiting
+    profiler.ready(RADIO, 1300);
+    profiler.switchTo(IDLE, 1400);
+    profiler.switchTo(RADIO, 1500);
+    EXPECT_EQ(2u, find(profiler, 1500, RADIO).wakeups);
+}
+
+TEST(ThreadProfiler, resetStartsNewWindow) {
+    ThreadProfiler profiler;
+    profiler.switchTo(CONTROL, 0);
+    profiler.ready(RADIO, 500);
+    profiler.reset(1000);
+
+    // the wait that started before the window still counts in full
+    profiler.switchTo(RADIO, 1200);
+    EXPECT_EQ(200u, find(profiler, 1200, CONTROL).runUs);
+    EXPECT_EQ(0u, find(profiler, 1200, CONTROL).switches);
+    EXPECT_EQ(700u, find(profiler, 1200, RADIO).latencyMaxUs);
+    EXPECT_EQ(200u, profiler.windowUs(1200));
+
+    profiler.clear(2000);
+    EXPECT_EQ(0u, profiler.stats(2000, nullptr, 0));
+    EXPECT_EQ(uint8_t(ThreadProfiler::NO_THREAD), profiler.running());
+}
+
+TEST(ThreadProfiler, handlesTimerWrap) {
+    ThreadProfiler profiler;
+    const uint32_t start = UINT32_MAX - 1000;
+    profiler.reset(start);
+    profiler.switchTo(CONTROL, start);
+    profiler.ready(RADIO, start + 500);
+    profiler.switchTo(RADIO, start + 3000);
+
+    EXPECT_EQ(3000u, find(profiler, start + 4000, CONTROL).runUs);
+    EXPECT_EQ(2500u, find(profiler, start + 4000, RADIO).latencyMaxUs);
+    EXPECT_EQ(1000u, find(profiler, start + 4000, RADIO).runUs);
+    EXPECT_EQ(4000u, profiler.windowUs(start + 4000));
+}
+
+TEST(ThreadProfiler, dropsThreadsPastLimit) {
+    ThreadProfiler profiler;
+    for (uint32_t i = 0; i < ThreadProfiler::MAX_THREADS + 2; i++) {
+        profiler.switchTo(i + 1, i * 10);
+    }
+    EXPECT_EQ(2u, profiler.dropped());
+    EXPECT_EQ(size_t(ThreadProfiler::MAX_THREADS),
+              profiler.stats(1000, nullptr, 0));
+
+    // the ones it has still add up
+    ThreadProfiler::Stats stats[4];
+    EXPECT_EQ(size_t(ThreadProfiler::MAX_THREADS),
+              profiler.stats(1000, stats, 4));
+    EXPECT_EQ(10u, stats[0].runUs);
+}
+
+TEST(ThreadProfiler, exactTraceOfSchedule) {
+    // switch at every change of the schedule, like a context switch hook
+    const Schedule schedule;
+    ThreadProfiler profiler;
+    std::vector<uint8_t> ready, lastReady;
+    uint8_t last = ThreadProfiler::NO_THREAD;
+    const uint32_t end = 100000;
+    for (uint32_t us = 0; us < end; us++) {
+        const uint8_t running = schedule.at(us, &ready);
+        for (uint8_t id : ready) {
+            if (std::find(lastReady.begin(), lastReady.end(), id) ==
+                lastReady.end()) {
+                profiler.ready(id, us);
+            }
+        }
+        if (running != last) profiler.switchTo(running, us);
+        last = running;
+        lastReady = ready;
+    }
+
+    // 20 periods of 5 ms
+    EXPECT_EQ(20000u, find(profiler, end, CONTROL).runUs);
+    EXPECT_EQ(20u, find(profiler, end, CONTROL).switches);
+    EXPECT_EQ(50u * 300, find(profiler, end, RADIO).runUs);
+    EXPECT_EQ(end, find(profiler, end, CONTROL).runUs +
+                       find(profiler, end, RADIO).runUs +
+                       find(profiler, end, CONSOLE).runUs +
+                       find(profiler, end, IDLE).runUs);
+
+    // every 10 ms, the radio wakes up right as the control loop does, and
+    // waits for it.  The rest of the time it runs right away.
+    const ThreadProfiler::Stats radio = find(profiler, end, RADIO);
+    EXPECT_EQ(10u, radio.wakeups);
+    EXPECT_EQ(1000u, radio.latencyMaxUs);
+    EXPECT_FLOAT_EQ(1000, radio.meanLatencyUs());
+}
+
+TEST(ThreadProfiler, sampledTraceOfSchedule) {
+    // sample at a period that doesn't line up with the schedule, like the
+    // robot's profiler does
+    const Schedule schedule;
+    ThreadProfiler profiler;
+    std::vector<uint8_t> ready;
+    const uint32_t period = 97;
+    const uint32_t end = 1000000;
+    for (uint32_t us = 0; us < end; us += period) {
+        const uint8_t running = schedule.at(us, &ready);
+        profiler.sample(us, running, ready.data(), ready.size());
+    }
+
+    // the run times come out close on average
+    const uint32_t now = end / period * period;
+    EXPECT_NEAR(0.2, find(profiler, now, CONTROL).runUs / float(now), 0.01);
+    EXPECT_NEAR(0.15, find(profiler, now, RADIO).runUs / float(now), 0.01);
+    EXPECT_NEAR(0.04, find(profiler, now, CONSOLE).runUs / float(now), 0.01);
+    EXPECT_NEAR(0.61, find(profiler, now, IDLE).runUs / float(now), 0.01);
+
+    // and the long waits are caught, to within a sample
+    const ThreadProfiler::Stats radio = find(profiler, now, RADIO);
+    EXPECT_NEAR(100, radio.wakeups, 2);
+    EXPECT_LE(radio.latencyMaxUs, 1000 + period);
+    EXPECT_GT(radio.latencyMaxUs, 1000 - period);
+    EXPECT_NEAR(1000, radio.meanLatencyUs(), period);
+}
@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include "../utils/trajectory-buffer.hpp"
+
+using Velocity = TrajectoryBuffer::Velocity;
+
+TEST(TrajectoryBuffer, interpolates) {
+    TrajectoryBuffer buffer;
+    EXPECT_FALSE(buffer.active(0));
+    EXPECT_EQ(0, buffer.at(0).x);
+
+    const Velocity points[] = {{1, 0, -1}, {3, 0, -1}};
+    buffer.set(1000, {0, 2, 0}, points, 2, 10);
+    EXPECT_EQ(3u, buffer.size());
+    EXPECT_TRUE(buffer.active(1000));
+
+    EXPECT_FLOAT_EQ(0, buffer.at(1000).x);
+    EXPECT_FLOAT_EQ(0.5, buffer.at(1005).x);
+    EXPECT_FLOAT_EQ(1, buffer.at(1005).y);
+    EXPECT_FLOAT_EQ(-0.5, buffer.at(1005).w);
+    EXPECT_FLOAT_EQ(1, buffer.at(1010).x);
+    EXPECT_FLOAT_EQ(2, buffer.at(1015).x);
+
+    // then holds the last one
+    EXPECT_FLOAT_EQ(3, buffer.at(1020).x);
+    EXPECT_FLOAT_EQ(3, buffer.at(1100).x);
+
+    // times from before the plan came in are the start of it
+    EXPECT_FLOAT_EQ(0, buffer.at(990).x);
+
+    buffer.clear();
+    EXPECT_FALSE(buffer.active(1000));
+    EXPECT_EQ(0, buffer.at(1005).x);
+}
+
+TEST(TrajectoryBuffer, limitsPoints) {
+    TrajectoryBuffer buffer;
+    Velocity points[TrajectoryBuffer::MAX_POINTS + 4];
+    for (size_t i = 0; i < TrajectoryBuffer::MAX_POINTS + 4; i++) {
+        points[i] = {float(i + 1), 0, 0};
+    }
+    buffer.set(0, {0, 0, 0}, points, TrajectoryBuffer::MAX_POINTS + 4, 5);
+    EXPECT_EQ(TrajectoryBuffer::MAX_POINTS + 1, buffer.size());
+    EXPECT_FLOAT_EQ(TrajectoryBuffer::MAX_POINTS, buffer.at(100).x);
+
+    // points without a step between them are ignored
+    buffer.set(0, {1, 0, 0}, points, 4, 0);
+    EXPECT_EQ(1u, buffer.size());
+    EXPECT_FLOAT_EQ(1, buffer.at(20).x);
+}
+
+TEST(TrajectoryBuffer, decaysToTimeout) {
+    TrajectoryBuffer buffer;
+    buffer.set(0xFFFFFF00, {2, -2, 1});
+    const uint32_t fadeStart =
+        0xFFFFFF00 + TrajectoryBuffer::TIMEOUT_MS - TrajectoryBuffer::DECAY_MS;
+
+    // full speed until the fade, across the clock wrapping
+    EXPECT_FLOAT_EQ(2, buffer.at(fadeStart).x);
+
+    // then down to zero in a straight line, never jumping
+    float last = buffer.at(fadeStart).x;
+    for (uint32_t t = fadeStart; t != fadeStart + TrajectoryBuffer::DECAY_MS;
+         t++) {
+        const float v = buffer.at(t).x;
+        EXPECT_LE(v, last);
+        EXPECT_LE(last - v, 2.0f / TrajectoryBuffer::DECAY_MS + 1e-5f);
+        last = v;
+    }
+    EXPECT_FLOAT_EQ(1, buffer.at(fadeStart + TrajectoryBuffer::DECAY_MS / 2).x);
+    EXPECT_FLOAT_EQ(-1,
+                    buffer.at(fadeStart + TrajectoryBuffer::DECAY_MS / 2).y);
+
+    const uint32_t timeout = 0xFFFFFF00 + TrajectoryBuffer::TIMEOUT_MS;
+    EXPECT_TRUE(buffer.active(timeout - 1));
+    EXPECT_FALSE(buffer.active(timeout));
+    EXPECT_EQ(0, buffer.at(timeout).x);
+    EXPECT_EQ(0, buffer.at(timeout + 100000).w);
+}
+
+namespace {
+/// A robot's planned velocity, weaving across the field, in m/s
+float planned(uint32_t ms) {
+    const float t = ms / 1000.0f;
+    return 2 * std::sin(t * 2.5f) + std::sin(t * 7.0f);
+}
+
+struct Tracking {
+    double rmsError = 0;
+    double maxJump = 0;
+};
+
+/**
+ * Sends the plan at 60 Hz with each forward packet lost with chance @loss, in
+ * bursts of @burst packets, and follows it in a 5 ms control loop.  Packets
+ * either carry 8 points 10 ms apart, or just the velocity for now like before,
+ * which the robot held until the 250 ms command timeout.
+ */
+Tracking track(bool withTrajectory, double loss, int burst) {
+    const uint32_t frameMs = 16;
+    const uint32_t tickMs = 5;
+    const uint32_t stepMs = 10;
+    const uint32_t durationMs = 60000;
+
+    std::mt19937 rng(39);
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    TrajectoryBuffer buffer;
+    float held = 0;
+    uint32_t lastRx = 0;
+    bool haveCommand = false;
+
+    Tracking result;
+    float lastOut = 0;
+    int dropping = 0;
+    unsigned int ticks = 0;
+    for (uint32_t now = 0; now < durationMs; now += tickMs) {
+        if (now % frameMs < tickMs) {
+            if (!dropping && unit(rng) < loss / burst) dropping = burst;
+            if (dropping) {
+                dropping--;
+            } else {
+                const float v = planned(now);
+                Velocity points[TrajectoryBuffer::MAX_POINTS];
+                for (size_t i = 0; i < TrajectoryBuffer::MAX_POINTS; i++) {
+                    points[i] = {planned(now + (i + 1) * stepMs), 0, 0};
+                }
+                buffer.set(now, {v, 0, 0}, points,
+                           withTrajectory ? TrajectoryBuffer::MAX_POINTS : 0,
+                           stepMs);
+                held = v;
+                lastRx = now;
+                haveCommand = true;
+            }
+        }
+
+        float out;
+        if (withTrajectory) {
+            out = buffer.at(now).x;
+        } else {
+            out = haveCommand && now - lastRx < TrajectoryBuffer::TIMEOUT_MS
+                      ? held
+                      : 0;
+        }
+
+        const double error = out - planned(now);
+        result.rmsError += error * error;
+        result.maxJump =
+            std::max(result.maxJump, double(std::abs(out - lastOut)));
+        lastOut = out;
+        ticks++;
+    }
+    result.rmsError = std::sqrt(result.rmsError / ticks);
+    return result;
+}
+}  // namespace
+
+TEST(TrajectoryBuffer, tracksThroughLoss) {
+    printf(
+        "  loss   burst   rms error (hold / trajectory)   biggest step "
+        "(hold / trajectory)\n");
+    for (double loss : {0.0, 0.1, 0.3}) {
+        for (int burst : {1, 5, 20}) {
+            if (loss == 0 && burst > 1) continue;
+            const Tracking hold = track(false, loss, burst);
+            const Tracking traj = track(true, loss, burst);
+            printf(
+                "  %3.0f%%   %5d   %6.3f m/s / %6.3f m/s          "
+                "%5.3f m/s / %5.3f m/s\n",
+                loss * 100, burst, hold.rmsError, traj.rmsError, hold.maxJump,
+                traj.maxJump);
+
+            // following the plan through the gaps beats holding still
+            EXPECT_LT(traj.rmsError, hold.rmsError);
+
+            // and it never lurches more than holding a command does
+            EXPECT_LE(traj.maxJump, hold.maxJump + 1e-6);
+        }
+    }
+}
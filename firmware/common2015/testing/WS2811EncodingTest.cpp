@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "../drivers/ws2811/ws2811-encoding.hpp"
+
+using namespace ws2811;
+
+namespace {
+const double SLOT_NS = 1e9 / SLOTS_PER_SECOND;
+
+/**
+ * Runs a DMA chain the way the LPC1768's GPDMA does with one request per
+ * slot, and returns the level of the pin after every transfer.
+ */
+std::vector<bool> playChain(const Descriptor* first, uintptr_t setReg,
+                            uintptr_t clrReg, uint32_t mask,
+                            bool* endedWithInterrupt) {
+    std::vector<bool> levels;
+
+    // other output pins on the same port, which have to be left alone
+    const uint32_t others = 0xAAAAAAAA & ~mask;
+    uint32_t port = others;
+
+    const Descriptor* d = first;
+    while (true) {
+        const uint32_t count = d->control & DMA_TRANSFER_SIZE_MASK;
+        const uint32_t* src = reinterpret_cast<const uint32_t*>(d->src);
+        for (uint32_t i = 0; i < count; i++) {
+            const uint32_t word = src[(d->control & DMA_SRC_INCREMENT) ? i : 0];
+            if (d->dst == setReg) {
+                port |= word;
+            } else if (d->dst == clrReg) {
+                port &= ~word;
+            } else {
+                ADD_FAILURE() << "transfer to an unexpected address";
+            }
+            levels.push_back(port & mask);
+        }
+
+        if (!d->next) {
+            *endedWithInterrupt = d->control & DMA_TC_INTERRUPT;
+            break;
+        }
+        d = reinterpret_cast<const Descriptor*>(d->next);
+    }
+
+    EXPECT_EQ(others, port & ~mask);
+    return levels;
+}
+
+/// Splits a waveform into high/low pulse pairs and decodes them into bytes,
+/// checking every pulse against the datasheet timing
+std::vector<uint8_t> decode(const std::vector<bool>& levels) {
+    std::vector<uint8_t> bytes;
+    size_t i = 0;
+    int bitCount = 0;
+    uint8_t byte = 0;
+
+    while (i < levels.size()) {
+        int high = 0, low = 0;
+        while (i < levels.size() && levels[i]) high++, i++;
+        while (i < levels.size() && !levels[i]) low++, i++;
+
+        const double highNs = high * SLOT_NS;
+        const double lowNs = low * SLOT_NS;
+        const bool one = highNs > (T0H_NS + T1H_NS) / 2;
+
+        EXPECT_NEAR(one ? T1H_NS : T0H_NS, highNs, TOLERANCE_NS);
+        EXPECT_NEAR(one ? T1L_NS : T0L_NS, lowNs, TOLERANCE_NS);
+
+        byte = (byte << 1) | one;
+        if (++bitCount == 8) {
+            bytes.push_back(byte);
+            bitCount = 0;
+        }
+    }
+    EXPECT_EQ(0, bitCount);
+    return bytes;
+}
+}  // namespace
+
+TEST(WS2811Encoding, slotPattern) {
+    // 1 -> 110, 0 -> 100
+    const uint8_t data[] = {0xA5, 0x00, 0xFF};
+    uint8_t slots[encodedSize(3)] = {};
+    encode(data, 3, slots);
+
+    // 110 100 110 100 100 110 100 110
+    EXPECT_EQ(0xD3, slots[0]);
+    EXPECT_EQ(0x49, slots[1]);
+    EXPECT_EQ(0xA6, slots[2]);
+
+    // 100 100 100 100 100 100 100 100
+    EXPECT_EQ(0x92, slots[3]);
+    EXPECT_EQ(0x49, slots[4]);
+    EXPECT_EQ(0x24, slots[5]);
+
+    // 110 110 110 110 110 110 110 110
+    EXPECT_EQ(0xDB, slots[6]);
+    EXPECT_EQ(0x6D, slots[7]);
+    EXPECT_EQ(0xB6, slots[8]);
+}
+
+TEST(WS2811Encoding, slotTiming) {
+    // one slot is 40 ticks of the 96 MHz core clock on the mbed
+    EXPECT_EQ(96000000 % SLOTS_PER_SECOND, 0);
+    EXPECT_EQ(40, 96000000 / SLOTS_PER_SECOND);
+
+    EXPECT_NEAR(T0H_NS, 1 * SLOT_NS, TOLERANCE_NS);
+    EXPECT_NEAR(T0L_NS, 2 * SLOT_NS, TOLERANCE_NS);
+    EXPECT_NEAR(T1H_NS, 2 * SLOT_NS, TOLERANCE_NS);
+    EXPECT_NEAR(T1L_NS, 1 * SLOT_NS, TOLERANCE_NS);
+}
+
+TEST(WS2811Encoding, dmaChainPlaysBackSlots) {
+    // a few pixels in GRB order, plus every byte value
+    std::vector<uint8_t> data = {0xA5, 0xFF, 0x00, 0x01, 0x80, 0x7E};
+    for (int b = 0; b < 256; b++) data.push_back(b);
+
+    std::vector<uint8_t> slots(encodedSize(data.size()));
+    encode(data.data(), data.size(), slots.data());
+
+    uint32_t words[3];
+    std::vector<Descriptor> chain(chainLength(data.size()));
+
+    // the pin is bit 0 of its port, with other output pins around it
+    uint32_t setReg = 0, clrReg = 0;
+    const uint32_t mask = 1 << 0;
+    buildChain(slots.data(), data.size() * 8, words, chain.data(), mask,
+               reinterpret_cast<uintptr_t>(&setReg),
+               reinterpret_cast<uintptr_t>(&clrReg));
+
+    EXPECT_EQ(0u, words[0]);
+    EXPECT_EQ(mask, words[1]);
+    EXPECT_EQ(mask, words[2]);
+
+    bool interrupt = false;
+    const std::vector<bool> levels =
+        playChain(&chain[0], reinterpret_cast<uintptr_t>(&setReg),
+                  reinterpret_cast<uintptr_t>(&clrReg), mask, &interrupt);
+    EXPECT_TRUE(interrupt);
+
+    // one transfer per slot, and the pin follows the slots exactly
+    ASSERT_EQ(data.size() * 8 * SLOTS_PER_BIT, levels.size());
+    for (size_t i = 0; i < levels.size(); i++) {
+        ASSERT_EQ(slotLevel(slots.data(), i), levels[i]) << "slot " << i;
+    }
+
+    // and it's a valid waveform for the data that went in
+    EXPECT_EQ(data, decode(levels));
+
+    // the line is left low for the reset pulse
+    EXPECT_FALSE(levels.back());
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Keeps track of the battery for the control loop, from the battery sense pin
+ * sampled at about 1 kHz and the current the motors draw.
+ *
+ * The duty cycle the wheels need for a given speed goes up as the battery
+ * drains, and supplyScale() gives what to multiply feedforward duty cycles by
+ * to make up for that.
+ *
+ * Under load, the battery's terminal voltage drops by its internal resistance
+ * times the current, and a hard acceleration on a drained pack can pull it
+ * low enough to brown out the mbed.  The open circuit voltage is taken
+ * whenever the motors are drawing next to nothing, and the internal resistance
+ * is worked out from how far the voltage sags when they aren't, so
+ * maxAmps() can say how much current the battery can give before it sags to
+ * minVolts.  The resistance starts out high, so the first hard acceleration
+ * is on the safe side.
+ *
+ * sample() is meant to be called from a timer, and only does integer math.
+ * The rest is plain logic, so it can be tested on the host.
+ */
+class BatteryMonitor {
+public:
+    /// The filter's time constant in samples, as a power of two
+    static const int FILTER_SHIFT = 3;
+
+    /// Below this, the battery isn't connected, and the robot is probably on
+    /// USB power
+    static constexpr float MIN_SENSED_VOLTS = 5;
+
+    /// Draw that counts as resting, and that's enough to measure the
+    /// resistance from, in A
+    static constexpr float RESTING_AMPS = 0.5;
+    static constexpr float LOADED_AMPS = 3;
+
+    /// What the resistance estimate can be, in ohms
+    static constexpr float MIN_RESISTANCE = 0.02;
+    static constexpr float MAX_RESISTANCE = 1;
+
+    /// Fraction of the way the estimates move each tick
+    static constexpr float GAIN = 1 / 16.0f;
+
+    struct Params {
+        /// What the feedforward duty cycles were tuned at, in V
+        float nominalVolts;
+
+        /// Lowest the battery should sag to, with margin over where the
+        /// regulators drop out, in V
+        float minVolts;
+
+        /// Internal resistance to start from, in ohms, including the wiring
+        float resistance;
+    };
+
+    /// @param voltsPerCount battery volts per count of AnalogIn::read_u16()
+    /// @param params typical values for the robot's pack unless given
+    explicit BatteryMonitor(float voltsPerCount,
+                            const Params& params = {18, 14, 0.3})
+        : _voltsPerCount(voltsPerCount) {
+        setParams(params);
+    }
+
+    void setParams(const Params& params) {
+        _params = params;
+        _resistance = params.resistance;
+    }
+    const Params& params() const { return _params; }
+
+    /// Adds a reading from the battery sense pin
+    void sample(uint16_t raw) {
+        if (_filtered == 0) {
+            _filtered = static_cast<uint32_t>(raw) << FILTER_SHIFT;
+        } else {
+            _filtered = _filtered - (_filtered >> FILTER_SHIFT) + raw;
+        }
+    }
+
+    /// The filtered battery voltage, in V
+    float volts() const {
+        return _filtered * _voltsPerCount / (1 << FILTER_SHIFT);
+    }
+
+    /// The filtered reading in the same 8 bit units it's always been sent
+    /// over the radio in
+    uint8_t reading() const { return (_filtered >> FILTER_SHIFT) >> 8; }
+
+    /// False if the battery isn't connected
+    bool sensed() const { return volts() >= MIN_SENSED_VOLTS; }
+
+    /// What to multiply feedforward duty cycles by for the voltage the
+    /// battery's at
+    float supplyScale() const {
+        if (!sensed()) return 1;
+        const float v = std::fmax(volts(), _params.minVolts);
+        return _params.nominalVolts / v;
+    }
+
+    /**
+     * Updates the estimates of the battery's open circuit voltage and
+     * internal resistance, once a control tick.
+     *
+     * @param amps the current drawn from the battery over the last tick
+     */
+    void update(float amps) {
+        if (!sensed()) return;
+
+        const float v = volts();
+        if (_openVolts == 0) _openVolts = v;
+
+        if (std::abs(amps) <= RESTING_AMPS) {
+            _openVolts += (v + amps * _resistance - _openVolts) * GAIN;
+        } else if (std::abs(amps) >= LOADED_AMPS) {
+            float r = (_openVolts - v) / amps;
+            if (r < MIN_RESISTANCE) r = MIN_RESISTANCE;
+            if (r > MAX_RESISTANCE) r = MAX_RESISTANCE;
+            _resistance += (r - _resistance) * GAIN;
+        }
+    }
+
+    /// The most current the battery can give before sagging to minVolts
+    float maxAmps() const {
+        if (!sensed() || _openVolts == 0) return INFINITY;
+        const float amps = (_openVolts - _params.minVolts) / _resistance;
+        return amps > 0 ? amps : 0;
+    }
+
+    /// What to scale current requests that would draw @amps from the battery
+    /// by to keep it above minVolts, from 0 to 1
+    float powerScale(float amps) const {
+        const float most = maxAmps();
+        return amps > most ? most / amps : 1;
+    }
+
+    float openVolts() const { return _openVolts; }
+    float resistance() const { return _resistance; }
+
+private:
+    const float _voltsPerCount;
+    Params _params;
+
+    volatile uint32_t _filtered = 0;
+
+    float _openVolts = 0;
+    float _resistance;
+};
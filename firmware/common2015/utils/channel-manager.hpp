@@ -0,0 +1,366 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "forward-packet.hpp"
+#include "rtp.hpp"
+
+/**
+ * Coordinated radio channel switching.
+ *
+ * The base station runs a ChannelPlanner, which decides when the current
+ * channel has gotten bad enough to leave, from the replies it stops getting
+ * and from noise floor measurements it takes between frames.  When it picks a
+ * new channel, it announces it in the rtp::ChannelSchedule at the start of
+ * every forward packet for SWITCH_NOTICE_FRAMES frames, counting down, and
+ * moves after the packet that counts down to 1 and its replies.
+ *
+ * Each robot runs a ChannelFollower, which moves at the same frame boundary.
+ * A robot that stops hearing the base station, because it missed the
+ * announcement or because the new channel doesn't work where it is, goes back
+ * to the last channel it heard the base station on and then looks through the
+ * rest of them.
+ *
+ * Channels are numbered from 0 up to however many the radio has.  Both
+ * classes are plain logic, driven by calls from the radio code, so they can
+ * be simulated on the host.
+ */
+
+/**
+ * The base station's side of channel switching.  Call startFrame() before
+ * sending each forward packet, replyReceived() for each reply, and
+ * noiseSample() whenever the radio can measure a channel.
+ */
+class ChannelPlanner {
+public:
+    /// Forward packets that announce a switch before it happens
+    static const uint8_t SWITCH_NOTICE_FRAMES = 10;
+
+    /// Frames to stay on a channel before leaving it because of loss or noise
+    static const unsigned int MIN_DWELL_FRAMES = 120;
+
+    /// Frames after a switch without a single reply before going back
+    static const unsigned int FALLBACK_FRAMES = 30;
+
+    /// Reply loss, averaged over frames, that's bad enough to switch
+    static constexpr float LOSS_THRESHOLD = 0.4f;
+
+    /// How much quieter another channel has to be to switch to it
+    static constexpr float NOISE_MARGIN_DB = 6;
+
+    /// Noise floor assumed for channels that haven't been measured
+    static constexpr float UNMEASURED_NOISE_DBM = -90;
+
+    /// Penalty for a channel that was lossy the last time it was used, at
+    /// 100% loss.  It wears off over about ten seconds.
+    static constexpr float LOSS_PENALTY_DB = 40;
+
+    ChannelPlanner(uint8_t numChannels, uint8_t home)
+        : _numChannels(numChannels > MAX_CHANNELS ? MAX_CHANNELS : numChannels),
+          _channel(home < _numChannels ? home : 0),
+          _prev(_channel) {}
+
+    uint8_t channel() const { return _channel; }
+
+    /**
+     * Starts a frame.  Fills in the schedule for its forward packet.
+     *
+     * @return true if the radio has to be moved to channel() before sending
+     */
+    bool startFrame(rtp::ChannelSchedule* schedule) {
+        endFrame();
+
+        bool retune = false;
+        if (_countdown == 0 && _switchPending) {
+            _switchPending = false;
+            if (_loss > _penalty[_channel]) _penalty[_channel] = _loss;
+
+            // after falling back, there's nowhere to fall back to
+            _prev = _fallingBack ? _next : _channel;
+            _channel = _next;
+            _framesOnChannel = 0;
+            _repliesOnChannel = 0;
+            _loss = 0;
+            switches++;
+            retune = true;
+        }
+
+        if (!_switchPending) decide();
+
+        schedule->channel = _channel;
+        schedule->next = _switchPending ? _next : _channel;
+        schedule->countdown = _switchPending ? _countdown-- : 0;
+        return retune;
+    }
+
+    void replyReceived() { _replies++; }
+
+    /// Records a noise floor measurement taken while nothing was being sent
+    void noiseSample(uint8_t channel, float dBm) {
+        if (channel >= _numChannels) return;
+        _noise[channel] =
+            _measured[channel] ? _noise[channel] + (dBm - _noise[channel]) / 8
+                               : dBm;
+        _measured[channel] = true;
+    }
+
+    /// The next channel to measure, going around all of them in turn
+    uint8_t scanChannel() {
+        _scan = (_scan + 1) % _numChannels;
+        return _scan;
+    }
+
+    /// Moves to @channel, announcing it first, whatever the link looks like
+    void requestChannel(uint8_t channel) {
+        if (channel >= _numChannels) return;
+        if (channel == _channel) {
+            _switchPending = false;
+            return;
+        }
+        plan(channel, SWITCH_NOTICE_FRAMES, false);
+    }
+
+    /// Reply loss on the current channel, averaged over recent frames
+    float lossRate() const { return _loss; }
+
+    bool measured(uint8_t channel) const { return _measured[channel]; }
+    float noiseFloor(uint8_t channel) const { return _noise[channel]; }
+
+    /// What picking @channel would cost, in dB.  Lower is better.
+    float cost(uint8_t channel) const {
+        return (_measured[channel] ? _noise[channel] : UNMEASURED_NOISE_DBM) +
+               LOSS_PENALTY_DB * _penalty[channel];
+    }
+
+    unsigned int switches = 0;
+    unsigned int fallbacks = 0;
+
+private:
+    static const uint8_t MAX_CHANNELS = 8;
+
+    /// Frames that the expected number of replies is taken over
+    static const unsigned int EXPECTED_WINDOW = 60;
+
+    void endFrame() {
+        if (!_started) {
+            _started = true;
+            return;
+        }
+
+        // the number of robots answering is the most replies in a frame
+        // recently, which lets robots come and go
+        if (_replies > _maxThisWindow) _maxThisWindow = _replies;
+        if (++_windowFrames == EXPECTED_WINDOW) {
+            _maxLastWindow = _maxThisWindow;
+            _maxThisWindow = 0;
+            _windowFrames = 0;
+        }
+        const unsigned int expected =
+            _maxThisWindow > _maxLastWindow ? _maxThisWindow : _maxLastWindow;
+
+        if (expected) {
+            const float loss = 1 - float(_replies) / expected;
+            _loss += (loss - _loss) / 16;
+        }
+        _repliesOnChannel += _replies;
+        _replies = 0;
+        _framesOnChannel++;
+
+        for (uint8_t c = 0; c < _numChannels; c++) _penalty[c] *= 0.995f;
+    }
+
+    void decide() {
+        // nobody followed us to the new channel, or it doesn't work where
+        // they are, so go back to where the robots last were
+        if (_channel != _prev && _repliesOnChannel == 0 &&
+            _maxLastWindow + _maxThisWindow > 0 &&
+            _framesOnChannel >= FALLBACK_FRAMES) {
+            _penalty[_channel] = 1;
+            fallbacks++;
+            plan(_prev, 1, true);
+            return;
+        }
+
+        if (_framesOnChannel < MIN_DWELL_FRAMES) return;
+
+        uint8_t best = (_channel + 1) % _numChannels;
+        for (uint8_t i = 2; i < _numChannels; i++) {
+            const uint8_t c = (_channel + i) % _numChannels;
+            if (cost(c) < cost(best)) best = c;
+        }
+        if (best == _channel) return;
+
+        // the loss here counts against this channel the same way it will
+        // once we've left it
+        const float here = cost(_channel) + LOSS_PENALTY_DB * _loss;
+        const bool lossy = _loss > LOSS_THRESHOLD && cost(best) < here;
+        const bool noisy = _measured[_channel] && _measured[best] &&
+                           _noise[_channel] > _noise[best] + NOISE_MARGIN_DB;
+        if (lossy || noisy) plan(best, SWITCH_NOTICE_FRAMES, false);
+    }
+
+    void plan(uint8_t channel, uint8_t notice, bool fallback) {
+        _switchPending = true;
+        _fallingBack = fallback;
+        _next = channel;
+        _countdown = notice;
+    }
+
+    uint8_t _numChannels;
+    uint8_t _channel;
+    uint8_t _prev;
+    uint8_t _scan = 0;
+
+    bool _switchPending = false;
+    bool _fallingBack = false;
+    uint8_t _next = 0;
+    uint8_t _countdown = 0;
+
+    bool _started = false;
+    unsigned int _replies = 0;
+    unsigned int _maxThisWindow = 0;
+    unsigned int _maxLastWindow = 0;
+    unsigned int _windowFrames = 0;
+    unsigned int _framesOnChannel = 0;
+    unsigned int _repliesOnChannel = 0;
+    float _loss = 0;
+
+    bool _measured[MAX_CHANNELS] = {};
+    float _noise[MAX_CHANNELS] = {};
+    float _penalty[MAX_CHANNELS] = {};
+};
+
+/**
+ * A robot's side of channel switching.  Call received() with the schedule
+ * from each forward packet, replied() once its reply is out, and update()
+ * after that and every few milliseconds, moving the radio whenever update()
+ * says to.  It isn't thread safe, so if those come from different threads,
+ * like RadioProtocol's RX thread and timers, the caller has to lock around it.
+ */
+class ChannelFollower {
+public:
+    /// Time between forward packets
+    static const uint32_t FRAME_PERIOD_MS = 17;
+
+    /// How long after a forward packet all of the replies are out
+    static const uint32_t REPLY_WINDOW_MS = rtp::REPLY_WINDOW_MS;
+
+    /// Time without hearing the base station before looking for it elsewhere
+    static const uint32_t LOST_SYNC_MS = 250;
+
+    /// Time spent listening on each channel while looking
+    static const uint32_t HUNT_DWELL_MS = 100;
+
+    ChannelFollower(uint8_t numChannels, uint8_t home, uint32_t nowMs)
+        : _numChannels(numChannels),
+          _home(home < numChannels ? home : 0),
+          _channel(_home),
+          _lastGood(_home),
+          _lastRx(nowMs) {}
+
+    uint8_t channel() const { return _channel; }
+    uint8_t lastGood() const { return _lastGood; }
+    bool hunting() const { return _hunting; }
+
+    /// Sets the channel to start looking on after the last good one
+    void setHome(uint8_t home) {
+        if (home < _numChannels) _home = home;
+    }
+
+    /// Handles the schedule from a forward packet heard on channel()
+    void received(const rtp::ChannelSchedule& schedule, uint32_t nowMs) {
+        _lastRx = nowMs;
+        _lastGood = _channel;
+        _hunting = false;
+        _replied = false;
+
+        _switchPending = schedule.countdown > 0 &&
+                         schedule.next < _numChannels &&
+                         schedule.next != _channel;
+        if (_switchPending) {
+            _next = schedule.next;
+            _lastCountdown = schedule.countdown;
+
+            // if we miss the rest of the countdown, move when the base station
+            // does anyway
+            _switchAt = nowMs + (schedule.countdown - 1) * FRAME_PERIOD_MS +
+                        REPLY_WINDOW_MS;
+        }
+    }
+
+    /// Call once the reply to the last forward packet has been sent
+    void replied() { _replied = true; }
+
+    /**
+     * Moves on to the next channel if it's time to.
+     *
+     * @return true if the radio has to be moved to channel()
+     */
+    bool update(uint32_t nowMs) {
+        if (_switchPending &&
+            ((_replied && _lastCountdown == 1) ||
+             int32_t(nowMs - _switchAt) >= 0)) {
+            _switchPending = false;
+            _channel = _next;
+            // give the base station a chance to show up on the new channel
+            _lastRx = nowMs;
+            return true;
+        }
+
+        if (!_hunting && int32_t(nowMs - _lastRx) > int32_t(LOST_SYNC_MS)) {
+            _hunting = true;
+            _huntStep = 0;
+            return hunt(nowMs);
+        }
+        if (_hunting &&
+            int32_t(nowMs - _dwellStart) > int32_t(HUNT_DWELL_MS)) {
+            return hunt(nowMs);
+        }
+        return false;
+    }
+
+private:
+    /// Tries the last good channel, then home, then each channel in turn
+    bool hunt(uint32_t nowMs) {
+        _dwellStart = nowMs;
+
+        const uint8_t from = _channel;
+        while (true) {
+            const unsigned int step = _huntStep++;
+            uint8_t c;
+            if (step == 0) {
+                c = _lastGood;
+            } else if (step == 1) {
+                c = _home;
+            } else {
+                c = (_home + step - 1) % _numChannels;
+            }
+
+            // don't waste a dwell on the channel we just gave up on, unless
+            // there's nowhere else to go
+            if (c != from || _numChannels == 1) {
+                _channel = c;
+                break;
+            }
+        }
+        return _channel != from;
+    }
+
+    uint8_t _numChannels;
+    uint8_t _home;
+    uint8_t _channel;
+    uint8_t _lastGood;
+
+    uint32_t _lastRx;
+    bool _replied = false;
+
+    bool _switchPending = false;
+    uint8_t _next = 0;
+    uint8_t _lastCountdown = 0;
+    uint32_t _switchAt = 0;
+
+    bool _hunting = false;
+    unsigned int _huntStep = 0;
+    uint32_t _dwellStart = 0;
+};
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "forward-packet.hpp"
+#include "rtp.hpp"
+
+/**
+ * Compact control messages, see rtp::COMPACT_ENTRIES for the format.
+ *
+ * Most of what the base station sends a robot is the same as last frame, or
+ * close to it, so instead of the whole message, the encoder sends what changed
+ * since the previous forward packet.  That only works if the robot got the
+ * previous packet, so the encoder only sends a robot changes if it replied to
+ * the previous packet, and a whole message (a keyframe) otherwise.  A robot
+ * that can't decode its entry doesn't reply, so it gets a keyframe next.
+ *
+ * Both ends are plain logic, so they can be tested on the host.
+ */
+
+/**
+ * The base station's side.  Call encode() with each frame's control messages,
+ * and acked() for each robot that replies before the next frame.
+ */
+class ControlEncoder {
+public:
+    /// Every robot gets a keyframe at least this often, in frames
+    static const unsigned int KEYFRAME_INTERVAL = 60;
+
+    /// Robots with uids at least this high always get keyframes
+    static const uint8_t MAX_UIDS = 16;
+
+    /// Set to false to always send whole control messages
+    bool enabled = true;
+
+    /// Records a reply from @uid, which means it got the last forward packet
+    void acked(uint8_t uid) {
+        if (uid < MAX_UIDS) _robots[uid].acked = true;
+    }
+
+    /**
+     * Appends the payload of a forward packet to @payload, with compact
+     * entries if they come out smaller than whole messages, and the
+     * trajectories section @trajectories, if there is one.
+     *
+     * @return false if there are too many messages, or the trajectories
+     *     wouldn't fit with whole messages
+     */
+    bool encode(const rtp::ChannelSchedule& schedule,
+                const rtp::ControlMessage* msgs, size_t count,
+                std::vector<uint8_t>* payload,
+                const uint8_t* trajectories = nullptr,
+                size_t trajectoriesSize = 0) {
+        if (count > rtp::MAX_FORWARD_ENTRIES) return false;
+        if (rtp::ForwardPayloadSize(count) + trajectoriesSize >
+            rtp::MAX_FORWARD_PAYLOAD) {
+            return false;
+        }
+
+        _compact.clear();
+        for (size_t i = 0; i < count; i++) encodeEntry(msgs[i]);
+
+        // remember what everyone was sent, whichever way it goes out
+        bool inFrame[MAX_UIDS] = {};
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t uid = msgs[i].uid;
+            if (uid >= MAX_UIDS) continue;
+            inFrame[uid] = true;
+            _robots[uid].last = msgs[i];
+        }
+        for (uint8_t uid = 0; uid < MAX_UIDS; uid++) {
+            Robot& robot = _robots[uid];
+            robot.inLastFrame = inFrame[uid];
+            robot.acked = false;
+        }
+
+        const bool compact =
+            enabled && _compact.size() < count * sizeof(rtp::ControlMessage);
+        if (!compact) {
+            // the robots still have what was sent, so deltas can follow
+            return rtp::ForwardPayload::build(schedule, msgs, count, payload,
+                                              trajectories, trajectoriesSize);
+        }
+
+        frames++;
+        payload->reserve(payload->size() + rtp::ForwardPayloadSize(0) +
+                         _compact.size() + trajectoriesSize);
+        rtp::SerializeToVector(schedule, payload);
+        payload->push_back(count | rtp::COMPACT_ENTRIES |
+                           (trajectoriesSize ? rtp::HAS_TRAJECTORIES : 0));
+        payload->insert(payload->end(), _compact.begin(), _compact.end());
+        payload->insert(payload->end(), trajectories,
+                        trajectories + trajectoriesSize);
+        return true;
+    }
+
+    /// Forward packets sent with compact entries
+    unsigned int frames = 0;
+
+    /// Compact entries that were keyframes and deltas
+    unsigned int keyframes = 0;
+    unsigned int deltas = 0;
+
+private:
+    struct Robot {
+        rtp::ControlMessage last;
+        bool inLastFrame = false;
+        bool acked = false;
+        unsigned int sinceKeyframe = 0;
+    };
+
+    void encodeEntry(const rtp::ControlMessage& msg) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&msg);
+        _compact.push_back(msg.uid);
+
+        Robot* robot = msg.uid < MAX_UIDS ? &_robots[msg.uid] : nullptr;
+        if (!robot || !robot->inLastFrame || !robot->acked ||
+            robot->sinceKeyframe + 1 >= KEYFRAME_INTERVAL) {
+            _compact.push_back(rtp::COMPACT_KEY);
+            _compact.insert(_compact.end(), bytes + 1,
+                            bytes + sizeof(rtp::ControlMessage));
+            if (robot) robot->sinceKeyframe = 0;
+            keyframes++;
+            return;
+        }
+
+        const size_t flagsAt = _compact.size();
+        _compact.push_back(0);
+        uint8_t flags = 0;
+        const int16_t now[3] = {msg.bodyX, msg.bodyY, msg.bodyW};
+        const int16_t before[3] = {robot->last.bodyX, robot->last.bodyY,
+                                   robot->last.bodyW};
+        for (int field = 0; field < 3; field++) {
+            const int delta = now[field] - before[field];
+            if (delta == 0) continue;
+            if (delta >= INT8_MIN && delta <= INT8_MAX) {
+                flags |= rtp::BYTE_DELTA << (2 * field);
+                _compact.push_back(uint8_t(int8_t(delta)));
+            } else {
+                flags |= rtp::WORD << (2 * field);
+                _compact.push_back(now[field] & 0xFF);
+                _compact.push_back((now[field] >> 8) & 0xFF);
+            }
+        }
+
+        const uint8_t* tail = tailOf(&msg);
+        if (memcmp(tail, tailOf(&robot->last), rtp::CONTROL_TAIL_SIZE)) {
+            flags |= rtp::COMPACT_TAIL;
+            _compact.insert(_compact.end(), tail,
+                            tail + rtp::CONTROL_TAIL_SIZE);
+        }
+
+        _compact[flagsAt] = flags;
+        robot->sinceKeyframe++;
+        deltas++;
+    }
+
+    static const uint8_t* tailOf(const rtp::ControlMessage* msg) {
+        return reinterpret_cast<const uint8_t*>(msg) +
+               sizeof(rtp::ControlMessage) - rtp::CONTROL_TAIL_SIZE;
+    }
+
+    Robot _robots[MAX_UIDS];
+    std::vector<uint8_t> _compact;
+};
+
+/**
+ * A robot's side.  Call decode() with every forward packet, compact or not,
+ * so it knows which one it got last.
+ */
+class ControlDecoder {
+public:
+    enum Result {
+        /// There's no entry for us
+        NOT_ADDRESSED,
+
+        /// The message is in @msg
+        DECODED,
+
+        /// There's an entry for us, but it's changes from a packet we missed
+        /// or didn't have an entry in.  Don't reply, so we get a keyframe.
+        NEED_KEYFRAME,
+    };
+
+    /**
+     * Finds and decodes the message for @uid in a forward packet.  @seq is
+     * the packet's sequence number.
+     *
+     * @param entry set to the index of the entry, or -1 if there isn't one
+     */
+    Result decode(const rtp::ForwardPayload& forward, uint8_t seq, uint8_t uid,
+                  rtp::ControlMessage* msg, int* entry) {
+        const bool followsLast = _have && seq == uint8_t(_lastSeq + 1);
+        _lastSeq = seq;
+
+        // we're usually in the same place as last time
+        *entry = forward.find(uid, _hint);
+        if (*entry < 0) {
+            _have = false;
+            return NOT_ADDRESSED;
+        }
+        _hint = *entry;
+
+        if (!forward.compact()) {
+            _last = forward.entry(*entry);
+        } else {
+            const uint8_t* p = forward.compactEntry(*entry);
+            const uint8_t flags = p[1];
+            p += 2;
+
+            if (flags & rtp::COMPACT_KEY) {
+                uint8_t* bytes = reinterpret_cast<uint8_t*>(&_last);
+                bytes[0] = uid;
+                memcpy(bytes + 1, p, sizeof(rtp::ControlMessage) - 1);
+            } else if (!followsLast) {
+                _have = false;
+                missed++;
+                return NEED_KEYFRAME;
+            } else {
+                applyDelta(flags, p);
+            }
+        }
+
+        _have = true;
+        *msg = _last;
+        return DECODED;
+    }
+
+    /// Entries we couldn't decode because we'd missed what they changed
+    unsigned int missed = 0;
+
+private:
+    void applyDelta(uint8_t flags, const uint8_t* p) {
+        int16_t fields[3] = {_last.bodyX, _last.bodyY, _last.bodyW};
+        for (int field = 0; field < 3; field++) {
+            switch ((flags >> (2 * field)) & 0x3) {
+                case rtp::BYTE_DELTA:
+                    fields[field] += int8_t(*p++);
+                    break;
+                case rtp::WORD:
+                    fields[field] = int16_t(p[0] | (p[1] << 8));
+                    p += 2;
+                    break;
+            }
+        }
+        _last.bodyX = fields[0];
+        _last.bodyY = fields[1];
+        _last.bodyW = fields[2];
+
+        if (flags & rtp::COMPACT_TAIL) {
+            uint8_t* tail = reinterpret_cast<uint8_t*>(&_last) +
+                            sizeof(rtp::ControlMessage) -
+                            rtp::CONTROL_TAIL_SIZE;
+            memcpy(tail, p, rtp::CONTROL_TAIL_SIZE);
+        }
+    }
+
+    bool _have = false;
+    uint8_t _lastSeq = 0;
+    int _hint = -1;
+    rtp::ControlMessage _last;
+};
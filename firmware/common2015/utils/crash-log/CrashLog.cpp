@@ -0,0 +1,256 @@
+#include "CrashLog.hpp"
+
+#include <rtos.h>
+
+#include "logger.hpp"
+
+extern void* os_active_TCB[];
+extern "C" uint32_t os_time;
+
+namespace {
+// Marks the retained RAM block as holding a not-yet-stored fault record
+const uint32_t RETAINED_MARKER = 0xFA17C0DE;
+
+// RTX's TCB state value for the thread that's currently running
+const uint8_t TCB_STATE_RUNNING = 2;
+
+// OS_TASKCNT from RTX_Conf_CM.c, same as cmd_ps()
+const size_t MAX_THREADS = 15;
+
+// IAP ROM entry point and command codes
+typedef void (*IapEntry)(unsigned int[], unsigned int[]);
+const IapEntry iap_entry = reinterpret_cast<IapEntry>(0x1FFF1FF1);
+enum {
+    IAP_PREPARE_SECTORS = 50,
+    IAP_COPY_RAM_TO_FLASH = 51,
+    IAP_ERASE_SECTORS = 52,
+    IAP_CMD_SUCCESS = 0
+};
+
+// RSID register bits
+enum {
+    RSID_POR = 1 << 0,
+    RSID_EXTR = 1 << 1,
+    RSID_WDTR = 1 << 2,
+    RSID_BODR = 1 << 3
+};
+
+struct RetainedFault {
+    uint32_t marker;
+    uint32_t size;
+    uint8_t data[crash::MAX_ENCODED_SIZE];
+};
+
+// AHB SRAM bank 1 is NOLOAD in the linker script, so its contents survive a
+// reset.  The robot doesn't use USB device mode, which is the bank's only
+// other user.
+RetainedFault retainedFault __attribute__((section("AHBSRAM1"), aligned(4)));
+
+IapCrashStorage storage;
+crash::CrashRing<IapCrashStorage> ring(storage);
+
+crash::ResetReason lastResetReason = crash::RESET_POWER_ON;
+
+unsigned int iap(unsigned int cmd, unsigned int p1 = 0, unsigned int p2 = 0,
+                 unsigned int p3 = 0, unsigned int p4 = 0) {
+    unsigned int command[5] = {cmd, p1, p2, p3, p4};
+    unsigned int result[5] = {0};
+    iap_entry(command, result);
+    return result[0];
+}
+
+uint8_t runningThreadId() {
+    for (size_t i = 0; i < MAX_THREADS; i++) {
+        P_TCB p = (P_TCB)os_active_TCB[i];
+        if (p != nullptr && p->state == TCB_STATE_RUNNING) return p->task_id;
+    }
+    return crash::NO_THREAD;
+}
+
+/// Copies the most recent log messages into @rec after the @first lines it
+/// already has
+void captureLog(crash::Record* rec, size_t first) {
+    char lines[LOG_HISTORY_SIZE][LOG_HISTORY_LINE_SIZE];
+    const size_t n = logHistory(lines, crash::LOG_LINES - first);
+    for (size_t i = 0; i < n; i++) {
+        char* line = rec->logLines[first + i];
+        strncpy(line, lines[i], crash::LOG_LINE_LEN - 1);
+        line[crash::LOG_LINE_LEN - 1] = '\0';
+    }
+    rec->numLogLines = first + n;
+}
+
+/// Keeps @rec in retained RAM for Init() to store after the reset
+void retain(const crash::Record& rec) {
+    retainedFault.size =
+        crash::encode(rec, retainedFault.data, sizeof(retainedFault.data));
+    retainedFault.marker = RETAINED_MARKER;
+}
+}  // namespace
+
+bool IapCrashStorage::program(size_t i, const uint8_t* data) {
+    // IAP requires the source to be word aligned and in RAM
+    static uint32_t buf[SLOT_SIZE / sizeof(uint32_t)];
+    memcpy(buf, data, SLOT_SIZE);
+
+    const unsigned int cclkKhz = SystemCoreClock / 1000;
+
+    // flash can't be read while it's being programmed, so make sure no
+    // interrupt tries to fetch a vector or handler from it
+    __disable_irq();
+    unsigned int status = iap(IAP_PREPARE_SECTORS, SECTOR_NUM, SECTOR_NUM);
+    if (status == IAP_CMD_SUCCESS) {
+        status = iap(IAP_COPY_RAM_TO_FLASH, SECTOR_ADDR + i * SLOT_SIZE,
+                     reinterpret_cast<unsigned int>(buf), SLOT_SIZE, cclkKhz);
+    }
+    __enable_irq();
+
+    return status == IAP_CMD_SUCCESS;
+}
+
+bool IapCrashStorage::erase() {
+    const unsigned int cclkKhz = SystemCoreClock / 1000;
+
+    __disable_irq();
+    unsigned int status = iap(IAP_PREPARE_SECTORS, SECTOR_NUM, SECTOR_NUM);
+    if (status == IAP_CMD_SUCCESS) {
+        status = iap(IAP_ERASE_SECTORS, SECTOR_NUM, SECTOR_NUM, cclkKhz);
+    }
+    __enable_irq();
+
+    return status == IAP_CMD_SUCCESS;
+}
+
+void CrashLog::Init() {
+    const uint32_t rsid = LPC_SC->RSID;
+    // the bits are sticky, so clear them for next time
+    LPC_SC->RSID = rsid;
+
+    crash::Record rec;
+    bool haveFault = false;
+
+    if (retainedFault.marker == RETAINED_MARKER) {
+        retainedFault.marker = 0;
+        haveFault =
+            crash::decode(retainedFault.data, retainedFault.size, &rec);
+    }
+
+    if (haveFault) {
+        lastResetReason = rec.reason;
+    } else if (rsid & RSID_POR) {
+        lastResetReason = crash::RESET_POWER_ON;
+    } else if ((rsid & RSID_WDTR) || (LPC_WDT->WDMOD & (1 << 2))) {
+        lastResetReason = crash::RESET_WATCHDOG;
+    } else if (rsid & RSID_BODR) {
+        lastResetReason = crash::RESET_BROWNOUT;
+    } else if (rsid & RSID_EXTR) {
+        lastResetReason = crash::RESET_EXTERNAL;
+    } else {
+        lastResetReason = crash::RESET_SOFTWARE;
+    }
+
+    // power-on, reset button, and `reboot` resets are routine - don't wear
+    // out the flash recording them
+    if (!haveFault && (lastResetReason == crash::RESET_WATCHDOG ||
+                       lastResetReason == crash::RESET_BROWNOUT)) {
+        rec.reason = lastResetReason;
+        rec.numLogLines = 0;
+        haveFault = true;
+    }
+
+    if (haveFault && !ring.append(rec)) {
+        LOG(SEVERE, "Unable to store %s crash record",
+            crash::RESET_REASON_STRING[rec.reason]);
+    }
+}
+
+crash::ResetReason CrashLog::LastResetReason() { return lastResetReason; }
+
+void CrashLog::CaptureFault(const uint32_t* stackFrame) {
+    crash::Record rec;
+    rec.reason = crash::RESET_HARD_FAULT;
+    rec.uptimeMs = os_time;
+    rec.threadId = runningThreadId();
+
+    rec.regs.r0 = stackFrame[0];
+    rec.regs.r1 = stackFrame[1];
+    rec.regs.r2 = stackFrame[2];
+    rec.regs.r3 = stackFrame[3];
+    rec.regs.r12 = stackFrame[4];
+    rec.regs.lr = stackFrame[5];
+    rec.regs.pc = stackFrame[6];
+    rec.regs.psr = stackFrame[7];
+    rec.regs.msp = __get_MSP();
+    rec.regs.hfsr = SCB->HFSR;
+    rec.regs.cfsr = SCB->CFSR;
+    rec.regs.mmfar = SCB->MMFAR;
+    rec.regs.bfar = SCB->BFAR;
+
+    // the stack contents just above the 8 word exception frame belong to the
+    // function that faulted
+    rec.numStackWords = crash::STACK_WORDS;
+    for (size_t i = 0; i < crash::STACK_WORDS; i++)
+        rec.stack[i] = stackFrame[8 + i];
+
+    captureLog(&rec, 0);
+    retain(rec);
+}
+
+void CrashLog::CaptureStarved(uint8_t threadId, const char* what) {
+    crash::Record rec;
+    rec.reason = crash::RESET_STARVED;
+    rec.uptimeMs = os_time;
+    rec.threadId = threadId;
+
+    strncpy(rec.logLines[0], what, crash::LOG_LINE_LEN - 1);
+    rec.logLines[0][crash::LOG_LINE_LEN - 1] = '\0';
+    captureLog(&rec, 1);
+    retain(rec);
+}
+
+void CrashLog::Print() {
+    size_t n = 0;
+
+    ring.forEach([&n](const crash::Record& rec) {
+        n++;
+        printf("#%-4lu %-10s uptime: %lu.%03lus  thread: ",
+               static_cast<unsigned long>(rec.seq),
+               crash::RESET_REASON_STRING[rec.reason],
+               static_cast<unsigned long>(rec.uptimeMs / 1000),
+               static_cast<unsigned long>(rec.uptimeMs % 1000));
+        if (rec.threadId == crash::NO_THREAD)
+            printf("N/A\r\n");
+        else
+            printf("%u\r\n", rec.threadId);
+
+        if (rec.reason == crash::RESET_HARD_FAULT) {
+            const auto& r = rec.regs;
+            printf(
+                "    pc:   0x%08lX  lr:   0x%08lX  psr:  0x%08lX\r\n"
+                "    r0:   0x%08lX  r1:   0x%08lX  r2:   0x%08lX\r\n"
+                "    r3:   0x%08lX  r12:  0x%08lX  msp:  0x%08lX\r\n"
+                "    hfsr: 0x%08lX  cfsr: 0x%08lX\r\n"
+                "    mmfar: 0x%08lX  bfar: 0x%08lX\r\n",
+                r.pc, r.lr, r.psr, r.r0, r.r1, r.r2, r.r3, r.r12, r.msp,
+                r.hfsr, r.cfsr, r.mmfar, r.bfar);
+
+            printf("    stack:");
+            for (size_t i = 0; i < rec.numStackWords; i++) {
+                if (i % 6 == 0) printf("\r\n     ");
+                printf(" %08lX", rec.stack[i]);
+            }
+            printf("\r\n");
+        }
+
+        for (size_t i = 0; i < rec.numLogLines; i++)
+            printf("    log:  %s\r\n", rec.logLines[i]);
+
+        fflush(stdout);
+    });
+
+    if (n == 0) printf("No crash records stored.\r\n");
+}
+
+size_t CrashLog::Count() { return ring.count(); }
+
+bool CrashLog::Clear() { return ring.clear(); }
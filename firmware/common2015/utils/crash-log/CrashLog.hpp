@@ -0,0 +1,83 @@
+#pragma once
+
+#include <mbed.h>
+
+#include "CrashRecord.hpp"
+
+/**
+ * Flash storage for crash records using the LPC1768's In-Application
+ * Programming (IAP) ROM routines.
+ *
+ * The last flash sector (sector 29, 32KB) is reserved for the crash ring.  The
+ * firmware image must stay below 0x78000 for this to be safe, which the build
+ * checks after linking, see MBED_FLASH_LIMIT in arm_mbed.cmake.
+ */
+class IapCrashStorage {
+public:
+    static const size_t SLOT_SIZE = 512;
+
+    size_t numSlots() const { return SECTOR_SIZE / SLOT_SIZE; }
+
+    const uint8_t* slot(size_t i) const {
+        return reinterpret_cast<const uint8_t*>(SECTOR_ADDR + i * SLOT_SIZE);
+    }
+
+    /// Write SLOT_SIZE bytes to the given slot.  The slot must be erased.
+    bool program(size_t i, const uint8_t* data);
+
+    /// Erase the whole sector
+    bool erase();
+
+private:
+    static const uint32_t SECTOR_NUM = 29;
+    static const uint32_t SECTOR_ADDR = 0x78000;
+    static const uint32_t SECTOR_SIZE = 0x8000;
+};
+
+/**
+ * Captures a record of every abnormal reset so that it can be inspected after
+ * the fact, even if no serial console was attached when it happened.
+ *
+ * Hard faults are captured into a block of retained RAM (AHB SRAM bank 1, which
+ * isn't cleared on reset) since it's not safe to program flash from inside the
+ * fault handler, or from a thread that's about to reset.  On the next boot,
+ * Init() moves any captured record, or a record of a watchdog/brownout reset,
+ * into the flash-backed crash ring.
+ */
+class CrashLog {
+public:
+    /**
+     * Determine why we reset and store a record of it if it was abnormal.
+     * Call this once, early in main().
+     */
+    static void Init();
+
+    /// The reason for the most recent reset, as determined by Init()
+    static crash::ResetReason LastResetReason();
+
+    /**
+     * Save the fault state.  Only call this from the hard fault handler.
+     *
+     * @param stackFrame The exception stack frame pushed by the processor
+     */
+    static void CaptureFault(const uint32_t* stackFrame);
+
+    /**
+     * Save a record of a thread that stopped checking in with the watchdog
+     * supervisor, see Heartbeat, to be stored on the next boot.  Call this
+     * right before resetting.
+     *
+     * @param what  says which thread it was and how long it went, and is
+     *     stored as the first log line
+     */
+    static void CaptureStarved(uint8_t threadId, const char* what);
+
+    /// Print all stored records to the console
+    static void Print();
+
+    /// Number of records currently stored in flash
+    static size_t Count();
+
+    /// Erase all stored records
+    static bool Clear();
+};
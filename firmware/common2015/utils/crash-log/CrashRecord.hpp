@@ -0,0 +1,320 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "../crc.hpp"
+
+/**
+ * Binary format and storage ring for crash/reset records.
+ *
+ * Everything in this file is free of mbed dependencies so that the codec and
+ * ring logic can be unit tested on the host.  See CrashLog.hpp for the part
+ * that talks to the hardware.
+ */
+namespace crash {
+
+/// Why the mbed came back up.  Only abnormal resets are ever stored.
+enum ResetReason : uint8_t {
+    RESET_POWER_ON = 0,
+    RESET_EXTERNAL,
+    RESET_WATCHDOG,
+    RESET_BROWNOUT,
+    RESET_SOFTWARE,
+    RESET_HARD_FAULT,
+
+    /// A thread stopped checking in with the watchdog supervisor
+    RESET_STARVED,
+    RESET_REASON_END
+};
+
+static const char* const RESET_REASON_STRING[] = {
+    "POWER-ON", "EXTERNAL",   "WATCHDOG", "BROWNOUT",
+    "SOFTWARE", "HARD FAULT", "STARVED"};
+
+/// Number of stack words copied from just above the exception frame
+static const size_t STACK_WORDS = 24;
+
+/// Number of recent log messages stored with each record
+static const size_t LOG_LINES = 4;
+
+/// Max length (including the null terminator) of each stored log message
+static const size_t LOG_LINE_LEN = 48;
+
+/// Thread id used when the faulting context isn't a known thread
+static const uint8_t NO_THREAD = 0xFF;
+
+/// Register values captured by the hard fault handler
+struct FaultRegs {
+    uint32_t r0, r1, r2, r3, r12, lr, pc, psr;
+    uint32_t msp, hfsr, cfsr, mmfar, bfar;
+};
+
+static const size_t NUM_FAULT_REGS = sizeof(FaultRegs) / sizeof(uint32_t);
+
+struct Record {
+    /// Monotonic record number, assigned when the record is stored
+    uint32_t seq = 0;
+
+    /// Milliseconds the system had been running for when the record was made
+    uint32_t uptimeMs = 0;
+
+    ResetReason reason = RESET_POWER_ON;
+
+    /// RTX task id of the thread that was running at the time of the fault,
+    /// or the one that starved
+    uint8_t threadId = NO_THREAD;
+
+    FaultRegs regs = {};
+
+    uint8_t numStackWords = 0;
+    std::array<uint32_t, STACK_WORDS> stack = {};
+
+    uint8_t numLogLines = 0;
+    char logLines[LOG_LINES][LOG_LINE_LEN] = {};
+};
+
+/*
+ * Encoded record layout (all values little-endian):
+ *
+ *  Offset | Size | Field
+ * --------------------------------------------------------
+ *  0      | 2    | magic (MAGIC)
+ *  2      | 1    | format version (VERSION)
+ *  3      | 1    | reset reason
+ *  4      | 2    | payload length
+ *  6      | 2    | CRC-16 of the payload
+ * --------------------------------------------------------
+ *  8      | 4    | seq
+ *  12     | 4    | uptime (ms)
+ *  16     | 1    | thread id
+ *  17     | 1    | number of stack words (S)
+ *  18     | 1    | number of log lines (L)
+ *  19     | 1    | reserved
+ *  20     | 52   | fault registers
+ *  72     | 4*S  | stack words
+ *  ...    | L*   | log lines, each as a length byte followed by its chars
+ * --------------------------------------------------------
+ */
+static const uint16_t MAGIC = 0x5243;  // 'CR'
+static const uint8_t VERSION = 1;
+static const size_t HEADER_SIZE = 8;
+static const size_t FIXED_PAYLOAD_SIZE = 12 + 4 * NUM_FAULT_REGS;
+
+/// The largest size an encoded record can ever be
+static const size_t MAX_ENCODED_SIZE = HEADER_SIZE + FIXED_PAYLOAD_SIZE +
+                                       4 * STACK_WORDS +
+                                       LOG_LINES * LOG_LINE_LEN;
+
+namespace detail {
+inline void put16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+inline void put32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (v >> (8 * i)) & 0xFF;
+}
+inline uint16_t get16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+inline uint32_t get32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) |
+           (static_cast<uint32_t>(p[3]) << 24);
+}
+}  // namespace detail
+
+/**
+ * Serialize a record into @buf.
+ *
+ * @return The number of bytes written, or 0 if @buf is too small
+ */
+inline size_t encode(const Record& rec, uint8_t* buf, size_t bufSize) {
+    using namespace detail;
+
+    const size_t numStack =
+        rec.numStackWords < STACK_WORDS ? rec.numStackWords : STACK_WORDS;
+    const size_t numLog =
+        rec.numLogLines < LOG_LINES ? rec.numLogLines : LOG_LINES;
+
+    // figure out how large the payload is before touching the buffer
+    size_t logLens[LOG_LINES];
+    size_t payloadLen = FIXED_PAYLOAD_SIZE + 4 * numStack;
+    for (size_t i = 0; i < numLog; i++) {
+        logLens[i] = strnlen(rec.logLines[i], LOG_LINE_LEN - 1);
+        payloadLen += 1 + logLens[i];
+    }
+
+    if (HEADER_SIZE + payloadLen > bufSize) return 0;
+
+    uint8_t* p = buf + HEADER_SIZE;
+    put32(p, rec.seq);
+    put32(p + 4, rec.uptimeMs);
+    p[8] = rec.threadId;
+    p[9] = numStack;
+    p[10] = numLog;
+    p[11] = 0;
+    p += 12;
+
+    const uint32_t* regs = reinterpret_cast<const uint32_t*>(&rec.regs);
+    for (size_t i = 0; i < NUM_FAULT_REGS; i++, p += 4) put32(p, regs[i]);
+
+    for (size_t i = 0; i < numStack; i++, p += 4) put32(p, rec.stack[i]);
+
+    for (size_t i = 0; i < numLog; i++) {
+        *p++ = logLens[i];
+        memcpy(p, rec.logLines[i], logLens[i]);
+        p += logLens[i];
+    }
+
+    put16(buf, MAGIC);
+    buf[2] = VERSION;
+    buf[3] = rec.reason;
+    put16(buf + 4, payloadLen);
+    put16(buf + 6, crc::crc16(buf + HEADER_SIZE, payloadLen));
+
+    return HEADER_SIZE + payloadLen;
+}
+
+/**
+ * Deserialize a record from @buf.
+ *
+ * @return false if the buffer doesn't hold a complete, valid record
+ */
+inline bool decode(const uint8_t* buf, size_t bufSize, Record* rec) {
+    using namespace detail;
+
+    if (bufSize < HEADER_SIZE + FIXED_PAYLOAD_SIZE) return false;
+    if (get16(buf) != MAGIC || buf[2] != VERSION) return false;
+    if (buf[3] >= RESET_REASON_END) return false;
+
+    const size_t payloadLen = get16(buf + 4);
+    if (payloadLen < FIXED_PAYLOAD_SIZE || HEADER_SIZE + payloadLen > bufSize)
+        return false;
+    if (crc::crc16(buf + HEADER_SIZE, payloadLen) != get16(buf + 6))
+        return false;
+
+    const uint8_t* p = buf + HEADER_SIZE;
+    const uint8_t* end = p + payloadLen;
+
+    *rec = Record();
+    rec->reason = static_cast<ResetReason>(buf[3]);
+    rec->seq = get32(p);
+    rec->uptimeMs = get32(p + 4);
+    rec->threadId = p[8];
+    rec->numStackWords = p[9];
+    rec->numLogLines = p[10];
+    p += 12;
+
+    if (rec->numStackWords > STACK_WORDS || rec->numLogLines > LOG_LINES)
+        return false;
+
+    uint32_t* regs = reinterpret_cast<uint32_t*>(&rec->regs);
+    for (size_t i = 0; i < NUM_FAULT_REGS; i++, p += 4) regs[i] = get32(p);
+
+    if (p + 4 * rec->numStackWords > end) return false;
+    for (size_t i = 0; i < rec->numStackWords; i++, p += 4)
+        rec->stack[i] = get32(p);
+
+    for (size_t i = 0; i < rec->numLogLines; i++) {
+        if (p >= end) return false;
+        const size_t len = *p++;
+        if (len >= LOG_LINE_LEN || p + len > end) return false;
+        memcpy(rec->logLines[i], p, len);
+        rec->logLines[i][len] = '\0';
+        p += len;
+    }
+
+    return p == end;
+}
+
+/**
+ * A ring of crash records kept in a block of erasable storage (ie a flash
+ * sector).
+ *
+ * The storage is split into fixed-size slots that are written in order.  An
+ * erased slot reads back as all 0xFF.  Once every slot has been used, the
+ * whole block is erased and writing starts over from the first slot, so the
+ * newest record is never lost.
+ *
+ * The STORAGE type must provide:
+ *  - static const size_t SLOT_SIZE
+ *  - size_t numSlots() const
+ *  - const uint8_t* slot(size_t i) const
+ *  - bool program(size_t i, const uint8_t* data)    // writes SLOT_SIZE bytes
+ *  - bool erase()
+ */
+template <class STORAGE>
+class CrashRing {
+public:
+    static_assert(STORAGE::SLOT_SIZE >= MAX_ENCODED_SIZE,
+                  "storage slots are too small to hold a crash record");
+
+    explicit CrashRing(STORAGE& storage) : _storage(storage) {}
+
+    /// Store a record, assigning it the next sequence number
+    bool append(Record rec) {
+        size_t next = firstFreeSlot();
+        uint32_t lastSeq = 0;
+
+        for (size_t i = 0; i < next; i++) {
+            Record stored;
+            if (read(i, &stored) && stored.seq > lastSeq) lastSeq = stored.seq;
+        }
+
+        if (next >= _storage.numSlots()) {
+            if (!_storage.erase()) return false;
+            next = 0;
+        }
+
+        rec.seq = lastSeq + 1;
+
+        // unused bytes are left erased
+        std::array<uint8_t, STORAGE::SLOT_SIZE> buf;
+        buf.fill(0xFF);
+        if (encode(rec, buf.data(), buf.size()) == 0) return false;
+
+        return _storage.program(next, buf.data());
+    }
+
+    /// Read the record in the given slot
+    bool read(size_t slot, Record* rec) const {
+        if (slot >= _storage.numSlots()) return false;
+        return decode(_storage.slot(slot), STORAGE::SLOT_SIZE, rec);
+    }
+
+    /// Number of valid records currently stored
+    size_t count() const {
+        size_t n = 0;
+        Record rec;
+        for (size_t i = 0; i < firstFreeSlot(); i++)
+            if (read(i, &rec)) n++;
+        return n;
+    }
+
+    /// Call @func with each valid record, oldest first
+    template <class FUNC>
+    void forEach(FUNC func) const {
+        Record rec;
+        for (size_t i = 0; i < firstFreeSlot(); i++)
+            if (read(i, &rec)) func(rec);
+    }
+
+    /// Remove all stored records
+    bool clear() { return _storage.erase(); }
+
+private:
+    bool isErased(size_t slot) const {
+        const uint8_t* p = _storage.slot(slot);
+        return p[0] == 0xFF && p[1] == 0xFF;
+    }
+
+    size_t firstFreeSlot() const {
+        size_t i = 0;
+        while (i < _storage.numSlots() && !isErased(i)) i++;
+        return i;
+    }
+
+    STORAGE& _storage;
+};
+
+}  // namespace crash
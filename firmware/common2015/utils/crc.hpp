@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Checksum helpers shared by anything that stores or transmits binary records.
+ *
+ * These are bitwise implementations (no lookup tables) so they don't cost any
+ * flash on the mbed and can be used from both firmware and host-side tests.
+ */
+namespace crc {
+
+/**
+ * CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF).
+ *
+ * @param data  Buffer to checksum
+ * @param len   Number of bytes in @data
+ * @param crc   Running checksum value when computing over multiple buffers
+ */
+inline uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF) {
+    for (size_t i = 0; i < len; i++) {
+        crc ^= static_cast<uint16_t>(data[i]) << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+/**
+ * CRC-32 (poly 0xEDB88320 reflected, the same one zlib uses).
+ *
+ * To checksum multiple buffers, pass the return value of the previous call as
+ * @crc.
+ *
+ * @param data  Buffer to checksum
+ * @param len   Number of bytes in @data
+ * @param crc   Running checksum value when computing over multiple buffers
+ */
+inline uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc = 0) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : (crc >> 1);
+        }
+    }
+    return ~crc;
+}
+
+}  // namespace crc
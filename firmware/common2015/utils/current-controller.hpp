@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Inner current (torque) loop for the drive motors, run on the currents the
+ * FPGA measures through the DRV8303 shunt amplifiers.
+ *
+ * The wheel velocity PIDs ask for a duty cycle, and with only the duty cycle
+ * to go on, the torque that comes out of it depends on the supply voltage and
+ * on how hot the windings are.  Here, the part of the duty cycle that isn't
+ * spent on back EMF is taken as a request for current, by way of the motor's
+ * nominal stall current.  The request is clamped to the current limit, and a
+ * PI loop on the measured current corrects the duty cycle until the motor
+ * draws what was asked for.
+ *
+ * The FPGA only reports how much current flows, not which way, so it's taken
+ * to flow the way it was last asked to.  The control loop runs far slower than
+ * the motor's electrical time constant, so the current follows the duty cycle
+ * within a tick, and the loop only has to make up for the model being off.
+ *
+ * This is plain logic, so it can be tested on the host.
+ */
+class CurrentController {
+public:
+    static const size_t NUM_MOTORS = 4;
+    static const int16_t MAX_DUTY = 511;
+
+    struct Params {
+        /// Current at full duty with the motor held still, in A
+        float stallCurrent;
+
+        /// Most current to ask for, in A
+        float limit;
+
+        /// Duty cycle per A of error, and per A s for the integral
+        float kp;
+        float ki;
+    };
+
+    CurrentController() {
+        // the stall current is from the motor datasheet, not measured
+        setParams({15, 8, 4, 300});
+    }
+
+    void setParams(const Params& params) { _params = params; }
+    const Params& params() const { return _params; }
+
+    /**
+     * Corrects motor @motor's duty cycle for the current it draws.
+     *
+     * @param duty the duty cycle the velocity loop wants
+     * @param backEmf the duty cycle that would balance the motor's back EMF at
+     *     the speed it's turning
+     * @param measured the current the motor drew over the last tick, in A
+     * @param dt how long the last tick was, in s
+     * @return the duty cycle to drive at
+     */
+    int16_t run(size_t motor, float duty, float backEmf, float measured,
+                float dt) {
+        Motor& m = _motors[motor];
+
+        // how far off the last tick was
+        const float actual = m.command < 0 ? -measured : measured;
+        const float err = m.command - actual;
+        if (dt > 0 && _params.ki > 0) {
+            const float maxIntegral = MAX_DUTY / 4 / _params.ki;
+            m.integral += err * dt;
+            if (m.integral > maxIntegral) m.integral = maxIntegral;
+            if (m.integral < -maxIntegral) m.integral = -maxIntegral;
+        }
+
+        const float command = request(duty, backEmf);
+        m.command = command;
+
+        float out = dutyFor(command, backEmf) + _params.kp * err +
+                    _params.ki * m.integral;
+        if (out > MAX_DUTY) out = MAX_DUTY;
+        if (out < -MAX_DUTY) out = -MAX_DUTY;
+        return static_cast<int16_t>(std::lround(out));
+    }
+
+    /// The current that @duty asks for, in A, within the limit
+    float request(float duty, float backEmf) const {
+        float amps = (duty - backEmf) / MAX_DUTY * _params.stallCurrent;
+        if (amps > _params.limit) amps = _params.limit;
+        if (amps < -_params.limit) amps = -_params.limit;
+        return amps;
+    }
+
+    /// The duty cycle that draws @amps by the model, before any correction
+    float dutyFor(float amps, float backEmf) const {
+        return backEmf + amps / _params.stallCurrent * MAX_DUTY;
+    }
+
+    /// The current motor @motor was last asked to draw, in A
+    float command(size_t motor) const { return _motors[motor].command; }
+
+    void reset() {
+        for (Motor& m : _motors) m = Motor();
+    }
+
+private:
+    struct Motor {
+        float command = 0;
+        float integral = 0;
+    };
+
+    Params _params;
+    Motor _motors[NUM_MOTORS];
+};
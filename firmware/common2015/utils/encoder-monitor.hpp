@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Catches drive wheels whose encoder has died, come unplugged, or been plugged
+ * into the wrong connector, by checking it against the motor's hall sensors,
+ * like robot2011's encoder_monitor.c.
+ *
+ * Both count how far the motor turned, but the halls much more coarsely, so a
+ * single control tick says little at low speed.  The deltas are summed over
+ * the last WINDOW ticks instead, and the encoder has to agree with the halls
+ * to within one hall count's worth of ticks plus some slack.  A hysteresis
+ * counter goes up by COUNT_BAD for every tick that doesn't agree and down by
+ * COUNT_GOOD for every one that does.  The encoder is flagged when the counter
+ * reaches FAULT_THRESHOLD, and trusted again once it's back to zero.
+ *
+ * While a wheel is flagged, hallEstimate() gives a velocity from the halls in
+ * encoder ticks per control tick, for the controller to use in its place.
+ * The margins and thresholds below haven't been checked against a drive motor
+ * on carpet yet, so until they have, robot2015 shuts a flagged wheel off
+ * instead, see RJ_ENCODER_FALLBACK.
+ *
+ * This is plain logic, so it can be tested on the host.
+ */
+class EncoderMonitor {
+public:
+    static const size_t NUM_WHEELS = 4;
+
+    /// Ticks to sum the deltas over, 40 ms at the 5 ms control loop
+    static const size_t WINDOW = 8;
+
+    /// How far apart the window's sums can be, in hall counts and encoder
+    /// ticks, and as a fraction of the expected value for a bad ratio
+    static const int HALL_MARGIN = 1;
+    static const int ENC_MARGIN = 16;
+    static constexpr float RELATIVE_MARGIN = 0.1;
+
+    static const int COUNT_BAD = 10;
+    static const int COUNT_GOOD = 1;
+
+    /// 20 bad ticks in a row to be flagged, 200 good ones to be trusted again
+    static const int FAULT_THRESHOLD = 200;
+
+    /// @param encPerHall encoder ticks per hall count
+    explicit EncoderMonitor(float encPerHall) : _encPerHall(encPerHall) {}
+
+    /**
+     * Checks the encoders against the halls for another tick.
+     *
+     * @param enc encoder ticks since the last tick
+     * @param halls hall counts since the last tick
+     */
+    void update(const int16_t enc[NUM_WHEELS], const int8_t halls[NUM_WHEELS]) {
+        for (size_t i = 0; i < NUM_WHEELS; i++) {
+            updateWheel(&_wheels[i], enc[i], halls[i]);
+        }
+        if (_filled < WINDOW) _filled++;
+        _next = (_next + 1) % WINDOW;
+    }
+
+    /// true if wheel @i's encoder shouldn't be trusted
+    bool faulted(size_t i) const { return _wheels[i].faulted; }
+
+    /// Bit i is set if wheel i's encoder is flagged
+    uint8_t faultMask() const {
+        uint8_t bits = 0;
+        for (size_t i = 0; i < NUM_WHEELS; i++) {
+            if (_wheels[i].faulted) bits |= 1 << i;
+        }
+        return bits;
+    }
+
+    /// Wheel @i's hysteresis counter, from 0 to FAULT_THRESHOLD
+    int counter(size_t i) const { return _wheels[i].counter; }
+
+    /**
+     * Encoder ticks per control tick that wheel @i turned over the window,
+     * going by the halls.  This lags by about half a window and only resolves
+     * one hall count per window, but it's enough to keep driving.
+     */
+    int16_t hallEstimate(size_t i) const {
+        if (_filled == 0) return 0;
+        return static_cast<int16_t>(
+            std::lround(_wheels[i].hallSum * _encPerHall / _filled));
+    }
+
+    /// Times an encoder has been flagged since startup
+    unsigned int faults = 0;
+
+private:
+    struct Wheel {
+        int16_t enc[WINDOW] = {};
+        int8_t halls[WINDOW] = {};
+        int32_t encSum = 0;
+        int32_t hallSum = 0;
+        int counter = 0;
+        bool faulted = false;
+    };
+
+    void updateWheel(Wheel* w, int16_t enc, int8_t halls) {
+        w->encSum += enc - w->enc[_next];
+        w->hallSum += halls - w->halls[_next];
+        w->enc[_next] = enc;
+        w->halls[_next] = halls;
+
+        // don't judge until there's a whole window to go on
+        if (_filled + 1 < WINDOW) return;
+
+        const float expected = w->hallSum * _encPerHall;
+        const float margin = HALL_MARGIN * _encPerHall + ENC_MARGIN +
+                             RELATIVE_MARGIN * std::fabs(expected);
+        if (std::fabs(w->encSum - expected) > margin) {
+            w->counter += COUNT_BAD;
+            if (w->counter > FAULT_THRESHOLD) w->counter = FAULT_THRESHOLD;
+        } else {
+            w->counter -= COUNT_GOOD;
+            if (w->counter < 0) w->counter = 0;
+        }
+
+        if (!w->faulted && w->counter >= FAULT_THRESHOLD) {
+            w->faulted = true;
+            faults++;
+        } else if (w->faulted && w->counter == 0) {
+            w->faulted = false;
+        }
+    }
+
+    const float _encPerHall;
+    Wheel _wheels[NUM_WHEELS];
+    size_t _filled = 0;
+    size_t _next = 0;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Drive wheel velocities from the encoder counts and the time since each
+ * encoder's last edge, which the FPGA latches along with the counts.
+ *
+ * Counting edges over a 5 ms tick is only good to one tick per tick, which is
+ * 200 ticks/s, or 0.6 rad/s at the wheel, and that's all noise at the speeds
+ * fine positioning needs.  With the edge times, the edges counted this tick
+ * span from the last edge of the previous tick to the last edge of this one,
+ * which is known to within the timer's resolution, so velocity is the count
+ * over that span rather than over the tick.  With no edges at all, the wheel
+ * can't be going any faster than one tick over the time since the last edge,
+ * so the estimate decays toward zero instead of dropping to it, and is zero
+ * once the timer saturates.
+ *
+ * Past HYBRID_TICKS a tick, counting is already as good as it gets, so the
+ * estimate switches back to that.
+ *
+ * This is plain logic, so it can be tested on the host.
+ */
+class EncoderVelocity {
+public:
+    static const size_t NUM_WHEELS = 4;
+
+    /// Edges in a tick at which counting is good enough on its own
+    static const int HYBRID_TICKS = 32;
+
+    /// Where the FPGA's edge timers stop
+    static const uint16_t AGE_MAX = 0xFFFF;
+
+    /// @param ageTick seconds per count of the edge timers
+    explicit EncoderVelocity(float ageTick) : _ageTick(ageTick) {}
+
+    /**
+     * Estimates wheel @wheel's velocity for another tick.
+     *
+     * @param ticks encoder ticks since the last call
+     * @param age the edge timer latched with @ticks, in timer counts
+     * @param dt how long it's been since the last call, in s
+     * @return the velocity in encoder ticks per second
+     */
+    float update(size_t wheel, int16_t ticks, uint16_t age, float dt) {
+        Wheel& w = _wheels[wheel];
+        const bool saturated = (age == AGE_MAX);
+        const float ageSeconds = age * _ageTick;
+
+        if (ticks == 0) {
+            // no faster than an edge that's about to come
+            if (saturated || ageSeconds <= 0) {
+                w.velocity = 0;
+            } else if (std::abs(w.velocity) > 1 / ageSeconds) {
+                w.velocity = std::copysign(1 / ageSeconds, w.velocity);
+            }
+        } else {
+            const float span = dt + w.age - ageSeconds;
+            if (std::abs(ticks) >= HYBRID_TICKS || !w.timed || span <= 0) {
+                w.velocity = dt > 0 ? ticks / dt : 0;
+            } else {
+                w.velocity = ticks / span;
+            }
+        }
+
+        // the span can only start from an edge that was timed
+        w.timed = !saturated;
+        w.age = ageSeconds;
+        return w.velocity;
+    }
+
+    float velocity(size_t wheel) const { return _wheels[wheel].velocity; }
+
+    void reset() {
+        for (Wheel& w : _wheels) w = Wheel();
+    }
+
+private:
+    struct Wheel {
+        float velocity = 0;
+        float age = 0;  // s since the last edge, at the last call
+        bool timed = false;
+    };
+
+    const float _ageTick;
+    Wheel _wheels[NUM_WHEELS];
+};
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "rtp.hpp"
+
+namespace rtp {
+
+/**
+ * Time from a forward packet going out to the end of the last reply slot.
+ * The next forward packet follows a few ms later.
+ */
+const uint32_t REPLY_WINDOW_MS = 13;
+
+/// Reply slots are this wide, in ms.  Robots start their replies from an RTOS
+/// timer, which can go off a tick early or late, so it takes two ticks to keep
+/// one robot's reply from running into the next one's.
+const uint32_t REPLY_SLOT_MS = 2;
+
+/// Reply slots that fit in the reply window, after the ms the forward packet
+/// takes to go out
+const size_t REPLY_SLOTS = (REPLY_WINDOW_MS - 1) / REPLY_SLOT_MS;
+
+/// What ReplyDelayMs() gives a robot that doesn't reply to a forward packet
+const int32_t NO_REPLY = -1;
+
+/// Set in a forward packet's count when its entries are compact ones
+const uint8_t COMPACT_ENTRIES = 0x80;
+
+/// Set in a forward packet's count when trajectories follow the entries
+const uint8_t HAS_TRAJECTORIES = 0x40;
+
+/// Most bytes of payload a forward packet can have, which is what's left of a
+/// 127 byte DW1000 frame after the MAC header, CRC, and our header
+const size_t MAX_FORWARD_PAYLOAD = 127 - 9 - 2 - sizeof(header_data);
+static_assert(MAX_FORWARD_PAYLOAD >= ForwardPayloadSize(MAX_FORWARD_ENTRIES),
+              "forward packets with every entry have to fit");
+
+/**
+ * Size of the trajectories section at the start of @data, which is
+ *
+ *     uint8_t count
+ *     count times:
+ *         TrajectoryHeader
+ *         TrajectoryPoint points[header.points]
+ *
+ * @return 0 if it's invalid or runs past @size
+ */
+inline size_t TrajectoriesSize(const uint8_t* data, size_t size) {
+    if (size < 1) return 0;
+    size_t offset = 1;
+    for (uint8_t i = 0; i < data[0]; i++) {
+        if (size - offset < sizeof(TrajectoryHeader)) return 0;
+        const auto header =
+            reinterpret_cast<const TrajectoryHeader*>(data + offset);
+        if (header->points > MAX_TRAJECTORY_POINTS) return 0;
+
+        const size_t trajectorySize = sizeof(TrajectoryHeader) +
+                                      header->points * sizeof(TrajectoryPoint);
+        if (size - offset < trajectorySize) return 0;
+        offset += trajectorySize;
+    }
+    return offset;
+}
+
+/**
+ * Compact entries, which a ControlEncoder sends in place of whole control
+ * messages when they come out smaller:
+ *
+ *     uint8_t uid
+ *     uint8_t flags
+ *     fields, as the flags say
+ *
+ * With COMPACT_KEY set, the rest of a ControlMessage follows and the entry
+ * stands on its own.  Otherwise, it's a change from the robot's entry in the
+ * previous forward packet: two bits each for bodyX, bodyY, and bodyW, from the
+ * bottom, say whether it's the same, changed by a signed byte, or replaced by
+ * an int16, and COMPACT_TAIL says that the last three bytes of the message
+ * (dribbler, kick strength, and modes) follow.
+ */
+const uint8_t COMPACT_KEY = 0x80;
+const uint8_t COMPACT_TAIL = 0x40;
+enum CompactField { SAME = 0, BYTE_DELTA = 1, WORD = 2 };
+
+/// Bytes of a ControlMessage after its uid and body velocities
+const size_t CONTROL_TAIL_SIZE = sizeof(ControlMessage) - 7;
+
+/**
+ * Size of a compact entry, from its flags.
+ *
+ * @return 0 if the flags are invalid
+ */
+inline size_t CompactEntrySize(uint8_t flags) {
+    if (flags & COMPACT_KEY) return 1 + sizeof(ControlMessage);
+
+    size_t size = 2;
+    for (int field = 0; field < 3; field++) {
+        switch ((flags >> (2 * field)) & 0x3) {
+            case SAME:
+                break;
+            case BYTE_DELTA:
+                size += 1;
+                break;
+            case WORD:
+                size += 2;
+                break;
+            default:
+                return 0;
+        }
+    }
+    if (flags & COMPACT_TAIL) size += CONTROL_TAIL_SIZE;
+    return size;
+}
+
+/**
+ * The payload of a forward packet on the CONTROL port:
+ *
+ *     ChannelSchedule
+ *     uint8_t count
+ *     ControlMessage entries[count]
+ *
+ * There's one entry per robot being sent commands, in no particular order.
+ * Each robot replies in the slot numbered by the position of its entry.
+ *
+ * If the count has COMPACT_ENTRIES set, the entries are compact ones, which
+ * vary in size, and have to be decoded with a ControlDecoder.  If it has
+ * HAS_TRAJECTORIES set, a trajectories section follows the entries, see
+ * TrajectoriesSize().
+ *
+ * This only points into the buffer it was parsed from, so it's cheap enough to
+ * make for every packet, but the buffer has to outlive it.
+ */
+class ForwardPayload {
+public:
+    /**
+     * Reads a forward packet's payload.
+     *
+     * @return false, leaving this empty, if @size doesn't match the count
+     */
+    bool parse(const uint8_t* data, size_t size) {
+        _schedule = nullptr;
+        _entryData = nullptr;
+        _entries = nullptr;
+        _count = 0;
+
+        _compact = false;
+        _trajectories = nullptr;
+
+        const size_t headerSize = ForwardPayloadSize(0);
+        if (size < headerSize) return false;
+        const uint8_t countByte = data[sizeof(ChannelSchedule)];
+        const bool compact = countByte & COMPACT_ENTRIES;
+        const bool hasTrajectories = countByte & HAS_TRAJECTORIES;
+        const uint8_t count = countByte & ~(COMPACT_ENTRIES | HAS_TRAJECTORIES);
+        if (count > MAX_FORWARD_ENTRIES) return false;
+
+        size_t offset = headerSize;
+        if (compact) {
+            for (size_t i = 0; i < count; i++) {
+                if (size - offset < 2) return false;
+                const size_t entrySize = CompactEntrySize(data[offset + 1]);
+                if (!entrySize || size - offset < entrySize) return false;
+                offset += entrySize;
+            }
+        } else {
+            offset = ForwardPayloadSize(count);
+            if (size < offset) return false;
+        }
+
+        // everything has to add up to exactly what's there
+        if (hasTrajectories) {
+            const size_t trajectoriesSize =
+                TrajectoriesSize(data + offset, size - offset);
+            if (!trajectoriesSize) return false;
+            _trajectories = data + offset;
+            offset += trajectoriesSize;
+        }
+        if (offset != size) {
+            _trajectories = nullptr;
+            return false;
+        }
+
+        _schedule = reinterpret_cast<const ChannelSchedule*>(data);
+        _entryData = data + headerSize;
+        _entries = reinterpret_cast<const ControlMessage*>(_entryData);
+        _count = count;
+        _compact = compact;
+        return true;
+    }
+
+    bool valid() const { return _schedule != nullptr; }
+
+    size_t count() const { return _count; }
+    bool compact() const { return _compact; }
+    const ChannelSchedule& schedule() const { return *_schedule; }
+
+    /// Entry @i of a packet with whole control messages
+    const ControlMessage& entry(size_t i) const { return _entries[i]; }
+
+    /**
+     * The trajectory for @uid, with its points right after it.
+     *
+     * @return nullptr if there isn't one
+     */
+    const TrajectoryHeader* trajectory(uint8_t uid) const {
+        if (!_trajectories) return nullptr;
+
+        const uint8_t* p = _trajectories + 1;
+        for (uint8_t i = 0; i < _trajectories[0]; i++) {
+            const auto header = reinterpret_cast<const TrajectoryHeader*>(p);
+            if (header->uid == uid) return header;
+            p += sizeof(TrajectoryHeader) +
+                 header->points * sizeof(TrajectoryPoint);
+        }
+        return nullptr;
+    }
+
+    /// Entry @i of a packet with compact entries, starting from its uid
+    const uint8_t* compactEntry(size_t i) const {
+        const uint8_t* p = _entryData;
+        while (i--) p += CompactEntrySize(p[1]);
+        return p;
+    }
+
+    /**
+     * Finds the entry for @uid.  Robots are usually in the same place from one
+     * packet to the next, so this checks @hint, where it was last time, before
+     * looking through the rest.
+     *
+     * @return the index of the entry, or -1 if there isn't one
+     */
+    int find(uint8_t uid, int hint = -1) const {
+        if (_compact) {
+            const uint8_t* p = _entryData;
+            for (size_t i = 0; i < _count; i++) {
+                if (p[0] == uid) return i;
+                p += CompactEntrySize(p[1]);
+            }
+            return -1;
+        }
+
+        if (hint >= 0 && size_t(hint) < _count && _entries[hint].uid == uid) {
+            return hint;
+        }
+        for (size_t i = 0; i < _count; i++) {
+            if (_entries[i].uid == uid) return i;
+        }
+        return -1;
+    }
+
+    /**
+     * Builds a payload from @count control messages, and optionally a
+     * trajectories section of @trajectoriesSize bytes.
+     *
+     * @return false if there are too many of them, or they don't fit
+     */
+    static bool build(const ChannelSchedule& schedule,
+                      const ControlMessage* entries, size_t count,
+                      std::vector<uint8_t>* payload,
+                      const uint8_t* trajectories = nullptr,
+                      size_t trajectoriesSize = 0) {
+        if (count > MAX_FORWARD_ENTRIES) return false;
+        const size_t size = ForwardPayloadSize(count) + trajectoriesSize;
+        if (size > MAX_FORWARD_PAYLOAD) return false;
+
+        payload->reserve(payload->size() + size);
+        SerializeToVector(schedule, payload);
+        payload->push_back(count | (trajectoriesSize ? HAS_TRAJECTORIES : 0));
+        for (size_t i = 0; i < count; i++) {
+            SerializeToVector(entries[i], payload);
+        }
+        payload->insert(payload->end(), trajectories,
+                        trajectories + trajectoriesSize);
+        return true;
+    }
+
+private:
+    const ChannelSchedule* _schedule = nullptr;
+    const uint8_t* _entryData = nullptr;
+    const ControlMessage* _entries = nullptr;
+    size_t _count = 0;
+    bool _compact = false;
+    const uint8_t* _trajectories = nullptr;
+};
+
+/**
+ * When a robot should reply after forward packet @seq with @count entries, in
+ * ms.  @entry is the index of its entry, or -1 if it doesn't have one.
+ *
+ * Every entry gets its own slot, in order, as long as there are REPLY_SLOTS
+ * or fewer.  Past that, they take turns, a different run of them getting
+ * slots each frame.  The rest don't reply, and get keyframes in the next
+ * forward packet, see ControlEncoder.
+ *
+ * Robots without an entry share the slots left over after the entries', by
+ * uid, and don't reply when there aren't any.
+ *
+ * @return the delay, or NO_REPLY if it isn't this robot's turn
+ */
+inline int32_t ReplyDelayMs(int entry, size_t count, uint8_t uid,
+                            uint8_t seq) {
+    const size_t entrySlots = count < REPLY_SLOTS ? count : REPLY_SLOTS;
+
+    size_t slot;
+    if (entry < 0) {
+        const size_t spares = REPLY_SLOTS - entrySlots;
+        if (spares == 0) return NO_REPLY;
+        slot = entrySlots + uid % spares;
+    } else {
+        const size_t first = (size_t(seq) * entrySlots) % count;
+        slot = (size_t(entry) + count - first) % count;
+        if (slot >= entrySlots) return NO_REPLY;
+    }
+    return 1 + slot * REPLY_SLOT_MS;
+}
+
+}  // namespace rtp
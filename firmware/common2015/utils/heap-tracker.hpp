@@ -0,0 +1,242 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Keeps track of what's being allocated from the heap, and by what.
+ *
+ * Whatever hooks into the allocator calls allocated() and freed() with the
+ * size of each block.  From that it keeps the bytes in use and the most there
+ * have been, counts of allocations and frees, and how fast they're happening.
+ *
+ * Allocations are also counted against the tag that the thread making them is
+ * in, see enter().  A tag can be marked as a hot path that shouldn't allocate
+ * at all, and allocations in one are counted as violations, so something like
+ * the control loop can be checked for them both on the robot and in host
+ * tests.  Threads are told apart by a context id that the hooks pass in, like
+ * an RTX task id.  Frees aren't counted against tags, since which tag a block
+ * came from isn't kept.
+ *
+ * walkHeap() goes through newlib's heap chunk by chunk, for how much of it is
+ * free and how broken up that is.
+ *
+ * Times are in us and wrap, so a window for the rates is good for about 71
+ * minutes.  This is plain logic, so it can be tested on the host.
+ */
+class HeapTracker {
+public:
+    static const size_t MAX_TAGS = 16;
+
+    /// Allocations made outside of any tag count against this one
+    static const uint8_t UNTAGGED = 0;
+
+    struct TagStats {
+        const char* name = nullptr;
+        bool noAlloc = false;
+        uint32_t allocs = 0;
+        uint32_t bytes = 0;
+        uint32_t violations = 0;  // allocations while it was no-alloc
+    };
+
+    HeapTracker() { _tags[UNTAGGED].name = "untagged"; }
+
+    /**
+     * Finds the tag named @name, adding it if there isn't one.  Names are
+     * compared by their contents, and have to stay around.
+     *
+     * @param noAlloc whether allocating in it is a violation.  This is kept
+     *     from when it's added.
+     * @return the tag, or UNTAGGED if there's no more room for tags
+     */
+    uint8_t tag(const char* name, bool noAlloc = false) {
+        for (size_t i = 1; i < _tagCount; i++) {
+            if (!strcmp(_tags[i].name, name)) return i;
+        }
+        if (_tagCount >= MAX_TAGS) return UNTAGGED;
+
+        _tags[_tagCount].name = name;
+        _tags[_tagCount].noAlloc = noAlloc;
+        return _tagCount++;
+    }
+
+    /**
+     * Counts @context's allocations against @tag until it's changed again.
+     *
+     * @return the tag it was in, to go back to with leave()
+     */
+    uint8_t enter(uint8_t context, uint8_t tag) {
+        const uint8_t previous = _contextTags[context];
+        _contextTags[context] = tag < _tagCount ? tag : UNTAGGED;
+        return previous;
+    }
+
+    void leave(uint8_t context, uint8_t previous) {
+        _contextTags[context] = previous;
+    }
+
+    /// The tag @context is in
+    uint8_t current(uint8_t context) const { return _contextTags[context]; }
+
+    /**
+     * @context allocated a block of @bytes.
+     *
+     * @return false if it was in a no-alloc tag
+     */
+    bool allocated(uint8_t context, size_t bytes) {
+        _inUse += bytes;
+        if (_inUse > _peak) _peak = _inUse;
+        _allocs++;
+        _windowAllocs++;
+        _windowBytes += bytes;
+
+        TagStats& t = _tags[_contextTags[context]];
+        t.allocs++;
+        t.bytes += bytes;
+        if (!t.noAlloc) return true;
+        t.violations++;
+        _violations++;
+        return false;
+    }
+
+    /// A block of @bytes was freed
+    void freed(size_t bytes) {
+        // blocks from before the hooks went in can be freed too
+        _inUse = bytes < _inUse ? _inUse - bytes : 0;
+        _frees++;
+    }
+
+    /// Bytes in blocks that are allocated, by the hooks' count
+    uint32_t inUse() const { return _inUse; }
+    uint32_t peak() const { return _peak; }
+    void resetPeak() { _peak = _inUse; }
+
+    uint32_t allocs() const { return _allocs; }
+    uint32_t frees() const { return _frees; }
+
+    /// Allocations in no-alloc tags, in all of them
+    uint32_t violations() const { return _violations; }
+
+    size_t tagCount() const { return _tagCount; }
+    const TagStats& tagStats(uint8_t tag) const { return _tags[tag]; }
+
+    /// Starts over counting allocations for the rates at @nowUs
+    void startWindow(uint32_t nowUs) {
+        _windowStartUs = nowUs;
+        _windowAllocs = 0;
+        _windowBytes = 0;
+    }
+
+    /// How long it's been since startWindow() at @nowUs
+    uint32_t windowUs(uint32_t nowUs) const { return nowUs - _windowStartUs; }
+
+    /// Allocations per second since startWindow()
+    float allocRate(uint32_t nowUs) const {
+        const uint32_t us = windowUs(nowUs);
+        return us ? _windowAllocs * 1e6f / us : 0;
+    }
+
+    /// Bytes allocated per second since startWindow()
+    float byteRate(uint32_t nowUs) const {
+        const uint32_t us = windowUs(nowUs);
+        return us ? _windowBytes * 1e6f / us : 0;
+    }
+
+private:
+    TagStats _tags[MAX_TAGS];
+    size_t _tagCount = 1;
+
+    /// Which tag each context is in
+    uint8_t _contextTags[256] = {};
+
+    uint32_t _inUse = 0;
+    uint32_t _peak = 0;
+    uint32_t _allocs = 0;
+    uint32_t _frees = 0;
+    uint32_t _violations = 0;
+
+    uint32_t _windowStartUs = 0;
+    uint32_t _windowAllocs = 0;
+    uint32_t _windowBytes = 0;
+};
+
+/// How newlib's heap is laid out, see walkHeap()
+struct HeapLayout {
+    uint32_t usedChunks = 0;
+    uint32_t usedBytes = 0;
+
+    /// Free chunks, including the top one that the heap grows from
+    uint32_t freeChunks = 0;
+    uint32_t freeBytes = 0;
+    uint32_t largestFree = 0;
+    uint32_t topBytes = 0;
+
+    /// The walk hit a chunk that doesn't make sense, so the heap's been
+    /// written over, and the rest of it wasn't walked
+    bool corrupt = false;
+
+    /// How much of the free space can't be had in one allocation, from 0 for
+    /// none to 1 for all of it
+    float fragmentation() const {
+        return freeBytes ? 1 - float(largestFree) / freeBytes : 0;
+    }
+};
+
+/**
+ * Walks newlib's malloc heap from @start, where it starts, to @end, where
+ * sbrk() has it end, chunk by chunk.
+ *
+ * newlib's malloc is Doug Lea's: each chunk starts with the size of the one
+ * before it, then its own size, 8-byte aligned, with the low bit set if the
+ * chunk before it is in use.  So a chunk is free if the next one says so, and
+ * the last one is the top chunk, which is free and can grow.  The sizes
+ * include the 8 byte header.
+ */
+inline HeapLayout walkHeap(const uint8_t* start, const uint8_t* end) {
+    const size_t HEADER = 2 * sizeof(uint32_t);
+    const size_t MIN_CHUNK = 16;
+    const uint32_t PREV_INUSE = 1;
+    const uint32_t SIZE_BITS = 3;
+
+    HeapLayout layout;
+    auto sizeField = [](const uint8_t* chunk) {
+        uint32_t field;
+        memcpy(&field, chunk + sizeof(uint32_t), sizeof(field));
+        return field;
+    };
+
+    // the first chunk is aligned so that what's after its header is
+    const uintptr_t misalign =
+        (reinterpret_cast<uintptr_t>(start) + HEADER) & 7;
+    const uint8_t* chunk = start + (misalign ? 8 - misalign : 0);
+
+    while (chunk + MIN_CHUNK <= end) {
+        const uint32_t size = sizeField(chunk) & ~SIZE_BITS;
+        if (size < MIN_CHUNK || size % 8 || size > size_t(end - chunk)) {
+            layout.corrupt = true;
+            break;
+        }
+
+        const uint8_t* next = chunk + size;
+        if (next + MIN_CHUNK > end) {
+            // the top chunk, which newlib counts as free
+            layout.topBytes = size;
+            layout.freeChunks++;
+            layout.freeBytes += size;
+            if (size > layout.largestFree) layout.largestFree = size;
+            break;
+        }
+
+        if (sizeField(next) & PREV_INUSE) {
+            layout.usedChunks++;
+            layout.usedBytes += size;
+        } else {
+            layout.freeChunks++;
+            layout.freeBytes += size;
+            if (size > layout.largestFree) layout.largestFree = size;
+        }
+        chunk = next;
+    }
+    return layout;
+}
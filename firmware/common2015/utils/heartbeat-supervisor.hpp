@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Keeps track of whether the threads that matter are still running.
+ *
+ * Each one is added with a deadline, and has to check in at least that often.
+ * check() goes through all of them, and once any one has gone longer than its
+ * deadline without checking in, it's starved and the supervisor stays
+ * unhealthy, so whatever feeds the hardware watchdog stops.  A thread that
+ * blocks waiting for something that may never come, like a packet, has to
+ * wait with a timeout shorter than its deadline, and check in either way.
+ *
+ * Times are in ms and wrap, so a deadline can't be more than about 24 days.
+ * This is plain logic, so it can be tested on the host.
+ */
+class HeartbeatSupervisor {
+public:
+    static const size_t MAX_THREADS = 8;
+
+    /// Not a thread that's been added
+    static const int NONE = -1;
+
+    struct Entry {
+        const char* name = nullptr;
+        uint8_t threadId = 0;
+        uint32_t deadlineMs = 0;
+        uint32_t lastMs = 0;
+
+        /// The longest it's gone between check-ins, up to the last one
+        uint32_t worstMs = 0;
+    };
+
+    /**
+     * Adds a thread that's checking in from @nowMs on.  @name has to stay
+     * around.
+     *
+     * @return its index to checkIn() with, or NONE if there's no more room
+     */
+    int add(const char* name, uint8_t threadId, uint32_t deadlineMs,
+            uint32_t nowMs) {
+        if (_count >= MAX_THREADS) return NONE;
+
+        Entry& e = _entries[_count];
+        e.name = name;
+        e.threadId = threadId;
+        e.deadlineMs = deadlineMs;
+        e.lastMs = nowMs;
+        return _count++;
+    }
+
+    void checkIn(int index, uint32_t nowMs) {
+        if (index < 0 || size_t(index) >= _count) return;
+
+        Entry& e = _entries[index];
+        const uint32_t gap = nowMs - e.lastMs;
+        if (gap > e.worstMs) e.worstMs = gap;
+        e.lastMs = nowMs;
+    }
+
+    /**
+     * Checks that every thread has checked in within its deadline as of
+     * @nowMs.  The first one that hasn't is remembered, see starved(), and
+     * checking in afterwards doesn't make it healthy again.
+     *
+     * @return whether they all have, and always have
+     */
+    bool check(uint32_t nowMs) {
+        if (_starved != NONE) return false;
+
+        for (size_t i = 0; i < _count; i++) {
+            const uint32_t since = nowMs - _entries[i].lastMs;
+            if (since > _entries[i].deadlineMs) {
+                _starved = i;
+                _starvedMs = since;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// The first thread added with @threadId, or NONE if there isn't one
+    int find(uint8_t threadId) const {
+        for (size_t i = 0; i < _count; i++) {
+            if (_entries[i].threadId == threadId) return i;
+        }
+        return NONE;
+    }
+
+    /// The thread that missed its deadline, or NONE if none has
+    int starved() const { return _starved; }
+
+    /// How long it had gone without checking in when check() caught it
+    uint32_t starvedMs() const { return _starvedMs; }
+
+    size_t count() const { return _count; }
+    const Entry& entry(size_t index) const { return _entries[index]; }
+
+    /// How long it's been since thread @index last checked in, at @nowMs
+    uint32_t sinceMs(size_t index, uint32_t nowMs) const {
+        return nowMs - _entries[index].lastMs;
+    }
+
+private:
+    Entry _entries[MAX_THREADS];
+    size_t _count = 0;
+
+    int _starved = NONE;
+    uint32_t _starvedMs = 0;
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "rtp.hpp"
+
+/**
+ * Statistics for one direction of a radio link, kept by whichever end
+ * receives the packets: loss from gaps in the header's sequence numbers, how
+ * long the runs of lost packets were, moving averages of the signal quality
+ * the radio reports, and the reply latency.
+ *
+ * This is plain bookkeeping so it can be tested on the host.
+ */
+class LinkStats {
+public:
+    /// Packets that lossRate() looks back over
+    static const size_t HISTORY = 64;
+
+    /// Runs of lost packets are counted in buckets of 1, 2, 3-4, 5-8, 9-16,
+    /// and 17 or more
+    static const size_t BURST_BUCKETS = 6;
+
+    /// A jump in sequence numbers at least this big means the sender
+    /// restarted, rather than that this many packets were lost
+    static const uint8_t MAX_GAP = 128;
+
+    /// Weight of each new reading in the moving averages
+    static constexpr float AVERAGE_WEIGHT = 1.0f / 8;
+
+    /// Records a received packet
+    void received(uint8_t seq, const rtp::packet::RxQuality& quality =
+                                   rtp::packet::RxQuality()) {
+        if (_started && seq == _lastSeq) {
+            duplicates++;
+            return;
+        }
+
+        if (_started) {
+            const uint8_t gap = seq - _lastSeq - 1;
+            if (gap >= MAX_GAP) {
+                resyncs++;
+            } else if (gap > 0) {
+                lost += gap;
+                bursts[bucket(gap)]++;
+                if (gap > longestBurst) longestBurst = gap;
+                for (size_t i = 0; i < gap && i < HISTORY; i++) record(true);
+            }
+        }
+        _started = true;
+        _lastSeq = seq;
+        packets++;
+        record(false);
+
+        if (quality.valid) {
+            _rssi = average(_rssi, quality.rssi, _hasQuality);
+            _lqi = average(_lqi, quality.lqi, _hasQuality);
+            _hasQuality = true;
+        }
+    }
+
+    /// Records how long the other end took to reply to a packet
+    void addLatencyUs(float us) {
+        _latencyUs = average(_latencyUs, us, _latencyCount > 0);
+        if (!_latencyCount || us < minLatencyUs) minLatencyUs = us;
+        if (!_latencyCount || us > maxLatencyUs) maxLatencyUs = us;
+        _latencyCount++;
+    }
+
+    /// Fraction of the last HISTORY packets that were lost
+    float lossRate() const {
+        if (!_historyLen) return 0;
+
+        size_t count = 0;
+        for (size_t i = 0; i < _historyLen; i++) count += (_history >> i) & 1;
+        return float(count) / _historyLen;
+    }
+
+    bool hasQuality() const { return _hasQuality; }
+    float rssi() const { return _rssi; }
+    float lqi() const { return _lqi; }
+
+    bool hasLatency() const { return _latencyCount > 0; }
+    float latencyUs() const { return _latencyUs; }
+
+    /// Smallest burst length counted in bucket @i
+    static unsigned int bucketStart(size_t i) {
+        return i < 2 ? i + 1 : (1 << (i - 1)) + 1;
+    }
+
+    /// Summary for a status reply
+    rtp::LinkSummary summary() const {
+        rtp::LinkSummary s;
+        s.loss = lossRate() * 100 + 0.5f;
+        s.rssi = _hasQuality ? int8_t(std::lround(_rssi)) : 0;
+        s.lqi = _hasQuality ? uint8_t(_lqi + 0.5f) : 0;
+        s.longestBurst = longestBurst > 255 ? 255 : longestBurst;
+        return s;
+    }
+
+    void reset() { *this = LinkStats(); }
+
+    uint32_t packets = 0;
+    uint32_t lost = 0;
+    uint32_t duplicates = 0;
+    uint32_t resyncs = 0;
+    uint32_t longestBurst = 0;
+    uint32_t bursts[BURST_BUCKETS] = {};
+
+    float minLatencyUs = 0;
+    float maxLatencyUs = 0;
+
+private:
+    static size_t bucket(unsigned int burst) {
+        size_t i = 0;
+        while (i + 1 < BURST_BUCKETS && burst >= bucketStart(i + 1)) i++;
+        return i;
+    }
+
+    static float average(float avg, float reading, bool started) {
+        return started ? avg + (reading - avg) * AVERAGE_WEIGHT : reading;
+    }
+
+    void record(bool lostPacket) {
+        _history = (_history << 1) | lostPacket;
+        if (_historyLen < HISTORY) _historyLen++;
+    }
+
+    bool _started = false;
+    uint8_t _lastSeq = 0;
+
+    uint64_t _history = 0;  // 1 for each lost packet, newest in bit 0
+    size_t _historyLen = 0;
+
+    bool _hasQuality = false;
+    float _rssi = 0;
+    float _lqi = 0;
+
+    uint32_t _latencyCount = 0;
+    float _latencyUs = 0;
+};
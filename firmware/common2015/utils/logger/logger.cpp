@@ -17,6 +17,13 @@ uint8_t rjLogLevel;
 
 Mutex log_mutex;
 
+namespace {
+// ring of the most recent log messages, kept for crash records
+char log_history[LOG_HISTORY_SIZE][LOG_HISTORY_LINE_SIZE];
+size_t log_history_next = 0;
+size_t log_history_count = 0;
+}
+
 LogHelper::LogHelper(uint8_t logLevel, const char* source, int line,
                      const char* func) {
     _logLevel = logLevel;
@@ -58,10 +65,37 @@ void log(uint8_t logLevel, const char* source, int line, const char* func,
         fflush(stdout);
 
         va_end(args);
+
+        // keep a short copy of the message around in case we crash soon
+        char* hist = log_history[log_history_next];
+        int n = snprintf(hist, LOG_HISTORY_LINE_SIZE, "%s %s:%d ",
+                         LOG_LEVEL_STRING[logLevel], source, line);
+        if (n >= 0 && static_cast<size_t>(n) < LOG_HISTORY_LINE_SIZE) {
+            va_start(args, format);
+            vsnprintf(hist + n, LOG_HISTORY_LINE_SIZE - n, format, args);
+            va_end(args);
+        }
+        log_history_next = (log_history_next + 1) % LOG_HISTORY_SIZE;
+        if (log_history_count < LOG_HISTORY_SIZE) log_history_count++;
+
         log_mutex.unlock();
     }
 }
 
+size_t logHistory(char (*lines)[LOG_HISTORY_LINE_SIZE], size_t maxLines) {
+    // This is called from the hard fault handler, so it intentionally doesn't
+    // take the mutex.
+    const size_t n = std::min(maxLines, log_history_count);
+    size_t idx = (log_history_next + LOG_HISTORY_SIZE - n) % LOG_HISTORY_SIZE;
+
+    for (size_t i = 0; i < n; i++) {
+        memcpy(lines[i], log_history[idx], LOG_HISTORY_LINE_SIZE);
+        idx = (idx + 1) % LOG_HISTORY_SIZE;
+    }
+
+    return n;
+}
+
 int logLvlChange(const std::string& s) {
     int n = 0;
 
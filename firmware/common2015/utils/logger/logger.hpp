@@ -96,3 +96,23 @@ void log(uint8_t logLevel, const char* source, int line, const char* func,
          const char* format, ...);
 
 int logLvlChange(const std::string& s);
+
+/**
+ * Number of recent log messages kept in RAM so they can be saved with a crash
+ * record.
+ */
+static const size_t LOG_HISTORY_SIZE = 4;
+
+/**
+ * Max length of each message kept in the log history, including the null
+ * terminator.  Longer messages are truncated.
+ */
+static const size_t LOG_HISTORY_LINE_SIZE = 48;
+
+/**
+ * Copies the most recent log messages into @lines, oldest first.
+ * @param lines    Destination for the messages
+ * @param maxLines Max number of messages to copy
+ * @return         The number of messages copied
+ */
+size_t logHistory(char (*lines)[LOG_HISTORY_LINE_SIZE], size_t maxLines);
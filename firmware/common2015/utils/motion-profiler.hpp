@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+/**
+ * Limits how fast the target body velocity changes, so a step in the command
+ * from the radio doesn't turn into a step in duty cycle.  Steps saturate the
+ * motors, slip the wheels, and wind up the wheel PIDs.
+ *
+ * Each axis (x, y, and rotation) has its own acceleration and jerk limit.  The
+ * acceleration ramps up at the jerk limit, holds at the acceleration limit, and
+ * ramps back down so that it reaches zero right as the velocity reaches the
+ * target.  A limit of zero means that part isn't limited, so with both zero,
+ * the target passes straight through.
+ *
+ * Each update is a few float operations per axis, with no state beyond the
+ * current velocity and acceleration, so it's cheap to run every control tick.
+ */
+class MotionProfiler {
+public:
+    static const size_t AXES = 3;
+
+    struct Limits {
+        /// m/s^2 for x and y, rad/s^2 for rotation
+        float accel[AXES];
+
+        /// m/s^3 for x and y, rad/s^3 for rotation
+        float jerk[AXES];
+    };
+
+    MotionProfiler() { setLimits({{0, 0, 0}, {0, 0, 0}}); }
+
+    void setLimits(const Limits& limits) { _limits = limits; }
+    const Limits& limits() const { return _limits; }
+
+    /// Jumps straight to @velocity, with no acceleration
+    void reset(const float velocity[AXES]) {
+        for (size_t i = 0; i < AXES; i++) {
+            _vel[i] = velocity[i];
+            _accel[i] = 0;
+        }
+    }
+
+    /**
+     * Moves the profiled velocity toward @target over @dt seconds.
+     *
+     * @param out the velocity to drive at now
+     */
+    void update(const float target[AXES], float dt, float out[AXES]) {
+        for (size_t i = 0; i < AXES; i++) {
+            updateAxis(i, target[i], dt);
+            out[i] = _vel[i];
+        }
+    }
+
+    /// The profiled velocity and acceleration on axis @i
+    float velocity(size_t i) const { return _vel[i]; }
+    float acceleration(size_t i) const { return _accel[i]; }
+
+private:
+    void updateAxis(size_t i, float target, float dt) {
+        const float maxAccel = _limits.accel[i];
+        const float maxJerk = _limits.jerk[i];
+        const float err = target - _vel[i];
+
+        if (maxAccel <= 0 || dt <= 0) {
+            _vel[i] = target;
+            _accel[i] = 0;
+            return;
+        }
+
+        // the acceleration we'd like: as much as we're allowed, but no more
+        // than we can ramp back down to zero from before reaching the target,
+        // and no more than it takes to get there this tick
+        const float dist = std::fabs(err);
+        float want = std::min(dist / dt, maxAccel);
+        if (maxJerk > 0) want = std::min(want, std::sqrt(2 * maxJerk * dist));
+        if (err < 0) want = -want;
+
+        if (maxJerk > 0) {
+            const float maxStep = maxJerk * dt;
+            const float step = want - _accel[i];
+            if (step > maxStep) {
+                want = _accel[i] + maxStep;
+            } else if (step < -maxStep) {
+                want = _accel[i] - maxStep;
+            }
+        }
+        _accel[i] = want;
+
+        // don't overshoot while the acceleration is still coming down
+        const float next = _vel[i] + _accel[i] * dt;
+        if ((err > 0 && next > target) || (err < 0 && next < target) ||
+            err == 0) {
+            _vel[i] = target;
+            _accel[i] = 0;
+        } else {
+            _vel[i] = next;
+        }
+    }
+
+    Limits _limits;
+    float _vel[AXES] = {};
+    float _accel[AXES] = {};
+};
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Protects the drive motors and dribbler from jams and overheating, ahead of
+ * the DRV8303's over-current trip.
+ *
+ * Each motor has two checks, both updated every control tick from the duty
+ * cycle it was driven at and how fast it actually turned:
+ *
+ * - A stall integrator, like robot2011's stall.c.  It counts up while the
+ *   motor is pushed hard but barely turns, and leaks back down otherwise.  If
+ *   it reaches STALL_THRESHOLD, the motor is shut off for STALL_COOLDOWN
+ *   seconds, then tried again.
+ *
+ * - An I^2t thermal model.  The current is estimated from the voltage that
+ *   isn't cancelled by back EMF, and the winding heats with its square and
+ *   cools with the winding's time constant.  Heat is scaled so that 1 is where
+ *   running at the continuous current rating settles.  Past DERATE_START, the
+ *   duty cycle is scaled down, reaching zero at 1.  If a motor gets there
+ *   anyway, it's shut off until it has cooled to RECOVER_AT.
+ *
+ * This is plain logic, so it can be tested on the host.
+ */
+class MotorProtection {
+public:
+    static const size_t NUM_MOTORS = 5;
+    static const size_t DRIBBLER = 4;
+
+    static const int16_t MAX_DUTY = 511;
+
+    /// Duty cycles under this fraction don't count toward a stall
+    static constexpr float STALL_DEADBAND = 0.12;
+
+    /// How much turning counts against pushing, for the stall integrator
+    static constexpr float STALL_SPEED_WEIGHT = 2;
+
+    /// The stall integrator leaks this much per second
+    static constexpr float STALL_DECAY = 0.1;
+
+    /// About how long a motor can push at full duty without turning, in s.
+    /// This is well before it would start to derate for heat.
+    static constexpr float STALL_THRESHOLD = 0.2;
+
+    /// How long a stalled motor stays off before it's tried again, in s
+    static constexpr float STALL_COOLDOWN = 1;
+
+    static constexpr float DERATE_START = 0.8;
+    static constexpr float RECOVER_AT = 0.6;
+
+    struct Params {
+        /// Current at full duty with the motor held still, in A
+        float stallCurrent;
+
+        /// Current the motor can take indefinitely, in A
+        float continuousCurrent;
+
+        /// Thermal time constant of the winding, in s
+        float timeConstant;
+    };
+
+    enum State : uint8_t {
+        OK,
+
+        /// Duty cycle is scaled down to keep it from getting hotter
+        DERATED,
+
+        /// Off, waiting to cool down
+        OVERHEATED,
+
+        /// Off, waiting to try again after stalling
+        STALLED,
+    };
+
+    /// With estimates from the motor datasheets
+    MotorProtection() : MotorProtection({15, 2, 30}, {5, 0.8, 10}) {}
+
+    MotorProtection(const Params& drive, const Params& dribbler) {
+        for (size_t i = 0; i < NUM_MOTORS; i++) _motors[i].params = drive;
+        _motors[DRIBBLER].params = dribbler;
+    }
+
+    void setParams(size_t motor, const Params& params) {
+        _motors[motor].params = params;
+    }
+
+    /**
+     * Updates the models with how the last tick went.
+     *
+     * @param duty the duty cycles the motors were driven at, after limit()
+     * @param speed how fast each motor turned, as a fraction of its speed at
+     *     full duty with no load
+     * @param dt how long the tick was, in s
+     */
+    void update(const int16_t duty[NUM_MOTORS], const float speed[NUM_MOTORS],
+                float dt) {
+        for (size_t i = 0; i < NUM_MOTORS; i++) {
+            updateMotor(&_motors[i], duty[i] / float(MAX_DUTY), speed[i], dt);
+        }
+    }
+
+    /// Scales down or zeroes out the duty cycles of motors that need it
+    void limit(int16_t duty[NUM_MOTORS]) const {
+        for (size_t i = 0; i < NUM_MOTORS; i++) {
+            duty[i] = static_cast<int16_t>(duty[i] * _motors[i].scale);
+        }
+    }
+
+    /**
+     * Zeroes out only the duty cycles of stalled motors, and leaves the ones
+     * that are hot alone.  The stall integrator only goes by the duty cycle
+     * and speed, so this doesn't depend on the thermal model's parameters.
+     */
+    void limitStalls(int16_t duty[NUM_MOTORS]) const {
+        for (size_t i = 0; i < NUM_MOTORS; i++) {
+            if (_motors[i].state == STALLED) duty[i] = 0;
+        }
+    }
+
+    State state(size_t motor) const { return _motors[motor].state; }
+
+    /// How hot motor @motor is, where 1 is as hot as it's allowed to get
+    float heat(size_t motor) const { return _motors[motor].heat; }
+
+    /// Bit i is set if motor i is off after stalling
+    uint8_t stalledMask() const { return mask(STALLED); }
+
+    /// Bit i is set if motor i is derated or off to cool down
+    uint8_t hotMask() const { return mask(DERATED) | mask(OVERHEATED); }
+
+    /// Stalls detected since startup
+    unsigned int stalls = 0;
+
+    static const char* StateName(State state) {
+        switch (state) {
+            case OK:
+                return "OK";
+            case DERATED:
+                return "DERATED";
+            case OVERHEATED:
+                return "HOT";
+            case STALLED:
+                return "STALLED";
+        }
+        return "?";
+    }
+
+private:
+    struct Motor {
+        Params params;
+        State state = OK;
+        float stall = 0;
+        float heat = 0;
+        float cooldown = 0;
+        float scale = 1;
+    };
+
+    void updateMotor(Motor* m, float duty, float speed, float dt) {
+        const float push = std::fabs(duty);
+        const float turn = std::fabs(speed);
+
+        // current from the voltage left over after back EMF, which is
+        // proportional to speed, so it's duty - speed at full voltage
+        float current = m->params.stallCurrent * (push - turn);
+        if (current < 0) current = 0;
+        const float load = current / m->params.continuousCurrent;
+        m->heat += (load * load - m->heat) * dt / m->params.timeConstant;
+
+        // pushing hard but not turning
+        const float pushing = push < STALL_DEADBAND ? 0 : push;
+        m->stall += (pushing - STALL_SPEED_WEIGHT * turn - STALL_DECAY) * dt;
+        if (m->stall < 0) m->stall = 0;
+
+        switch (m->state) {
+            case STALLED:
+                m->cooldown -= dt;
+                if (m->cooldown <= 0) {
+                    m->state = OK;
+                    m->stall = 0;
+                }
+                break;
+            case OVERHEATED:
+                if (m->heat <= RECOVER_AT) m->state = OK;
+                break;
+            default:
+                if (m->stall >= STALL_THRESHOLD) {
+                    m->state = STALLED;
+                    m->cooldown = STALL_COOLDOWN;
+                    stalls++;
+                } else if (m->heat >= 1) {
+                    m->state = OVERHEATED;
+                } else if (m->heat > DERATE_START) {
+                    m->state = DERATED;
+                } else {
+                    m->state = OK;
+                }
+        }
+
+        if (m->state == STALLED || m->state == OVERHEATED) {
+            m->scale = 0;
+        } else if (m->state == DERATED) {
+            // straight down from full at DERATE_START to nothing at 1
+            m->scale = (1 - m->heat) / (1 - DERATE_START);
+        } else {
+            m->scale = 1;
+        }
+    }
+
+    uint8_t mask(State state) const {
+        uint8_t bits = 0;
+        for (size_t i = 0; i < NUM_MOTORS; i++) {
+            if (_motors[i].state == state) bits |= 1 << i;
+        }
+        return bits;
+    }
+
+    Motor _motors[NUM_MOTORS];
+};
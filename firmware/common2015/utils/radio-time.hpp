@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Radio frame timestamps, and estimating the offset between the base
+ * station's and a robot's radio clocks from them.
+ *
+ * Timestamps are in DW1000 time units (1 / (128 * 499.2 MHz), about 15.65 ps)
+ * on a 40-bit counter that wraps about every 17.2 seconds.  The DW1000 stamps
+ * frames itself, links without hardware timestamps convert the time their
+ * interrupt fired into the same units with fromUs().
+ *
+ * Everything here is plain arithmetic so that the robot, the base station,
+ * and the unit tests share it.
+ */
+namespace radio_time {
+
+typedef uint64_t Timestamp;
+
+const int TIMESTAMP_BITS = 40;
+const Timestamp TIMESTAMP_MASK = (Timestamp(1) << TIMESTAMP_BITS) - 1;
+
+/// Timestamp of a frame whose time isn't known
+const Timestamp UNKNOWN = 0;
+
+/// Size of a timestamp on the wire
+const size_t TIMESTAMP_SIZE = 5;
+
+/// DW1000 time units in ten microseconds, which is a whole number
+const uint64_t TICKS_PER_10_US = 638976;
+
+/// Converts a microsecond clock reading to timestamp units
+inline Timestamp fromUs(uint64_t us) {
+    return (us * TICKS_PER_10_US / 10) & TIMESTAMP_MASK;
+}
+
+inline double ticksToUs(int64_t ticks) {
+    return ticks * 10.0 / TICKS_PER_10_US;
+}
+
+inline double ticksToNs(int64_t ticks) { return ticksToUs(ticks) * 1000; }
+
+/**
+ * Signed difference @a - @b between two timestamps, accounting for the
+ * counter wrapping.  Only meaningful when they're within half the wrap period
+ * (8.6 s) of each other.
+ */
+inline int64_t diff(Timestamp a, Timestamp b) {
+    const Timestamp d = (a - b) & TIMESTAMP_MASK;
+    const Timestamp half = Timestamp(1) << (TIMESTAMP_BITS - 1);
+    return d >= half ? int64_t(d) - (int64_t(1) << TIMESTAMP_BITS)
+                     : int64_t(d);
+}
+
+/// Adds a signed number of ticks to a timestamp
+inline Timestamp add(Timestamp t, int64_t ticks) {
+    return (t + Timestamp(ticks)) & TIMESTAMP_MASK;
+}
+
+/// Reads a little-endian timestamp, the way the DW1000 registers store it
+inline Timestamp fromBytes(const uint8_t* bytes) {
+    Timestamp t = 0;
+    for (int i = TIMESTAMP_SIZE - 1; i >= 0; i--) t = (t << 8) | bytes[i];
+    return t;
+}
+
+inline void toBytes(Timestamp t, uint8_t* bytes) {
+    for (size_t i = 0; i < TIMESTAMP_SIZE; i++) {
+        bytes[i] = t & 0xFF;
+        t >>= 8;
+    }
+}
+
+/**
+ * The four timestamps of a forward packet and the robot's reply to it:
+ *
+ *   base   t1 --------------------------------- t4
+ *              \                              /
+ *   robot       t2 -------- turnaround ----- t3
+ *
+ * t1 and t4 are on the base station's clock, t2 and t3 are on the robot's.
+ */
+struct Exchange {
+    Timestamp t1;  // base sent the forward packet
+    Timestamp t2;  // robot received it
+    Timestamp t3;  // robot sent its reply
+    Timestamp t4;  // base received the reply
+};
+
+/**
+ * Estimates the offset and rate difference between a robot's radio clock and
+ * the base station's from a stream of exchanges.
+ *
+ * Each exchange gives the round trip time (t4 - t1) - (t3 - t2) and an offset
+ * that assumes the two legs took the same time.  The robot takes several
+ * milliseconds to reply though, so even a 20 ppm difference in crystals
+ * would skew that by a couple hundred nanoseconds.  The turnaround is scaled
+ * by the current rate estimate to correct for that.
+ *
+ * The offset and rate are a least squares line through the offsets of the
+ * last WINDOW exchanges, leaving out the ones whose round trip took much
+ * longer than the shortest one in the window, since a late timestamp (on a
+ * link that captures them in an interrupt) shows up as extra round trip time.
+ */
+class OffsetEstimator {
+public:
+    static const size_t WINDOW = 16;
+
+    /// Exchanges with a round trip longer than this are thrown out
+    static constexpr double MAX_RTT_US = 20000;
+
+    /// And so are those this much slower than the fastest one in the window
+    static constexpr double RTT_SLACK_US = 5;
+
+    /// Largest difference in crystal frequencies that's believable
+    static constexpr double MAX_RATE_PPM = 200;
+
+    /**
+     * Adds an exchange.
+     *
+     * @return false if it was thrown out
+     */
+    bool add(const Exchange& e) {
+        const int64_t turnaround = diff(e.t3, e.t2);
+        const int64_t roundTrip = diff(e.t4, e.t1);
+
+        // until the rate is known, the round trip can come out a little
+        // negative when the robot's clock is the faster one
+        const double rtt = roundTrip - turnaround / (1 + _rate);
+        if (rtt < -turnaround * MAX_RATE_PPM * 1e-6 ||
+            ticksToUs(rtt) > MAX_RTT_US || turnaround < 0) {
+            rejected++;
+            return false;
+        }
+
+        Sample& s = _samples[_next];
+        _next = (_next + 1) % WINDOW;
+        if (_count < WINDOW) _count++;
+
+        s.t1 = e.t1;
+        s.forward = diff(e.t2, e.t1);
+        s.roundTrip = roundTrip;
+        s.turnaround = turnaround;
+        lastRttUs = ticksToUs(rtt);
+
+        // the rate found by the first fit changes the round trips that the
+        // second one works from
+        fit();
+        fit();
+        return true;
+    }
+
+    /// true once there are enough exchanges for an estimate
+    bool valid() const { return _usable >= 2; }
+
+    /**
+     * The robot's clock minus the base station's at @baseTime, in ticks.
+     * This is only good near the exchanges it's been given, within a few
+     * seconds.
+     */
+    double offsetAt(Timestamp baseTime) const {
+        return _offset + _rate * diff(baseTime, _ref);
+    }
+
+    /// Converts a base station timestamp to the robot's clock
+    Timestamp toRobot(Timestamp baseTime) const {
+        return radio_time::add(baseTime, int64_t(offsetAt(baseTime) + 0.5));
+    }
+
+    /// Converts a robot timestamp to the base station's clock
+    Timestamp toBase(Timestamp robotTime) const {
+        // offsetAt() changes slowly enough that evaluating it at the robot's
+        // time instead of the base station's is well under a tick off
+        const Timestamp guess = radio_time::add(robotTime, -int64_t(_offset));
+        return radio_time::add(robotTime, -int64_t(offsetAt(guess) + 0.5));
+    }
+
+    /// How much faster the robot's clock runs, in parts per million
+    double ratePpm() const { return _rate * 1e6; }
+
+    /// The fastest round trip in the window, in microseconds
+    double minRttUs() const { return ticksToUs(_minRtt); }
+
+    double lastRttUs = 0;
+    unsigned int rejected = 0;
+
+private:
+    struct Sample {
+        Timestamp t1;
+        int64_t forward;  // t2 - t1
+        int64_t roundTrip;
+        int64_t turnaround;
+
+        /// Time on the air, in base station ticks, at a given rate
+        double rtt(double rate) const {
+            return roundTrip - turnaround / (1 + rate);
+        }
+
+        /// Offset of the robot's clock at t1, assuming both legs took the
+        /// same time
+        double offset(double rate) const { return forward - rtt(rate) / 2; }
+    };
+
+    void fit() {
+        const Sample& newest = _samples[(_next + WINDOW - 1) % WINDOW];
+        const double rate = _rate;
+
+        _minRtt = newest.rtt(rate);
+        for (size_t i = 0; i < _count; i++) {
+            _minRtt = std::min(_minRtt, _samples[i].rtt(rate));
+        }
+        const double maxRtt = _minRtt + RTT_SLACK_US * TICKS_PER_10_US / 10;
+
+        // fit around the newest sample so the numbers stay small, and keep
+        // the offsets unwrapped relative to it
+        const double newestOffset = newest.offset(rate);
+        double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (size_t i = 0; i < _count; i++) {
+            const Sample& s = _samples[i];
+            if (s.rtt(rate) > maxRtt) continue;
+
+            const double x = diff(s.t1, newest.t1);
+            const double y = wrap(s.offset(rate) - newestOffset);
+            n++;
+            sx += x;
+            sy += y;
+            sxx += x * x;
+            sxy += x * y;
+        }
+        _usable = n;
+
+        const double denom = n * sxx - sx * sx;
+        if (n >= 2 && denom > 0) {
+            _rate = (n * sxy - sx * sy) / denom;
+        }
+        const double meanX = n ? sx / n : 0;
+        const double meanY = n ? sy / n : 0;
+
+        // the line's value at the newest sample
+        _ref = newest.t1;
+        _offset = newestOffset + meanY - _rate * meanX;
+    }
+
+    /// Brings a difference of offsets back within half the wrap period
+    static double wrap(double ticks) {
+        const double period = double(Timestamp(1) << TIMESTAMP_BITS);
+        if (ticks >= period / 2) return ticks - period;
+        if (ticks < -period / 2) return ticks + period;
+        return ticks;
+    }
+
+    Sample _samples[WINDOW];
+    size_t _next = 0;
+    size_t _count = 0;
+    size_t _usable = 0;
+
+    Timestamp _ref = 0;
+    double _offset = 0;
+    double _rate = 0;
+    double _minRtt = 0;
+};
+
+}  // namespace radio_time
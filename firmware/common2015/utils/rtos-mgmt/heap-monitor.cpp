@@ -0,0 +1,110 @@
+#include "heap-monitor.hpp"
+
+#include <malloc.h>
+#include <reent.h>
+#include <unistd.h>
+
+#include <rtos.h>
+#include <us_ticker_api.h>
+
+// The running thread, see cmd_ps
+extern struct OS_TSK os_tsk;
+
+// Where the heap starts, which mbed's _sbrk() grows it from
+extern "C" char __end__;
+
+// newlib's allocator, which the hooks below wrap
+extern "C" {
+void* __real__malloc_r(struct _reent* r, size_t size);
+void __real__free_r(struct _reent* r, void* ptr);
+void* __real__realloc_r(struct _reent* r, void* ptr, size_t size);
+}
+
+namespace {
+HeapTracker tracker;
+
+// Set while _realloc_r() runs, since it can allocate and free through the
+// other two, and that shouldn't count twice
+bool inRealloc = false;
+
+/// The calling thread's task id, or 0 before RTX is running
+uint8_t context() {
+    const P_TCB run = os_tsk.run;
+    return run ? run->task_id : 0;
+}
+
+/// Holds newlib's malloc lock, which is recursive, for as long as it's around
+class MallocLock {
+public:
+    explicit MallocLock(struct _reent* r = _REENT) : _r(r) {
+        __malloc_lock(_r);
+    }
+    ~MallocLock() { __malloc_unlock(_r); }
+
+private:
+    struct _reent* _r;
+};
+}  // namespace
+
+extern "C" void* __wrap__malloc_r(struct _reent* r, size_t size) {
+    MallocLock lock(r);
+    void* ptr = __real__malloc_r(r, size);
+    if (ptr && !inRealloc) {
+        tracker.allocated(context(), _malloc_usable_size_r(r, ptr));
+    }
+    return ptr;
+}
+
+extern "C" void __wrap__free_r(struct _reent* r, void* ptr) {
+    MallocLock lock(r);
+    if (ptr && !inRealloc) tracker.freed(_malloc_usable_size_r(r, ptr));
+    __real__free_r(r, ptr);
+}
+
+extern "C" void* __wrap__realloc_r(struct _reent* r, void* ptr, size_t size) {
+    MallocLock lock(r);
+    const size_t before = ptr ? _malloc_usable_size_r(r, ptr) : 0;
+
+    inRealloc = true;
+    void* moved = __real__realloc_r(r, ptr, size);
+    inRealloc = false;
+
+    // a failed realloc leaves the old block alone
+    if (moved || size == 0) {
+        if (ptr) tracker.freed(before);
+        if (moved) {
+            tracker.allocated(context(), _malloc_usable_size_r(r, moved));
+        }
+    }
+    return moved;
+}
+
+void HeapMonitor::read(HeapTracker* out, bool restart) {
+    MallocLock lock;
+    *out = tracker;
+    if (restart) {
+        tracker.startWindow(us_ticker_read());
+        tracker.resetPeak();
+    }
+}
+
+HeapLayout HeapMonitor::walk() {
+    MallocLock lock;
+    const uint8_t* end = static_cast<const uint8_t*>(sbrk(0));
+    return walkHeap(reinterpret_cast<const uint8_t*>(&__end__), end);
+}
+
+uint8_t HeapMonitor::tag(const char* name, bool noAlloc) {
+    MallocLock lock;
+    return tracker.tag(name, noAlloc);
+}
+
+uint8_t HeapMonitor::enter(uint8_t tag) {
+    MallocLock lock;
+    return tracker.enter(context(), tag);
+}
+
+void HeapMonitor::leave(uint8_t previous) {
+    MallocLock lock;
+    tracker.leave(context(), previous);
+}
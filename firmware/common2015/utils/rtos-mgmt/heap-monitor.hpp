@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "heap-tracker.hpp"
+
+/**
+ * Tracks everything that's allocated from the heap, with a HeapTracker.
+ *
+ * On the robot, it hooks newlib's _malloc_r(), _free_r(), and _realloc_r()
+ * with the linker's --wrap, see arm_mbed.cmake.  malloc(), new, and the rest
+ * of the C and C++ libraries all allocate through those.  Allocations are
+ * counted against the tag the RTX thread making them is in, see HeapTag.
+ *
+ * The simulator has its own version of this, which catches what's allocated
+ * with new, so scenarios can check that the hot paths don't allocate.
+ */
+class HeapMonitor {
+public:
+    /**
+     * Copies out the counts so far.  The rates are since the window was last
+     * restarted, see HeapTracker::allocRate().
+     *
+     * @param restart whether to start a new window for the rates, and the
+     *     peak, after this
+     */
+    static void read(HeapTracker* out, bool restart = false);
+
+    /**
+     * Walks the heap to see how much of it is free, and in how many pieces.
+     * Nothing can allocate meanwhile, and it goes through every chunk, so
+     * this isn't for anything time critical.
+     */
+    static HeapLayout walk();
+
+    /// See HeapTracker::tag()
+    static uint8_t tag(const char* name, bool noAlloc = false);
+
+    /// Counts the calling thread's allocations against @tag, and returns the
+    /// tag it was in, to leave() with
+    static uint8_t enter(uint8_t tag);
+    static void leave(uint8_t previous);
+};
+
+/**
+ * Counts the allocations the calling thread makes against a tag until it goes
+ * out of scope, like:
+ *
+ *     HeapTag heapTag("console");
+ *
+ * Looking up a tag by name takes the malloc lock, so a loop should look it up
+ * once, and only enter it each time around:
+ *
+ *     const uint8_t controlTag = HeapMonitor::tag("control", true);
+ *     while (true) {
+ *         HeapTag heapTag(controlTag);
+ *         ...
+ *     }
+ *
+ * Tags nest, and the innermost one is counted.
+ */
+class HeapTag {
+public:
+    /// @param noAlloc whether this is a hot path that shouldn't allocate
+    explicit HeapTag(const char* name, bool noAlloc = false)
+        : HeapTag(HeapMonitor::tag(name, noAlloc)) {}
+
+    /// @param tag from HeapMonitor::tag()
+    explicit HeapTag(uint8_t tag) : _previous(HeapMonitor::enter(tag)) {}
+
+    ~HeapTag() { HeapMonitor::leave(_previous); }
+
+    HeapTag(const HeapTag&) = delete;
+    HeapTag& operator=(const HeapTag&) = delete;
+
+private:
+    uint8_t _previous;
+};
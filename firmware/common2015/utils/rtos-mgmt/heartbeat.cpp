@@ -0,0 +1,47 @@
+#include "heartbeat.hpp"
+
+#include <rtos.h>
+
+#include "uptime.hpp"
+
+namespace {
+HeartbeatSupervisor supervisor;
+Mutex supervisorMutex;
+}  // namespace
+
+int Heartbeat::Register(const char* name, uint32_t deadlineMs) {
+    const uint8_t threadId = ((P_TCB)Thread::gettid())->task_id;
+
+    supervisorMutex.lock();
+    const int id = supervisor.add(name, threadId, deadlineMs, uptimeMs());
+    supervisorMutex.unlock();
+    return id;
+}
+
+void Heartbeat::CheckIn(int id) {
+    supervisorMutex.lock();
+    supervisor.checkIn(id, uptimeMs());
+    supervisorMutex.unlock();
+}
+
+void Heartbeat::CheckInThread() {
+    const uint8_t threadId = ((P_TCB)Thread::gettid())->task_id;
+
+    supervisorMutex.lock();
+    supervisor.checkIn(supervisor.find(threadId), uptimeMs());
+    supervisorMutex.unlock();
+}
+
+bool Heartbeat::Check() {
+    supervisorMutex.lock();
+    const bool healthy = supervisor.check(uptimeMs());
+    supervisorMutex.unlock();
+    return healthy;
+}
+
+void Heartbeat::Read(HeartbeatSupervisor* out, uint32_t* now) {
+    supervisorMutex.lock();
+    *out = supervisor;
+    *now = uptimeMs();
+    supervisorMutex.unlock();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+#include "heartbeat-supervisor.hpp"
+
+/**
+ * The threads that have to keep running for the robot or base station to be
+ * safe check in here, see HeartbeatSupervisor.  The main loop only feeds the
+ * hardware watchdog while Check() says they all have.
+ *
+ * A thread registers once, from itself, and then checks in at least once per
+ * deadline:
+ *
+ *     const int heartbeat = Heartbeat::Register("control", 250);
+ *     while (true) {
+ *         Heartbeat::CheckIn(heartbeat);
+ *         ...
+ *     }
+ *
+ * Anything that can take longer than that, like writing out a file, has to
+ * check in as it goes.  Code that runs in someone else's thread, like a port
+ * callback, can do that with CheckInThread().
+ */
+class Heartbeat {
+public:
+    /**
+     * Registers the calling thread, which has to check in every @deadlineMs
+     * from now on.  @name has to stay around.
+     *
+     * @return the id to check in with, or HeartbeatSupervisor::NONE if too
+     *     many threads have registered, which CheckIn() ignores
+     */
+    static int Register(const char* name, uint32_t deadlineMs);
+
+    static void CheckIn(int id);
+
+    /// Checks in for the calling thread, if it's registered
+    static void CheckInThread();
+
+    /**
+     * Checks that every registered thread is keeping up.  Once one misses its
+     * deadline, this stays false.
+     */
+    static bool Check();
+
+    /**
+     * Copies out each thread's deadline, and how it's kept up.
+     *
+     * @param now set to the time now, in the same ms as the check-ins
+     */
+    static void Read(HeartbeatSupervisor* out, uint32_t* now);
+};
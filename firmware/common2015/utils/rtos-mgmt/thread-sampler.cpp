@@ -0,0 +1,88 @@
+#include "thread-sampler.hpp"
+
+#include <rtos.h>
+#include <us_ticker_api.h>
+
+// The running thread, the idle thread, and the table of threads that cmd_ps
+// goes through too
+extern struct OS_TSK os_tsk;
+extern struct OS_TCB os_idle_TCB;
+extern void* os_active_TCB[];
+
+namespace {
+// OS_TASKCNT, plus one for main(), see cmd_ps
+const size_t TASK_COUNT = 15;
+
+// P_TCB::state for a thread that's ready to run, from rt_TypeDef.h
+const uint8_t STATE_READY = 1;
+
+// TIMER1's bits in PCONP and PCLKSEL0
+const uint32_t PCONP_TIM1 = 1 << 2;
+const uint32_t PCLKSEL0_TIM1_SHIFT = 4;
+}  // namespace
+
+ThreadProfiler ThreadSampler::_profiler;
+volatile bool ThreadSampler::_running = false;
+
+void ThreadSampler::start(uint32_t periodUs) {
+    stop();
+
+    // power up TIMER1 and count us from the full core clock
+    LPC_SC->PCONP |= PCONP_TIM1;
+    LPC_SC->PCLKSEL0 =
+        (LPC_SC->PCLKSEL0 & ~(3 << PCLKSEL0_TIM1_SHIFT)) |
+        (1 << PCLKSEL0_TIM1_SHIFT);
+
+    // interrupt and reset on every MR0 match
+    LPC_TIM1->TCR = 2;
+    LPC_TIM1->PR = SystemCoreClock / 1000000 - 1;
+    LPC_TIM1->MR0 = periodUs - 1;
+    LPC_TIM1->MCR = (1 << 0) | (1 << 1);
+    LPC_TIM1->IR = 0x3F;
+
+    // threads may have come and gone since the last profile
+    _profiler.clear(us_ticker_read());
+    _running = true;
+
+    NVIC_SetVector(TIMER1_IRQn, reinterpret_cast<uint32_t>(&timerIrq));
+    NVIC_EnableIRQ(TIMER1_IRQn);
+    LPC_TIM1->TCR = 1;
+}
+
+void ThreadSampler::stop() {
+    NVIC_DisableIRQ(TIMER1_IRQn);
+    LPC_TIM1->TCR = 0;
+    _running = false;
+}
+
+size_t ThreadSampler::read(ThreadProfiler::Stats* stats, size_t max,
+                           uint32_t* windowUs, bool restart) {
+    // keep the interrupt from changing things partway through
+    NVIC_DisableIRQ(TIMER1_IRQn);
+    const uint32_t now = us_ticker_read();
+    const size_t n = _profiler.stats(now, stats, max);
+    if (windowUs) *windowUs = _profiler.windowUs(now);
+    if (restart) _profiler.reset(now);
+    if (_running) NVIC_EnableIRQ(TIMER1_IRQn);
+    return n;
+}
+
+void ThreadSampler::timerIrq() {
+    LPC_TIM1->IR = 1 << 0;
+
+    uint8_t ready[TASK_COUNT];
+    size_t count = 0;
+    for (size_t i = 0; i < TASK_COUNT; i++) {
+        const P_TCB p = static_cast<P_TCB>(os_active_TCB[i]);
+        if (p && p->state == STATE_READY) ready[count++] = p->task_id;
+    }
+
+    const P_TCB run = os_tsk.run;
+    uint8_t running = ThreadProfiler::NO_THREAD;
+    if (run == &os_idle_TCB) {
+        running = IDLE_ID;
+    } else if (run) {
+        running = run->task_id;
+    }
+    _profiler.sample(us_ticker_read(), running, ready, count);
+}
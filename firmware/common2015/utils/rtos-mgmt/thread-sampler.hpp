@@ -0,0 +1,54 @@
+#pragma once
+
+#include <mbed.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "thread-profiler.hpp"
+
+/**
+ * Profiles the RTX threads by sampling which one is running, and which ones
+ * are ready to run but waiting, from TIMER1's interrupt.  See ThreadProfiler
+ * for what comes out of it.
+ *
+ * RTX doesn't have a context switch hook to trace with, so this samples
+ * instead.  The period doesn't divide the kernel's 1 ms tick, so threads that
+ * wake up on the tick don't always get caught at the same point.  Time spent
+ * in interrupts, including this one, counts toward the thread they
+ * interrupted.
+ *
+ * This uses TIMER1, and there's only one of it.
+ */
+class ThreadSampler {
+public:
+    /// About 10 kHz, which takes a percent or two of the CPU
+    static const uint32_t DEFAULT_PERIOD_US = 97;
+
+    /// What the idle thread shows up as
+    static const uint8_t IDLE_ID = 255;
+
+    /// Starts a new profile, sampling every @periodUs
+    static void start(uint32_t periodUs = DEFAULT_PERIOD_US);
+
+    static void stop();
+
+    static bool running() { return _running; }
+
+    /**
+     * Copies out each thread's stats since the profile started or was last
+     * restarted.
+     *
+     * @param windowUs set to how long that's been
+     * @param restart whether to start over after this
+     * @return how many threads there are
+     */
+    static size_t read(ThreadProfiler::Stats* stats, size_t max,
+                       uint32_t* windowUs, bool restart = false);
+
+private:
+    static void timerIrq();
+
+    static ThreadProfiler _profiler;
+    static volatile bool _running;
+};
@@ -0,0 +1,19 @@
+#include "uptime.hpp"
+
+#include <mbed.h>
+#include <us_ticker_api.h>
+
+namespace {
+uint32_t lastUs = 0;
+uint32_t wraps = 0;
+}  // namespace
+
+uint32_t uptimeMs() {
+    __disable_irq();
+    const uint32_t us = us_ticker_read();
+    if (us < lastUs) wraps++;
+    lastUs = us;
+    const uint64_t totalUs = (uint64_t(wraps) << 32) | us;
+    __enable_irq();
+    return totalUs / 1000;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Milliseconds since startup, from the us ticker.  The ticker wraps every 71
+ * minutes, so this counts its wraps to keep going across them, which works as
+ * long as something calls it more often than that.  It can be called from any
+ * thread.
+ */
+uint32_t uptimeMs();
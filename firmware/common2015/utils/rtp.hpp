@@ -1,9 +1,13 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 
+#include "radio-time.hpp"
+
 namespace rtp {
 
 /// Max packet size.  This is limited by the CC1201 buffer size.
@@ -43,20 +47,29 @@ bool DeserializeFromBuffer(PACKET_TYPE* pkt, uint8_t* buf, size_t bufSize) {
 /**
  * @brief Port enumerations for different communication protocols.
  */
-enum Port { SINK = 0, LINK = 1, CONTROL = 2, LEGACY = 3, PING = 4 };
+enum Port { SINK = 0, LINK = 1, CONTROL = 2, LEGACY = 3, PING = 4, OTA = 5 };
 
 struct header_data {
-    enum Type { Control, Tuning, FirmwareUpdate, Misc };
+    /// Trajectories is only used over USB, for control packets that come
+    /// with a trajectories section, see base2015/main.cpp
+    enum Type { Control, Tuning, FirmwareUpdate, Misc, Trajectories };
 
-    header_data(Port p = SINK) : address(0), port(p), type(Control){};
+    header_data(Port p = SINK) : address(0), port(p), type(Control), seq(0){};
 
     uint8_t address;
     Port port : 4;
     Type type : 4;
+
+    /// Counts up by one with each control packet a sender sends, so the
+    /// receiver can tell how many were lost
+    uint8_t seq;
 } __attribute__((packed));
 
 // binary-packed version of Control.proto
 struct ControlMessage {
+    /// Body velocities are sent in mm/s and mrad/s
+    static constexpr float VELOCITY_SCALE_FACTOR = 1000;
+
     uint8_t uid;  // robot id
     int16_t bodyX;
     int16_t bodyY;
@@ -68,6 +81,64 @@ struct ControlMessage {
     unsigned song : 2;         // 0 = stop, 1 = continue, 2 = GT fight song
 } __attribute__((packed));
 
+/**
+ * Velocities a robot should reach over the next few frames, so it can keep
+ * following the plan through lost forward packets.  The control message has
+ * the velocity for when the packet arrives, and @points TrajectoryPoints
+ * follow this, @stepMs apart after that.  See TrajectoryBuffer.
+ */
+struct TrajectoryHeader {
+    uint8_t uid;
+    uint8_t stepMs;
+    uint8_t points;
+} __attribute__((packed));
+
+/// Most points a trajectory can have
+const size_t MAX_TRAJECTORY_POINTS = 8;
+
+/// A planned velocity, in the same units as a ControlMessage
+struct TrajectoryPoint {
+    int16_t bodyX;
+    int16_t bodyY;
+    int16_t bodyW;
+} __attribute__((packed));
+
+/**
+ * Limits for a robot's MotionProfiler, sent as-is on the CONTROL port with the
+ * Tuning type.  Robots apply them until they restart, and use their defaults
+ * before the first one.
+ */
+struct MotionLimitsMessage {
+    /// Limits are in cm/s^2 and cm/s^3 for x and y, and crad/s^2 and
+    /// crad/s^3 for rotation.  Zero means no limit.
+    static constexpr float LIMIT_SCALE_FACTOR = 100;
+
+    uint8_t uid;  // robot id, or INVALID_ROBOT_UID for every robot
+    uint16_t accel[3];
+    uint16_t jerk[3];
+} __attribute__((packed));
+
+/**
+ * Starts or stops system identification of a robot's drive motors, see
+ * system-id.hpp, sent as-is on the CONTROL port with the Tuning type.  The
+ * robot should be up on a stand, since the wheels get driven open loop.
+ * Tuning packets are told apart by their size.
+ */
+struct SystemIdMessage {
+    /// Save the gains to the robot's flash once it's done
+    static const uint8_t SAVE = 1 << 0;
+
+    /// Stop one that's running, instead of starting one
+    static const uint8_t STOP = 1 << 1;
+
+    uint8_t uid;     // robot id, or INVALID_ROBOT_UID for every robot
+    uint8_t wheels;  // mask of the wheels to identify
+    uint8_t flags;
+} __attribute__((packed));
+
+static_assert(sizeof(SystemIdMessage) != sizeof(MotionLimitsMessage),
+              "Tuning packets are told apart by their size");
+
 struct RobotStatusMessage {
     uint8_t uid;  // robot id
 
@@ -81,8 +152,53 @@ struct RobotStatusMessage {
     uint8_t battVoltage;
 
     uint8_t ballSenseStatus : 2;
+
+    /// 0 if it's running, 1 if it never came up, 2 if it's had errors
+    uint8_t fpgaStatus : 2;
+
+    /// Each of these has bit i for motor i, with the dribbler last
+    uint8_t motorErrors;    // errors reported by the FPGA
+    uint8_t motorStalled;   // off after stalling, see MotorProtection
+    uint8_t motorHot;       // derated or off to cool down
+    uint8_t encoderFaults;  // driving on halls, see EncoderMonitor
 };
 
+/**
+ * Channel plan that the base station puts at the start of each forward
+ * packet.  See ChannelPlanner.
+ */
+struct ChannelSchedule {
+    uint8_t channel;    // channel this packet was sent on
+    uint8_t next;       // channel to move to
+    uint8_t countdown;  // forward packets left before moving, 0 if not moving
+} __attribute__((packed));
+
+/**
+ * A robot's view of the forward link, appended to its status reply.  See
+ * LinkStats for how these are measured.
+ */
+struct LinkSummary {
+    uint8_t loss;          // percent of the last 64 forward packets lost
+    int8_t rssi;           // dBm, averaged.  0 if the radio doesn't report it.
+    uint8_t lqi;           // radio-specific link quality, averaged
+    uint8_t longestBurst;  // most forward packets lost in a row, up to 255
+} __attribute__((packed));
+
+/**
+ * Radio timestamps that a robot appends to its status reply, so the base
+ * station can measure the link and estimate the offset between their clocks.
+ * See radio_time::Exchange for what t1-t4 are.
+ *
+ * The robot can't know when its reply will go out until after it has been
+ * sent, so each reply carries the t2 of the forward packet it answers along
+ * with the t2 and t3 of its previous reply.
+ */
+struct ReplyTimestamps {
+    uint8_t rx[radio_time::TIMESTAMP_SIZE];      // t2
+    uint8_t prevRx[radio_time::TIMESTAMP_SIZE];  // t2 of the last reply
+    uint8_t prevTx[radio_time::TIMESTAMP_SIZE];  // t3 of the last reply
+} __attribute__((packed));
+
 /**
  * @brief Real-Time packet definition
  */
@@ -91,6 +207,18 @@ public:
     rtp::header_data header;
     std::vector<uint8_t> payload;
 
+    /// When the packet was received, on the receiving radio's clock.  This
+    /// isn't sent over the air.
+    radio_time::Timestamp rxTimestamp = radio_time::UNKNOWN;
+
+    /// Signal quality the radio reported for the packet, if it did.  Also
+    /// not sent over the air.
+    struct RxQuality {
+        bool valid = false;
+        float rssi = 0;  // dBm
+        uint8_t lqi = 0;
+    } rxQuality;
+
     packet(){};
     packet(const std::string& s, Port p = SINK) : header(p) {
         for (char c : s) payload.push_back(c);
@@ -133,10 +261,24 @@ public:
     }
 };
 
+/// Most robots a forward packet can carry commands for.  This fills a DW1000
+/// frame, which is 127 bytes including its 9 byte MAC header and 2 byte CRC.
+const size_t MAX_FORWARD_ENTRIES = 10;
+
+/// Size of a forward packet's payload with @count entries.  See
+/// ForwardPayload.
+constexpr size_t ForwardPayloadSize(size_t count) {
+    return sizeof(ChannelSchedule) + sizeof(uint8_t) +
+           count * sizeof(ControlMessage);
+}
+
 // Packet sizes
-constexpr unsigned int Forward_Size =
-    sizeof(header_data) + 6 * sizeof(ControlMessage);
+constexpr unsigned int Max_Forward_Size =
+    sizeof(header_data) + ForwardPayloadSize(MAX_FORWARD_ENTRIES);
+static_assert(Max_Forward_Size <= MAX_DATA_SZ,
+              "forward packets with every entry have to fit in a frame");
 constexpr unsigned int Reverse_Size =
-    sizeof(header_data) + sizeof(RobotStatusMessage);
+    sizeof(header_data) + sizeof(RobotStatusMessage) + sizeof(LinkSummary) +
+    sizeof(ReplyTimestamps);
 
 }  // namespace rtp
@@ -0,0 +1,460 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * System identification for the drive motors, and PID gains worked out from
+ * it, so each robot's wheels get tuned to its own motors instead of sharing
+ * hand-picked gains and RobotModel's DutyCycleMultiplier.
+ *
+ * With the robot on a stand, a Runner drives one wheel at a time open loop
+ * through an Excitation: a step up, a step down, and a chirp.  Each control
+ * tick's duty cycle and measured wheel velocity go into a log in RAM, and once
+ * the wheel is done, fitFirstOrder() fits a first order model to the log:
+ *
+ *     velocity[k] = a velocity[k-1] + b duty[k] + c
+ *
+ * which is a DC gain, a time constant, and a duty cycle it takes to overcome
+ * friction.  tune() turns the model into a feedforward multiplier and PI gains
+ * with the SIMC rules, Skogestad's take on IMC tuning.  The results are saved
+ * as text, one line per wheel, see formatTuning().
+ *
+ * This is plain logic and stdio, so it can be tested on the host.
+ */
+namespace sysid {
+
+const size_t NUM_WHEELS = 4;
+
+const int16_t MAX_DUTY = 511;
+
+/**
+ * Duty cycles to excite a motor with.  The steps give the time constant
+ * cleanly, and the chirp covers the frequencies the velocity loop works at.
+ * Everything stays between the low and high duty cycles, so the wheel never
+ * stops and static friction, which isn't first order, stays out of it.
+ */
+class Excitation {
+public:
+    struct Params {
+        int16_t high;     // duty cycle of the step up, and the chirp's top
+        int16_t low;      // the step down, and the chirp's bottom
+        float stepSecs;   // how long each step is held
+        float chirpStartHz;
+        float chirpEndHz;
+        float chirpSecs;
+    };
+
+    Excitation() : Excitation(Params{300, 150, 0.3, 1, 15, 1.5}) {}
+    explicit Excitation(const Params& params) : _params(params) {}
+
+    const Params& params() const { return _params; }
+
+    /// How long it runs, in s
+    float duration() const { return 2 * _params.stepSecs + _params.chirpSecs; }
+
+    /// The duty cycle @t seconds in, or zero once it's over
+    int16_t duty(float t) const {
+        const Params& p = _params;
+        if (t < 0 || t >= duration()) return 0;
+        if (t < p.stepSecs) return p.high;
+        if (t < 2 * p.stepSecs) return p.low;
+
+        // the frequency sweeps linearly, so the phase is its integral
+        const float tc = t - 2 * p.stepSecs;
+        const float sweep = (p.chirpEndHz - p.chirpStartHz) / p.chirpSecs;
+        const float phase =
+            2 * float(M_PI) * (p.chirpStartHz * tc + sweep * tc * tc / 2);
+        const float mid = (p.high + p.low) / 2.0f;
+        const float amplitude = (p.high - p.low) / 2.0f;
+        return static_cast<int16_t>(std::lround(mid + amplitude * std::sin(phase)));
+    }
+
+private:
+    Params _params;
+};
+
+/// One control tick of a wheel being identified
+struct Sample {
+    float velocity;  // rad/s, measured at the end of the tick
+    uint16_t dtUs;   // how long the tick was
+    int16_t duty;    // what the wheel was driven at during it
+};
+
+/// A motor and wheel as a first order system from duty cycle to velocity
+struct FirstOrderModel {
+    float gain = 0;       // rad/s per duty cycle count, in steady state
+    float tau = 0;        // time constant, in s
+    float offset = 0;     // duty cycle that friction takes up
+    float rmsError = 0;   // of the fit's one tick predictions, in rad/s
+    size_t samples = 0;   // that went into the fit
+    bool valid = false;
+};
+
+/**
+ * Least squares fit of a first order model to @count samples, which are
+ * assumed to be about evenly spaced, like control ticks are.  Samples that
+ * start from under @minVelocity are left out, since the wheel could be held
+ * by static friction.
+ *
+ * The model isn't valid if there isn't enough to go on, or it doesn't come
+ * out stable with a positive gain.  A negative gain means the motor is wired
+ * backwards.
+ */
+inline FirstOrderModel fitFirstOrder(const Sample* samples, size_t count,
+                                     float minVelocity = 1) {
+    FirstOrderModel model;
+
+    // normal equations for [a b c] against [velocity[k-1] duty[k] 1]
+    double m[3][3] = {}, v[3] = {};
+    double dtSum = 0;
+    size_t n = 0;
+    for (size_t k = 1; k < count; k++) {
+        const double prev = samples[k - 1].velocity;
+        if (std::fabs(prev) < minVelocity) continue;
+
+        const double x[3] = {prev, double(samples[k].duty), 1};
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) m[i][j] += x[i] * x[j];
+            v[i] += x[i] * samples[k].velocity;
+        }
+        dtSum += samples[k].dtUs * 1e-6;
+        n++;
+    }
+    model.samples = n;
+    if (n < 10) return model;
+
+    // Gaussian elimination with partial pivoting
+    int order[3] = {0, 1, 2};
+    for (int col = 0; col < 3; col++) {
+        int pivot = col;
+        for (int row = col + 1; row < 3; row++) {
+            if (std::fabs(m[order[row]][col]) > std::fabs(m[order[pivot]][col]))
+                pivot = row;
+        }
+        std::swap(order[col], order[pivot]);
+        const double* top = m[order[col]];
+        if (std::fabs(top[col]) < 1e-12) return model;
+
+        for (int row = col + 1; row < 3; row++) {
+            double* r = m[order[row]];
+            const double f = r[col] / top[col];
+            for (int j = col; j < 3; j++) r[j] -= f * top[j];
+            v[order[row]] -= f * v[order[col]];
+        }
+    }
+    double coef[3];
+    for (int col = 2; col >= 0; col--) {
+        double sum = v[order[col]];
+        for (int j = col + 1; j < 3; j++) sum -= m[order[col]][j] * coef[j];
+        coef[col] = sum / m[order[col]][col];
+    }
+    const double a = coef[0], b = coef[1], c = coef[2];
+    if (!(a > 0 && a < 1 && b > 0)) return model;
+
+    double errSq = 0;
+    for (size_t k = 1; k < count; k++) {
+        const double prev = samples[k - 1].velocity;
+        if (std::fabs(prev) < minVelocity) continue;
+        const double err =
+            samples[k].velocity - (a * prev + b * samples[k].duty + c);
+        errSq += err * err;
+    }
+
+    const double dt = dtSum / n;
+    model.gain = b / (1 - a);
+    model.tau = -dt / std::log(a);
+    model.offset = -c / b;
+    model.rmsError = std::sqrt(errSq / n);
+    model.valid = true;
+    return model;
+}
+
+/// Gains for a Pid, whose integral is a sum of errors, one per tick
+struct PidGains {
+    float kp = 0;
+    float ki = 0;
+    float kd = 0;
+};
+
+/// What the velocity loop for one wheel runs with
+struct WheelTuning {
+    PidGains pid;
+
+    /// Duty cycle per rad/s of wheel speed, like
+    /// RobotModel::DutyCycleMultiplier, at the nominal battery voltage
+    float dutyCycleMultiplier = 0;
+
+    /// What it was worked out from, for reference
+    FirstOrderModel model;
+};
+
+/**
+ * Feedforward and PI gains for a wheel.  The feedforward is the inverse of
+ * the model's gain.  The PI loop is tuned with SIMC for a closed loop time
+ * constant of @lambda, which defaults to the model's time constant, or the
+ * loop's delay if that's longer.  That's on the smooth side, which suits a
+ * loop that the feedforward is doing most of the work for.
+ *
+ * @param dt the control loop's period, in s.  It's taken as the loop's
+ *     delay too, since the duty cycles for a tick go out at the start of the
+ *     next one.
+ * @param supplyScale BatteryMonitor::supplyScale() while the model was
+ *     measured, so the feedforward comes out for the nominal voltage
+ */
+inline WheelTuning tune(const FirstOrderModel& model, float dt,
+                        float supplyScale = 1, float lambda = 0) {
+    WheelTuning tuning;
+    tuning.model = model;
+    if (!model.valid || dt <= 0) return tuning;
+
+    const float delay = dt;
+    if (lambda <= 0) lambda = std::fmax(model.tau, delay);
+
+    tuning.dutyCycleMultiplier = 1 / (model.gain * supplyScale);
+    tuning.pid.kp = model.tau / (model.gain * (lambda + delay));
+    const float ti = std::fmin(model.tau, 4 * (lambda + delay));
+    tuning.pid.ki = tuning.pid.kp * dt / ti;
+    tuning.pid.kd = 0;
+    return tuning;
+}
+
+/**
+ * Writes the tunings of the wheels in @mask as text, one line per wheel:
+ *
+ *     <wheel> kp=<kp> ki=<ki> kd=<kd> ff=<multiplier> gain=<gain> tau=<tau>
+ *
+ * @return what snprintf() does
+ */
+inline int formatTuning(const WheelTuning tunings[NUM_WHEELS], uint8_t mask,
+                        char* buf, size_t size) {
+    int len = snprintf(buf, size, "# drive motor tuning, see system-id.hpp\n");
+    for (size_t i = 0; i < NUM_WHEELS && len >= 0; i++) {
+        if (!(mask & (1 << i))) continue;
+        const WheelTuning& t = tunings[i];
+        const size_t used = std::min<size_t>(len, size);
+        const int n = snprintf(
+            buf + used, size - used,
+            "%u kp=%.4f ki=%.5f kd=%.4f ff=%.4f gain=%.5f tau=%.5f\n",
+            unsigned(i), t.pid.kp, t.pid.ki, t.pid.kd, t.dutyCycleMultiplier,
+            t.model.gain, t.model.tau);
+        len = n < 0 ? n : len + n;
+    }
+    return len;
+}
+
+/**
+ * Reads what formatTuning() writes into @tunings.  Blank lines, comments
+ * starting with #, and keys it doesn't know are skipped.  Lines for a wheel
+ * that doesn't exist or without a positive multiplier are left out.
+ *
+ * @return a mask of the wheels that were read
+ */
+inline uint8_t parseTuning(const char* text, WheelTuning tunings[NUM_WHEELS]) {
+    uint8_t mask = 0;
+    while (*text) {
+        const char* end = strchr(text, '\n');
+        if (!end) end = text + strlen(text);
+
+        char line[128];
+        const size_t len = std::min<size_t>(end - text, sizeof(line) - 1);
+        memcpy(line, text, len);
+        line[len] = '\0';
+        text = *end ? end + 1 : end;
+
+        char* p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\0' || *p == '\r') continue;
+
+        char* after;
+        const long wheel = strtol(p, &after, 10);
+        if (after == p || wheel < 0 || wheel >= long(NUM_WHEELS)) continue;
+
+        WheelTuning t;
+        for (char* tok = strtok(after, " \t\r"); tok;
+             tok = strtok(nullptr, " \t\r")) {
+            char* eq = strchr(tok, '=');
+            if (!eq) continue;
+            *eq = '\0';
+            const float value = strtof(eq + 1, nullptr);
+            if (!strcmp(tok, "kp")) t.pid.kp = value;
+            else if (!strcmp(tok, "ki")) t.pid.ki = value;
+            else if (!strcmp(tok, "kd")) t.pid.kd = value;
+            else if (!strcmp(tok, "ff")) t.dutyCycleMultiplier = value;
+            else if (!strcmp(tok, "gain")) t.model.gain = value;
+            else if (!strcmp(tok, "tau")) t.model.tau = value;
+        }
+        if (!(t.dutyCycleMultiplier > 0)) continue;
+
+        t.model.valid = t.model.gain > 0 && t.model.tau > 0;
+        tunings[wheel] = t;
+        mask |= 1 << wheel;
+    }
+    return mask;
+}
+
+/// Longest a tuning file can be
+const size_t MAX_TUNING_TEXT = 512;
+
+/// @return a mask of the wheels read from the file at @path, see
+///     parseTuning()
+inline uint8_t loadTuning(const char* path, WheelTuning tunings[NUM_WHEELS]) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return 0;
+
+    char text[MAX_TUNING_TEXT + 1];
+    const size_t len = fread(text, 1, MAX_TUNING_TEXT, fp);
+    fclose(fp);
+    text[len] = '\0';
+    return parseTuning(text, tunings);
+}
+
+/// Writes the wheels in @mask to the file at @path
+inline bool saveTuning(const char* path, const WheelTuning tunings[NUM_WHEELS],
+                       uint8_t mask) {
+    char text[MAX_TUNING_TEXT];
+    const int len = formatTuning(tunings, mask, text, sizeof(text));
+    if (len < 0 || size_t(len) >= sizeof(text)) return false;
+
+    FILE* fp = fopen(path, "w");
+    if (!fp) return false;
+    const bool ok = fwrite(text, 1, len, fp) == size_t(len);
+    return fclose(fp) == 0 && ok;
+}
+
+/**
+ * Identifies the wheels in a mask one after another, from the control loop.
+ * Each one runs through the Excitation while the others are held at zero,
+ * then gets a rest to spin down before the next one starts.  The log holds
+ * the wheel being identified, or the last one once it's done, so it can be
+ * looked at afterward.
+ */
+class Runner {
+public:
+    /// Enough for the default Excitation with a bit of room, at 5 ms ticks
+    static const size_t LOG_SIZE = 512;
+
+    /// How long a wheel gets to spin down before the next one, in s
+    static constexpr float REST_SECS = 0.5;
+
+    explicit Runner(const Excitation& excitation = Excitation())
+        : _excitation(excitation) {}
+
+    /// Starts identifying the wheels in @mask
+    void start(uint8_t mask) {
+        _mask = mask & ((1 << NUM_WHEELS) - 1);
+        _identified = 0;
+        _wheel = -1;
+        nextWheel();
+    }
+
+    void stop() { _wheel = -1; }
+
+    bool active() const { return _wheel >= 0; }
+
+    /// The wheel being identified, or -1
+    int wheel() const { return _wheel; }
+
+    /**
+     * Runs a control tick.
+     *
+     * @param velocities each wheel's velocity over the last tick, in rad/s
+     * @param applied the duty cycles each wheel was driven at over it
+     * @param dt how long the last tick was, in s
+     * @param duty set to the duty cycles to drive the wheels at next
+     * @return true on the tick that it finishes
+     */
+    bool update(const float velocities[NUM_WHEELS],
+                const int16_t applied[NUM_WHEELS], float dt,
+                int16_t duty[NUM_WHEELS]) {
+        for (size_t i = 0; i < NUM_WHEELS; i++) duty[i] = 0;
+        if (!active()) return false;
+
+        const float excited = _excitation.duration();
+        if (_t < excited) {
+            // the first tick's velocity is from before it started
+            if (_t > 0 && _logSize < LOG_SIZE) {
+                const float dtUs = std::fmin(dt * 1e6f, UINT16_MAX);
+                _log[_logSize++] = {velocities[_wheel], uint16_t(dtUs),
+                                    applied[_wheel]};
+            }
+            _dtSum += dt;
+            _ticks++;
+        }
+
+        _t += dt;
+        if (_t < excited) {
+            duty[_wheel] = _excitation.duty(_t);
+            return false;
+        }
+
+        if (!(_identified & (1 << _wheel)) && !_fitted) {
+            _models[_wheel] = fitFirstOrder(_log, _logSize);
+            if (_models[_wheel].valid) _identified |= 1 << _wheel;
+            _fitted = true;
+        }
+        if (_t < excited + REST_SECS) return false;
+
+        nextWheel();
+        return !active();
+    }
+
+    /// The model for @wheel from the last run, if it was identified
+    const FirstOrderModel& model(size_t wheel) const { return _models[wheel]; }
+
+    /// Wheels that came out with valid models
+    uint8_t identified() const { return _identified; }
+
+    /// Wheels that were asked for
+    uint8_t requested() const { return _mask; }
+
+    /// Average control loop period while a wheel was excited, in s
+    float meanDt() const { return _ticks ? _dtSum / _ticks : 0; }
+
+    const Sample* log() const { return _log; }
+    size_t logSize() const { return _logSize; }
+
+    /// The wheel that log() is from, or -1
+    int logWheel() const { return _logWheel; }
+
+private:
+    void nextWheel() {
+        int next = _wheel + 1;
+        while (next < int(NUM_WHEELS) && !(_mask & (1 << next))) next++;
+        if (next >= int(NUM_WHEELS)) {
+            _wheel = -1;
+            return;
+        }
+
+        _wheel = next;
+        _logWheel = next;
+        _models[next] = FirstOrderModel();
+        _logSize = 0;
+        _t = 0;
+        _fitted = false;
+    }
+
+    Excitation _excitation;
+
+    uint8_t _mask = 0;
+    uint8_t _identified = 0;
+    int _wheel = -1;
+    float _t = 0;
+    bool _fitted = false;
+
+    float _dtSum = 0;
+    uint32_t _ticks = 0;
+
+    FirstOrderModel _models[NUM_WHEELS];
+
+    Sample _log[LOG_SIZE];
+    size_t _logSize = 0;
+    int _logWheel = -1;
+};
+
+}  // namespace sysid
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Accounts for how much of the CPU each thread gets, and how long threads wait
+ * to run once they're ready to, from a trace of context switches.
+ *
+ * It's told when a thread becomes ready, with ready(), and when one starts
+ * running, with switchTo().  A thread's run time is from when it's switched to
+ * until the next switch, and its wake latency is from when it's ready until
+ * it's switched to.  The idle thread is just another thread to it, so idle
+ * time is the idle thread's run time.
+ *
+ * The trace can also come from sampling which thread is running and which
+ * ones are ready every so often, with sample().  The run times come out the
+ * same on average, but a thread has to be caught waiting to have its latency
+ * measured, so waits shorter than the sample period mostly go uncounted and
+ * the ones that are come out rounded to it.
+ *
+ * Times are in us and wrap, so a window is good for about 71 minutes.  This
+ * is plain logic, so it can be tested on the host.
+ */
+class ThreadProfiler {
+public:
+    /// RTX's thread limit, plus the idle thread
+    static const size_t MAX_THREADS = 16;
+
+    /// Not a thread, for when nothing's known to be running yet
+    static const uint8_t NO_THREAD = 0;
+
+    struct Stats {
+        uint8_t id = NO_THREAD;
+        uint32_t runUs = 0;
+        uint32_t switches = 0;  // times it was switched to
+
+        uint32_t wakeups = 0;   // that were measured
+        uint32_t latencySumUs = 0;
+        uint32_t latencyMaxUs = 0;
+
+        float meanLatencyUs() const {
+            return wakeups ? float(latencySumUs) / wakeups : 0;
+        }
+    };
+
+    ThreadProfiler() { reset(0); }
+
+    /// Starts a new window at @nowUs, keeping track of what's running and
+    /// what's ready
+    void reset(uint32_t nowUs) {
+        for (Slot& s : _slots) {
+            const uint8_t id = s.stats.id;
+            s.stats = Stats();
+            s.stats.id = id;
+        }
+        _startUs = nowUs;
+        _runningSinceUs = nowUs;
+        _dropped = 0;
+    }
+
+    /// Forgets the threads too, for when they've all changed
+    void clear(uint32_t nowUs) {
+        for (Slot& s : _slots) s = Slot();
+        _running = NO_THREAD;
+        reset(nowUs);
+    }
+
+    /// Thread @id became ready to run at @nowUs.  Being told again before
+    /// it's switched to doesn't change when it became ready.
+    void ready(uint8_t id, uint32_t nowUs) {
+        if (id == _running) return;
+        Slot* s = slot(id);
+        if (!s || s->waiting) return;
+        s->waiting = true;
+        s->readyUs = nowUs;
+    }
+
+    /// Thread @id started running at @nowUs
+    void switchTo(uint8_t id, uint32_t nowUs) {
+        if (id == _running) return;
+
+        Slot* prev = find(_running);
+        if (prev) prev->stats.runUs += nowUs - _runningSinceUs;
+
+        _running = id;
+        _runningSinceUs = nowUs;
+
+        Slot* s = slot(id);
+        if (!s) return;
+        s->stats.switches++;
+        if (s->waiting) {
+            const uint32_t latency = nowUs - s->readyUs;
+            s->stats.wakeups++;
+            s->stats.latencySumUs += latency;
+            if (latency > s->stats.latencyMaxUs) {
+                s->stats.latencyMaxUs = latency;
+            }
+            s->waiting = false;
+        }
+    }
+
+    /**
+     * Thread @running was running at @nowUs, and the @count threads in
+     * @readyIds were ready to run.
+     */
+    void sample(uint32_t nowUs, uint8_t running, const uint8_t* readyIds,
+                size_t count) {
+        for (size_t i = 0; i < count; i++) ready(readyIds[i], nowUs);
+        switchTo(running, nowUs);
+    }
+
+    /**
+     * Copies out each thread's stats for the window so far, counting the
+     * running thread's time up to @nowUs.
+     *
+     * @return how many threads there are
+     */
+    size_t stats(uint32_t nowUs, Stats* out, size_t max) const {
+        size_t n = 0;
+        for (const Slot& s : _slots) {
+            if (s.stats.id == NO_THREAD) continue;
+            if (n < max) {
+                out[n] = s.stats;
+                if (s.stats.id == _running) {
+                    out[n].runUs += nowUs - _runningSinceUs;
+                }
+            }
+            n++;
+        }
+        return n;
+    }
+
+    /// How long the window's been going at @nowUs
+    uint32_t windowUs(uint32_t nowUs) const { return nowUs - _startUs; }
+
+    /// Events for threads that didn't fit, since the window started
+    uint32_t dropped() const { return _dropped; }
+
+    uint8_t running() const { return _running; }
+
+private:
+    struct Slot {
+        Stats stats;
+        bool waiting = false;
+        uint32_t readyUs = 0;
+    };
+
+    Slot* find(uint8_t id) {
+        if (id == NO_THREAD) return nullptr;
+        for (Slot& s : _slots) {
+            if (s.stats.id == id) return &s;
+        }
+        return nullptr;
+    }
+
+    /// The slot for @id, taking a free one if it doesn't have one yet
+    Slot* slot(uint8_t id) {
+        if (id == NO_THREAD) return nullptr;
+        Slot* s = find(id);
+        if (s) return s;
+        for (Slot& free : _slots) {
+            if (free.stats.id == NO_THREAD) {
+                free.stats.id = id;
+                return &free;
+            }
+        }
+        _dropped++;
+        return nullptr;
+    }
+
+    Slot _slots[MAX_THREADS];
+
+    uint8_t _running = NO_THREAD;
+    uint32_t _runningSinceUs = 0;
+    uint32_t _startUs = 0;
+    uint32_t _dropped = 0;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * The velocity a robot should be going, as planned by soccer.
+ *
+ * Each forward packet sets a new plan: the velocity in its control message,
+ * for right now, and optionally a few more, spaced evenly after it, for where
+ * the robot is headed over the next frames.  The controller asks for the
+ * velocity every tick, which is interpolated along the plan and then held at
+ * the end of it.  If forward packets stop coming, it keeps following the plan
+ * and then fades out to a stop over DECAY_MS, rather than holding a velocity
+ * and stopping dead when the command times out.
+ *
+ * This is fixed size and plain logic, so it can be tested on the host.
+ */
+class TrajectoryBuffer {
+public:
+    /// Most planned velocities after the one for right now
+    static const size_t MAX_POINTS = 8;
+
+    /// Time after the last update that the velocity reaches zero, in ms
+    static const uint32_t TIMEOUT_MS = 250;
+
+    /// How long it takes to fade out to zero, ending at TIMEOUT_MS
+    static const uint32_t DECAY_MS = 100;
+
+    struct Velocity {
+        float x, y, w;
+    };
+
+    /**
+     * Replaces the plan.
+     *
+     * @param now time, in ms, that @start is for
+     * @param points planned velocities at @stepMs, 2 * @stepMs, ... after
+     *     @now.  Any more than MAX_POINTS are ignored.
+     */
+    void set(uint32_t now, const Velocity& start,
+             const Velocity* points = nullptr, size_t count = 0,
+             uint32_t stepMs = 0) {
+        if (stepMs == 0) count = 0;
+        if (count > MAX_POINTS) count = MAX_POINTS;
+
+        _start = now;
+        _stepMs = stepMs;
+        _points[0] = start;
+        for (size_t i = 0; i < count; i++) _points[i + 1] = points[i];
+        _count = count + 1;
+        _active = true;
+    }
+
+    /// Stops right away
+    void clear() { _active = false; }
+
+    /// The velocity to be going at @now, in ms
+    Velocity at(uint32_t now) const {
+        if (!_active) return {0, 0, 0};
+
+        // time since the plan came in.  Anything from before it is treated as
+        // right at the start.
+        const int32_t signedAge = int32_t(now - _start);
+        const uint32_t age = signedAge > 0 ? signedAge : 0;
+        if (age >= TIMEOUT_MS) return {0, 0, 0};
+
+        Velocity v;
+        const uint32_t end = (_count - 1) * _stepMs;
+        if (age >= end) {
+            v = _points[_count - 1];
+        } else {
+            const size_t i = age / _stepMs;
+            const float t = float(age - i * _stepMs) / _stepMs;
+            const Velocity& a = _points[i];
+            const Velocity& b = _points[i + 1];
+            v = {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t,
+                 a.w + (b.w - a.w) * t};
+        }
+
+        if (age > TIMEOUT_MS - DECAY_MS) {
+            const float scale = float(TIMEOUT_MS - age) / DECAY_MS;
+            v = {v.x * scale, v.y * scale, v.w * scale};
+        }
+        return v;
+    }
+
+    /// Whether there's a plan that hasn't timed out at @now
+    bool active(uint32_t now) const {
+        return _active && int32_t(now - _start) < int32_t(TIMEOUT_MS);
+    }
+
+    /// Number of velocities in the plan, including the one for the start
+    size_t size() const { return _count; }
+
+private:
+    bool _active = false;
+    uint32_t _start = 0;
+    uint32_t _stepMs = 0;
+    size_t _count = 0;
+    Velocity _points[MAX_POINTS + 1] = {};
+};
@@ -92,8 +92,26 @@ set(MBED_LINK_LIBRARY stdc++ supc++ m gcc g c nosys rdimon)
 # ------------------------------------------------------------------------------
 # linker settings
 set(MBED_CMAKE_EXE_LINKER_FLAGS "-Wl,--gc-sections -Wl,--wrap,main --specs=nosys.specs  -u _printf_float -u _scanf_float")
+# hook newlib's allocator to track the heap, see heap-monitor.hpp.  -u pulls
+# the hooks in before libc, which is what calls them, is linked.
+set(MBED_CMAKE_EXE_LINKER_FLAGS "${MBED_CMAKE_EXE_LINKER_FLAGS} -Wl,--wrap,_malloc_r -Wl,--wrap,_free_r -Wl,--wrap,_realloc_r -Wl,-u,__wrap__malloc_r")
 set(MBED_CMAKE_EXE_LINKER_FLAGS "${MBED_CMAKE_EXE_LINKER_FLAGS} -T '${MBED_REPO_DIR}/build/mbed/TARGET_${MBED_PLATFORM_UPPERC}/TOOLCHAIN_${MBED_TOOLCHAIN}/${MBED_PLATFORM}.ld' -static")
 
+# ------------------------------------------------------------------------------
+# the last flash sector, 0x78000 on, holds the crash log, see CrashLog.hpp.  The
+# linker script gives the firmware all of flash, so mbed_check_flash_size()
+# adds a check after linking that the image stays below it.
+set(MBED_FLASH_LIMIT 491520) # 0x78000
+set(MBED_CHECK_FLASH_SIZE_SCRIPT ${CMAKE_CURRENT_LIST_DIR}/check_flash_size.cmake)
+
+function(MBED_CHECK_FLASH_SIZE target)
+    add_custom_command(TARGET ${target} POST_BUILD
+        COMMAND ${CMAKE_COMMAND} -DSIZE_TOOL=${ARM_SIZE} -DELF_FILE=$<TARGET_FILE:${target}>
+                -DFLASH_LIMIT=${MBED_FLASH_LIMIT} -P ${MBED_CHECK_FLASH_SIZE_SCRIPT}
+        COMMENT "Checking that ${target} fits below the crash log"
+    )
+endfunction()
+
 # ------------------------------------------------------------------------------
 # mbed include directories for all targets
 set(MBED_INC_DIRS           "${MBED_REPO_DIR}/build/mbed")
@@ -26,6 +26,7 @@ find_program( ARM_NM            ${ARM_PREFIX}-nm        )
 find_program( ARM_LD            ${ARM_PREFIX}-ld        )
 find_program( ARM_OBJCOPY       ${ARM_PREFIX}-objcopy   )
 find_program( ARM_OBJDUMP       ${ARM_PREFIX}-objdump   )
+find_program( ARM_SIZE          ${ARM_PREFIX}-size      )
 
 # make sure we define this since we'll be using GCC
 add_definitions(-DTOOLCHAIN_GCC)
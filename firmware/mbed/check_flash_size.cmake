@@ -0,0 +1,33 @@
+# =============================================================================
+# Fails the build if an elf file's flash image is bigger than a limit.
+#
+# Usage:
+#   cmake -DSIZE_TOOL=<size> -DELF_FILE=<elf> -DFLASH_LIMIT=<bytes> -P check_flash_size.cmake
+#
+# The flash image is the text and data columns from size's default output,
+# since the initial values of .data are stored in flash right after the code.
+# =============================================================================
+CMAKE_MINIMUM_REQUIRED(VERSION 3.0.0)
+
+execute_process(
+    COMMAND         ${SIZE_TOOL} ${ELF_FILE}
+    OUTPUT_VARIABLE _size_output
+    RESULT_VARIABLE _size_result
+)
+if(NOT _size_result EQUAL 0)
+    message(FATAL_ERROR "unable to get the size of ${ELF_FILE}")
+endif()
+
+# the second line is "text data bss dec hex filename"
+string(REGEX MATCH "\n[ \t]*([0-9]+)[ \t]+([0-9]+)" _size_line "${_size_output}")
+if(NOT _size_line)
+    message(FATAL_ERROR "unable to read the size of ${ELF_FILE}:\n${_size_output}")
+endif()
+math(EXPR _flash_used "${CMAKE_MATCH_1} + ${CMAKE_MATCH_2}")
+
+if(_flash_used GREATER FLASH_LIMIT)
+    math(EXPR _flash_over "${_flash_used} - ${FLASH_LIMIT}")
+    message(FATAL_ERROR "${ELF_FILE} uses ${_flash_used} bytes of flash, "
+        "which is ${_flash_over} over the ${FLASH_LIMIT} it's allowed")
+endif()
+message(STATUS "${ELF_FILE} uses ${_flash_used} of ${FLASH_LIMIT} bytes of flash")
@@ -0,0 +1,134 @@
+#include "RobotPlant.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+const float GRAVITY = 9.81;  // m/s^2
+
+/// Wheel speed below which a load torque fades out, so a stopped wheel
+/// doesn't get pushed backwards by it
+const float LOAD_SMOOTHING = 0.5;  // rad/s
+
+int32_t countAt(double angle, float perTurn) {
+    return static_cast<int32_t>(std::floor(angle / (2 * M_PI) * perTurn));
+}
+}  // namespace
+
+RobotPlant::RobotPlant() : RobotPlant(Params()) {}
+
+RobotPlant::RobotPlant(const Params& params)
+    : _params(params), _volts(params.batteryVolts) {}
+
+void RobotPlant::advanceTo(uint64_t us) {
+    while (_nowUs < us) {
+        step(std::min<uint64_t>(_params.substepUs, us - _nowUs));
+    }
+}
+
+void RobotPlant::step(uint32_t us) {
+    const float dt = us * 1e-6f;
+    const Params& p = _params;
+    const float r = RobotModel2015.WheelRadius;
+
+    // how fast each wheel would turn if it were rolling without slipping
+    const Eigen::Vector4f rolling = RobotModel2015.BotToWheel * _vel;
+
+    const float normalForce = p.mass * GRAVITY / NUM_WHEELS;
+    Eigen::Vector4f traction;
+    std::array<double, NUM_MOTORS> prevAngle = _angle;
+
+    // the dribbler's speed is in hall counts per second
+    const float dribblerKe = 18.0f / p.dribblerFullSpeed;
+
+    // Each motor draws (V d - e) / R through the bridge, and the battery gets
+    // d of that, so the battery current is V G - H for the terminal voltage
+    // V.  Solving that against the battery's own resistance at once keeps
+    // the voltage from ringing between substeps on a weak battery.
+    float g = 0, h = 0;
+    for (size_t i = 0; i < NUM_MOTORS; i++) {
+        const float duty = float(_duty[i]) / MAX_DUTY;
+        const bool dribbler = i == DRIBBLER;
+        const float emf = (dribbler ? dribblerKe : p.ke) * _speed[i];
+        const float ohms = dribbler ? p.dribblerResistance : p.resistance;
+        g += duty * duty / ohms;
+        h += duty * emf / ohms;
+    }
+    _volts = (p.batteryVolts - p.batteryResistance * (p.idleAmps - h)) /
+             (1 + p.batteryResistance * g);
+
+    // the battery only charges back up so much
+    _batteryAmps = p.idleAmps + _volts * g - h;
+    if (_batteryAmps < 0) {
+        _batteryAmps = 0;
+        _volts = p.batteryVolts;
+    }
+
+    for (size_t i = 0; i < NUM_WHEELS; i++) {
+        const float duty = float(_duty[i]) / MAX_DUTY;
+        _amps[i] = (_volts * duty - p.ke * _speed[i]) / p.resistance;
+
+        const float slip = (_speed[i] - rolling[i]) * r;
+        traction[i] =
+            p.friction * normalForce * std::tanh(slip / p.slipSpeed);
+
+        const float torque = p.ke * _amps[i] - p.wheelDrag * _speed[i] -
+                             _load[i] * std::tanh(_speed[i] / LOAD_SMOOTHING) -
+                             traction[i] * r;
+        _speed[i] += torque / p.wheelInertia * dt;
+        _angle[i] += _speed[i] * dt;
+    }
+
+    {
+        const float duty = float(_duty[DRIBBLER]) / MAX_DUTY;
+        _amps[DRIBBLER] = (_volts * duty - dribblerKe * _speed[DRIBBLER]) /
+                          p.dribblerResistance;
+
+        _speed[DRIBBLER] += (_volts * duty / dribblerKe - _speed[DRIBBLER]) /
+                            p.dribblerTimeConstant * dt;
+        _angle[DRIBBLER] += _speed[DRIBBLER] * dt;
+    }
+
+    // the wheels push the body along their drive directions, see
+    // RobotModel::recalculateBotToWheel()
+    const Eigen::Vector3f push =
+        r * RobotModel2015.BotToWheel.transpose() * traction;
+    Eigen::Vector3f accel(push[0] / p.mass, push[1] / p.mass,
+                          push[2] / p.inertia);
+
+    // the body's frame turns with it
+    accel[0] += _vel[2] * _vel[1];
+    accel[1] -= _vel[2] * _vel[0];
+    _vel += accel * dt;
+
+    const float heading = _pose[2];
+    _pose[0] += (_vel[0] * std::cos(heading) - _vel[1] * std::sin(heading)) * dt;
+    _pose[1] += (_vel[0] * std::sin(heading) + _vel[1] * std::cos(heading)) * dt;
+    _pose[2] += _vel[2] * dt;
+
+    const float alpha = dt / (p.currentTimeConstant + dt);
+    for (size_t i = 0; i < NUM_MOTORS; i++) {
+        _sensedAmps[i] += (std::abs(_amps[i]) - _sensedAmps[i]) * alpha;
+    }
+
+    // quantize the wheels, and find when within the step each encoder last
+    // ticked over
+    for (size_t i = 0; i < NUM_WHEELS; i++) {
+        const int32_t count = countAt(_angle[i], p.encoderTicksPerTurn);
+        if (count != _encCount[i]) {
+            // going backwards, the last edge is the top of the new count
+            const double edge = count > _encCount[i] ? count : count + 1;
+            const double edgeAngle = edge * 2 * M_PI / p.encoderTicksPerTurn;
+            const double frac =
+                (edgeAngle - prevAngle[i]) / (_angle[i] - prevAngle[i]);
+            _lastEdgeUs[i] = _nowUs + static_cast<uint64_t>(
+                                          std::max(0.0, std::min(1.0, frac)) *
+                                          us);
+            _encCount[i] = count;
+        }
+        _hallCount[i] = countAt(_angle[i], p.hallsPerTurn);
+    }
+    _hallCount[DRIBBLER] = static_cast<int32_t>(std::floor(_angle[DRIBBLER]));
+
+    _nowUs += us;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "RobotModel.hpp"
+
+/**
+ * Rigid-body model of a 2015 robot on the field, for the simulated FPGA to
+ * drive and read back from.
+ *
+ * Each of the four drive motors turns its wheel through the motor constants,
+ * and the wheels push the body through tire slip, so wheels can spin out and
+ * get dragged.  The body moves in the plane with its mass and moment of
+ * inertia.  Wheel angles are quantized to encoder and hall counts the way the
+ * FPGA counts them, and the dribbler is a motor with a first order response.
+ * Everything runs off of a battery with internal resistance, so hard
+ * acceleration sags the voltage the motors get.
+ *
+ * The plant only moves forward when asked to with advanceTo(), in substeps
+ * short enough for the stiff tire model.
+ */
+class RobotPlant {
+public:
+    static const size_t NUM_WHEELS = 4;
+    static const size_t NUM_MOTORS = 5;
+    static const size_t DRIBBLER = 4;
+
+    static const int16_t MAX_DUTY = 511;
+
+    struct Params {
+        float mass = 2.5;         // kg
+        float inertia = 0.011;    // kg m^2, about the center
+        float wheelInertia = 1e-4;  // kg m^2, with the rotor through the gears
+        float friction = 0.8;     // coefficient between the wheels and carpet
+        float slipSpeed = 0.05;   // m/s of slip for most of the friction
+
+        /// Drive motor constants at the wheel.  The back EMF constant matches
+        /// RobotModel2015.DutyCycleMultiplier at 18 V, and the resistance
+        /// the stall current that CurrentController assumes.
+        float ke = 18.0f / (MAX_DUTY / 9.0f);  // V / (rad/s), and N m / A
+        float resistance = 1.2;                 // ohms
+        float wheelDrag = 0.002;                // N m / (rad/s)
+
+        /// Dribbler, in the hall counts per second the firmware uses
+        float dribblerFullSpeed = 20000;  // at 18 V and no load
+        float dribblerTimeConstant = 0.1;  // s
+        float dribblerResistance = 2;      // ohms
+
+        float encoderTicksPerTurn = 2048;
+        float hallsPerTurn = 24;
+
+        /// Time constant of the FPGA's current filter
+        float currentTimeConstant = 0.001;  // s
+
+        float batteryVolts = 16.8;     // open circuit
+        float batteryResistance = 0.15;  // ohms
+        float idleAmps = 0.3;            // for the electronics
+
+        uint32_t substepUs = 50;
+    };
+
+    RobotPlant();
+    explicit RobotPlant(const Params& params);
+
+    const Params& params() const { return _params; }
+
+    /// Runs the model up to @us, in the simulator's microseconds
+    void advanceTo(uint64_t us);
+
+    /// What the FPGA is driving the motors with, from -MAX_DUTY to MAX_DUTY
+    void setDuty(size_t motor, int16_t duty) { _duty[motor] = duty; }
+    int16_t duty(size_t motor) const { return _duty[motor]; }
+
+    /// Changes the battery, which could be one that's worn out or nearly dead
+    void setBattery(float volts, float resistance) {
+        _params.batteryVolts = volts;
+        _params.batteryResistance = resistance;
+    }
+
+    /// Adds a torque against wheel @wheel's motion, like something caught in
+    /// it.  A big one stalls it.
+    void setWheelLoad(size_t wheel, float nm) { _load[wheel] = nm; }
+
+    /// Encoder and hall counts since startup, and when each encoder last
+    /// changed
+    int32_t encoderCount(size_t wheel) const { return _encCount[wheel]; }
+    int32_t hallCount(size_t motor) const { return _hallCount[motor]; }
+    uint64_t lastEdgeUs(size_t wheel) const { return _lastEdgeUs[wheel]; }
+
+    /// Motor currents, in amps, through the FPGA's filter
+    float sensedAmps(size_t motor) const { return _sensedAmps[motor]; }
+
+    /// Voltage at the battery's terminals
+    float batteryVolts() const { return _volts; }
+
+    /// Body velocity in m/s and rad/s, in the robot's frame
+    const Eigen::Vector3f& bodyVel() const { return _vel; }
+
+    /// Where it is on the field, in m and rad
+    const Eigen::Vector3f& pose() const { return _pose; }
+
+private:
+    void step(uint32_t us);
+
+    Params _params;
+    uint64_t _nowUs = 0;
+
+    std::array<int16_t, NUM_MOTORS> _duty{};
+    std::array<float, NUM_WHEELS> _load{};
+
+    /// Wheel speeds and angles, in rad/s and rad.  The dribbler's "angle" is
+    /// in hall counts.
+    std::array<float, NUM_MOTORS> _speed{};
+    std::array<double, NUM_MOTORS> _angle{};
+    std::array<float, NUM_MOTORS> _amps{};
+    std::array<float, NUM_MOTORS> _sensedAmps{};
+
+    std::array<int32_t, NUM_WHEELS> _encCount{};
+    std::array<int32_t, NUM_MOTORS> _hallCount{};
+    std::array<uint64_t, NUM_WHEELS> _lastEdgeUs{};
+
+    float _volts;
+    float _batteryAmps = 0;
+
+    Eigen::Vector3f _vel = Eigen::Vector3f::Zero();
+    Eigen::Vector3f _pose = Eigen::Vector3f::Zero();
+};
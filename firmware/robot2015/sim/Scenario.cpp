@@ -0,0 +1,101 @@
+#include "Scenario.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace {
+/// How many arguments each timed command takes, at least and at most
+struct Arity {
+    const char* command;
+    size_t min;
+    size_t max;
+};
+
+const Arity COMMANDS[] = {
+    {"vel", 3, 3},     {"dribbler", 1, 1}, {"radio", 1, 1},
+    {"loss", 1, 2},    {"latency", 1, 2},  {"battery", 2, 2},
+    {"load", 2, 2},    {"unplug", 1, 1},   {"limits", 4, 4},
+    {"end", 0, 0},
+};
+
+bool isNumber(const std::string& s) {
+    if (s.empty()) return false;
+    char* end;
+    strtod(s.c_str(), &end);
+    return *end == '\0';
+}
+}  // namespace
+
+bool Scenario::load(const std::string& path, std::string* error) {
+    std::ifstream file(path);
+    if (!file) {
+        *error = "can't open " + path;
+        return false;
+    }
+
+    std::string text;
+    for (int line = 1; std::getline(file, text); line++) {
+        text = text.substr(0, text.find('#'));
+        std::istringstream in(text);
+        std::vector<std::string> words;
+        for (std::string word; in >> word;) words.push_back(word);
+        if (words.empty()) continue;
+
+        std::ostringstream where;
+        where << path << ":" << line << ": ";
+
+        if (isNumber(words[0])) {
+            if (words.size() < 2) {
+                *error = where.str() + "missing command";
+                return false;
+            }
+
+            Event event;
+            event.ms = strtoul(words[0].c_str(), nullptr, 10);
+            event.command = words[1];
+            event.args.assign(words.begin() + 2, words.end());
+            event.line = line;
+
+            const Arity* arity = std::find_if(
+                std::begin(COMMANDS), std::end(COMMANDS),
+                [&](const Arity& a) { return event.command == a.command; });
+            if (arity == std::end(COMMANDS)) {
+                *error = where.str() + "unknown command '" + event.command + "'";
+                return false;
+            }
+            if (event.args.size() < arity->min ||
+                event.args.size() > arity->max) {
+                *error = where.str() + "wrong number of arguments for '" +
+                         event.command + "'";
+                return false;
+            }
+
+            if (event.command == "end") endMs = std::max(endMs, event.ms);
+            events.push_back(event);
+        } else if (words[0] == "seed" && words.size() == 2) {
+            seed = strtoul(words[1].c_str(), nullptr, 10);
+        } else if (words[0] == "loop_jitter" && words.size() == 2) {
+            loopJitterUs = strtoul(words[1].c_str(), nullptr, 10);
+        } else if (words[0] == "expect" && words.size() == 4 &&
+                   (words[2] == "<" || words[2] == ">") &&
+                   isNumber(words[3])) {
+            expectations.push_back(
+                {words[1], words[2] == "<", strtod(words[3].c_str(), nullptr),
+                 line});
+        } else {
+            *error = where.str() + "can't parse '" + text + "'";
+            return false;
+        }
+    }
+
+    if (endMs == 0) {
+        *error = path + ": no end";
+        return false;
+    }
+
+    std::stable_sort(events.begin(), events.end(),
+                     [](const Event& a, const Event& b) { return a.ms < b.ms; });
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A scripted simulator run, read from a text file like the ones in
+ * scenarios/.  Each line is a command, and # starts a comment.
+ *
+ * Commands that happen at a time start with it, in ms:
+ *
+ *     <ms> vel <x m/s> <y m/s> <w rad/s>   what the base station commands
+ *     <ms> dribbler <0-255>
+ *     <ms> radio on|off                    whether the base station sends
+ *     <ms> loss <fraction> [channel]       packet loss, on one or all channels
+ *     <ms> latency <us> [jitter us]        each way, for each packet
+ *     <ms> battery <volts> <ohms>          open circuit voltage and resistance
+ *     <ms> load <wheel> <N m>              a torque against a wheel
+ *     <ms> unplug <wheel>                  the wheel's encoder stops ticking
+ *     <ms> limits <accel> <jerk> <rot accel> <rot jerk>
+ *                                          motion limits the base station
+ *                                          sends, see MotionLimitsMessage
+ *     <ms> end
+ *
+ * and the rest are for the whole run:
+ *
+ *     seed <n>                  for the random loss and jitter
+ *     loop_jitter <us>          how late each thread wakes up, at most
+ *     expect <metric> <|> <n>   fails the run if it doesn't hold
+ *
+ * See main.cpp for the metrics.
+ */
+struct Scenario {
+    struct Event {
+        uint32_t ms;
+        std::string command;
+        std::vector<std::string> args;
+        int line;
+    };
+
+    struct Expectation {
+        std::string metric;
+        bool lessThan;
+        double value;
+        int line;
+    };
+
+    std::vector<Event> events;
+    std::vector<Expectation> expectations;
+
+    uint32_t seed = 1;
+    uint32_t loopJitterUs = 0;
+    uint32_t endMs = 0;
+
+    /// @return false with a message in @error if the file can't be read
+    bool load(const std::string& path, std::string* error);
+};
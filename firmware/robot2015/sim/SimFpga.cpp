@@ -0,0 +1,145 @@
+#include "SimFpga.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "SimRtos.hpp"
+#include "fpga.hpp"
+
+namespace {
+/// Status byte fields, see robocup.v
+const uint8_t SYS_RDY = 1 << 7;
+const uint8_t WATCHDOG_TRIGGER = 1 << 6;
+const uint8_t MOTORS_EN = 1 << 5;
+
+/// FPGA clock cycles per watchdog timer count, which is how the firmware
+/// reads it in ControllerTaskThread.cpp
+const double WATCHDOG_TICK_US = 128 / 18.432;
+
+/// The watchdog stops the motors when its 16 bit timer overflows
+const uint64_t WATCHDOG_EXPIRE_US = 0xFFFF * WATCHDOG_TICK_US;
+
+/// Amps per count of the filtered currents, like AMPS_PER_CURRENT_COUNT in
+/// ControllerTaskThread.cpp
+const float AMPS_PER_COUNT = 8 * 3.3f / 4096 / 40 / 0.002f;
+
+/// The command byte, then 5 duty cycles, 5 hall counts, 5 currents, and 4
+/// encoder ages, at the 500 kHz that FPGA sets its SPI clock to
+const uint32_t TRANSFER_BYTES = 1 + 2 * 5 + 5 + 5 + 2 * 4;
+const uint32_t TRANSFER_US = TRANSFER_BYTES * 8 * 1000000 / 500000;
+
+template <class T>
+T saturate(double value, double max) {
+    return static_cast<T>(std::max(0.0, std::min(max, value)));
+}
+}  // namespace
+
+SimFpga* SimFpga::Instance = nullptr;
+
+SimFpga::SimFpga(RobotPlant* plant) : _plant(plant) { Instance = this; }
+
+SimFpga::~SimFpga() {
+    if (Instance == this) Instance = nullptr;
+}
+
+uint8_t SimFpga::transfer(const int16_t* duty, int16_t* encs, int8_t* halls,
+                          uint8_t* currents, uint16_t* ages) {
+    const uint64_t start = sim::nowUs();
+    uint8_t status = SYS_RDY | MOTORS_EN;
+
+    // the motors were stopped if it went too long without a transfer
+    if (_transferred && start - _lastTransferUs > WATCHDOG_EXPIRE_US) {
+        _plant->advanceTo(_lastTransferUs + WATCHDOG_EXPIRE_US);
+        for (size_t i = 0; i < RobotPlant::NUM_MOTORS; i++) {
+            _plant->setDuty(i, 0);
+        }
+        status |= WATCHDOG_TRIGGER;
+    }
+    _plant->advanceTo(start);
+
+    for (size_t i = 0; i < RobotPlant::NUM_WHEELS; i++) {
+        if (_unplugged & (1 << i)) {
+            encs[i] = 0;
+            ages[i] = 0xFFFF;
+            continue;
+        }
+
+        const int32_t count = _plant->encoderCount(i);
+        encs[i] = static_cast<int16_t>(count - _lastEnc[i]);
+        _lastEnc[i] = count;
+
+        ages[i] = saturate<uint16_t>(
+            (start - _plant->lastEdgeUs(i)) / FPGA::ENC_AGE_TICK_US, 0xFFFF);
+    }
+    // the fifth "encoder" is the watchdog timer's count since the last one
+    encs[4] = saturate<uint16_t>(
+        (start - _lastTransferUs) / WATCHDOG_TICK_US, 0xFFFF);
+
+    for (size_t i = 0; i < RobotPlant::NUM_MOTORS; i++) {
+        const int32_t count = _plant->hallCount(i);
+        halls[i] = static_cast<int8_t>(count - _lastHall[i]);
+        _lastHall[i] = count;
+
+        currents[i] = saturate<uint8_t>(
+            std::round(_plant->sensedAmps(i) / AMPS_PER_COUNT), 0xFF);
+    }
+
+    if (_transferred) {
+        const uint64_t period = start - _lastTransferUs;
+        _stats.count++;
+        _stats.total += period;
+        _stats.min = std::min(_stats.min, period);
+        _stats.max = std::max(_stats.max, period);
+        if (period > _overrunUs) _stats.overruns++;
+    }
+    _lastTransferUs = start;
+    _transferred = true;
+
+    // the new duty cycles take effect once they've all been clocked in
+    sim::busy(TRANSFER_US);
+    _plant->advanceTo(sim::nowUs());
+    for (size_t i = 0; i < RobotPlant::NUM_MOTORS; i++) {
+        _plant->setDuty(i, duty[i]);
+    }
+
+    return status;
+}
+
+FPGA* FPGA::Instance = nullptr;
+
+FPGA::FPGA(std::shared_ptr<SharedSPI> sharedSPI, PinName nCs, PinName initB,
+           PinName progB, PinName done)
+    : SharedSPIDevice(sharedSPI, nCs, true),
+      _initB(initB),
+      _done(done),
+      _progB(progB) {
+    _isInit = true;
+}
+
+bool FPGA::isReady() { return _isInit; }
+
+uint8_t FPGA::set_duty_get_enc(int16_t* duty_cycles, size_t size_dut,
+                               int16_t* enc_deltas, size_t size_enc,
+                               int8_t* hall_deltas, size_t size_halls,
+                               uint8_t* currents, size_t size_currents,
+                               uint16_t* enc_ages, size_t size_ages) {
+    // same checks as the real one
+    for (size_t i = 0; i < size_dut; i++) {
+        if (abs(duty_cycles[i]) > MAX_DUTY_CYCLE) return 0x7F;
+    }
+
+    int8_t halls[RobotPlant::NUM_MOTORS];
+    uint8_t amps[RobotPlant::NUM_MOTORS];
+    uint16_t ages[RobotPlant::NUM_WHEELS];
+
+    chipSelect();
+    const uint8_t status =
+        SimFpga::Instance->transfer(duty_cycles, enc_deltas, halls, amps, ages);
+    chipDeselect();
+
+    if (hall_deltas) std::copy(halls, halls + size_halls, hall_deltas);
+    if (currents) std::copy(amps, amps + size_currents, currents);
+    if (enc_ages) std::copy(ages, ages + size_ages, enc_ages);
+
+    return status;
+}
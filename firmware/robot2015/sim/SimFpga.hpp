@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+#include "RobotPlant.hpp"
+
+/**
+ * The FPGA's side of FPGA::set_duty_get_enc(), against a RobotPlant.  While
+ * one of these exists, FPGA methods talk to it instead of an SPI bus.
+ *
+ * Transfers take as long as they do at the FPGA's SPI clock, and readings are
+ * latched at the start of one and the duty cycles applied at the end, like the
+ * real thing.  The time between transfers is recorded, which is the control
+ * loop's period.
+ */
+class SimFpga {
+public:
+    static SimFpga* Instance;
+
+    explicit SimFpga(RobotPlant* plant);
+    ~SimFpga();
+
+    /// One set_duty_get_enc() transfer
+    uint8_t transfer(const int16_t* duty, int16_t* encs, int8_t* halls,
+                     uint8_t* currents, uint16_t* ages);
+
+    /// Wheel @wheel's encoder stops ticking, like it came unplugged
+    void unplugEncoder(size_t wheel) { _unplugged |= 1 << wheel; }
+
+    /// Time between transfers longer than this counts as an overrun
+    void setOverrunUs(uint32_t us) { _overrunUs = us; }
+
+    /// Control loop periods seen so far, in us
+    struct LoopStats {
+        uint32_t count = 0;
+        uint32_t overruns = 0;
+        uint64_t total = 0;
+        uint64_t min = UINT64_MAX;
+        uint64_t max = 0;
+
+        double mean() const { return count ? double(total) / count : 0; }
+    };
+    const LoopStats& loopStats() const { return _stats; }
+
+private:
+    RobotPlant* _plant;
+
+    uint64_t _lastTransferUs = 0;
+    bool _transferred = false;
+    uint32_t _overrunUs = UINT32_MAX;
+    LoopStats _stats;
+
+    uint8_t _unplugged = 0;
+    int32_t _lastEnc[RobotPlant::NUM_WHEELS] = {};
+    int32_t _lastHall[RobotPlant::NUM_MOTORS] = {};
+};
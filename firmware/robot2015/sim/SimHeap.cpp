@@ -0,0 +1,70 @@
+#include "heap-monitor.hpp"
+
+#include <malloc.h>
+#include <us_ticker_api.h>
+
+#include <cstdlib>
+#include <new>
+
+#include "SimRtos.hpp"
+
+/*
+ * The simulator's version of common2015/utils/rtos-mgmt/heap-monitor.cpp.
+ * Instead of hooking newlib, it replaces new and delete, which is what the
+ * firmware's containers, std::function, and shared_ptr allocate with.
+ * Only what the simulated threads allocate is counted, and not the simulator's
+ * own bookkeeping.  There's only ever one of them running at a time, so
+ * nothing needs to be locked.
+ */
+
+namespace {
+/// Made on first use, since new can be called before main()
+HeapTracker& tracker() {
+    static HeapTracker t;
+    return t;
+}
+
+void* allocate(size_t size) {
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+    const uint8_t thread = sim::threadId();
+    if (thread) tracker().allocated(thread, malloc_usable_size(ptr));
+    return ptr;
+}
+
+void release(void* ptr) {
+    if (!ptr) return;
+    tracker().freed(malloc_usable_size(ptr));
+    free(ptr);
+}
+}  // namespace
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void operator delete(void* ptr) noexcept { release(ptr); }
+void operator delete[](void* ptr) noexcept { release(ptr); }
+void operator delete(void* ptr, size_t) noexcept { release(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { release(ptr); }
+
+void HeapMonitor::read(HeapTracker* out, bool restart) {
+    *out = tracker();
+    if (restart) {
+        tracker().startWindow(us_ticker_read());
+        tracker().resetPeak();
+    }
+}
+
+/// The host's heap isn't laid out like newlib's, so there's nothing to walk
+HeapLayout HeapMonitor::walk() { return HeapLayout(); }
+
+uint8_t HeapMonitor::tag(const char* name, bool noAlloc) {
+    return tracker().tag(name, noAlloc);
+}
+
+uint8_t HeapMonitor::enter(uint8_t tag) {
+    return tracker().enter(sim::threadId(), tag);
+}
+
+void HeapMonitor::leave(uint8_t previous) {
+    tracker().leave(sim::threadId(), previous);
+}
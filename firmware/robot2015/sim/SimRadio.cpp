@@ -0,0 +1,180 @@
+#include "SimRadio.hpp"
+
+#include <cstring>
+
+#include "SimRtos.hpp"
+
+namespace {
+/// DW1000 frames are 127 bytes, with a 9 byte MAC header and 2 byte CRC
+const size_t FRAME_LEN_MAX = 127;
+const size_t MAC_OVERHEAD = 9 + 2;
+}  // namespace
+
+Decawave* global_radio = nullptr;
+
+Decawave::Decawave(std::shared_ptr<SharedSPI> sharedSPI, PinName nCs,
+                   PinName intPin)
+    : CommLink(sharedSPI, nCs, intPin) {
+    CommLink::ready();
+}
+
+int32_t Decawave::sendPacket(const rtp::packet* pkt) {
+    if (MAC_OVERHEAD + pkt->size() > FRAME_LEN_MAX) return COMM_DEV_BUF_ERR;
+
+    std::vector<uint8_t> frame;
+    pkt->pack(&frame);
+    stampTx();
+    if (onTransmit) onTransmit(frame, _channel);
+
+    return COMM_SUCCESS;
+}
+
+uint8_t Decawave::numChannels() const { return SimBaseStation::NUM_CHANNELS; }
+
+void Decawave::setChannel(uint8_t channel) {
+    if (channel >= numChannels()) return;
+    _channel = channel;
+    _rxPending = false;
+}
+
+void Decawave::receiveFrame(const std::vector<uint8_t>& frame,
+                            uint8_t channel) {
+    if (channel != _channel || frame.size() < sizeof(rtp::header_data)) return;
+
+    // the address is the first byte of the header
+    if (frame[0] != _addr && frame[0] != rtp::BROADCAST_ADDRESS) return;
+
+    _rxFrame = frame;
+    _rxPending = true;
+    ISR();
+}
+
+int32_t Decawave::getData(std::vector<uint8_t>* buf) {
+    if (!_rxPending) return COMM_NO_DATA;
+
+    buf->insert(buf->end(), _rxFrame.begin(), _rxFrame.end());
+    _rxPending = false;
+    return COMM_SUCCESS;
+}
+
+SimBaseStation::SimBaseStation(Decawave* robotRadio, uint8_t uid,
+                               uint32_t seed)
+    : _robotRadio(robotRadio),
+      _uid(uid),
+      _planner(NUM_CHANNELS, 0),
+      _rng(seed) {
+    memset(&_command, 0, sizeof(_command));
+    _command.uid = uid;
+
+    _robotRadio->onTransmit = [this](const std::vector<uint8_t>& frame,
+                                     uint8_t channel) {
+        if (channel != _planner.channel()) return;
+        transmit(channel, [this, frame]() { receive(frame); });
+    };
+}
+
+void SimBaseStation::start(uint32_t periodUs) {
+    _periodUs = periodUs;
+    const uint32_t generation = ++_generation;
+    const uint64_t first = sim::nowUs() + periodUs;
+    sim::at(first, [=]() { sendFrame(first, generation); });
+}
+
+void SimBaseStation::setLoss(float loss, int channel) {
+    if (channel < 0) {
+        _loss.fill(loss);
+    } else if (channel < NUM_CHANNELS) {
+        _loss[channel] = loss;
+    }
+}
+
+void SimBaseStation::sendLimits(const MotionProfiler::Limits& limits) {
+    const float scale = rtp::MotionLimitsMessage::LIMIT_SCALE_FACTOR;
+    rtp::MotionLimitsMessage msg;
+    msg.uid = _uid;
+    for (size_t axis = 0; axis < MotionProfiler::AXES; axis++) {
+        msg.accel[axis] = limits.accel[axis] * scale;
+        msg.jerk[axis] = limits.jerk[axis] * scale;
+    }
+
+    rtp::packet pkt;
+    pkt.header.address = rtp::ROBOT_ADDRESS;
+    pkt.header.port = rtp::Port::CONTROL;
+    pkt.header.type = rtp::header_data::Tuning;
+    rtp::SerializeToVector(msg, &pkt.payload);
+
+    std::vector<uint8_t> frame;
+    pkt.pack(&frame);
+
+    const uint8_t channel = _planner.channel();
+    transmit(channel, [this, frame, channel]() {
+        _robotRadio->receiveFrame(frame, channel);
+    });
+}
+
+template <class F>
+void SimBaseStation::transmit(uint8_t channel, F deliver) {
+    if (std::uniform_real_distribution<float>(0, 1)(_rng) < _loss[channel]) {
+        return;
+    }
+
+    uint32_t delay = _latencyUs;
+    if (_jitterUs > 0) {
+        delay += std::uniform_int_distribution<uint32_t>(0, _jitterUs)(_rng);
+    }
+    sim::at(sim::nowUs() + delay, deliver);
+}
+
+void SimBaseStation::sendFrame(uint64_t scheduledUs, uint32_t generation) {
+    if (generation != _generation) return;
+
+    const uint64_t next = scheduledUs + _periodUs;
+    sim::at(next, [=]() { sendFrame(next, generation); });
+
+    rtp::packet pkt;
+    pkt.header.address = rtp::ROBOT_ADDRESS;
+    pkt.header.port = rtp::Port::CONTROL;
+    pkt.header.type = rtp::header_data::Control;
+    pkt.header.seq = _seq++;
+
+    rtp::ChannelSchedule schedule;
+    _planner.startFrame(&schedule);
+    _encoder.encode(schedule, &_command, 1, &pkt.payload);
+
+    std::vector<uint8_t> frame;
+    pkt.pack(&frame);
+
+    _stats.sent++;
+    _lastSentUs = sim::nowUs();
+    _awaitingReply = true;
+
+    const uint8_t channel = _planner.channel();
+    transmit(channel, [this, frame, channel]() {
+        _stats.delivered++;
+        _robotRadio->receiveFrame(frame, channel);
+    });
+}
+
+void SimBaseStation::receive(const std::vector<uint8_t>& frame) {
+    rtp::packet pkt;
+    pkt.recv(frame);
+    if (pkt.header.port != rtp::Port::CONTROL ||
+        pkt.header.address != rtp::BASE_STATION_ADDRESS ||
+        pkt.payload.size() < sizeof(rtp::RobotStatusMessage)) {
+        return;
+    }
+
+    memcpy(&_status, pkt.payload.data(), sizeof(_status));
+    _planner.replyReceived();
+    _encoder.acked(_status.uid);
+
+    // a reply that shows up after the next forward packet went out is late,
+    // so only count the first one
+    if (!_awaitingReply) return;
+    _awaitingReply = false;
+
+    const uint64_t latency = sim::nowUs() - _lastSentUs;
+    _stats.replies++;
+    _stats.latencyTotalUs += latency;
+    _stats.latencyMaxUs = std::max(_stats.latencyMaxUs, latency);
+}
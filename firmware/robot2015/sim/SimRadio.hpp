@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "Decawave.hpp"
+#include "channel-manager.hpp"
+#include "control-codec.hpp"
+#include "motion-profiler.hpp"
+#include "rtp.hpp"
+
+/**
+ * A base station and the air between it and the robot's radio.
+ *
+ * Every frame, the base station sends a forward packet with the control
+ * message for the robot, built with the same ControlEncoder and
+ * ChannelPlanner as base2015, and reads the robot's reply.  Each frame takes
+ * the link's latency, plus up to its jitter at random, to get across, and is
+ * lost with its channel's loss rate.
+ */
+class SimBaseStation {
+public:
+    static const uint8_t NUM_CHANNELS = 6;
+
+    struct Stats {
+        uint32_t sent = 0;       // forward packets
+        uint32_t delivered = 0;  // forward packets that made it to the robot
+        uint32_t replies = 0;    // replies that made it back
+
+        /// From sending a forward packet to getting the reply to it
+        uint64_t latencyTotalUs = 0;
+        uint64_t latencyMaxUs = 0;
+
+        double latencyMeanUs() const {
+            return replies ? double(latencyTotalUs) / replies : 0;
+        }
+    };
+
+    SimBaseStation(Decawave* robotRadio, uint8_t uid, uint32_t seed = 1);
+
+    /// Starts sending a forward packet every @periodUs
+    void start(uint32_t periodUs);
+
+    /// Stops sending, like when soccer stops
+    void stop() { _generation++; }
+
+    /// What the robot is told to do
+    rtp::ControlMessage& command() { return _command; }
+
+    void setLatency(uint32_t latencyUs, uint32_t jitterUs) {
+        _latencyUs = latencyUs;
+        _jitterUs = jitterUs;
+    }
+
+    /// Sends the robot a MotionLimitsMessage, on the channel it's on now
+    void sendLimits(const MotionProfiler::Limits& limits);
+
+    /// Sets the loss rate on @channel, or every channel if it's negative
+    void setLoss(float loss, int channel = -1);
+
+    /// The last status the robot sent back
+    const rtp::RobotStatusMessage& status() const { return _status; }
+
+    const Stats& stats() const { return _stats; }
+    uint8_t channel() const { return _planner.channel(); }
+    unsigned int channelSwitches() const { return _planner.switches; }
+
+private:
+    void sendFrame(uint64_t scheduledUs, uint32_t generation);
+    void receive(const std::vector<uint8_t>& frame);
+
+    /// Sends a frame across the air on @channel, calling @deliver when and if
+    /// it gets there
+    template <class F>
+    void transmit(uint8_t channel, F deliver);
+
+    Decawave* _robotRadio;
+    uint8_t _uid;
+
+    uint32_t _periodUs = 0;
+
+    /// Bumped on every start and stop, so frames from before know to stop
+    uint32_t _generation = 0;
+    uint8_t _seq = 0;
+
+    rtp::ControlMessage _command;
+    ControlEncoder _encoder;
+    ChannelPlanner _planner;
+
+    uint32_t _latencyUs = 300;
+    uint32_t _jitterUs = 0;
+    std::array<float, NUM_CHANNELS> _loss{};
+    std::mt19937 _rng;
+
+    uint64_t _lastSentUs = 0;
+    bool _awaitingReply = false;
+
+    rtp::RobotStatusMessage _status{};
+    Stats _stats;
+};
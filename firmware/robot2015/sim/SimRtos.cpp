@@ -0,0 +1,426 @@
+#include "SimRtos.hpp"
+
+#include <mbed.h>
+#include <rtos.h>
+#include <ucontext.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace sim {
+
+/// A simulated thread, with its own stack to switch to
+struct Task {
+    /// Counts up from 1, like RTX's task ids.  It goes first so that casting
+    /// to a P_TCB gets it, like on the robot.
+    uint8_t id;
+
+    void (*entry)(void const*);
+    void* argument;
+    osPriority priority;
+
+    ucontext_t context;
+    std::vector<char> stack;
+
+    bool done = false;
+
+    /// Signals set on it
+    int32_t signals = 0;
+
+    /// It's blocked until this is true or it's @wakeUs, whichever is first
+    std::function<bool()> until;
+    uint64_t wakeUs = 0;
+
+    /// In busy(), so lower priority threads can't run either
+    bool busy = false;
+};
+
+struct MailQueue {
+    uint32_t itemSize;
+    uint32_t size;
+    uint32_t allocated = 0;
+    std::deque<void*> mail;
+};
+
+namespace {
+
+const size_t STACK_SIZE = 512 * 1024;
+const uint64_t NEVER = UINT64_MAX;
+
+struct Kernel {
+    uint64_t now = 0;
+    std::vector<Task*> tasks;
+    Task* current = nullptr;
+    ucontext_t context;
+
+    /// Events by time, then by the order they were added in
+    std::map<std::pair<uint64_t, uint64_t>, std::function<void()>> events;
+    uint64_t eventOrder = 0;
+
+    uint32_t jitterUs = 0;
+    std::mt19937 rng;
+};
+
+/// The running thread's id, kept apart from the kernel so new can look at it
+/// without making one
+uint8_t runningId = 0;
+
+/// Never freed, so nothing goes away under a thread that's still waiting
+/// when the program exits
+Kernel& kernel() {
+    static Kernel* k = new Kernel();
+    return *k;
+}
+
+void fail(const char* what) {
+    fprintf(stderr, "sim: %s\n", what);
+    abort();
+}
+
+Task* currentTask(const char* call) {
+    Task* t = kernel().current;
+    if (!t) {
+        fprintf(stderr, "sim: %s called outside of a thread\n", call);
+        abort();
+    }
+    return t;
+}
+
+bool ready(const Task* t, uint64_t now) {
+    if (t->done) return false;
+    if (t->until && t->until()) return true;
+    return t->wakeUs <= now;
+}
+
+/// The thread to run next: the highest priority one that's ready, then the
+/// one that's been waiting longest.  Busy threads keep lower priority ones
+/// from running.
+Task* nextReady() {
+    Kernel& k = kernel();
+    int busyPriority = osPriorityIdle - 1;
+    for (Task* t : k.tasks) {
+        if (!t->done && t->busy) {
+            busyPriority = std::max<int>(busyPriority, t->priority);
+        }
+    }
+
+    Task* best = nullptr;
+    for (Task* t : k.tasks) {
+        if (!ready(t, k.now)) continue;
+        if (!t->busy && t->priority <= busyPriority) continue;
+        if (!best || t->priority > best->priority ||
+            (t->priority == best->priority && t->wakeUs < best->wakeUs)) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+/// When something next happens after now.  Threads that could run now but
+/// for a busy one don't count, since the busy one wakes up after now anyway.
+uint64_t nextWake() {
+    Kernel& k = kernel();
+    uint64_t next = NEVER;
+    for (Task* t : k.tasks) {
+        if (!t->done && t->wakeUs > k.now) next = std::min(next, t->wakeUs);
+    }
+    if (!k.events.empty()) next = std::min(next, k.events.begin()->first.first);
+    return next;
+}
+
+void trampoline() {
+    Task* t = kernel().current;
+    t->entry(t->argument);
+    t->done = true;
+    swapcontext(&t->context, &kernel().context);
+}
+
+/// Gives the processor back until @until is true, or it's @wakeUs
+void block(Task* t, std::function<bool()> until, uint64_t wakeUs) {
+    t->until = std::move(until);
+    t->wakeUs = wakeUs;
+    swapcontext(&t->context, &kernel().context);
+    t->until = nullptr;
+
+    // it's been waiting since now as far as the next wait is concerned
+    t->wakeUs = kernel().now;
+}
+
+uint64_t timeoutUs(uint32_t millisec) {
+    return millisec == osWaitForever ? NEVER
+                                     : kernel().now + uint64_t(millisec) * 1000;
+}
+
+}  // namespace
+
+uint64_t nowUs() { return kernel().now; }
+
+void runUntil(uint64_t us) {
+    Kernel& k = kernel();
+    if (k.current) fail("runUntil() called from a thread");
+
+    while (true) {
+        // interrupts first
+        while (!k.events.empty() && k.events.begin()->first.first <= k.now) {
+            auto it = k.events.begin();
+            std::function<void()> fn = std::move(it->second);
+            k.events.erase(it);
+            fn();
+        }
+
+        Task* t = nextReady();
+        if (t) {
+            k.current = t;
+            runningId = t->id;
+            swapcontext(&k.context, &t->context);
+            k.current = nullptr;
+            runningId = 0;
+            continue;
+        }
+
+        const uint64_t next = nextWake();
+        if (next > us) {
+            k.now = us;
+            return;
+        }
+        k.now = std::max(k.now, next);
+    }
+}
+
+void at(uint64_t us, std::function<void()> fn) {
+    Kernel& k = kernel();
+    k.events.emplace(std::make_pair(std::max(us, k.now), k.eventOrder++),
+                     std::move(fn));
+}
+
+void busy(uint32_t us) {
+    Task* t = currentTask("sim::busy()");
+    t->busy = true;
+    block(t, nullptr, kernel().now + us);
+    t->busy = false;
+}
+
+void setWakeJitter(uint32_t us, uint32_t seed) {
+    kernel().jitterUs = us;
+    kernel().rng.seed(seed);
+}
+
+uint8_t threadId() { return runningId; }
+
+}  // namespace sim
+
+using sim::kernel;
+
+uint32_t us_ticker_read() { return uint32_t(kernel().now); }
+
+int32_t osSignalSet(osThreadId thread_id, int32_t signals) {
+    if (!thread_id) return 0x80000000;
+    const int32_t previous = thread_id->signals;
+    thread_id->signals |= signals;
+    return previous;
+}
+
+osThreadId osThreadGetId() { return kernel().current; }
+
+osPriority osThreadGetPriority(osThreadId thread_id) {
+    return thread_id ? thread_id->priority : osPriorityError;
+}
+
+osStatus osThreadSetPriority(osThreadId thread_id, osPriority priority) {
+    if (!thread_id) return osErrorParameter;
+    thread_id->priority = priority;
+    return osOK;
+}
+
+osMailQId osMailCreate(const osMailQDef_t* queue_def, osThreadId thread_id) {
+    sim::MailQueue* queue = new sim::MailQueue();
+    queue->itemSize = queue_def->item_sz;
+    queue->size = queue_def->queue_sz;
+    return queue;
+}
+
+void* osMailAlloc(osMailQId queue_id, uint32_t millisec) {
+    if (!queue_id) return nullptr;
+    if (queue_id->allocated >= queue_id->size) {
+        if (millisec == 0 || !kernel().current) return nullptr;
+        sim::block(kernel().current,
+                   [queue_id]() { return queue_id->allocated < queue_id->size; },
+                   sim::timeoutUs(millisec));
+        if (queue_id->allocated >= queue_id->size) return nullptr;
+    }
+    queue_id->allocated++;
+    return calloc(1, queue_id->itemSize);
+}
+
+osStatus osMailPut(osMailQId queue_id, void* mail) {
+    if (!queue_id || !mail) return osErrorParameter;
+    queue_id->mail.push_back(mail);
+    return osOK;
+}
+
+osEvent osMailGet(osMailQId queue_id, uint32_t millisec) {
+    osEvent event;
+    event.status = osEventTimeout;
+    event.value.p = nullptr;
+    if (!queue_id) {
+        event.status = osErrorParameter;
+        return event;
+    }
+
+    if (queue_id->mail.empty() && millisec != 0) {
+        sim::block(sim::currentTask("osMailGet()"),
+                   [queue_id]() { return !queue_id->mail.empty(); },
+                   sim::timeoutUs(millisec));
+    }
+    if (!queue_id->mail.empty()) {
+        event.status = osEventMail;
+        event.value.p = queue_id->mail.front();
+        queue_id->mail.pop_front();
+    }
+    return event;
+}
+
+osStatus osMailFree(osMailQId queue_id, void* mail) {
+    if (!queue_id || !mail) return osErrorParameter;
+    free(mail);
+    queue_id->allocated--;
+    return osOK;
+}
+
+namespace rtos {
+
+Thread::Thread(void (*task)(void const* argument), void* argument,
+               osPriority priority, uint32_t stack_size,
+               unsigned char* stack_pointer) {
+    sim::Kernel& k = kernel();
+    sim::Task* t = new sim::Task();
+    t->entry = task;
+    t->argument = argument;
+    t->priority = priority;
+    t->id = std::min<size_t>(k.tasks.size() + 1, UINT8_MAX);
+    t->wakeUs = k.now;
+    t->stack.resize(sim::STACK_SIZE);
+
+    getcontext(&t->context);
+    t->context.uc_stack.ss_sp = t->stack.data();
+    t->context.uc_stack.ss_size = t->stack.size();
+    t->context.uc_link = nullptr;
+    makecontext(&t->context, &sim::trampoline, 0);
+
+    k.tasks.push_back(t);
+    _tid = t;
+}
+
+Thread::~Thread() {
+    // it never runs again, but its stack stays around in case this is being
+    // called from it
+    _tid->done = true;
+}
+
+int32_t Thread::signal_set(int32_t signals) {
+    return osSignalSet(_tid, signals);
+}
+
+osStatus Thread::set_priority(osPriority priority) {
+    return osThreadSetPriority(_tid, priority);
+}
+
+osPriority Thread::get_priority() { return osThreadGetPriority(_tid); }
+
+osEvent Thread::signal_wait(int32_t signals, uint32_t millisec) {
+    sim::Task* t = sim::currentTask("Thread::signal_wait()");
+
+    // waiting for signals 0 means any of them
+    auto signaled = [t, signals]() {
+        return signals == 0 ? t->signals != 0
+                            : (t->signals & signals) == signals;
+    };
+    if (!signaled() && millisec != 0) {
+        sim::block(t, signaled, sim::timeoutUs(millisec));
+    }
+
+    osEvent event;
+    if (signaled()) {
+        const int32_t got = signals == 0 ? t->signals : signals;
+        t->signals &= ~got;
+        event.status = osEventSignal;
+        event.value.signals = got;
+    } else {
+        event.status = osEventTimeout;
+        event.value.signals = 0;
+    }
+    return event;
+}
+
+osStatus Thread::wait(uint32_t millisec) {
+    sim::Kernel& k = kernel();
+    sim::Task* t = sim::currentTask("Thread::wait()");
+
+    uint64_t late = 0;
+    if (k.jitterUs > 0 && millisec > 0) {
+        late = std::uniform_int_distribution<uint32_t>(0, k.jitterUs)(k.rng);
+    }
+    sim::block(t, nullptr, k.now + uint64_t(millisec) * 1000 + late);
+    return osEventTimeout;
+}
+
+osStatus Thread::yield() { return wait(0); }
+
+osThreadId Thread::gettid() { return osThreadGetId(); }
+
+struct RtosTimer::State {
+    void (*func)(void const*);
+    void* argument;
+    os_timer_type type;
+    uint64_t periodUs = 0;
+
+    /// Bumped on every start and stop, so stale events know to do nothing
+    uint64_t generation = 0;
+    bool running = false;
+};
+
+namespace {
+void scheduleTimer(std::shared_ptr<RtosTimer::State> state) {
+    const uint64_t generation = state->generation;
+    sim::at(sim::nowUs() + state->periodUs, [state, generation]() {
+        if (!state->running || state->generation != generation) return;
+        if (state->type == osTimerPeriodic) {
+            scheduleTimer(state);
+        } else {
+            state->running = false;
+        }
+        state->func(state->argument);
+    });
+}
+}  // namespace
+
+RtosTimer::RtosTimer(void (*func)(void const* argument), os_timer_type type,
+                     void* argument)
+    : _state(std::make_shared<State>()) {
+    _state->func = func;
+    _state->argument = argument;
+    _state->type = type;
+}
+
+RtosTimer::~RtosTimer() { stop(); }
+
+osStatus RtosTimer::start(uint32_t millisec) {
+    _state->generation++;
+    _state->running = true;
+    _state->periodUs = uint64_t(millisec) * 1000;
+    scheduleTimer(_state);
+    return osOK;
+}
+
+osStatus RtosTimer::stop() {
+    _state->generation++;
+    _state->running = false;
+    return osOK;
+}
+
+}  // namespace rtos
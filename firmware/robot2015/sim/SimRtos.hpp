@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+/**
+ * Drives the virtual time that the simulated RTOS in platform/rtos.h runs in.
+ *
+ * Threads run until they wait, and whenever none of them can run, the clock
+ * jumps to whatever happens next: a thread waking up, a timer, or an event
+ * from at().  Events and timers go first, like interrupts, then threads by
+ * priority.
+ */
+namespace sim {
+
+/// Microseconds since the simulation started
+uint64_t nowUs();
+
+/// Runs everything until the clock reaches @us
+void runUntil(uint64_t us);
+
+/// Calls @fn at @us, outside of any thread, like an interrupt would
+void at(uint64_t us, std::function<void()> fn);
+
+/**
+ * Takes up @us of the calling thread's time, like a blocking SPI transfer
+ * does on the robot.  Only events and higher priority threads run meanwhile.
+ */
+void busy(uint32_t us);
+
+/**
+ * Makes each Thread::wait() wake up as much as @us late, at random, like when
+ * higher priority threads and interrupts get in the way on the robot.  Zero
+ * turns it off.  The same @seed gives the same delays.
+ */
+void setWakeJitter(uint32_t us, uint32_t seed = 1);
+
+/// A small id for the running thread, like its RTX task id, or 0 outside of
+/// threads
+uint8_t threadId();
+
+}  // namespace sim
@@ -0,0 +1,471 @@
+/**
+ * Software-in-the-loop simulator for the robot firmware.
+ *
+ * The real control loop, radio protocol, and CommModule run on a simulated
+ * RTOS against a RobotPlant through a SimFpga, and a SimBaseStation talks to
+ * them over a simulated radio.  A Scenario scripts what the base station asks
+ * for and what goes wrong, and the run prints how well the robot kept up.
+ * Time is virtual, so a run is much faster than real time and comes out the
+ * same every time.
+ *
+ * Usage: robot2015-sim <scenario> [--csv <file>]
+ *
+ * With --csv, the commanded and actual velocities and the battery voltage are
+ * written out every ms for plotting.
+ *
+ * Metrics that a scenario can expect things of:
+ *
+ *     rms_vel_error, max_vel_error    m/s, from the profiled command
+ *     rms_rot_error                   rad/s
+ *     loop_overruns                   control loop periods over 7.5 ms
+ *     loop_period_mean_ms, loop_period_max_ms
+ *     reply_rate                      replies per forward packet sent
+ *     reply_latency_mean_ms, reply_latency_max_ms
+ *     channel_switches                by the base station
+ *     min_battery_volts
+ *     distance                        m driven
+ *     final_x, final_y, final_heading m and rad, from where it started
+ *     motor_stalled, encoder_faults   bitmasks from the last reply
+ *     motor_stalls                    stalls that shut a motor off
+ *     heap_alloc_rate                 allocations per second by the robot's
+ *                                     threads, with new
+ *
+ * Allocating in a hot path that's tagged not to, like the control loop, see
+ * HeapTag, fails the run whatever the scenario expects, and so does a thread
+ * going longer than its deadline without checking in, see Heartbeat, which
+ * would have the watchdog reset the robot.
+ */
+
+#include <rtos.h>
+#include <us_ticker_api.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include <assert.hpp>
+#include <heap-monitor.hpp>
+#include <heartbeat.hpp>
+
+#include "Decawave.hpp"
+#include "PidMotionController.hpp"
+#include "RadioProtocol.hpp"
+#include "RobotPlant.hpp"
+#include "RtosTimerHelper.hpp"
+#include "Scenario.hpp"
+#include "SharedSPI.hpp"
+#include "SimFpga.hpp"
+#include "SimRadio.hpp"
+#include "SimRtos.hpp"
+#include "fpga.hpp"
+#include "motion-profiler.hpp"
+#include "motors.hpp"
+#include "robot-config.hpp"
+#include "robot-devices.hpp"
+#include "task-signals.hpp"
+
+using namespace std;
+
+void Task_Controller(void const* args);
+void Task_Controller_UpdateTarget(Eigen::Vector3f targetVel);
+void Task_Controller_UpdateTrajectory(Eigen::Vector3f targetVel,
+                                      const rtp::TrajectoryPoint* points,
+                                      size_t count, uint8_t stepMs);
+void Task_Controller_UpdateMotionLimits(const rtp::MotionLimitsMessage& msg);
+void Task_Controller_UpdateDribbler(uint8_t dribbler);
+void InitializeCommModule(shared_ptr<SharedSPI> sharedSPI);
+
+namespace {
+/// The battery sense pin's scale, see motors.cpp
+const float BATT_VOLTS_PER_COUNT =
+    rtp::RobotStatusMessage::BATTERY_READING_SCALE_FACTOR / 256;
+}
+
+// these live in motors.cpp on the robot, which goes with the console
+MotorProtection global_motor_protection;
+EncoderMonitor global_encoder_monitor(RJ_ENCODER_TICKS_PER_TURN /
+                                      float(RJ_HALL_COUNTS_PER_TURN));
+BatteryMonitor global_battery_monitor(BATT_VOLTS_PER_COUNT);
+
+// the console isn't simulated, but the control loop has a command in it
+void show_invalid_args(const vector<string>& args) {}
+
+void assertFail(const char* expr, const char* file, int line) {
+    fprintf(stderr, "%s:%d: assertion failed: %s\n", file, line, expr);
+    abort();
+}
+
+namespace {
+const uint8_t ROBOT_UID = 1;
+
+/// Soccer sends a forward packet every 60 Hz frame
+const uint32_t FRAME_PERIOD_US = 16667;
+
+/// The control loop waits 5 ms, so anything past 1.5x that is an overrun
+const uint32_t LOOP_OVERRUN_US = 7500;
+
+const uint32_t SAMPLE_PERIOD_US = 1000;
+
+/// Longest the firmware gets to start up before the scenario does
+const uint64_t BOOT_TIMEOUT_US = 1000000;
+
+RobotPlant* plant = nullptr;
+
+/**
+ * The parts of the robot's main() in src-ctrl/main.cpp that there's something
+ * to simulate for: the FPGA, control loop, radio, and battery sensing.  This
+ * runs in its own thread, like main() does under RTX.
+ */
+void robotMain(void const*) {
+    const osThreadId mainID = Thread::gettid();
+
+    shared_ptr<SharedSPI> sharedSPI =
+        make_shared<SharedSPI>(RJ_SPI_MOSI, RJ_SPI_MISO, RJ_SPI_SCK);
+
+    FPGA::Instance = new FPGA(sharedSPI, RJ_FPGA_nCS, RJ_FPGA_INIT_B,
+                              RJ_FPGA_PROG_B, RJ_FPGA_DONE);
+
+    Thread controller_task(Task_Controller, mainID, osPriorityHigh,
+                           DEFAULT_STACK_SIZE / 2);
+    Thread::signal_wait(MAIN_TASK_CONTINUE, osWaitForever);
+
+    InitializeCommModule(sharedSPI);
+
+    // the battery sense divider, as the ADC would read it
+    RtosTimerHelper battTimer([]() {
+        const float counts = plant->batteryVolts() / BATT_VOLTS_PER_COUNT;
+        global_battery_monitor.sample(
+            static_cast<uint16_t>(min(counts, 65535.0f)));
+    }, osTimerPeriodic);
+    battTimer.start(1);
+
+    RadioProtocol radioProtocol(CommModule::Instance, global_radio);
+    radioProtocol.setUID(ROBOT_UID);
+    radioProtocol.setHomeChannel(0);
+    radioProtocol.start();
+
+    radioProtocol.motionLimitsCallback = &Task_Controller_UpdateMotionLimits;
+    radioProtocol.rxCallback = [&](const rtp::ControlMessage* msg,
+                                   const bool addressed,
+                                   const rtp::TrajectoryHeader* trajectory) {
+        if (addressed) {
+            const Eigen::Vector3f targetVel = {
+                static_cast<float>(msg->bodyX) /
+                    rtp::ControlMessage::VELOCITY_SCALE_FACTOR,
+                static_cast<float>(msg->bodyY) /
+                    rtp::ControlMessage::VELOCITY_SCALE_FACTOR,
+                static_cast<float>(msg->bodyW) /
+                    rtp::ControlMessage::VELOCITY_SCALE_FACTOR,
+            };
+            if (trajectory) {
+                Task_Controller_UpdateTrajectory(
+                    targetVel,
+                    reinterpret_cast<const rtp::TrajectoryPoint*>(trajectory +
+                                                                  1),
+                    trajectory->points, trajectory->stepMs);
+            } else {
+                Task_Controller_UpdateTarget(targetVel);
+            }
+
+            Task_Controller_UpdateDribbler(msg->dribbler);
+        }
+
+        rtp::RobotStatusMessage reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.uid = ROBOT_UID;
+        reply.battVoltage = global_battery_monitor.reading();
+        reply.motorStalled = global_motor_protection.stalledMask();
+        reply.motorHot = global_motor_protection.hotMask();
+        reply.encoderFaults = global_encoder_monitor.faultMask();
+
+        vector<uint8_t> replyBuf;
+        rtp::SerializeToVector(reply, &replyBuf);
+        return replyBuf;
+    };
+
+    controller_task.signal_set(SUB_TASK_CONTINUE);
+
+    while (true) Thread::wait(1000);
+}
+
+/// How closely the robot followed what it was told, sampled every ms
+struct Tracking {
+    Tracking() { reference.setLimits(PidMotionController::DefaultLimits()); }
+
+    /// What the controller should be doing with the command it was given,
+    /// profiled the same way the controller profiles it
+    MotionProfiler reference;
+    float command[MotionProfiler::AXES] = {};
+
+    uint32_t samples = 0;
+    double velErrorSq = 0;
+    double velErrorMax = 0;
+    double rotErrorSq = 0;
+    float minBatteryVolts = INFINITY;
+    double distance = 0;
+
+    void sample(FILE* csv, uint64_t nowUs) {
+        float ref[MotionProfiler::AXES];
+        reference.update(command, SAMPLE_PERIOD_US / 1e6f, ref);
+
+        const Eigen::Vector3f& vel = plant->bodyVel();
+        const double velError = hypot(vel[0] - ref[0], vel[1] - ref[1]);
+        const double rotError = vel[2] - ref[2];
+
+        samples++;
+        velErrorSq += velError * velError;
+        velErrorMax = max(velErrorMax, velError);
+        rotErrorSq += rotError * rotError;
+        minBatteryVolts = min(minBatteryVolts, plant->batteryVolts());
+        distance += hypot(vel[0], vel[1]) * SAMPLE_PERIOD_US / 1e6;
+
+        if (csv) {
+            fprintf(csv, "%.3f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.3f\n",
+                    nowUs / 1e3, ref[0], ref[1], ref[2], vel[0], vel[1],
+                    vel[2], plant->batteryVolts());
+        }
+    }
+
+    double rms(double sumSq) const {
+        return samples ? sqrt(sumSq / samples) : 0;
+    }
+};
+
+/// Carries out a scenario command
+void apply(const Scenario::Event& event, SimBaseStation* base,
+           Tracking* tracking) {
+    const vector<string>& args = event.args;
+    auto arg = [&](size_t i) { return strtod(args[i].c_str(), nullptr); };
+
+    if (event.command == "vel") {
+        rtp::ControlMessage& cmd = base->command();
+        cmd.bodyX = arg(0) * rtp::ControlMessage::VELOCITY_SCALE_FACTOR;
+        cmd.bodyY = arg(1) * rtp::ControlMessage::VELOCITY_SCALE_FACTOR;
+        cmd.bodyW = arg(2) * rtp::ControlMessage::VELOCITY_SCALE_FACTOR;
+        for (size_t i = 0; i < MotionProfiler::AXES; i++) {
+            tracking->command[i] = arg(i);
+        }
+    } else if (event.command == "dribbler") {
+        base->command().dribbler = arg(0);
+    } else if (event.command == "radio") {
+        if (args[0] == "on") {
+            base->start(FRAME_PERIOD_US);
+        } else {
+            // the robot stops once it notices
+            base->stop();
+            for (float& c : tracking->command) c = 0;
+        }
+    } else if (event.command == "loss") {
+        base->setLoss(arg(0), args.size() > 1 ? int(arg(1)) : -1);
+    } else if (event.command == "latency") {
+        base->setLatency(arg(0), args.size() > 1 ? arg(1) : 0);
+    } else if (event.command == "battery") {
+        plant->setBattery(arg(0), arg(1));
+    } else if (event.command == "load") {
+        const size_t wheel = arg(0);
+        if (wheel < RobotPlant::NUM_WHEELS) plant->setWheelLoad(wheel, arg(1));
+    } else if (event.command == "unplug") {
+        const size_t wheel = arg(0);
+        if (wheel < RobotPlant::NUM_WHEELS) {
+            SimFpga::Instance->unplugEncoder(wheel);
+        }
+    } else if (event.command == "limits") {
+        const MotionProfiler::Limits limits = {{float(arg(0)), float(arg(0)),
+                                                float(arg(2))},
+                                               {float(arg(1)), float(arg(1)),
+                                                float(arg(3))}};
+        base->sendLimits(limits);
+        tracking->reference.setLimits(limits);
+    }
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    string scenarioPath, csvPath;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csvPath = argv[++i];
+        } else if (scenarioPath.empty() && argv[i][0] != '-') {
+            scenarioPath = argv[i];
+        } else {
+            scenarioPath.clear();
+            break;
+        }
+    }
+    if (scenarioPath.empty()) {
+        fprintf(stderr, "usage: %s <scenario> [--csv <file>]\n", argv[0]);
+        return 2;
+    }
+
+    Scenario scenario;
+    string error;
+    if (!scenario.load(scenarioPath, &error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 2;
+    }
+
+    FILE* csv = nullptr;
+    if (!csvPath.empty()) {
+        csv = fopen(csvPath.c_str(), "w");
+        if (!csv) {
+            fprintf(stderr, "can't open %s\n", csvPath.c_str());
+            return 2;
+        }
+        fprintf(csv, "ms,ref_x,ref_y,ref_w,vel_x,vel_y,vel_w,battery\n");
+    }
+
+    const auto wallStart = chrono::steady_clock::now();
+
+    RobotPlant robot;
+    plant = &robot;
+    SimFpga fpga(&robot);
+    fpga.setOverrunUs(LOOP_OVERRUN_US);
+    sim::setWakeJitter(scenario.loopJitterUs, scenario.seed);
+
+    Thread robotThread(robotMain, nullptr, osPriorityNormal);
+
+    // let the firmware start up before the base station starts talking
+    while (!RadioProtocol::Instance() && sim::nowUs() < BOOT_TIMEOUT_US) {
+        sim::runUntil(sim::nowUs() + SAMPLE_PERIOD_US);
+    }
+    if (!RadioProtocol::Instance()) {
+        fprintf(stderr, "firmware didn't start up\n");
+        return 1;
+    }
+    const uint64_t startUs = sim::nowUs();
+
+    // start counting allocations now that the firmware's set up
+    HeapTracker heap;
+    HeapMonitor::read(&heap, true);
+
+    SimBaseStation base(global_radio, ROBOT_UID, scenario.seed);
+    base.start(FRAME_PERIOD_US);
+
+    Tracking tracking;
+    for (const Scenario::Event& event : scenario.events) {
+        sim::at(startUs + event.ms * 1000ull,
+                [&]() { apply(event, &base, &tracking); });
+    }
+
+    const uint64_t endUs = startUs + scenario.endMs * 1000ull;
+    for (uint64_t t = startUs + SAMPLE_PERIOD_US; t <= endUs;
+         t += SAMPLE_PERIOD_US) {
+        sim::at(t, [&, t]() {
+            robot.advanceTo(t);
+            tracking.sample(csv, t - startUs);
+
+            // what the robot's main loop does before feeding the watchdog
+            Heartbeat::Check();
+        });
+    }
+
+    sim::runUntil(endUs);
+    robot.advanceTo(endUs);
+    if (csv) fclose(csv);
+
+    const double wallSecs =
+        chrono::duration<double>(chrono::steady_clock::now() - wallStart)
+            .count();
+
+    const SimFpga::LoopStats& loop = fpga.loopStats();
+    const SimBaseStation::Stats& radio = base.stats();
+    const Eigen::Vector3f& pose = robot.pose();
+    HeapMonitor::read(&heap);
+    const uint32_t nowUs = us_ticker_read();
+    HeartbeatSupervisor heartbeats;
+    uint32_t nowMs;
+    Heartbeat::Read(&heartbeats, &nowMs);
+
+    const map<string, double> metrics = {
+        {"rms_vel_error", tracking.rms(tracking.velErrorSq)},
+        {"max_vel_error", tracking.velErrorMax},
+        {"rms_rot_error", tracking.rms(tracking.rotErrorSq)},
+        {"loop_overruns", loop.overruns},
+        {"loop_period_mean_ms", loop.mean() / 1e3},
+        {"loop_period_max_ms", loop.max / 1e3},
+        {"reply_rate", radio.sent ? double(radio.replies) / radio.sent : 0},
+        {"reply_latency_mean_ms", radio.latencyMeanUs() / 1e3},
+        {"reply_latency_max_ms", radio.latencyMaxUs / 1e3},
+        {"channel_switches", base.channelSwitches()},
+        {"min_battery_volts", tracking.minBatteryVolts},
+        {"distance", tracking.distance},
+        {"final_x", pose[0]},
+        {"final_y", pose[1]},
+        {"final_heading", pose[2]},
+        {"motor_stalled", base.status().motorStalled},
+        {"motor_stalls", global_motor_protection.stalls},
+        {"encoder_faults", base.status().encoderFaults},
+        {"heap_alloc_rate", heap.allocRate(nowUs)},
+    };
+
+    printf("%s: %.3f s simulated in %.3f s\n", scenarioPath.c_str(),
+           scenario.endMs / 1e3, wallSecs);
+    printf("  control loop   %u runs, %.2f mean / %.2f max ms, %u overruns\n",
+           loop.count, metrics.at("loop_period_mean_ms"),
+           metrics.at("loop_period_max_ms"), loop.overruns);
+    printf("  tracking       %.3f rms / %.3f max m/s, %.3f rms rad/s\n",
+           metrics.at("rms_vel_error"), metrics.at("max_vel_error"),
+           metrics.at("rms_rot_error"));
+    printf(
+        "  radio          %u sent, %u delivered, %u replies, "
+        "%.2f mean / %.2f max ms, %u channel switches\n",
+        radio.sent, radio.delivered, radio.replies,
+        metrics.at("reply_latency_mean_ms"), metrics.at("reply_latency_max_ms"),
+        base.channelSwitches());
+    printf("  battery        %.2f V min\n", tracking.minBatteryVolts);
+    printf("  robot          (%.3f, %.3f) m, %.3f rad, %.3f m driven\n",
+           pose[0], pose[1], pose[2], tracking.distance);
+    printf("  status         stalled 0x%02X, hot 0x%02X, encoder faults 0x%02X\n",
+           base.status().motorStalled, base.status().motorHot,
+           base.status().encoderFaults);
+    printf("  heap           %.1f allocations/s, %.0f bytes/s\n",
+           heap.allocRate(nowUs), heap.byteRate(nowUs));
+
+    printf("  heartbeats     worst gap / deadline");
+    for (size_t i = 0; i < heartbeats.count(); i++) {
+        const HeartbeatSupervisor::Entry& e = heartbeats.entry(i);
+        printf("%s %s %u/%u ms", i ? "," : "", e.name, e.worstMs,
+               e.deadlineMs);
+    }
+    printf("\n");
+
+    bool passed = true;
+    if (heartbeats.starved() != HeartbeatSupervisor::NONE) {
+        printf("  '%s' went %u ms without checking in: FAILED\n",
+               heartbeats.entry(heartbeats.starved()).name,
+               heartbeats.starvedMs());
+        passed = false;
+    }
+    for (size_t i = 0; i < heap.tagCount(); i++) {
+        const HeapTracker::TagStats& t = heap.tagStats(i);
+        if (!t.violations) continue;
+        printf("  %u allocations in '%s', which shouldn't allocate: FAILED\n",
+               t.violations, t.name);
+        passed = false;
+    }
+    for (const Scenario::Expectation& expect : scenario.expectations) {
+        auto metric = metrics.find(expect.metric);
+        if (metric == metrics.end()) {
+            printf("%s:%d: no metric '%s'\n", scenarioPath.c_str(),
+                   expect.line, expect.metric.c_str());
+            passed = false;
+            continue;
+        }
+
+        const bool held = expect.lessThan ? metric->second < expect.value
+                                          : metric->second > expect.value;
+        printf("  expect %s %c %g: %s (%g)\n", expect.metric.c_str(),
+               expect.lessThan ? '<' : '>', expect.value,
+               held ? "ok" : "FAILED", metric->second);
+        passed &= held;
+    }
+
+    // the robot's threads are still in the middle of things, so don't wait
+    // around for them to be torn down
+    fflush(stdout);
+    _Exit(passed ? 0 : 1);
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+// The simulated radio is a Decawave, see Decawave.hpp
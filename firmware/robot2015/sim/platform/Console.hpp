@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdio>
+
+/// The simulator has no console, so output just goes to stdout
+class Console {
+public:
+    static Console* Instance() {
+        static Console console;
+        return &console;
+    }
+
+    void Flush() { fflush(stdout); }
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "CommLink.hpp"
+
+/**
+ * A DW1000 that sends and receives over a simulated link instead.  It has the
+ * real radio's channels and address filtering, and hands frames to the real
+ * CommLink rx thread through CommLink::ISR(), so everything above it runs
+ * the way it does on the robot.  See SimRadio.cpp.
+ */
+class Decawave : public CommLink {
+public:
+    Decawave(std::shared_ptr<SharedSPI> sharedSPI, PinName nCs, PinName intPin);
+
+    int32_t sendPacket(const rtp::packet* pkt) override;
+    uint8_t numChannels() const override;
+    void setChannel(uint8_t channel) override;
+    void reset() override {}
+    int32_t selfTest() override { return 0; }
+    bool isConnected() const override { return true; }
+
+    void setAddress(uint16_t addr) { _addr = addr; }
+    void printStuff() {}
+
+    uint8_t channel() const { return _channel; }
+
+    /**
+     * Called by the simulated link when a frame reaches the antenna, from an
+     * event rather than a thread.  Frames for other channels and addresses
+     * are dropped, and a frame that isn't read before the next one arrives
+     * is lost.
+     */
+    void receiveFrame(const std::vector<uint8_t>& frame, uint8_t channel);
+
+    /// Gets every frame sent, with the channel it went out on
+    std::function<void(const std::vector<uint8_t>& frame, uint8_t channel)>
+        onTransmit;
+
+protected:
+    int32_t getData(std::vector<uint8_t>* buf) override;
+
+private:
+    uint8_t _addr = rtp::INVALID_ROBOT_UID;
+    uint8_t _channel = 0;
+
+    std::vector<uint8_t> _rxFrame;
+    bool _rxPending = false;
+};
+
+extern Decawave* global_radio;
@@ -0,0 +1,12 @@
+#pragma once
+
+/// The mbed's DIP pins, for pins-ctrl-2015.hpp
+typedef enum {
+    p5 = 5, p6, p7, p8, p9, p10, p11, p12, p13, p14, p15, p16, p17, p18, p19,
+    p20, p21, p22, p23, p24, p25, p26, p27, p28, p29, p30,
+
+    USBTX,
+    USBRX,
+
+    NC = -1
+} PinName;
@@ -0,0 +1,3 @@
+#pragma once
+
+// Nothing in the simulated firmware is exposed over RPC
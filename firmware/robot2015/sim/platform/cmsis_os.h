@@ -0,0 +1,5 @@
+#pragma once
+
+// everything from cmsis_os.h that the firmware uses is in the simulator's
+// rtos.h
+#include "rtos.h"
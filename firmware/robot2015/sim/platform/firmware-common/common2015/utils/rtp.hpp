@@ -0,0 +1,4 @@
+#pragma once
+
+// CommModule.hpp and CommLink.hpp include rtp.hpp by this path
+#include <rtp.hpp>
@@ -0,0 +1,5 @@
+#pragma once
+
+// Nothing in the simulator reads or writes the expander's pins, so this only
+// needs the pin names
+#include "mcp23017.hpp"
@@ -0,0 +1,98 @@
+#pragma once
+
+/**
+ * Host stand-in for the parts of the mbed library that the simulated firmware
+ * uses.  Pins don't go anywhere, and the us ticker runs on the simulator's
+ * virtual clock.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "PinNames.h"
+
+typedef enum { PullUp, PullDown, PullNone, OpenDrain } PinMode;
+
+namespace mbed {
+
+class DigitalOut {
+public:
+    DigitalOut(PinName pin = NC, int value = 0) : _value(value) {}
+
+    void write(int value) { _value = value; }
+    int read() const { return _value; }
+
+    DigitalOut& operator=(int value) {
+        write(value);
+        return *this;
+    }
+    operator int() const { return read(); }
+
+private:
+    int _value;
+};
+
+class DigitalIn {
+public:
+    DigitalIn(PinName pin = NC) {}
+
+    int read() const { return 0; }
+    operator int() const { return read(); }
+};
+
+class DigitalInOut {
+public:
+    DigitalInOut(PinName pin = NC) {}
+
+    void output() {}
+    void input() {}
+    void write(int value) { _value = value; }
+    int read() const { return _value; }
+
+    DigitalInOut& operator=(int value) {
+        write(value);
+        return *this;
+    }
+    operator int() const { return read(); }
+
+private:
+    int _value = 0;
+};
+
+/// Interrupt pins never fire on their own.  Simulated devices call their
+/// handlers directly instead.
+class InterruptIn {
+public:
+    InterruptIn(PinName pin = NC) {}
+
+    void mode(PinMode pull) {}
+
+    template <class T>
+    void rise(T* obj, void (T::*method)()) {}
+    void rise(void (*fptr)()) {}
+};
+
+class SPI {
+public:
+    SPI(PinName mosi, PinName miso, PinName sclk) {}
+    virtual ~SPI() {}
+
+    void format(int bits, int mode = 0) {}
+    void frequency(int hz = 1000000) {}
+    virtual int write(int value) { return 0; }
+};
+
+}  // namespace mbed
+
+using namespace mbed;
+
+/// Microseconds of virtual time, wrapping like the real one
+uint32_t us_ticker_read();
+
+inline void __disable_irq() {}
+inline void __enable_irq() {}
+
+// the real mbed.h pulls std into everything, and some of the firmware counts
+// on it
+using namespace std;
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <mbed.h>
+
+/// The pin names from the real MCP23017 driver, for pins-ctrl-2015.hpp, and
+/// an expander with nothing on it
+class MCP23017 {
+public:
+    typedef enum {
+        PinA0 = 0,
+        PinA1,
+        PinA2,
+        PinA3,
+        PinA4,
+        PinA5,
+        PinA6,
+        PinA7,
+        PinB0,
+        PinB1,
+        PinB2,
+        PinB3,
+        PinB4,
+        PinB5,
+        PinB6,
+        PinB7
+    } ExpPinName;
+
+    typedef enum { DIR_OUTPUT = 0, DIR_INPUT = 1 } PinMode;
+
+    void pinMode(ExpPinName pin, PinMode mode) {}
+    void writePin(int value, ExpPinName pin) {}
+    uint8_t readPin(ExpPinName pin) { return 0; }
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+/**
+ * Host stand-in for the parts of the mbed RTOS that the simulated firmware
+ * uses.  Threads are coroutines that SimRtos.cpp switches between in virtual
+ * time, one at a time, so a run comes out the same every time and goes as
+ * fast as the host can go.  See SimRtos.hpp for driving it.
+ *
+ * Nothing is preempted, and code runs in no time at all, so a thread only
+ * gives up the processor when it waits.  That's why Mutex doesn't need to do
+ * anything.
+ */
+
+#include <cstdint>
+#include <memory>
+
+// MailHelper only fills in queue definitions for RTX
+#define CMSIS_OS_RTX
+
+#define DEFAULT_STACK_SIZE (4 * 1024)
+
+typedef enum {
+    osPriorityIdle = -3,
+    osPriorityLow = -2,
+    osPriorityBelowNormal = -1,
+    osPriorityNormal = 0,
+    osPriorityAboveNormal = +1,
+    osPriorityHigh = +2,
+    osPriorityRealtime = +3,
+    osPriorityError = 0x84
+} osPriority;
+
+typedef enum {
+    osOK = 0,
+    osEventSignal = 0x08,
+    osEventMail = 0x20,
+    osEventTimeout = 0x40,
+    osErrorParameter = 0x80,
+    osErrorResource = 0x81,
+    osErrorISR = 0x82,
+} osStatus;
+
+typedef enum { osTimerOnce = 0, osTimerPeriodic = 1 } os_timer_type;
+
+#define osWaitForever 0xFFFFFFFF
+
+namespace sim {
+struct Task;
+struct MailQueue;
+}
+typedef sim::Task* osThreadId;
+typedef sim::MailQueue* osMailQId;
+
+/// Only here for the casts that get a thread's task id, which a sim::Task
+/// starts with
+typedef struct OS_TCB {
+    uint8_t task_id;
+} * P_TCB;
+
+typedef struct {
+    osStatus status;
+    union {
+        uint32_t v;
+        void* p;
+        int32_t signals;
+    } value;
+} osEvent;
+
+typedef struct {
+    uint32_t queue_sz;
+    uint32_t item_sz;
+    void* pool;
+} osMailQDef_t;
+
+int32_t osSignalSet(osThreadId thread_id, int32_t signals);
+osThreadId osThreadGetId();
+osPriority osThreadGetPriority(osThreadId thread_id);
+osStatus osThreadSetPriority(osThreadId thread_id, osPriority priority);
+
+/// Mail comes zeroed, like from RTX's pools, and isn't destructed when freed
+osMailQId osMailCreate(const osMailQDef_t* queue_def, osThreadId thread_id);
+void* osMailAlloc(osMailQId queue_id, uint32_t millisec);
+osStatus osMailPut(osMailQId queue_id, void* mail);
+osEvent osMailGet(osMailQId queue_id, uint32_t millisec);
+osStatus osMailFree(osMailQId queue_id, void* mail);
+
+namespace rtos {
+
+class Thread {
+public:
+    Thread(void (*task)(void const* argument), void* argument = nullptr,
+           osPriority priority = osPriorityNormal, uint32_t stack_size = 0,
+           unsigned char* stack_pointer = nullptr);
+    ~Thread();
+
+    Thread(const Thread&) = delete;
+
+    int32_t signal_set(int32_t signals);
+    osStatus set_priority(osPriority priority);
+    osPriority get_priority();
+
+    static osEvent signal_wait(int32_t signals,
+                               uint32_t millisec = osWaitForever);
+    static osStatus wait(uint32_t millisec);
+    static osStatus yield();
+    static osThreadId gettid();
+
+private:
+    osThreadId _tid;
+};
+
+class Mutex {
+public:
+    osStatus lock(uint32_t millisec = osWaitForever) { return osOK; }
+    bool trylock() { return true; }
+    osStatus unlock() { return osOK; }
+};
+
+class RtosTimer {
+public:
+    RtosTimer(void (*func)(void const* argument),
+              os_timer_type type = osTimerPeriodic, void* argument = nullptr);
+    virtual ~RtosTimer();
+
+    RtosTimer(const RtosTimer&) = delete;
+
+    osStatus start(uint32_t millisec);
+    osStatus stop();
+
+    struct State;
+
+private:
+    std::shared_ptr<State> _state;
+};
+
+}  // namespace rtos
+
+using namespace rtos;
@@ -0,0 +1,4 @@
+#pragma once
+
+// us_ticker_read() is in the simulator's mbed.h
+#include "mbed.h"
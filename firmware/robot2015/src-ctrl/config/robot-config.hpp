@@ -11,3 +11,76 @@
 
 // The amount of time (in ms) that all LEDs stay lit during startup
 #define RJ_STARTUP_LED_TIMEOUT_MS 500
+
+// Parts of the drive that act on values that haven't been checked on a robot
+// yet.  Each one stays off, and the drive does what it did before it, until
+// what it depends on has been.  The simulator turns them on, since its robot
+// is modeled from the same values.
+
+// Closes a current loop inside the wheel velocity loops, on the motor currents
+// the FPGA measures.  Before turning it on, check the current sense ADCs' part
+// and channel mapping in src-fpga/src/Current_Sampler.v and the shunt
+// resistance below against the board, and measure the drive motors' stall
+// current, see CurrentController.  src-fpga/sim/current_sampler_tb.v checks
+// the sampler against a model of the ADCs.
+#ifndef RJ_CURRENT_LOOP
+#define RJ_CURRENT_LOOP 0
+#endif
+
+// The drive motors' current sense resistors, in ohms
+#define RJ_SHUNT_RESISTANCE 0.002
+
+// Derates motors that get hot, see MotorProtection.  Motors that stall are
+// shut off either way, since that doesn't depend on the thermal values.  Until
+// it's on, heat is only reported, in the robot's status replies and the
+// 'motors' command.  Before turning it on, measure the motor values below.
+#ifndef RJ_MOTOR_PROTECTION
+#define RJ_MOTOR_PROTECTION 0
+#endif
+
+// The drive motors' and dribbler's current at full duty held still and the
+// current they can take indefinitely, in A, and their windings' thermal time
+// constants, in s.  These are from the motor datasheets.
+#define RJ_DRIVE_MOTOR_STALL_AMPS 15
+#define RJ_DRIVE_MOTOR_CONTINUOUS_AMPS 2
+#define RJ_DRIVE_MOTOR_THERMAL_SECS 30
+#define RJ_DRIBBLER_STALL_AMPS 5
+#define RJ_DRIBBLER_CONTINUOUS_AMPS 0.8
+#define RJ_DRIBBLER_THERMAL_SECS 10
+
+// Hall counts per second from the dribbler at full duty with no load, worked
+// out from its datasheet's no load speed
+#define RJ_DRIBBLER_FULL_SPEED 20000
+
+// Holds the motors' current down to what the battery can give without sagging
+// below RJ_BATTERY_MIN_VOLTS, see BatteryMonitor.  The drive's duty cycles are
+// scaled to the battery voltage either way, since that's just
+// RJ_BATTERY_NOMINAL_VOLTS over the measured voltage.  The current limit works
+// through the current loop, so it needs RJ_CURRENT_LOOP too.  Before turning it
+// on, measure the battery values below on a robot.
+#ifndef RJ_BATTERY_LIMITER
+#define RJ_BATTERY_LIMITER 0
+#endif
+
+// The voltage the feedforward duty cycles are tuned at, the lowest the battery
+// should sag to with margin over where the regulators drop out, in V, and the
+// pack's internal resistance with its wiring, in ohms.  These are typical for
+// the robot's pack, not measured.
+#define RJ_BATTERY_NOMINAL_VOLTS 18
+#define RJ_BATTERY_MIN_VOLTS 14
+#define RJ_BATTERY_RESISTANCE 0.3
+
+// Drives a wheel on its hall sensors when its encoder stops agreeing with them,
+// see EncoderMonitor.  Until it's on, a wheel with a bad encoder is shut off
+// until it agrees again, and that's reported in the robot's status replies and
+// the 'motors' command.  Before turning it on,
+// check the counts below on a drive motor, and that good encoders aren't
+// flagged on carpet with EncoderMonitor's margins.
+#ifndef RJ_ENCODER_FALLBACK
+#define RJ_ENCODER_FALLBACK 0
+#endif
+
+// Encoder ticks and hall counts per turn of a drive motor, from the encoder's
+// resolution and the motor's 4 pole pairs on its datasheet
+#define RJ_ENCODER_TICKS_PER_TURN 2048
+#define RJ_HALL_COUNTS_PER_TURN 24
@@ -5,7 +5,9 @@
 
 #include <rtos.h>
 
+#include <CrashLog.hpp>
 #include <assert.hpp>
+#include <heartbeat.hpp>
 #include <helper-funcs.hpp>
 #include <logger.hpp>
 #include <watchdog.hpp>
@@ -14,6 +16,7 @@
 // #include "CC1201.cpp"
 #include "Decawave.hpp"
 #include "HackedKickerBoard.hpp"
+#include "OtaUpdater.hpp"
 #include "RadioProtocol.hpp"
 #include "RobotModel.hpp"
 #include "RotarySelector.hpp"
@@ -32,7 +35,13 @@ using namespace std;
 
 void Task_Controller(void const* args);
 void Task_Controller_UpdateTarget(Eigen::Vector3f targetVel);
+void Task_Controller_UpdateTrajectory(Eigen::Vector3f targetVel,
+                                      const rtp::TrajectoryPoint* points,
+                                      size_t count, uint8_t stepMs);
+void Task_Controller_UpdateMotionLimits(const rtp::MotionLimitsMessage& msg);
 void Task_Controller_UpdateDribbler(uint8_t dribbler);
+void Task_Controller_UpdateSystemId(const rtp::SystemIdMessage& msg);
+bool Task_Controller_SaveTuning();
 
 /**
  * @brief Sets the hardware configurations for the status LEDs & places
@@ -47,6 +56,35 @@ void statusLights(bool state) {
     for (DigitalOut& led : init_leds) led = !state;
 }
 
+/**
+ * Feeds the watchdog as long as every thread that checks in with Heartbeat is
+ * keeping up.  Once one isn't, a record of which one it was is kept for the
+ * crash log, the motors are shut off, and the mbed resets.  If shutting the
+ * motors off hangs too, like when the starved thread is holding the SPI bus,
+ * the watchdog resets it anyway since it isn't being fed anymore.
+ */
+void superviseThreads() {
+    if (Heartbeat::Check()) {
+        Watchdog::Renew();
+        return;
+    }
+
+    HeartbeatSupervisor supervisor;
+    uint32_t now;
+    Heartbeat::Read(&supervisor, &now);
+    const HeartbeatSupervisor::Entry& starved =
+        supervisor.entry(supervisor.starved());
+
+    char what[crash::LOG_LINE_LEN];
+    snprintf(what, sizeof(what), "%s starved for %lu ms", starved.name,
+             supervisor.starvedMs());
+    CrashLog::CaptureStarved(starved.threadId, what);
+
+    LOG(FATAL, "%s, shutting down the motors and resetting", what);
+    if (FPGA::Instance) FPGA::Instance->motors_en(false);
+    NVIC_SystemReset();
+}
+
 /**
  * The entry point of the system where each submodule's thread is started.
  */
@@ -62,9 +100,13 @@ int main() {
     // set baud rate to higher value than the default for faster terminal
     s.baud(57600);
 
-    uint8_t wd_flag = (LPC_WDT->WDMOD >> 2) & 1;
-    printf("Watchdog caused reset: %s\r\n", (wd_flag > 0) ? "True" : "False");
-    wd_flag = (LPC_WDT->WDMOD >> 2) & 1;
+    // figure out why we reset and store a record of it if it was a crash
+    CrashLog::Init();
+    printf("Reset reason: %s\r\n",
+           crash::RESET_REASON_STRING[CrashLog::LastResetReason()]);
+    if (CrashLog::Count() > 0)
+        printf("%u crash record(s) stored, see `crash`\r\n",
+               CrashLog::Count());
 
     // Turn on some startup LEDs to show they're working, they are turned off
     // before we hit the while loop
@@ -168,12 +210,14 @@ int main() {
     // Init IO Expander and turn all LEDs on.  The first parameter to config()
     // sets the first 8 lines to input and the last 8 to output.  The pullup
     // resistors and polarity swap are enabled for the 4 rotary selector lines.
-    MCP23017 ioExpander(RJ_I2C_SDA, RJ_I2C_SCL, RJ_IO_EXPANDER_I2C_ADDRESS);
+    MCP23017 ioExpander(RJ_I2C_SDA, RJ_I2C_SCL, RJ_IO_EXPANDER_I2C_ADDRESS,
+                        RJ_IOEXP_INT);
     ioExpander.config(0x00FF, 0x00ff, 0x00ff);
     ioExpander.writeMask(static_cast<uint16_t>(~IOExpanderErrorLEDMask),
                          IOExpanderErrorLEDMask);
 
-    // DIP Switch 1 controls the radio channel.
+    // DIP Switch 1 picks the radio channel to start out on.  The base station
+    // can move everyone to another one after that.
     uint8_t currentRadioChannel = 0;
     IOExpanderDigitalInOut radioChannelSwitch(&ioExpander, RJ_DIP_SWITCH_1,
                                               MCP23017::DIR_INPUT);
@@ -218,10 +262,13 @@ int main() {
     // Make sure all of the motors are enabled
     motors_Init();
 
-    // setup analog in on battery sense pin
-    // the value is updated in the main loop below
+    // sample the battery sense pin at 1 kHz for the control loop, which
+    // scales the motors to the battery and keeps it from browning out
     AnalogIn batt(RJ_BATT_SENSE);
-    uint8_t battVoltage = 0;
+    RtosTimerHelper battTimer(
+        [&]() { global_battery_monitor.sample(batt.read_u16()); },
+        osTimerPeriodic);
+    battTimer.start(1);
 
     // Radio timeout timer
     const uint32_t RADIO_TIMEOUT = 100;
@@ -238,23 +285,43 @@ int main() {
     // Setup radio protocol handling
     RadioProtocol radioProtocol(CommModule::Instance, global_radio);
     radioProtocol.setUID(robotShellID);
+    currentRadioChannel = radioChannelSwitch.read();
+    radioProtocol.setHomeChannel(currentRadioChannel);
     radioProtocol.start();
 
+    // Accept firmware updates over the radio
+    OtaUpdater otaUpdater(CommModule::Instance, global_radio);
+    otaUpdater.setUID(robotShellID);
+    otaUpdater.start();
+
+    radioProtocol.motionLimitsCallback = &Task_Controller_UpdateMotionLimits;
+    radioProtocol.systemIdCallback = &Task_Controller_UpdateSystemId;
     radioProtocol.rxCallback =
-        [&](const rtp::ControlMessage* msg, const bool addressed) {
+        [&](const rtp::ControlMessage* msg, const bool addressed,
+            const rtp::TrajectoryHeader* trajectory) {
             // reset timeout
             radioTimeoutTimer.start(RADIO_TIMEOUT);
 
             if (addressed) {
-                // update target velocity from packet
-                Task_Controller_UpdateTarget({
+                // update target velocity from packet, and where it's headed
+                // if the base station sent that too
+                const Eigen::Vector3f targetVel = {
                     static_cast<float>(msg->bodyX) /
                         rtp::ControlMessage::VELOCITY_SCALE_FACTOR,
                     static_cast<float>(msg->bodyY) /
                         rtp::ControlMessage::VELOCITY_SCALE_FACTOR,
                     static_cast<float>(msg->bodyW) /
                         rtp::ControlMessage::VELOCITY_SCALE_FACTOR,
-                });
+                };
+                if (trajectory) {
+                    Task_Controller_UpdateTrajectory(
+                        targetVel,
+                        reinterpret_cast<const rtp::TrajectoryPoint*>(
+                            trajectory + 1),
+                        trajectory->points, trajectory->stepMs);
+                } else {
+                    Task_Controller_UpdateTarget(targetVel);
+                }
 
                 // dribbler
                 Task_Controller_UpdateDribbler(msg->dribbler);
@@ -278,7 +345,7 @@ int main() {
 
             rtp::RobotStatusMessage reply;
             reply.uid = robotShellID;
-            reply.battVoltage = battVoltage;
+            reply.battVoltage = global_battery_monitor.reading();
             reply.ballSenseStatus = ballSense.have_ball() ? 1 : 0;
 
             // report any motor errors
@@ -287,6 +354,9 @@ int main() {
                 auto err = global_motors[i].status.hasError;
                 if (err) reply.motorErrors |= (1 << i);
             }
+            reply.motorStalled = global_motor_protection.stalledMask();
+            reply.motorHot = global_motor_protection.hotMask();
+            reply.encoderFaults = global_encoder_monitor.faultMask();
 
             // fpga status
             if (!fpgaInitialized) {
@@ -331,9 +401,9 @@ int main() {
     }
 
     while (true) {
-        // make sure we can always reach back to main by
-        // renewing the watchdog timer periodicly
-        Watchdog::Renew();
+        // renew the watchdog timer periodically, as long as main and all of
+        // the threads that check in are still running
+        superviseThreads();
         global_radio->printStuff();
         // periodically reset the console text's format
         ll++;
@@ -344,6 +414,10 @@ int main() {
 
         Thread::wait(RJ_WATCHDOG_TIMER_VALUE * 250);
 
+        // save new drive motor gains that were asked to be, which takes too
+        // long for the control loop to do
+        Task_Controller_SaveTuning();
+
         // Pack errors into bitmask
         errorBitmask |= (!global_radio || !global_radio->isConnected())
                         << RJ_ERR_LED_RADIO;
@@ -366,26 +440,27 @@ int main() {
             errorBitmask |= (status.hasError << pair.second);
         }
 
-        // get the battery voltage
-        battVoltage = (batt.read_u16() >> 8);
-
         // get kicker voltage
         // KickerBoard::Instance->read_voltage(&kickerVoltage);
         LOG(INF1, "Kicker voltage: %u", kickerVoltage);
 
+        // re-read the switches, but only if one of them has changed
+        ioExpander.refresh();
+
         // update shell id
         robotShellID = rotarySelector.read();
         radioProtocol.setUID(robotShellID);
 
-        // update radio channel
+        // update home radio channel
         uint8_t newRadioChannel = radioChannelSwitch.read();
         if (newRadioChannel != currentRadioChannel) {
-            // global_radio->setChannel(newRadioChannel);
+            radioProtocol.setHomeChannel(newRadioChannel);
             currentRadioChannel = newRadioChannel;
-            LOG(INIT, "Changed radio channel to %u", newRadioChannel);
+            LOG(INIT, "Changed home radio channel to %u", newRadioChannel);
         }
 
-        // Set error-indicating leds on the control board
+        // Set error-indicating leds on the control board.  This only goes out
+        // over I2C if one of them changed.
         ioExpander.writeMask(~errorBitmask, IOExpanderErrorLEDMask);
 
         if (errorBitmask || !fpgaInitialized || fpgaError) {
@@ -429,6 +504,9 @@ _EXTERN void HARD_FAULT_HANDLER(uint32_t* stackAddr) {
     volatile uint32_t pc;  /* Program counter. */
     volatile uint32_t psr; /* Program status register. */
 
+    // save everything to retained RAM first in case printing faults again
+    CrashLog::CaptureFault(stackAddr);
+
     r0 = stackAddr[0];
     r1 = stackAddr[1];
     r2 = stackAddr[2];
@@ -458,11 +536,17 @@ _EXTERN void HARD_FAULT_HANDLER(uint32_t* stackAddr) {
         "\r\n"
         "========== HARD FAULT ==========\r\n"
         "================================",
-        __get_MSP, SCB->HFSR, SCB->CFSR, r0, r1, r2, r3, r12, lr, pc, psr);
+        __get_MSP(), SCB->HFSR, SCB->CFSR, r0, r1, r2, r3, r12, lr, pc, psr);
 
-    // do nothing so everything remains unchanged for debugging
-    while (true) {
+    // do nothing so everything remains unchanged for debugging if a debugger
+    // is attached.  Otherwise reset so the robot gets back in the game - the
+    // crash record is stored in flash on the next boot.
+    if (CoreDebug->DHCSR & CoreDebug_DHCSR_C_DEBUGEN_Msk) {
+        while (true) {
+        }
     }
+
+    NVIC_SystemReset();
 }
 
 _EXTERN void NMI_Handler() { std::printf("NMI Fault!\n"); }
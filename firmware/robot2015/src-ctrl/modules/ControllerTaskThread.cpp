@@ -7,12 +7,21 @@
 
 #include "PidMotionController.hpp"
 #include "RtosTimerHelper.hpp"
+#include "commands.hpp"
+#include "current-controller.hpp"
+#include "encoder-velocity.hpp"
 #include "fpga.hpp"
+#include "heap-monitor.hpp"
+#include "heartbeat.hpp"
 #include "io-expander.hpp"
 #include "motors.hpp"
 #include "mpu-6050.hpp"
 #include "robot-devices.hpp"
+#include "rtp.hpp"
+#include "system-id.hpp"
 #include "task-signals.hpp"
+#include "trajectory-buffer.hpp"
+#include "uptime.hpp"
 
 using namespace std;
 
@@ -23,17 +32,63 @@ static const int CONTROL_LOOP_WAIT_MS = 5;
 // initialize PID controller
 PidMotionController pidController;
 
+// torque loop inside the wheel velocity loops
+CurrentController currentController;
+
+// wheel velocities from the encoder edge times
+EncoderVelocity encoderVelocity(FPGA::ENC_AGE_TICK_US * 1e-6f);
+
+/// Amps per count of the motor currents from the FPGA.  That's 8 ADC codes of
+/// 3.3 V / 4096 through the DRV8303's 40 V/V shunt amplifiers.
+static const float AMPS_PER_CURRENT_COUNT =
+    8 * 3.3f / 4096 / 40 / RJ_SHUNT_RESISTANCE;
+
 /** If this amount of time (in ms) elapses without
- * Task_Controller_UpdateTarget() being called, the target velocity is reset to
- * zero.  This is a safety feature to prevent robots from doing unwanted things
- * when they lose radio communication.
+ * Task_Controller_UpdateTarget() being called, the motors are turned off.
+ * This is a safety feature to prevent robots from doing unwanted things
+ * when they lose radio communication.  The trajectory has faded out to zero
+ * by then, so it only matters if something goes wrong with that.
  */
-static const uint32_t COMMAND_TIMEOUT_INTERVAL = 250;
+static const uint32_t COMMAND_TIMEOUT_INTERVAL = TrajectoryBuffer::TIMEOUT_MS;
 unique_ptr<RtosTimerHelper> commandTimeoutTimer = nullptr;
 bool commandTimedOut = true;
 
-void Task_Controller_UpdateTarget(Eigen::Vector3f targetVel) {
-    pidController.setTargetVel(targetVel);
+/// How long the control loop can go without running before the robot's shut
+/// down and reset, see Heartbeat.  That's a lot of missed periods, but the
+/// FPGA stops the motors on its own after half a second anyway.
+static const uint32_t HEARTBEAT_DEADLINE_MS = 250;
+
+// where the robot should be going, set by the radio thread and followed by the
+// control loop
+TrajectoryBuffer trajectory;
+Mutex trajectoryMutex;
+
+static TrajectoryBuffer::Velocity toVelocity(const Eigen::Vector3f& v) {
+    return {v[0], v[1], v[2]};
+}
+
+/**
+ * Sets the velocity to go at now, and the velocities to follow @stepMs apart
+ * after that, from a forward packet.
+ */
+void Task_Controller_UpdateTrajectory(Eigen::Vector3f targetVel,
+                                      const rtp::TrajectoryPoint* points,
+                                      size_t count, uint8_t stepMs) {
+    if (count > TrajectoryBuffer::MAX_POINTS) {
+        count = TrajectoryBuffer::MAX_POINTS;
+    }
+
+    const float scale = rtp::ControlMessage::VELOCITY_SCALE_FACTOR;
+    TrajectoryBuffer::Velocity velocities[TrajectoryBuffer::MAX_POINTS];
+    for (size_t i = 0; i < count; i++) {
+        velocities[i] = {points[i].bodyX / scale, points[i].bodyY / scale,
+                         points[i].bodyW / scale};
+    }
+
+    trajectoryMutex.lock();
+    trajectory.set(uptimeMs(), toVelocity(targetVel), velocities, count,
+                   stepMs);
+    trajectoryMutex.unlock();
 
     // reset timeout
     commandTimedOut = false;
@@ -41,11 +96,176 @@ void Task_Controller_UpdateTarget(Eigen::Vector3f targetVel) {
         commandTimeoutTimer->start(COMMAND_TIMEOUT_INTERVAL);
 }
 
+void Task_Controller_UpdateTarget(Eigen::Vector3f targetVel) {
+    Task_Controller_UpdateTrajectory(targetVel, nullptr, 0, 0);
+}
+
+// new motion limits from the radio, applied by the control loop
+MotionProfiler::Limits pendingLimits;
+bool newLimits = false;
+Mutex limitsMutex;
+
+void Task_Controller_UpdateMotionLimits(const rtp::MotionLimitsMessage& msg) {
+    const float scale = rtp::MotionLimitsMessage::LIMIT_SCALE_FACTOR;
+
+    limitsMutex.lock();
+    for (size_t i = 0; i < MotionProfiler::AXES; i++) {
+        pendingLimits.accel[i] = msg.accel[i] / scale;
+        pendingLimits.jerk[i] = msg.jerk[i] / scale;
+    }
+    newLimits = true;
+    limitsMutex.unlock();
+
+    LOG(INF1, "Motion limits set to %u/%u/%u cm/s^2, %u/%u/%u cm/s^3",
+        msg.accel[0], msg.accel[1], msg.accel[2], msg.jerk[0], msg.jerk[1],
+        msg.jerk[2]);
+}
+
 uint8_t dribblerSpeed = 0;
 void Task_Controller_UpdateDribbler(uint8_t dribbler) {
     dribblerSpeed = dribbler;
 }
 
+/// Where this robot's drive motor tuning is kept, see system-id.hpp
+static const char* TUNING_PATH = "/local/TUNING.TXT";
+
+// system identification of the drive motors, which the control loop runs in
+// place of the velocity loops.  Only the control loop touches it, the rest
+// goes through the requests below.
+sysid::Runner systemId;
+
+// a request to start or stop system identification, and whether to save the
+// gains it comes up with
+uint8_t pendingSystemIdWheels = 0;
+bool newSystemId = false;
+bool stopSystemId = false;
+bool saveSystemId = false;
+
+// the tuning of the wheels in tunedWheels, from the last run or the file
+sysid::WheelTuning tunings[sysid::NUM_WHEELS];
+uint8_t tunedWheels = 0;
+bool tuningUnsaved = false;
+Mutex systemIdMutex;
+
+/**
+ * Starts identifying the drive motors in @wheels, and tuning their velocity
+ * loops to them.  The robot needs to be up on a stand, since the wheels get
+ * driven open loop.
+ *
+ * @param save whether to save the gains to the robot's flash once it's done,
+ *     which Task_Controller_SaveTuning() does from the main loop
+ */
+void Task_Controller_StartSystemId(uint8_t wheels, bool save) {
+    systemIdMutex.lock();
+    pendingSystemIdWheels = wheels;
+    newSystemId = true;
+    stopSystemId = false;
+    saveSystemId = save;
+    systemIdMutex.unlock();
+}
+
+void Task_Controller_StopSystemId() {
+    systemIdMutex.lock();
+    newSystemId = false;
+    stopSystemId = true;
+    systemIdMutex.unlock();
+}
+
+void Task_Controller_UpdateSystemId(const rtp::SystemIdMessage& msg) {
+    if (msg.flags & rtp::SystemIdMessage::STOP) {
+        Task_Controller_StopSystemId();
+        LOG(INIT, "System identification stopped over the radio");
+    } else {
+        Task_Controller_StartSystemId(msg.wheels,
+                                      msg.flags & rtp::SystemIdMessage::SAVE);
+        LOG(INIT, "System identification of wheels 0x%02X started over the "
+                  "radio", msg.wheels);
+    }
+}
+
+/**
+ * Saves the tuning to flash if there's any that's waiting to be.  Writing to
+ * the local filesystem takes a while, so the main loop does it instead of the
+ * control loop.
+ *
+ * @return true if it saved something
+ */
+bool Task_Controller_SaveTuning() {
+    sysid::WheelTuning toSave[sysid::NUM_WHEELS];
+    systemIdMutex.lock();
+    const bool unsaved = tuningUnsaved;
+    const uint8_t wheels = tunedWheels;
+    std::copy(tunings, tunings + sysid::NUM_WHEELS, toSave);
+    tuningUnsaved = false;
+    systemIdMutex.unlock();
+    if (!unsaved) return false;
+
+    if (!sysid::saveTuning(TUNING_PATH, toSave, wheels)) {
+        LOG(SEVERE, "Couldn't save the drive motor tuning to %s", TUNING_PATH);
+        return false;
+    }
+    LOG(INIT, "Saved the tuning of wheels 0x%02X to %s", wheels, TUNING_PATH);
+    return true;
+}
+
+/// Has the velocity loop for @wheel use its tuning
+static void applyTuning(size_t wheel) {
+    const sysid::WheelTuning& t = tunings[wheel];
+    pidController.setPidValues(wheel, t.pid.kp, t.pid.ki, t.pid.kd);
+    pidController.setDutyCycleMultiplier(wheel, t.dutyCycleMultiplier);
+}
+
+/**
+ * Starts or stops system identification if it's been asked to, and runs a
+ * tick of it if it's going.  Once it's done, the wheels it identified get
+ * tuned.
+ *
+ * @param velocities the drive motors' velocities, in encoder ticks per second
+ * @param applied what the drive motors were driven at while they were
+ *     measured
+ * @param duty set to what to drive the motors at next
+ * @return true if the wheels are being identified
+ */
+static bool runSystemId(const array<float, 4>& velocities,
+                        const array<int16_t, 5>& applied, float dt,
+                        array<int16_t, 4>* duty) {
+    systemIdMutex.lock();
+    if (stopSystemId) systemId.stop();
+    if (newSystemId) systemId.start(pendingSystemIdWheels);
+    const bool save = saveSystemId;
+    newSystemId = stopSystemId = false;
+    systemIdMutex.unlock();
+
+    if (!systemId.active() || dt <= 0) return systemId.active();
+
+    float vels[sysid::NUM_WHEELS];
+    int16_t prev[sysid::NUM_WHEELS];
+    for (size_t i = 0; i < sysid::NUM_WHEELS; i++) {
+        vels[i] = velocities[i] * 2 * M_PI /
+                  PidMotionController::ENC_TICKS_PER_TURN;
+        prev[i] = applied[i];
+    }
+    if (!systemId.update(vels, prev, dt, duty->data())) return true;
+
+    // tune to the motors at the battery voltage they were measured at
+    const float supplyScale = global_battery_monitor.supplyScale();
+    const uint8_t identified = systemId.identified();
+    systemIdMutex.lock();
+    for (size_t i = 0; i < sysid::NUM_WHEELS; i++) {
+        if (!(identified & (1 << i))) continue;
+        tunings[i] = sysid::tune(systemId.model(i), systemId.meanDt(),
+                                 supplyScale);
+        applyTuning(i);
+    }
+    tunedWheels |= identified;
+    if (save && identified) tuningUnsaved = true;
+    systemIdMutex.unlock();
+
+    LOG(INIT, "System identification done, tuned wheels 0x%02X of 0x%02X",
+        identified, systemId.requested());
+    return true;
+}
+
 /**
  * initializes the motion controller thread
  */
@@ -86,33 +306,83 @@ void Task_Controller(void const* args) {
             testResp);
     }
 
+    // use the gains this robot's motors were tuned to, for the wheels that
+    // have been
+    pidController.setPidValues(0.8, 0.05, 0);
+    tunedWheels = sysid::loadTuning(TUNING_PATH, tunings);
+    for (size_t i = 0; i < sysid::NUM_WHEELS; i++) {
+        if (tunedWheels & (1 << i)) applyTuning(i);
+    }
+    if (tunedWheels) {
+        LOG(INIT, "Loaded the tuning of wheels 0x%02X from %s", tunedWheels,
+            TUNING_PATH);
+    }
+
     // signal back to main and wait until we're signaled to continue
     osSignalSet(mainID, MAIN_TASK_CONTINUE);
     Thread::signal_wait(SUB_TASK_CONTINUE, osWaitForever);
 
     array<int16_t, 5> duty_cycles{};
 
-    // pidController.setPidValues(1.5, 0.05, 0);  // TODO: tune pid values
-    pidController.setPidValues(0.8, 0.05, 0);
+    // what the motors were driven at since the last transfer, for the motor
+    // protection
+    array<int16_t, 5> applied{};
+
+    // encoder ticks per second from a drive motor at full duty with no load,
+    // going by its feedforward
+    auto driveFullSpeed = [](size_t wheel) {
+        return FPGA::MAX_DUTY_CYCLE / pidController.dutyCycleMultiplier(wheel) *
+               PidMotionController::ENC_TICKS_PER_TURN / (2 * M_PI);
+    };
 
     // initialize timeout timer
     commandTimeoutTimer = make_unique<RtosTimerHelper>(
         [&]() { commandTimedOut = true; }, osTimerPeriodic);
 
+    const int heartbeat = Heartbeat::Register("control", HEARTBEAT_DEADLINE_MS);
+
+    // nothing in the loop should need to allocate, see the 'heap' command
+    const uint8_t controlTag = HeapMonitor::tag("control", true);
+
     while (true) {
+        Heartbeat::CheckIn(heartbeat);
+        HeapTag heapTag(controlTag);
+
         // imu.getGyro(gyroVals);
         // imu.getAccelero(accelVals);
 
         // note: the 4th value is not an encoder value.  See the large comment
         // below for an explanation.
         array<int16_t, 5> enc_deltas{};
+        array<int8_t, 5> hall_deltas{};
+        array<uint8_t, 5> currents{};
+        array<uint16_t, 4> enc_ages{};
+
+        // zero out command if we haven't gotten an updated target in a while,
+        // unless the wheels are being identified, which doesn't need the radio
+        if (commandTimedOut && !systemId.active()) {
+            duty_cycles = {0, 0, 0, 0, 0};
+        }
 
-        // zero out command if we haven't gotten an updated target in a while
-        if (commandTimedOut) duty_cycles = {0, 0, 0, 0, 0};
+        // follow the trajectory between radio updates
+        trajectoryMutex.lock();
+        const TrajectoryBuffer::Velocity target =
+            trajectory.at(uptimeMs());
+        trajectoryMutex.unlock();
+        pidController.setTargetVel({target.x, target.y, target.w});
+
+        limitsMutex.lock();
+        if (newLimits) {
+            pidController.setMotionLimits(pendingLimits);
+            newLimits = false;
+        }
+        limitsMutex.unlock();
 
         auto statusByte = FPGA::Instance->set_duty_get_enc(
             duty_cycles.data(), duty_cycles.size(), enc_deltas.data(),
-            enc_deltas.size());
+            enc_deltas.size(), hall_deltas.data(), hall_deltas.size(),
+            currents.data(), currents.size(), enc_ages.data(),
+            enc_ages.size());
 
         /*
          * The time since the last update is derived with the value of
@@ -138,20 +408,100 @@ void Task_Controller(void const* args) {
          */
         const float dt = enc_deltas.back() * (1 / 18.432e6) * 2 * 64;
 
-        // take first 4 encoder deltas
-        array<int16_t, 4> driveMotorEnc;
-        for (auto i = 0; i < 4; i++) driveMotorEnc[i] = enc_deltas[i];
+        // check the encoders against the halls, and go by the halls for the
+        // wheels whose encoders can't be trusted if RJ_ENCODER_FALLBACK is
+        // on.  Otherwise, the edge times give the velocity in encoder ticks
+        // per second.
+        global_encoder_monitor.update(enc_deltas.data(), hall_deltas.data());
+        array<float, 4> driveMotorVel{};
+        for (auto i = 0; i < 4; i++) {
+            const float vel =
+                encoderVelocity.update(i, enc_deltas[i], enc_ages[i], dt);
+            if (RJ_ENCODER_FALLBACK && global_encoder_monitor.faulted(i)) {
+                driveMotorVel[i] =
+                    dt > 0 ? global_encoder_monitor.hallEstimate(i) / dt : 0;
+            } else {
+                driveMotorVel[i] = vel;
+            }
+        }
+
+        // check the motors for stalls and overheating
+        if (dt > 0) {
+            float speeds[5];
+            for (auto i = 0; i < 4; i++) {
+                speeds[i] = driveMotorVel[i] / driveFullSpeed(i);
+            }
+            speeds[4] = hall_deltas[4] / dt / RJ_DRIBBLER_FULL_SPEED;
+            global_motor_protection.update(applied.data(), speeds, dt);
+        }
+
+        // drive the wheels open loop while they're being identified
+        array<int16_t, 4> systemIdDuty{};
+        const bool identifying =
+            runSystemId(driveMotorVel, applied, dt, &systemIdDuty);
+        applied = duty_cycles;
+
+        // what the motors drew from the battery, which gets a fraction of the
+        // motor current as big as the duty cycle
+        float batteryAmps = 0;
+        for (auto i = 0; i < 5; i++) {
+            batteryAmps += std::abs(applied[i]) * currents[i] *
+                           AMPS_PER_CURRENT_COUNT / FPGA::MAX_DUTY_CYCLE;
+        }
+        global_battery_monitor.update(batteryAmps);
+        const float supplyScale = global_battery_monitor.supplyScale();
+        pidController.setSupplyScale(supplyScale);
 
         // run PID controller to determine what duty cycles to use to drive the
         // motors.
+        Eigen::Vector4f wheelVels;
+        wheelVels << driveMotorVel[0], driveMotorVel[1], driveMotorVel[2],
+            driveMotorVel[3];
+        wheelVels *= 2 * M_PI / PidMotionController::ENC_TICKS_PER_TURN;
         array<int16_t, 4> driveMotorDutyCycles =
-            pidController.run(driveMotorEnc, dt);
+            pidController.run(wheelVels, dt);
+
+        // get the torque the velocity loops asked for out of the motors, but
+        // no more than the battery can give without browning out.  Without
+        // the current loop, the duty cycles go out the way the velocity loops
+        // asked for them.
+        if (identifying) {
+            driveMotorDutyCycles = systemIdDuty;
+        } else if (RJ_CURRENT_LOOP && dt > 0) {
+            array<float, 4> backEmf, request;
+            float draw = 0;
+            for (auto i = 0; i < 4; i++) {
+                backEmf[i] = driveMotorVel[i] / driveFullSpeed(i) *
+                             FPGA::MAX_DUTY_CYCLE * supplyScale;
+                request[i] = currentController.request(driveMotorDutyCycles[i],
+                                                       backEmf[i]);
+                const float duty =
+                    std::fmin(FPGA::MAX_DUTY_CYCLE,
+                              std::abs(currentController.dutyFor(
+                                  request[i], backEmf[i])));
+                draw += duty / FPGA::MAX_DUTY_CYCLE * std::abs(request[i]);
+            }
+            const float powerScale =
+                RJ_BATTERY_LIMITER ? global_battery_monitor.powerScale(draw)
+                                   : 1;
+
+            for (auto i = 0; i < 4; i++) {
+                const float duty = currentController.dutyFor(
+                    request[i] * powerScale, backEmf[i]);
+                driveMotorDutyCycles[i] = currentController.run(
+                    i, duty, backEmf[i], currents[i] * AMPS_PER_CURRENT_COUNT,
+                    dt);
+            }
+        }
 
         // assign the duty cycles, zero out motors that the fpga returns an
-        // error for
+        // error for, and ones whose encoder is bad when there's no falling
+        // back to the halls
         auto i = 0;
         for (const auto& vel : driveMotorDutyCycles) {
-            const bool hasError = (statusByte & (1 << i));
+            const bool hasError =
+                (statusByte & (1 << i)) ||
+                (!RJ_ENCODER_FALLBACK && global_encoder_monitor.faulted(i));
             duty_cycles[i] = (hasError ? 0 : vel);
             ++i;
         }
@@ -166,6 +516,14 @@ void Task_Controller(void const* args) {
         // dribbler duty cycle
         duty_cycles[4] = dribblerSpeed;
 
+        // shut off motors that are jammed, and back off of ones that are hot
+        // once the thermal values for that have been measured
+        if (RJ_MOTOR_PROTECTION) {
+            global_motor_protection.limit(duty_cycles.data());
+        } else {
+            global_motor_protection.limitStalls(duty_cycles.data());
+        }
+
 #if 0
         // log duty cycle values
         printf("duty cycles: ");
@@ -178,3 +536,90 @@ void Task_Controller(void const* args) {
         Thread::wait(CONTROL_LOOP_WAIT_MS);
     }
 }
+
+// The console function to run with the 'sysid' command
+int cmd_sysid(cmd_args_t& args) {
+    if (args.empty()) {
+        show_invalid_args(args);
+        return 1;
+    }
+
+    const string& cmd = args.front();
+    if (cmd == "start") {
+        uint8_t wheels = 0;
+        bool save = false;
+        for (size_t i = 1; i < args.size(); i++) {
+            const int wheel = atoi(args[i].c_str());
+            if (args[i] == "save") {
+                save = true;
+            } else if (wheel >= 0 && wheel < int(sysid::NUM_WHEELS) &&
+                       isdigit(args[i][0])) {
+                wheels |= 1 << wheel;
+            } else {
+                show_invalid_args(args);
+                return 2;
+            }
+        }
+        if (!wheels) wheels = (1 << sysid::NUM_WHEELS) - 1;
+
+        Task_Controller_StartSystemId(wheels, save);
+        printf("Identifying wheels 0x%02X, which takes %.1f s each.  Keep the "
+               "robot on a stand.\r\n",
+               wheels, sysid::Excitation().duration() +
+                           sysid::Runner::REST_SECS);
+    } else if (cmd == "stop") {
+        Task_Controller_StopSystemId();
+        printf("Stopped.\r\n");
+    } else if (cmd == "show") {
+        systemIdMutex.lock();
+        for (size_t i = 0; i < sysid::NUM_WHEELS; i++) {
+            const sysid::WheelTuning& t = tunings[i];
+            if (tunedWheels & (1 << i)) {
+                printf("wheel %u: kp %.4f ki %.5f kd %.4f ff %.3f, "
+                       "gain %.4f rad/s tau %.1f ms\r\n",
+                       static_cast<unsigned int>(i), t.pid.kp, t.pid.ki,
+                       t.pid.kd, t.dutyCycleMultiplier, t.model.gain,
+                       t.model.tau * 1000);
+            } else {
+                printf("wheel %u: not tuned, ff %.3f\r\n",
+                       static_cast<unsigned int>(i),
+                       pidController.dutyCycleMultiplier(i));
+            }
+        }
+        printf("%s%s\r\n", systemId.active() ? "identifying" : "idle",
+               tuningUnsaved ? ", not saved yet" : "");
+        systemIdMutex.unlock();
+    } else if (cmd == "dump") {
+        // the log only changes while it's running
+        if (systemId.active()) {
+            printf("Still identifying wheel %d.\r\n", systemId.wheel());
+            return 3;
+        }
+        if (systemId.logWheel() < 0) {
+            printf("Nothing has been identified yet.\r\n");
+            return 3;
+        }
+
+        const sysid::FirstOrderModel& m = systemId.model(systemId.logWheel());
+        printf("# wheel %d, gain %f tau %f offset %f rms %f\r\n",
+               systemId.logWheel(), m.gain, m.tau, m.offset, m.rmsError);
+        printf("dt_us,duty,velocity\r\n");
+        for (size_t i = 0; i < systemId.logSize(); i++) {
+            const sysid::Sample& s = systemId.log()[i];
+            printf("%u,%d,%f\r\n", s.dtUs, s.duty, s.velocity);
+        }
+    } else if (cmd == "save") {
+        systemIdMutex.lock();
+        tuningUnsaved = tunedWheels != 0;
+        systemIdMutex.unlock();
+        if (!Task_Controller_SaveTuning()) {
+            printf("Nothing saved.\r\n");
+            return 4;
+        }
+    } else {
+        show_invalid_args(args);
+        return 5;
+    }
+
+    return 0;
+}
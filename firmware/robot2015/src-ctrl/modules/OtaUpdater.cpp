@@ -0,0 +1,193 @@
+#include "OtaUpdater.hpp"
+
+#include <strings.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <assert.hpp>
+#include <heartbeat.hpp>
+#include <logger.hpp>
+
+namespace {
+// LocalFileSystem only handles 8.3 filenames
+const char* const STAGING_FILE = "/local/OTA.TMP";
+
+// The new image alternates between these names so that the one we're
+// currently running from is never overwritten
+const char* const IMAGE_FILES[] = {"/local/RJOTA0.BIN", "/local/RJOTA1.BIN"};
+
+bool fileExists(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (fp) fclose(fp);
+    return fp != nullptr;
+}
+
+/// Copy @size bytes from @src to @dst, then read @dst back to make sure it
+/// matches.  This takes seconds, so it checks in as it goes.
+bool copyAndVerify(FILE* src, const char* dst, uint32_t size) {
+    uint8_t buf[ota::CHUNK_SIZE];
+    uint32_t srcCrc = 0, dstCrc = 0;
+
+    FILE* out = fopen(dst, "wb");
+    if (!out) return false;
+
+    fseek(src, 0, SEEK_SET);
+    for (uint32_t done = 0; done < size;) {
+        const size_t n = std::min<size_t>(sizeof(buf), size - done);
+        if (fread(buf, 1, n, src) != n || fwrite(buf, 1, n, out) != n) {
+            fclose(out);
+            return false;
+        }
+        srcCrc = crc::crc32(buf, n, srcCrc);
+        done += n;
+        Heartbeat::CheckInThread();
+    }
+    fclose(out);
+
+    FILE* in = fopen(dst, "rb");
+    if (!in) return false;
+    for (uint32_t done = 0; done < size;) {
+        const size_t n = std::min<size_t>(sizeof(buf), size - done);
+        if (fread(buf, 1, n, in) != n) break;
+        dstCrc = crc::crc32(buf, n, dstCrc);
+        done += n;
+        Heartbeat::CheckInThread();
+    }
+    fclose(in);
+
+    return srcCrc == dstCrc;
+}
+
+/// Remove every .bin file in /local except @keep
+void removeOtherImages(const char* keep) {
+    DIR* d = opendir("/local");
+    if (!d) return;
+
+    std::vector<std::string> toRemove;
+    struct dirent* p;
+    while ((p = readdir(d)) != nullptr) {
+        std::string name = std::string("/local/") + p->d_name;
+        const size_t len = name.size();
+        if (len > 4 && strcasecmp(name.c_str() + len - 4, ".BIN") == 0 &&
+            strcasecmp(name.c_str(), keep) != 0) {
+            toRemove.push_back(name);
+        }
+    }
+    closedir(d);
+
+    for (const auto& name : toRemove) {
+        remove(name.c_str());
+        Heartbeat::CheckInThread();
+    }
+}
+}  // namespace
+
+bool LocalFileStaging::begin(uint32_t imageSize) {
+    abort();
+
+    _file = fopen(STAGING_FILE, "w+b");
+    if (!_file) {
+        LOG(SEVERE, "Unable to create OTA staging file");
+        return false;
+    }
+
+    _size = imageSize;
+    return true;
+}
+
+bool LocalFileStaging::write(uint32_t offset, const uint8_t* data,
+                             size_t len) {
+    if (!_file || offset + len > _size) return false;
+    if (fseek(_file, offset, SEEK_SET) != 0) return false;
+    return fwrite(data, 1, len, _file) == len;
+}
+
+bool LocalFileStaging::read(uint32_t offset, uint8_t* data, size_t len) {
+    if (!_file || offset + len > _size) return false;
+    if (fseek(_file, offset, SEEK_SET) != 0) return false;
+
+    // the receiver reads the whole image back before committing it
+    Heartbeat::CheckInThread();
+    return fread(data, 1, len, _file) == len;
+}
+
+bool LocalFileStaging::commit() {
+    if (!_file) return false;
+
+    const char* dst = fileExists(IMAGE_FILES[0]) ? IMAGE_FILES[1]
+                                                 : IMAGE_FILES[0];
+
+    if (!copyAndVerify(_file, dst, _size)) {
+        LOG(SEVERE, "Failed writing OTA image to '%s'", dst);
+        remove(dst);
+        return false;
+    }
+
+    // the new image is good, so now it's safe to get rid of the old ones
+    removeOtherImages(dst);
+    abort();
+
+    LOG(OK, "OTA image saved to '%s'", dst);
+    return true;
+}
+
+void LocalFileStaging::abort() {
+    if (_file) {
+        fclose(_file);
+        _file = nullptr;
+        remove(STAGING_FILE);
+    }
+}
+
+OtaUpdater::OtaUpdater(std::shared_ptr<CommModule> commModule,
+                       CommLink* radio, uint8_t uid)
+    : _commModule(commModule),
+      _radio(radio),
+      _receiver(_staging, uid),
+      _rebootTimer(this, &OtaUpdater::reboot, osTimerOnce) {
+    ASSERT(commModule != nullptr);
+    ASSERT(radio != nullptr);
+}
+
+void OtaUpdater::start() {
+    _commModule->setRxHandler(this, &OtaUpdater::rxHandler, rtp::Port::OTA);
+    _commModule->setTxHandler(_radio, &CommLink::sendPacket, rtp::Port::OTA);
+
+    LOG(INF1, "OTA updates listening on port %d", rtp::Port::OTA);
+}
+
+void OtaUpdater::stop() { _commModule->close(rtp::Port::OTA); }
+
+void OtaUpdater::rxHandler(rtp::packet pkt) {
+    const ota::State prevState = _receiver.state();
+
+    std::vector<uint8_t> reply;
+    if (_receiver.handle(pkt.payload.data(), pkt.payload.size(), &reply)) {
+        rtp::packet replyPkt;
+        replyPkt.header.port = rtp::Port::OTA;
+        replyPkt.header.type = rtp::header_data::FirmwareUpdate;
+        replyPkt.header.address = rtp::BASE_STATION_ADDRESS;
+        replyPkt.payload = std::move(reply);
+
+        _commModule->send(std::move(replyPkt));
+    }
+
+    const ota::State state = _receiver.state();
+    if (state != prevState) {
+        LOG(INF1, "OTA update %s (%u/%u chunks)", ota::STATE_STRING[state],
+            _receiver.chunksReceived(), _receiver.totalChunks());
+    }
+
+    if (state == ota::STATE_COMMITTED && prevState != state) {
+        _rebootTimer.start(REBOOT_DELAY_MS);
+    }
+}
+
+void OtaUpdater::reboot() {
+    LOG(INIT, "Rebooting into new firmware");
+
+    // resetting through the interface chip makes it program the newest .bin
+    mbed_interface_reset();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <rtos.h>
+
+#include <CommLink.hpp>
+#include <CommModule.hpp>
+#include <OtaReceiver.hpp>
+
+#include "RtosTimerHelper.hpp"
+
+/**
+ * Stages an OTA image on the mbed's local filesystem.
+ *
+ * The image is written to a temporary file that the mbed interface chip
+ * ignores.  On commit, it's copied to a new .bin file and read back to make
+ * sure the copy is good before any other .bin file is removed.  Until then,
+ * the currently running firmware is left alone, so a failed update never
+ * leaves the robot without a bootable image.
+ *
+ * All of this happens in CommModule's RX thread, and reading back and copying
+ * the image takes seconds, so it checks in with Heartbeat every chunk to keep
+ * the watchdog supervisor from resetting the robot partway through.
+ */
+class LocalFileStaging {
+public:
+    bool begin(uint32_t imageSize);
+    bool write(uint32_t offset, const uint8_t* data, size_t len);
+    bool read(uint32_t offset, uint8_t* data, size_t len);
+    bool commit();
+    void abort();
+
+private:
+    FILE* _file = nullptr;
+    uint32_t _size = 0;
+};
+
+/**
+ * Handles OTA firmware updates on rtp::Port::OTA.  Once an image has been
+ * received and verified, the robot reboots into it.
+ */
+class OtaUpdater {
+public:
+    /// Delay between acknowledging a commit and rebooting, to give the reply
+    /// time to go out over the radio
+    static const uint32_t REBOOT_DELAY_MS = 500;
+
+    OtaUpdater(std::shared_ptr<CommModule> commModule, CommLink* radio,
+               uint8_t uid = rtp::INVALID_ROBOT_UID);
+
+    ~OtaUpdater() { stop(); }
+
+    void setUID(uint8_t uid) { _receiver.setUID(uid); }
+
+    void start();
+    void stop();
+
+    void rxHandler(rtp::packet pkt);
+
+    const ota::Receiver<LocalFileStaging>& receiver() const {
+        return _receiver;
+    }
+
+private:
+    void reboot();
+
+    std::shared_ptr<CommModule> _commModule;
+    CommLink* _radio;
+
+    LocalFileStaging _staging;
+    ota::Receiver<LocalFileStaging> _receiver;
+
+    RtosTimerHelper _rebootTimer;
+};
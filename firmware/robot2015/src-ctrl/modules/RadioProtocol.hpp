@@ -5,6 +5,11 @@
 #include "CommModule.hpp"
 #include "Decawave.hpp"
 #include "RtosTimerHelper.hpp"
+#include "channel-manager.hpp"
+#include "control-codec.hpp"
+#include "forward-packet.hpp"
+#include "link-stats.hpp"
+#include "uptime.hpp"
 
 class RadioProtocol {
 public:
@@ -18,14 +23,20 @@ public:
     /// base station, we are considered "disconnected"
     static const uint32_t TIMEOUT_INTERVAL = 2000;
 
+    /// How often to check whether it's time to change channels, in ms
+    static const uint32_t CHANNEL_CHECK_INTERVAL = 4;
+
     RadioProtocol(std::shared_ptr<CommModule> commModule, Decawave* radio,
                   uint8_t uid = rtp::INVALID_ROBOT_UID)
         : _commModule(commModule),
           _radio(radio),
           _uid(uid),
           _state(STOPPED),
+          _channels(radio->numChannels(), 0, 0),
           _replyTimer(this, &RadioProtocol::reply, osTimerOnce),
-          _timeoutTimer(this, &RadioProtocol::_timeout, osTimerOnce) {
+          _timeoutTimer(this, &RadioProtocol::_timeout, osTimerOnce),
+          _channelTimer(this, &RadioProtocol::updateChannel,
+                        osTimerPeriodic) {
         ASSERT(commModule != nullptr);
         ASSERT(radio != nullptr);
         _radio->setAddress(rtp::ROBOT_ADDRESS);
@@ -33,9 +44,24 @@ public:
 
     ~RadioProtocol() { stop(); }
 
+    /// The running radio protocol, or nullptr.  Used by the console.
+    static RadioProtocol* Instance() { return instance(); }
+
     /// Set robot unique id.  Also update address.
     void setUID(uint8_t uid) { _uid = uid; }
 
+    /**
+     * Sets the channel to listen on at startup, and to look on first when the
+     * base station goes missing.  The base station moves everyone off of it
+     * when it gets noisy.
+     */
+    void setHomeChannel(uint8_t channel) {
+        _channelsMutex.lock();
+        _home = channel;
+        _channels.setHome(channel);
+        _channelsMutex.unlock();
+    }
+
     /**
      * Callback that is called whenever a packet is received.  Set this in
      * order to handle parsing the packet and creating a response.  This
@@ -43,14 +69,34 @@ public:
      * should return a formatted reply buffer, which will be sent in the
      * appropriate reply slot.
      *
-     * @param msg A pointer to the start of the message addressed to this robot
+     * @param msg The message addressed to this robot, or nullptr if there
+     *     wasn't one in this packet
+     * @param trajectory Where to go after @msg, with its points right after
+     *     it, or nullptr if there wasn't one for this robot
      * @return formatted reply buffer
      */
-    std::function<std::vector<uint8_t>(const rtp::ControlMessage* msg,
-                                       const bool addresed)> rxCallback;
+    std::function<std::vector<uint8_t>(
+        const rtp::ControlMessage* msg, const bool addresed,
+        const rtp::TrajectoryHeader* trajectory)> rxCallback;
+
+    /// Called with motion limits sent to this robot, or to every robot
+    std::function<void(const rtp::MotionLimitsMessage& limits)>
+        motionLimitsCallback;
+
+    /// Called to start or stop system identification on this robot
+    std::function<void(const rtp::SystemIdMessage& msg)> systemIdCallback;
 
     void start() {
         _state = DISCONNECTED;
+        instance() = this;
+
+        _channelsMutex.lock();
+        _channels = ChannelFollower(_radio->numChannels(), _home, uptimeMs());
+        const uint8_t channel = _channels.channel();
+        _channelsMutex.unlock();
+
+        _radio->setChannel(channel);
+        _channelTimer.start(CHANNEL_CHECK_INTERVAL);
 
         _commModule->setRxHandler(this, &RadioProtocol::rxHandler,
                                   rtp::Port::CONTROL);
@@ -64,36 +110,46 @@ public:
         _commModule->close(rtp::Port::CONTROL);
 
         _replyTimer.stop();
+        _channelTimer.stop();
         _state = STOPPED;
+        if (instance() == this) instance() = nullptr;
 
         LOG(INF1, "Radio protocol stopped");
     }
 
     State state() const { return _state; }
 
+    /// Statistics for the forward link from the base station, with our
+    /// reply latency
+    const LinkStats& stats() const { return _stats; }
+    void resetStats() { _stats.reset(); }
+
+    /// The channel we're on, numbered the way the radio numbers them
+    uint8_t channel() {
+        _channelsMutex.lock();
+        const uint8_t channel = _channels.channel();
+        _channelsMutex.unlock();
+        return channel;
+    }
+
     void rxHandler(rtp::packet pkt) {
-        // LOG(INIT, "got pkt!");
-        // TODO: check packet size before parsing
-        bool addressed = false;
-        const rtp::ControlMessage* msg;
-        size_t slot;
-        // printf("UUIDs: ");
-        for (slot = 0; slot < 6; slot++) {
-            size_t offset = slot * sizeof(rtp::ControlMessage);
-            msg = (const rtp::ControlMessage*)(pkt.payload.data() + offset);
-
-            // printf("%d:%d ", slot, msg->uid);
-            if (msg->uid == _uid) {
-                // LOG(INIT, "")
-                addressed = true;
-                break;
-            }
+        if (pkt.header.type == rtp::header_data::Tuning) {
+            tuningRxHandler(pkt);
+            return;
         }
-        // printf("\r\n");
 
-        /// time, in ms, for each reply slot
-        // TODO(justin): double-check this
-        const uint32_t SLOT_DELAY = 2;
+        rtp::ForwardPayload forward;
+        if (!forward.parse(pkt.payload.data(), pkt.payload.size())) {
+            LOG(WARN, "Dropping malformed control packet, %u bytes",
+                pkt.payload.size());
+            return;
+        }
+
+        int entry;
+        const ControlDecoder::Result decoded =
+            _decoder.decode(forward, pkt.header.seq, _uid, &_msg, &entry);
+        const bool addressed = decoded == ControlDecoder::DECODED;
+        const rtp::ControlMessage* msg = addressed ? &_msg : nullptr;
 
         _state = CONNECTED;
 
@@ -101,34 +157,107 @@ public:
         _timeoutTimer.stop();
         _timeoutTimer.start(TIMEOUT_INTERVAL);
 
-        // TODO: this is bad and lazy
-        if (addressed) {
-            _replyTimer.start(1 + SLOT_DELAY * slot);
-        } else {
-            _replyTimer.start(1 + SLOT_DELAY * (_uid % 6));
-        }
+        _rxTimestamp = pkt.rxTimestamp;
+        _stats.received(pkt.header.seq, pkt.rxQuality);
+        _channelsMutex.lock();
+        _channels.received(forward.schedule(), uptimeMs());
+        _channelsMutex.unlock();
+
+        // our entry is changes from a packet we missed.  Skipping the reply
+        // tells the base station to send the whole thing next time.
+        if (decoded == ControlDecoder::NEED_KEYFRAME) return;
+
+        const int32_t replyMs = rtp::ReplyDelayMs(entry, forward.count(), _uid,
+                                                  pkt.header.seq);
+        if (replyMs != rtp::NO_REPLY) _replyTimer.start(replyMs);
 
         if (rxCallback) {
-            _reply = std::move(rxCallback(msg, addressed));
+            const rtp::TrajectoryHeader* trajectory =
+                addressed ? forward.trajectory(_uid) : nullptr;
+            _reply = std::move(rxCallback(msg, addressed, trajectory));
         } else {
             LOG(WARN, "no callback set");
         }
     }
 
 private:
+    /// Tuning packets aren't part of the frame, so there's no reply
+    void tuningRxHandler(const rtp::packet& pkt) {
+        if (pkt.payload.size() == sizeof(rtp::MotionLimitsMessage)) {
+            rtp::MotionLimitsMessage limits;
+            memcpy(&limits, pkt.payload.data(), sizeof(limits));
+            if (!forThisRobot(limits.uid)) return;
+
+            if (motionLimitsCallback) motionLimitsCallback(limits);
+        } else if (pkt.payload.size() == sizeof(rtp::SystemIdMessage)) {
+            rtp::SystemIdMessage msg;
+            memcpy(&msg, pkt.payload.data(), sizeof(msg));
+            if (!forThisRobot(msg.uid)) return;
+
+            if (systemIdCallback) systemIdCallback(msg);
+        } else {
+            LOG(WARN, "Dropping tuning packet, %u bytes", pkt.payload.size());
+        }
+    }
+
+    bool forThisRobot(uint8_t uid) const {
+        return uid == _uid || uid == rtp::INVALID_ROBOT_UID;
+    }
+
     void reply() {
         rtp::packet pkt;
         pkt.header.port = rtp::Port::CONTROL;
         pkt.header.type = rtp::header_data::Control;
         pkt.header.address = rtp::BASE_STATION_ADDRESS;
 
+        pkt.header.seq = _replySeq++;
+
         pkt.payload = std::move(_reply);
+        rtp::SerializeToVector(_stats.summary(), &pkt.payload);
+
+        // the radio's last transmission was our previous reply
+        const radio_time::Timestamp prevTx = _radio->lastTxTimestamp();
+        const int64_t turnaround = radio_time::diff(prevTx, _prevRxTimestamp);
+        if (_prevRxTimestamp != radio_time::UNKNOWN && turnaround > 0) {
+            _stats.addLatencyUs(radio_time::ticksToUs(turnaround));
+        }
+
+        rtp::ReplyTimestamps stamps;
+        radio_time::toBytes(_rxTimestamp, stamps.rx);
+        radio_time::toBytes(_prevRxTimestamp, stamps.prevRx);
+        radio_time::toBytes(prevTx, stamps.prevTx);
+        rtp::SerializeToVector(stamps, &pkt.payload);
+        _prevRxTimestamp = _rxTimestamp;
 
         _commModule->send(std::move(pkt));
+
+        // the reply goes out before the next channel check, so if this was
+        // the last packet before a switch, it's sent on the old channel
+        _channelsMutex.lock();
+        _channels.replied();
+        _channelsMutex.unlock();
     }
 
     void _timeout() { _state = DISCONNECTED; }
 
+    void updateChannel() {
+        _channelsMutex.lock();
+        const bool moved = _channels.update(uptimeMs());
+        const uint8_t channel = _channels.channel();
+        const bool hunting = _channels.hunting();
+        _channelsMutex.unlock();
+        if (!moved) return;
+
+        _radio->setChannel(channel);
+        LOG(INF1, "Radio moved to channel %u%s", channel,
+            hunting ? " looking for the base station" : "");
+    }
+
+    static RadioProtocol*& instance() {
+        static RadioProtocol* running = nullptr;
+        return running;
+    }
+
     std::shared_ptr<CommModule> _commModule;
     Decawave* _radio;
 
@@ -138,7 +267,25 @@ private:
     State _state;
 
     std::vector<uint8_t> _reply;
+    uint8_t _replySeq = 0;
+
+    LinkStats _stats;
+
+    ControlDecoder _decoder;
+    rtp::ControlMessage _msg;
+
+    uint8_t _home = 0;
+    ChannelFollower _channels;
+
+    /// The RX thread hands _channels each schedule while the timer thread is
+    /// using it to decide when to switch, so it's only touched with this held
+    Mutex _channelsMutex;
+
+    /// When the forward packet being replied to arrived, and the one before
+    radio_time::Timestamp _rxTimestamp = radio_time::UNKNOWN;
+    radio_time::Timestamp _prevRxTimestamp = radio_time::UNKNOWN;
 
     RtosTimerHelper _replyTimer;
     RtosTimerHelper _timeoutTimer;
+    RtosTimerHelper _channelTimer;
 };
@@ -8,14 +8,19 @@
 #include <rtos.h>
 #include <CC1201.hpp>
 #include <CommModule.hpp>
+#include <CrashLog.hpp>
 #include <Decawave.hpp>
 #include <KickerBoard.hpp>
 #include <logger.hpp>
 #include <numparser.hpp>
+#include <us_ticker_api.h>
 
 #include "ds2411.hpp"
 #include "fpga.hpp"
+#include "heap-monitor.hpp"
 #include "neostrip.hpp"
+#include "RadioProtocol.hpp"
+#include "thread-sampler.hpp"
 
 using std::string;
 using std::vector;
@@ -80,6 +85,12 @@ static const vector<command_t> commands = {
 
     {{"clear", "cls"}, false, cmd_console_clear, "Clears the screen.", "clear"},
 
+    {{"crash"},
+     false,
+     cmd_crash,
+     "list or clear stored crash records.",
+     "crash [clear]"},
+
     {{"echo"},
      false,
      cmd_console_echo,
@@ -98,6 +109,12 @@ static const vector<command_t> commands = {
      "print this message.",
      "help [{[--list|-l], [--all|-a]}] [<command name>...]"},
 
+    {{"heap"},
+     false,
+     cmd_heap,
+     "show what's allocated on the heap, by what, and how fragmented it is.",
+     "heap [reset]"},
+
     {{"host", "hostname"},
      false,
      cmd_console_hostname,
@@ -116,7 +133,7 @@ static const vector<command_t> commands = {
      false,
      cmd_kicker,
      "control the kicker board.",
-     "kicker {kick, chip, ping, volts, charge <on|off>}"},
+     "kicker {kick, chip, ping, volts, status, charge <on|off>}"},
 
     {{"led"},
      false,
@@ -162,7 +179,8 @@ static const vector<command_t> commands = {
      false,
      cmd_radio,
      "test radio connectivity.",
-     "radio [show, {set {close,reset} <port>, {test-tx,test-rx} [<port>], "
+     "radio [show, stats [reset], "
+     "{set {close,reset} <port>, {test-tx,test-rx} [<port>], "
      "loopback [<count>], "
      "debug, "
      "ping, "
@@ -199,7 +217,19 @@ static const vector<command_t> commands = {
      false,
      cmd_console_user,
      "set the active user.",
-     "su <user>"}};
+     "su <user>"},
+
+    {{"sysid"},
+     false,
+     cmd_sysid,
+     "identify the drive motors and tune their velocity loops to them.",
+     "sysid {start [<wheel>...] [save], stop, show, dump, save}"},
+
+    {{"top"},
+     false,
+     cmd_top,
+     "profile how much CPU each thread uses, and how long they wait to run.",
+     "top [<seconds>]"}};
 
 /**
 * Lists aliases for commands, if args are present, it will only list aliases
@@ -288,6 +318,26 @@ int cmd_console_clear(cmd_args_t& args) {
     return 0;
 }
 
+/**
+ * Lists the crash records stored in flash, or erases them.
+ */
+int cmd_crash(cmd_args_t& args) {
+    if (args.empty()) {
+        CrashLog::Print();
+    } else if (args.size() == 1 && args[0] == "clear") {
+        if (!CrashLog::Clear()) {
+            printf("Unable to erase crash records\r\n");
+            return 1;
+        }
+        printf("Crash records erased\r\n");
+    } else {
+        show_invalid_args(args);
+        return 1;
+    }
+
+    return 0;
+}
+
 /**
  * Echos text.
  */
@@ -710,6 +760,20 @@ int cmd_kicker(cmd_args_t& args) {
             } else {
                 printf("Kicker voltage read success.\r\n");
             }
+        } else if (args[0] == "status") {
+            if (KickerBoard::Instance->update()) {
+                const kicker_status& status = KickerBoard::Instance->status();
+                printf(
+                    "Volts: %u\r\nCharging: %s\r\nCharge enabled: "
+                    "%s\r\nLast kick: %u ms ago\r\nFaults: %02X\r\n",
+                    status.voltage,
+                    (status.flags & KICKER_STATUS_CHARGING) ? "yes" : "no",
+                    (status.flags & KICKER_STATUS_CHARGE_ALLOWED) ? "yes"
+                                                                  : "no",
+                    status.kick_age_ms, status.faults);
+            } else {
+                printf("Kicker status read failure.\r\n");
+            }
         } else if (args[0] == "charge") {
             if (args.size() != 2) {
                 printf("Must specify <on|off>.\r\n");
@@ -946,6 +1010,112 @@ int cmd_ps(cmd_args_t& args) {
     return 0;
 }
 
+int cmd_top(cmd_args_t& args) {
+    if (args.size() > 1) {
+        show_invalid_args(args);
+        return 1;
+    }
+
+    const float seconds = args.empty() ? 1 : atof(args.front().c_str());
+    if (!(seconds > 0 && seconds < 60)) {
+        show_invalid_args(args);
+        return 2;
+    }
+
+    // the console waits while it's profiling, so it'll show up as idle
+    printf("Profiling for %.1f s...\r\n", seconds);
+    Console::Instance()->Flush();
+    ThreadSampler::start();
+    Thread::wait(seconds * 1000);
+
+    ThreadProfiler::Stats stats[ThreadProfiler::MAX_THREADS];
+    uint32_t windowUs;
+    size_t count =
+        ThreadSampler::read(stats, ThreadProfiler::MAX_THREADS, &windowUs);
+    if (count > ThreadProfiler::MAX_THREADS) {
+        count = ThreadProfiler::MAX_THREADS;
+    }
+    ThreadSampler::stop();
+
+    printf("ID\tPRIOR\t CPU\tSWITCH\tWAITED\tWAIT AVG|MAX (us)\r\n");
+    for (size_t i = 0; i < count; i++) {
+        const ThreadProfiler::Stats& s = stats[i];
+
+        // the thread's priority, if it's still around
+        int prio = -1;
+        for (unsigned int t = 0; t < 15; t++) {
+            const P_TCB p = (P_TCB)os_active_TCB[t];
+            if (p && p->task_id == s.id) prio = p->prio;
+        }
+
+        if (s.id == ThreadSampler::IDLE_ID) {
+            printf("idle\t");
+        } else {
+            printf("%-4u\t", s.id);
+        }
+        if (prio >= 0) {
+            printf("  %-3d\t", prio);
+        } else {
+            printf("  -\t");
+        }
+        printf("%5.1f%%\t%-6u\t%-6u\t%-6.0f   %-6u\r\n",
+               100.0f * s.runUs / windowUs, s.switches, s.wakeups,
+               s.meanLatencyUs(), s.latencyMaxUs);
+    }
+    printf("==============\r\nWaits shorter than %u us mostly aren't "
+           "caught.\r\n",
+           ThreadSampler::DEFAULT_PERIOD_US);
+
+    return 0;
+}
+
+int cmd_heap(cmd_args_t& args) {
+    const bool reset = args.size() == 1 && args.front() == "reset";
+    if (!args.empty() && !reset) {
+        show_invalid_args(args);
+        return 1;
+    }
+
+    // copy everything out first, since printing allocates
+    static HeapTracker tracker;
+    HeapMonitor::read(&tracker, reset);
+    const uint32_t now = us_ticker_read();
+    const HeapLayout layout = HeapMonitor::walk();
+
+    printf("In use:\t\t%lu bytes, %lu at most\r\n", tracker.inUse(),
+           tracker.peak());
+    printf("Allocations:\t%lu, %lu freed\r\n", tracker.allocs(),
+           tracker.frees());
+    printf("Rate:\t\t%.1f/s, %.0f bytes/s over the last %.1f s\r\n",
+           tracker.allocRate(now), tracker.byteRate(now),
+           tracker.windowUs(now) / 1e6f);
+    printf("Chunks:\t\t%lu used, %lu bytes\r\n", layout.usedChunks,
+           layout.usedBytes);
+    printf(
+        "Free:\t\t%lu bytes in %lu chunks, %lu at most in one, %lu on "
+        "top\r\n",
+        layout.freeBytes, layout.freeChunks, layout.largestFree,
+        layout.topBytes);
+    printf("Fragmentation:\t%.1f%%\r\n", layout.fragmentation() * 100);
+    if (layout.corrupt) printf("*** the heap's been written over ***\r\n");
+
+    printf("\r\nTAG\t\tALLOCS\tBYTES\tNO-ALLOC\r\n");
+    for (size_t i = 0; i < tracker.tagCount(); i++) {
+        const HeapTracker::TagStats& t = tracker.tagStats(i);
+        printf("%-12s\t%-6lu\t%-6lu\t", t.name, t.allocs, t.bytes);
+        if (t.noAlloc) {
+            printf("%lu allocated\r\n", t.violations);
+        } else {
+            printf("-\r\n");
+        }
+    }
+    if (reset) {
+        printf("==============\r\nThe peak and rates start over now.\r\n");
+    }
+
+    return 0;
+}
+
 int cmd_heapfill(cmd_args_t& args) {
     if (!args.empty()) {
         show_invalid_args(args);
@@ -969,6 +1139,43 @@ int cmd_heapfill(cmd_args_t& args) {
     return 0;
 }
 
+/// Prints the forward link statistics kept by the radio protocol
+static void print_link_stats(const LinkStats& stats) {
+    printf(
+        "Forward packets:\t%lu received, %lu lost, %lu duplicated, %lu "
+        "restarts\r\n"
+        "Recent loss:\t\t%.1f%% of the last %u\r\n",
+        stats.packets, stats.lost, stats.duplicates, stats.resyncs,
+        stats.lossRate() * 100, LinkStats::HISTORY);
+
+    printf("Lost in a row:\t");
+    for (size_t i = 0; i < LinkStats::BURST_BUCKETS; i++) {
+        const unsigned int start = LinkStats::bucketStart(i);
+        if (i + 1 == LinkStats::BURST_BUCKETS) {
+            printf("\t%u+: %lu", start, stats.bursts[i]);
+        } else {
+            const unsigned int end = LinkStats::bucketStart(i + 1) - 1;
+            if (start == end) {
+                printf("\t%u: %lu", start, stats.bursts[i]);
+            } else {
+                printf("\t%u-%u: %lu", start, end, stats.bursts[i]);
+            }
+        }
+    }
+    printf("\r\n\tlongest: %lu\r\n", stats.longestBurst);
+
+    if (stats.hasQuality()) {
+        printf("Signal:\t\t\t%.1f dBm, LQI %.0f\r\n", stats.rssi(),
+               stats.lqi());
+    }
+    if (stats.hasLatency()) {
+        printf("Reply latency:\t\t%.0f us (%.0f - %.0f)\r\n",
+               stats.latencyUs(), stats.minLatencyUs, stats.maxLatencyUs);
+    }
+
+    Console::Instance()->Flush();
+}
+
 int cmd_radio(cmd_args_t& args) {
     shared_ptr<CommModule> commModule = CommModule::Instance;
 
@@ -994,6 +1201,17 @@ int cmd_radio(cmd_args_t& args) {
         if (args[0] == "show") {
             commModule->printInfo();
 
+        } else if (args[0] == "stats") {
+            RadioProtocol* protocol = RadioProtocol::Instance();
+            if (!protocol) {
+                printf("The radio protocol isn't running.\r\n");
+            } else if (args.size() > 1 && args[1] == "reset") {
+                protocol->resetStats();
+                printf("Radio statistics reset.\r\n");
+            } else {
+                print_link_stats(protocol->stats());
+            }
+
         } else if (args[0] == "test-tx") {
             printf("Placing %u byte packet in TX buffer.\r\n",
                    pck.payload.size());
@@ -1188,6 +1406,8 @@ int cmd_imu(cmd_args_t& args) { return 0; }
  * Much of this taken from `console.c` from the old robot firmware (2011).
  */
 void execute_line(char* rawCommand) {
+    HeapTag heapTag("console");
+
     char* endCmd;
     char* cmds = strtok_r(rawCommand, ";", &endCmd);
 
@@ -81,6 +81,7 @@ int cmd_console_echo(cmd_args_t&);
 int cmd_console_exit(cmd_args_t&);
 int cmd_console_hostname(cmd_args_t&);
 int cmd_console_user(cmd_args_t&);
+int cmd_crash(cmd_args_t&);
 int cmd_help(cmd_args_t&);
 int cmd_help_detail(cmd_args_t&);
 int cmd_serial_ping(cmd_args_t&);
@@ -94,9 +95,12 @@ int cmd_log_level(cmd_args_t&);
 int cmd_ls(cmd_args_t&);
 int cmd_ping(cmd_args_t&);
 int cmd_ps(cmd_args_t&);
+int cmd_heap(cmd_args_t&);
 int cmd_heapfill(cmd_args_t& args);
 int cmd_radio(cmd_args_t&);
 int cmd_ping(cmd_args_t&);
 int cmd_pong(cmd_args_t&);
 int cmd_rpc(cmd_args_t&);
+int cmd_sysid(cmd_args_t&);
+int cmd_top(cmd_args_t&);
 int cmd_imu(cmd_args_t&);
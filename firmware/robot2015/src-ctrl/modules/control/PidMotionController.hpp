@@ -3,30 +3,81 @@
 #include <array>
 #include "Pid.hpp"
 #include "RobotModel.hpp"
+#include "motion-profiler.hpp"
 
 /**
- * Robot controller that runs a PID loop on each of the four wheels.
+ * Robot controller that runs a PID loop on each of the four wheels.  The
+ * target velocity goes through a MotionProfiler first, so the wheels are asked
+ * for changes they can actually make.
+ *
+ * Until the base station sends a MotionLimitsMessage, the limits are
+ * DefaultLimits().
  */
 class PidMotionController {
 public:
+    /// Motion limits until the base station sends some.  They haven't been
+    /// tuned on carpet, so they're kept well under the 0.8 g or so that the
+    /// wheels can get out of it before they slip.
+    static constexpr float DEFAULT_ACCEL = 3;       // m/s^2
+    static constexpr float DEFAULT_JERK = 60;       // m/s^3
+    static constexpr float DEFAULT_ROT_ACCEL = 20;  // rad/s^2
+    static constexpr float DEFAULT_ROT_JERK = 400;  // rad/s^3
+
+    static MotionProfiler::Limits DefaultLimits() {
+        return {{DEFAULT_ACCEL, DEFAULT_ACCEL, DEFAULT_ROT_ACCEL},
+                {DEFAULT_JERK, DEFAULT_JERK, DEFAULT_ROT_JERK}};
+    }
+
     PidMotionController() {
         setPidValues(1, 0, 0);
 
         for (auto& ctrl : _controllers) {
             ctrl.setWindup(5);
         }
+
+        setMotionLimits(DefaultLimits());
+    }
+
+    /// Limits for the x, y, and rotation of the target velocity.  Zero turns
+    /// that limit off.
+    void setMotionLimits(const MotionProfiler::Limits& limits) {
+        _profiler.setLimits(limits);
     }
 
     void setPidValues(float p, float i, float d) {
-        for (Pid& ctl : _controllers) {
-            ctl.kp = p;
-            ctl.ki = i;
-            ctl.kd = d;
+        for (size_t wheel = 0; wheel < _controllers.size(); wheel++) {
+            setPidValues(wheel, p, i, d);
         }
     }
 
+    /// Sets the gains for just one wheel, like from system identification
+    void setPidValues(size_t wheel, float p, float i, float d) {
+        Pid& ctl = _controllers[wheel];
+        ctl.kp = p;
+        ctl.ki = i;
+        ctl.kd = d;
+    }
+
+    /// Duty cycle per rad/s of @wheel's speed at the nominal battery voltage,
+    /// which is RobotModel::DutyCycleMultiplier unless it's been measured.
+    /// Zero goes back to that.
+    void setDutyCycleMultiplier(size_t wheel, float multiplier) {
+        _dutyCycleMultipliers[wheel] = multiplier;
+    }
+
+    float dutyCycleMultiplier(size_t wheel) const {
+        // RobotModel2015 might not be initialized yet when this is constructed
+        return _dutyCycleMultipliers[wheel] > 0
+                   ? _dutyCycleMultipliers[wheel]
+                   : RobotModel2015.DutyCycleMultiplier;
+    }
+
     void setTargetVel(Eigen::Vector3f target) { _targetVel = target; }
 
+    /// What to scale the feedforward duty cycles by for the battery voltage,
+    /// see BatteryMonitor::supplyScale()
+    void setSupplyScale(float scale) { _supplyScale = scale; }
+
     /**
      * Return the duty cycle values for the motors to drive at the target
      * velocity.
@@ -44,15 +95,32 @@ public:
             encoderDeltas[3];
         wheelVels *= 2 * M_PI / ENC_TICKS_PER_TURN / dt;
 
+        return run(wheelVels, dt);
+    }
+
+    /**
+     * Same as above, for wheel velocities that have already been worked out.
+     *
+     * @param wheelVels Velocities of the four drive motors, in rad/s
+     * @param dt Time in s since the last call to run()
+     */
+    std::array<int16_t, 4> run(const Eigen::Vector4f& wheelVels, float dt) {
+        // ease into the target
+        const float target[3] = {_targetVel[0], _targetVel[1], _targetVel[2]};
+        float profiled[3];
+        _profiler.update(target, dt, profiled);
+        const Eigen::Vector3f profiledVel(profiled[0], profiled[1],
+                                          profiled[2]);
+
         Eigen::Vector4f targetWheelVels =
-            RobotModel2015.BotToWheel * _targetVel;
+            RobotModel2015.BotToWheel * profiledVel;
 
         Eigen::Vector4f wheelVelErr = targetWheelVels - wheelVels;
 
         std::array<int16_t, 4> dutyCycles;
         for (int i = 0; i < 4; i++) {
             int16_t dc =
-                targetWheelVels[i] * RobotModel2015.DutyCycleMultiplier;
+                targetWheelVels[i] * dutyCycleMultiplier(i) * _supplyScale;
             dc += _controllers[i].run(wheelVelErr[i]);
 
             dutyCycles[i] = dc;
@@ -62,7 +130,6 @@ public:
 // graphed to visualize pid control and debug problems
 #if 0
         printf("{\r\n");
-        printf("'encDelt': [%d, %d, %d, %d],\r\n", encoderDeltas[0], encoderDeltas[1], encoderDeltas[2], encoderDeltas[3]);
         printf("'dt': %f,\r\n", dt);
         printf("'wheelVels': [%f, %f, %f, %f],\r\n", wheelVels[0], wheelVels[1], wheelVels[2], wheelVels[3]);
         printf("'targetWheelVels': [%f, %f, %f, %f],\r\n", targetWheelVels[0], targetWheelVels[1], targetWheelVels[2], targetWheelVels[3]);
@@ -79,5 +146,11 @@ private:
     /// controllers for each wheel
     std::array<Pid, 4> _controllers;
 
-    Eigen::Vector3f _targetVel;
+    /// feedforward for each wheel, or zero for RobotModel's
+    std::array<float, 4> _dutyCycleMultipliers{};
+
+    Eigen::Vector3f _targetVel = Eigen::Vector3f::Zero();
+    float _supplyScale = 1;
+
+    MotionProfiler _profiler;
 };
@@ -7,6 +7,8 @@
 
 #include "commands.hpp"
 #include "fpga.hpp"
+#include "robot-config.hpp"
+#include "rtp.hpp"
 
 namespace {
 const int NUM_MOTORS = 5;
@@ -19,6 +21,20 @@ motor_t mtrEx = {.vel = 0x4D,
 }
 
 std::vector<motor_t> global_motors(NUM_MOTORS, mtrEx);
+MotorProtection global_motor_protection(
+    {RJ_DRIVE_MOTOR_STALL_AMPS, RJ_DRIVE_MOTOR_CONTINUOUS_AMPS,
+     RJ_DRIVE_MOTOR_THERMAL_SECS},
+    {RJ_DRIBBLER_STALL_AMPS, RJ_DRIBBLER_CONTINUOUS_AMPS,
+     RJ_DRIBBLER_THERMAL_SECS});
+
+EncoderMonitor global_encoder_monitor(RJ_ENCODER_TICKS_PER_TURN /
+                                      float(RJ_HALL_COUNTS_PER_TURN));
+
+// the battery sense reading is sent over the radio as the top 8 bits
+BatteryMonitor global_battery_monitor(
+    rtp::RobotStatusMessage::BATTERY_READING_SCALE_FACTOR / 256,
+    {RJ_BATTERY_NOMINAL_VOLTS, RJ_BATTERY_MIN_VOLTS, RJ_BATTERY_RESISTANCE});
+
 int start_s = clock();
 
 void motors_Init() {
@@ -65,27 +81,46 @@ void motors_show() {
         "\033[KLast Update:\t\t%-6.2fms\t%s\033E",
         (static_cast<float>(enc_deltas.back()) * (1 / 18.432) * 2 * 64) / 1000,
         status_byte & 0x40 ? "[EXPIRED]" : "[OK]     ");
-    printf("\033[K    ID\t\tVEL\tHALL\tENC\tDIR\tSTATUS\t\tFAULTS\033E");
+    printf(
+        "\033[K    ID\t\tVEL\tHALL\tENC\tDIR\tSTATUS\t\tFAULTS\tPROTECT"
+        "\t\tHEAT\tENC CHECK\033E");
+    const MotorProtection& protection = global_motor_protection;
+    const EncoderMonitor& monitor = global_encoder_monitor;
     for (size_t i = 0; i < duty_cycles.size() - 1; i++) {
-        printf("\033[K    %s\t%-3d\t%-3u\t%-5d\t%s\t%s\t0x%03X\033E",
-               global_motors[i].desc.c_str(), duty_cycles[i], halls[i],
-               enc_deltas[i], duty_cycles[i] < 0 ? "CW" : "CCW",
-               (status_byte & (1 << i)) ? "[OK]    " : "[UNCONN]",
-               driver_regs[i]);
+        printf(
+            "\033[K    %s\t%-3d\t%-3u\t%-5d\t%s\t%s\t0x%03X\t%-8s\t%3.0f%%"
+            "\t%s\033E",
+            global_motors[i].desc.c_str(), duty_cycles[i], halls[i],
+            enc_deltas[i], duty_cycles[i] < 0 ? "CW" : "CCW",
+            (status_byte & (1 << i)) ? "[OK]    " : "[UNCONN]", driver_regs[i],
+            MotorProtection::StateName(protection.state(i)),
+            protection.heat(i) * 100,
+            monitor.faulted(i) ? "[HALLS]" : "[OK]");
     }
-    printf("\033[K    %s\t%-3u\t%-3u\tN/A\t%s\t%s\t0x%03X\033E",
-           global_motors.back().desc.c_str(), duty_cycles.back() & 0x1FF,
-           halls.back(), duty_cycles.back() < 0 ? "CW" : "CCW",
-           (status_byte & (1 << (enc_deltas.size() - 1))) ? "[OK]    "
-                                                          : "[UNCONN]",
-           driver_regs.back());
+    printf(
+        "\033[K    %s\t%-3u\t%-3u\tN/A\t%s\t%s\t0x%03X\t%-8s\t%3.0f%%\033E",
+        global_motors.back().desc.c_str(), duty_cycles.back() & 0x1FF,
+        halls.back(), duty_cycles.back() < 0 ? "CW" : "CCW",
+        (status_byte & (1 << (enc_deltas.size() - 1))) ? "[OK]    "
+                                                       : "[UNCONN]",
+        driver_regs.back(),
+        MotorProtection::StateName(
+            protection.state(MotorProtection::DRIBBLER)),
+        protection.heat(MotorProtection::DRIBBLER) * 100);
+    printf("\033[K    Stalls since startup: %u\tEncoder faults: %u%s%s\033E",
+           protection.stalls, monitor.faults,
+           RJ_MOTOR_PROTECTION ? "" : "\t(heat is only reported)",
+           RJ_ENCODER_FALLBACK ? "" : "\t(bad encoders are shut off)");
+    const BatteryMonitor& battery = global_battery_monitor;
+    printf("\033[K    Battery: %.1fV\topen %.1fV\t%.0f mohm\033E",
+           battery.volts(), battery.openVolts(), battery.resistance() * 1000);
 }
 
 int cmd_motors_scroll(const std::vector<std::string>& args) {
     motors_show();
 
-    // move cursor back 8 rows
-    printf("\033[%uA", 8);
+    // move cursor back 10 rows
+    printf("\033[%uA", 10);
     Console::Instance()->Flush();
 
     Thread::wait(300);
@@ -4,8 +4,13 @@
 #include <cstdint>
 #include <ctime>
 #include <array>
+#include <string>
 #include <vector>
 
+#include "battery-monitor.hpp"
+#include "encoder-monitor.hpp"
+#include "motor-protection.hpp"
+
 /* Any math using the delta values for the hall/encoder (we really
  * only care about encoder readings...) is best handled through a task
  * queue where the calculations can be managed on the kernel's scheduler.
@@ -41,6 +46,13 @@ struct motor_t {
 // TODO(justin): is there a better solution than having a global variable?
 extern std::vector<motor_t> global_motors;
 
+/// Updated by the control loop every tick
+extern MotorProtection global_motor_protection;
+extern EncoderMonitor global_encoder_monitor;
+
+/// Sampled by a timer in main() and updated by the control loop
+extern BatteryMonitor global_battery_monitor;
+
 void motors_Init();
 uint8_t motors_refresh();
 void motors_show();
@@ -0,0 +1,150 @@
+`timescale 1ns/10ps
+
+`include "Current_Sampler.v"
+
+module Current_Sampler_tb;
+
+localparam NUM_MOTORS = 5;
+localparam NUM_ADCS = 2;
+localparam CURRENT_WIDTH = 8;
+
+reg clk = 0;
+reg en = 0;
+reg start = 0;
+
+wire sck, mosi, miso, busy, done;
+wire [NUM_ADCS-1:0] adc_ncs;
+wire [NUM_MOTORS*CURRENT_WIDTH-1:0] currents;
+
+Current_Sampler #(
+    .NUM_MOTORS     ( NUM_MOTORS    ),
+    .NUM_ADCS       ( NUM_ADCS      ),
+    .CURRENT_WIDTH  ( CURRENT_WIDTH )
+    ) current_sampler (
+    .clk            ( clk           ),
+    .en             ( en            ),
+    .start          ( start         ),
+    .miso           ( miso          ),
+    .sck            ( sck           ),
+    .mosi           ( mosi          ),
+    .adc_ncs        ( adc_ncs       ),
+    .busy           ( busy          ),
+    .done           ( done          ),
+    .currents       ( currents      )
+);
+
+// The readings on each ADC channel, phase A and B of each motor in turn
+reg [11:0] channel_codes [2*NUM_MOTORS-1:0];
+
+// Model of an ADC128S022 for each chip select. DIN is latched on rising edges
+// of SCK, DOUT changes on falling edges, and the conversion in each frame is
+// of the channel addressed in the frame before it.
+reg [15:0] adc_shift_in [NUM_ADCS-1:0];
+reg [15:0] adc_shift_out [NUM_ADCS-1:0];
+reg [2:0] adc_addr [NUM_ADCS-1:0];
+reg [4:0] adc_bit [NUM_ADCS-1:0];
+reg adc_miso [NUM_ADCS-1:0];
+
+assign miso = ( adc_ncs[0] == 0 ) ? adc_miso[0] : ( adc_ncs[1] == 0 ) ? adc_miso[1] : 1'bz;
+
+genvar g;
+generate
+    for (g = 0; g < NUM_ADCS; g = g + 1)
+    begin : ADC_MODELS
+        always @(negedge adc_ncs[g]) begin
+            adc_addr[g] = 0;
+            adc_bit[g] = 0;
+            adc_shift_out[g] = channel_codes[8*g];
+            adc_miso[g] = 0;
+        end
+
+        always @(posedge sck) begin
+            if ( adc_ncs[g] == 0 ) begin
+                adc_shift_in[g] = { adc_shift_in[g][14:0], mosi };
+                adc_bit[g] = adc_bit[g] + 1;
+                if ( adc_bit[g] == 16 ) begin
+                    // next frame converts the channel addressed in this one
+                    adc_addr[g] = adc_shift_in[g][13:11];
+                    adc_bit[g] = 0;
+                    adc_shift_out[g] = ( 8*g + adc_addr[g] < 2*NUM_MOTORS ) ? channel_codes[8*g + adc_addr[g]] : 12'h800;
+                end
+            end
+        end
+
+        always @(negedge sck) begin
+            if ( adc_ncs[g] == 0 ) begin
+                // four leading zeros, then the 12 bit result
+                adc_miso[g] = ( adc_bit[g] < 4 ) ? 1'b0 : adc_shift_out[g][15 - adc_bit[g]];
+            end
+        end
+    end
+endgenerate
+
+// module main clock
+initial begin
+    forever begin
+        #0.5 clk = !clk;
+    end
+end
+
+integer ii, jj, errors;
+reg [CURRENT_WIDTH-1:0] expected [NUM_MOTORS-1:0];
+
+task sweep;
+    begin
+        @(posedge clk) start = 1;
+        @(posedge clk) start = 0;
+        @(posedge done);
+    end
+endtask
+
+// main simulation entry
+initial begin
+    $dumpfile("Current_Sampler_tb-results.vcd");
+    $dumpvars(0, Current_Sampler_tb);
+
+    // half scale is no current, and it goes down as current goes up
+    //   motor 0: no current
+    //   motor 1: 800 codes in A, out B
+    //   motor 2: 400 in A, 400 in B, 800 out C
+    //   motor 3: 1000 out A, 300 in B, so 700 in C
+    //   motor 4: past full scale
+    channel_codes[0] = 12'd2048;    channel_codes[1] = 12'd2048;
+    channel_codes[2] = 12'd1248;    channel_codes[3] = 12'd2848;
+    channel_codes[4] = 12'd1648;    channel_codes[5] = 12'd1648;
+    channel_codes[6] = 12'd3048;    channel_codes[7] = 12'd1748;
+    channel_codes[8] = 12'd0;       channel_codes[9] = 12'd4095;
+
+    expected[0] = 0;
+    expected[1] = 800 >> 3;
+    expected[2] = 800 >> 3;
+    expected[3] = 1000 >> 3;
+    expected[4] = 255;
+
+    #20 en = 1;
+
+    // let the filters settle
+    for (ii = 0; ii < 64; ii = ii + 1) sweep;
+
+    errors = 0;
+    for (jj = 0; jj < NUM_MOTORS; jj = jj + 1) begin
+        $display("motor %0d: current %0d, expected %0d", jj,
+                 currents[CURRENT_WIDTH*jj +: CURRENT_WIDTH], expected[jj]);
+        // the filter can settle a count short
+        if ( ( currents[CURRENT_WIDTH*jj +: CURRENT_WIDTH] > expected[jj] ) ||
+             ( currents[CURRENT_WIDTH*jj +: CURRENT_WIDTH] + 1 < expected[jj] ) ) begin
+            errors = errors + 1;
+        end
+    end
+
+    if ( adc_ncs != 2'b11 ) begin
+        $display("chip selects left low after the sweep");
+        errors = errors + 1;
+    end
+
+    if ( errors == 0 ) $display("PASSED");
+    else $display("FAILED with %0d errors", errors);
+    $finish;
+end
+
+endmodule
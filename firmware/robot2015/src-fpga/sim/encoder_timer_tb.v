@@ -0,0 +1,110 @@
+`timescale 1ns/10ps
+
+`include "BLDC_Encoder_Timer.v"
+
+module BLDC_Encoder_Timer_tb;
+
+localparam AGE_WIDTH = 16;
+localparam PRESCALE = 16;
+
+// the timer sees an edge on the second rising clock after a step, since it
+// syncs the encoder through two flops.  The steps happen on a falling clock,
+// so that's 2.5 clocks, and rounding it up gives the same ages.
+localparam SYNC_CLOCKS = 3;
+
+reg clk = 0;
+reg [1:0] enc = 0;
+wire [AGE_WIDTH-1:0] age;
+
+BLDC_Encoder_Timer #(
+    .AGE_WIDTH      ( AGE_WIDTH     ),
+    .PRESCALE_WIDTH ( 4             )
+    ) encoder_timer (
+    .clk            ( clk           ),
+    .enc            ( enc           ),
+    .age            ( age           )
+);
+
+// module main clock, one clock per time unit
+initial begin
+    forever begin
+        #0.5 clk = !clk;
+    end
+end
+
+integer errors = 0;
+
+// steps the encoder one state forward or back, like quadrature does
+task step;
+    input forward;
+    begin
+        @(negedge clk);
+        case ( { forward, enc } )
+            3'b100: enc = 2'b01;
+            3'b101: enc = 2'b11;
+            3'b111: enc = 2'b10;
+            3'b110: enc = 2'b00;
+            3'b000: enc = 2'b10;
+            3'b010: enc = 2'b11;
+            3'b011: enc = 2'b01;
+            3'b001: enc = 2'b00;
+        endcase
+    end
+endtask
+
+// checks the age @clocks after the last edge
+task expect_age;
+    input integer clocks;
+    begin
+        if ( age != ( clocks - SYNC_CLOCKS ) / PRESCALE ) begin
+            $display("age %0d after %0d clocks, expected %0d", age, clocks, ( clocks - SYNC_CLOCKS ) / PRESCALE);
+            errors = errors + 1;
+        end
+    end
+endtask
+
+// main simulation entry
+initial begin
+    $dumpfile("BLDC_Encoder_Timer_tb-results.vcd");
+    $dumpvars(0, BLDC_Encoder_Timer_tb);
+
+    // nothing yet, so it's saturated
+    #100;
+    if ( age != {AGE_WIDTH{1'b1}} ) begin
+        $display("age %0d before any edges", age);
+        errors = errors + 1;
+    end
+
+    // edges every 1000 clocks forward, then every 333 backward
+    step(1);
+    #1000 expect_age(1000);
+    step(1);
+    #1000 expect_age(1000);
+    step(0);
+    #333 expect_age(333);
+    step(0);
+    #333 expect_age(333);
+
+    // a long stop saturates
+    #(PRESCALE * (1 << AGE_WIDTH) + 100);
+    if ( age != {AGE_WIDTH{1'b1}} ) begin
+        $display("age %0d after a long stop", age);
+        errors = errors + 1;
+    end
+
+    // and it comes right back on the next edge
+    step(1);
+    #50 expect_age(50);
+
+    // the first count lands on the clock that the sync delay says it should,
+    // so a flop too many or too few shows up here
+    step(0);
+    #18 expect_age(18);
+    #1 expect_age(19);
+
+    if ( errors == 0 ) $display("PASSED");
+    else $display("FAILED with %0d errors", errors);
+    $finish;
+end
+
+endmodule
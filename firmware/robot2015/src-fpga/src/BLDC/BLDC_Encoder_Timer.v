@@ -0,0 +1,65 @@
+/*
+*  BLDC_Encoder_Timer.v
+*
+*  Gives the time since the encoder last changed states, for working out the
+*  speed from the time between edges when they're few and far between.
+*
+*  The edge is timestamped at the clock's resolution, and the time since then
+*  counts up once every 2^PRESCALE_WIDTH clocks. It saturates at its maximum
+*  value, which means that there hasn't been an edge in at least that long.
+*
+*  The encoder pins aren't synchronous to clk, so they go through two flops
+*  before the edge is looked for, which puts the timestamp 2 clocks late.
+*
+*/
+
+`ifndef _BLDC_ENCODER_TIMER_
+`define _BLDC_ENCODER_TIMER_
+
+// BLDC_Encoder_Timer module
+module BLDC_Encoder_Timer ( clk, enc, age );
+
+// Module parameters
+parameter AGE_WIDTH         = ( 16 );
+parameter PRESCALE_WIDTH    = (  4 );
+
+// Module inputs/outputs
+input clk;
+input [1:0] enc;
+output reg [AGE_WIDTH-1:0] age = {AGE_WIDTH{1'b1}};
+// ===============================================
+
+
+// Register and Wire declarations
+// ===============================================
+reg [1:0] enc_meta = 0;     // the first flop, which can go metastable
+reg [1:0] enc_s = 0;        // the encoder, synced to clk
+reg [1:0] enc_d = 0;        // enc_s delayed by one clock cycle
+reg [PRESCALE_WIDTH-1:0] prescale = 0;
+
+always @( posedge clk ) begin : SYNC_ENCODER
+    enc_meta <= enc;
+    enc_s <= enc_meta;
+    enc_d <= enc_s;
+end
+
+// any change of state is an edge, whichever way it's going
+wire enc_edge = ( enc_d != enc_s );
+
+
+// Begin main logic
+always @( posedge clk ) begin : ENCODER_TIMER
+    if ( enc_edge ) begin
+        age <= 0;
+        prescale <= 0;
+    end else begin
+        prescale <= prescale + 1;
+        if ( ( prescale == {PRESCALE_WIDTH{1'b1}} ) && ( age != {AGE_WIDTH{1'b1}} ) ) begin
+            age <= age + 1;
+        end
+    end
+end
+
+endmodule
+
+`endif
@@ -14,18 +14,20 @@
 `include "BLDC_Driver.v"
 `include "BLDC_Hall_Counter.v"
 `include "BLDC_Encoder_Counter.v"
+`include "BLDC_Encoder_Timer.v"
 `include "BLDC_Encoder_Checker.v"
 `include "IIR_LowPass_Filter.v"
 
 
 // BLDC_Motor module
-module BLDC_Motor ( clk, en, reset_enc_count, reset_hall_count, duty_cycle, enc, hall, phaseH, phaseL, enc_count, hall_count, has_error );
+module BLDC_Motor ( clk, en, reset_enc_count, reset_hall_count, duty_cycle, enc, hall, phaseH, phaseL, enc_count, enc_age, hall_count, has_error );
 
 // Module parameters - passed parameters will overwrite the values here
 parameter MAX_DUTY_CYCLE =          ( 'h1FF             );
 parameter MAX_DUTY_CYCLE_COUNTER =  ( MAX_DUTY_CYCLE    );
 parameter ENCODER_COUNT_WIDTH =     ( 15                );
 parameter HALL_COUNT_WIDTH =        ( 7                 );
+parameter ENCODER_AGE_WIDTH =       ( 16                );
 
 // Local parameters - can not be altered outside this module
 `include "log2-macro.v"     // This must be included here
@@ -38,6 +40,7 @@ input [1:0] enc;
 input [2:0] hall;
 output [2:0] phaseH, phaseL;
 output signed [ENCODER_COUNT_WIDTH-1:0] enc_count;
+output [ENCODER_AGE_WIDTH-1:0] enc_age;
 output signed [HALL_COUNT_WIDTH-1:0] hall_count;
 output has_error;
 // ===============================================
@@ -71,6 +74,14 @@ BLDC_Hall_Counter #(            // Instantiation of the hall effect sensor's cou
     .count                      ( hall_count_raw            )
 );
 
+BLDC_Encoder_Timer #(           // Instantiation of the timer for the time since the last encoder edge
+    .AGE_WIDTH                  ( ENCODER_AGE_WIDTH         )
+    ) encoder_timer (
+    .clk                        ( clk                       ) ,
+    .enc                        ( enc                       ) ,
+    .age                        ( enc_age                   )
+);
+
 IIR_LowPass_Filter #(           // IIR filter for the encoder count value
     .WIDTH                      ( ENCODER_COUNT_WIDTH       ) ,
     .GAIN                       ( 5                         )
@@ -0,0 +1,234 @@
+/*
+*  Current_Sampler.v
+*
+*  Reads the phase currents of each motor from the DRV8303 shunt amplifiers
+*  through the external ADCs, and gives a filtered current for each motor.
+*
+*  The ADCs are 8 channel, 12 bit ADC128S022s (or anything that talks the same
+*  way). Each 16 bit frame sends the address of the channel to convert next and
+*  returns the conversion of the channel addressed in the frame before it, so
+*  the first result from each chip is thrown out and one extra frame at the end
+*  picks up the last one. The chip select for a chip stays low for its whole
+*  sweep.
+*
+*  Phases A and B of motor i are on channels 2*i and 2*i+1, counting up across
+*  the chips. The amplifiers sit at half scale with no current, so the motor's
+*  current is the biggest of |A|, |B|, and |A+B| (phase C) away from there,
+*  which is the current through the two phases that are driven. That goes
+*  through an IIR filter and comes out as CURRENT_WIDTH bits, in steps of
+*  2^CURRENT_SHIFT ADC codes.
+*
+*  A sweep is started with START and takes over the SPI master pins until it
+*  pulses DONE, so it can share the bus with the DRV8303 configuration.
+*
+*  The ADC part and the channel mapping haven't been checked against the board
+*  yet, so the firmware only reports these currents until they have, see
+*  RJ_CURRENT_LOOP in robot-config.hpp.
+*/
+
+`ifndef _CURRENT_SAMPLER_
+`define _CURRENT_SAMPLER_
+
+`include "SPI_Master.v"
+`include "IIR_LowPass_Filter.v"
+
+module Current_Sampler
+#(
+    parameter NUM_MOTORS    =   ( 5  ),
+    parameter NUM_ADCS      =   ( 2  ),
+    parameter ADC_CHANNELS  =   ( 8  ),
+    parameter CURRENT_WIDTH =   ( 8  ),
+    parameter CURRENT_SHIFT =   ( 3  ),
+    parameter FILTER_GAIN   =   ( 3  )
+) (
+    input clk, en, start, miso,
+    output sck, mosi,
+    output reg [NUM_ADCS-1:0] adc_ncs = ~0,
+    output busy,
+    output reg done = 0,
+    // motor i's current is in bits [CURRENT_WIDTH*(i+1)-1 : CURRENT_WIDTH*i]
+    output [NUM_MOTORS*CURRENT_WIDTH-1:0] currents
+);
+
+// Local parameters that can not be altered outside of this file
+// ===============================================
+localparam NUM_CHANNELS     = 2 * NUM_MOTORS;
+localparam ADC_WIDTH        = 12;
+localparam ADC_MIDSCALE     = 1 << (ADC_WIDTH - 1);
+localparam MAG_WIDTH        = ADC_WIDTH + 2;    // |A+B| can be twice full scale, plus a sign bit
+localparam SPI_DATA_WIDTH   = 16;
+
+localparam STATE_IDLE       = 0;
+localparam STATE_START      = 1;
+localparam STATE_TRANSFER   = 2;
+localparam STATE_NEXT       = 3;
+
+
+// Register and Wire declarations
+// ===============================================
+reg [1:0] state = STATE_IDLE;
+reg [3:0] adc_num = 0;          // which chip is being swept
+reg [4:0] frame = 0;            // frame number within the chip's sweep
+reg spi_start = 0;
+
+wire spi_busy, spi_valid, spi_sel;
+wire [SPI_DATA_WIDTH-1:0] spi_do;
+
+// channels on the chip being swept, and the frames it takes to get them all
+wire [4:0] adc_first_ch     = adc_num * ADC_CHANNELS;
+wire [4:0] adc_num_ch       = ( NUM_CHANNELS - adc_first_ch > ADC_CHANNELS ) ? ADC_CHANNELS : NUM_CHANNELS - adc_first_ch;
+wire last_frame             = ( frame == adc_num_ch );
+wire last_adc               = ( adc_first_ch + adc_num_ch == NUM_CHANNELS );
+
+// the address of the channel to convert goes in bits 13:11 of the frame
+wire [2:0] next_addr        = last_frame ? 3'd0 : frame[2:0];
+wire [SPI_DATA_WIDTH-1:0] spi_di = { 2'b00, next_addr, 11'b0 };
+
+// the result coming back is for the channel addressed in the last frame
+wire [4:0] result_ch        = adc_first_ch + frame - 1;
+wire signed [MAG_WIDTH-1:0] result = ADC_MIDSCALE - spi_do[ADC_WIDTH-1:0];
+
+// shift register for detecting the falling edge of spi_busy
+reg [1:0] spi_busy_sr = 0;  always @(posedge clk) spi_busy_sr <= { spi_busy_sr[0], spi_busy };
+wire spi_done_flag = ( spi_busy_sr == 2'b10 );
+
+// the last reading of phase A for each motor, and the magnitude once phase B
+// comes in
+reg signed [MAG_WIDTH-1:0] phase_a [NUM_MOTORS-1:0];
+reg signed [MAG_WIDTH-1:0] magnitude [NUM_MOTORS-1:0];
+reg [NUM_MOTORS-1:0] sample_rdy = 0;
+
+assign busy = ( state != STATE_IDLE );
+
+
+// Functions
+// ===============================================
+function signed [MAG_WIDTH-1:0] abs_val;
+    input signed [MAG_WIDTH-1:0] value;
+    begin
+        abs_val = ( value < 0 ) ? -value : value;
+    end
+endfunction
+
+function signed [MAG_WIDTH-1:0] max3;
+    input signed [MAG_WIDTH-1:0] a, b, c;
+    begin
+        max3 = a;
+        if ( b > max3 ) max3 = b;
+        if ( c > max3 ) max3 = c;
+    end
+endfunction
+
+
+// Instantiation of all the modules required for sampling
+// ===============================================
+SPI_Master #(
+    .DATA_BIT_WIDTH         ( SPI_DATA_WIDTH    )
+    ) spi_master (
+    .clk                    ( clk               ) ,
+    .EN                     ( en                ) ,
+    .SCK                    ( sck               ) ,
+    .MOSI                   ( mosi              ) ,
+    .MISO                   ( miso              ) ,
+    .SEL                    ( spi_sel           ) ,
+    .START                  ( spi_start         ) ,
+    .BUSY                   ( spi_busy          ) ,
+    .VALID                  ( spi_valid         ) ,
+    .DATA_OUT               ( spi_do            ) ,
+    .DATA_IN                ( spi_di            )
+);
+
+genvar i;
+generate
+    for (i = 0; i < NUM_MOTORS; i = i + 1)
+    begin : CURRENT_FILTERS
+        wire signed [MAG_WIDTH-1:0] filtered;
+
+        IIR_LowPass_Filter #(
+            .WIDTH          ( MAG_WIDTH         ) ,
+            .GAIN           ( FILTER_GAIN       )
+            ) current_filterer (
+            .clk            ( clk               ) ,
+            .reset          ( ~en               ) ,
+            .en             ( sample_rdy[i]     ) ,
+            .in             ( magnitude[i]      ) ,
+            .out            ( filtered          )
+        );
+
+        // scale it down, saturating at the top
+        assign currents[CURRENT_WIDTH*(i+1)-1:CURRENT_WIDTH*i] =
+            ( filtered >= (1 << (CURRENT_WIDTH + CURRENT_SHIFT)) ) ? {CURRENT_WIDTH{1'b1}} : filtered[CURRENT_WIDTH+CURRENT_SHIFT-1:CURRENT_SHIFT];
+    end
+endgenerate
+
+
+// Begin main logic
+always @( posedge clk ) begin : SWEEP_CHANNELS
+    done <= 0;
+    sample_rdy <= 0;
+
+    if ( en != 1 ) begin
+        state <= STATE_IDLE;
+        adc_ncs <= ~0;
+        spi_start <= 0;
+    end else begin
+        case ( state )
+            STATE_IDLE:
+            begin
+                if ( start == 1 ) begin
+                    adc_num <= 0;
+                    frame <= 0;
+                    adc_ncs <= ~1;
+                    state <= STATE_START;
+                end
+            end
+
+            STATE_START:
+            begin
+                // hold the start line up until the transfer begins
+                spi_start <= 1;
+                if ( spi_busy == 1 ) begin
+                    spi_start <= 0;
+                    state <= STATE_TRANSFER;
+                end
+            end
+
+            STATE_TRANSFER:
+            begin
+                if ( spi_done_flag == 1 ) begin
+                    if ( frame != 0 ) begin
+                        if ( result_ch[0] == 0 ) begin
+                            phase_a[result_ch >> 1] <= result;
+                        end else begin
+                            magnitude[result_ch >> 1] <= max3( abs_val(phase_a[result_ch >> 1]), abs_val(result), abs_val(phase_a[result_ch >> 1] + result) );
+                            sample_rdy[result_ch >> 1] <= 1;
+                        end
+                    end
+                    state <= STATE_NEXT;
+                end
+            end
+
+            STATE_NEXT:
+            begin
+                if ( last_frame == 0 ) begin
+                    frame <= frame + 1;
+                    state <= STATE_START;
+                end else if ( last_adc == 0 ) begin
+                    // on to the next chip
+                    adc_num <= adc_num + 1;
+                    frame <= 0;
+                    adc_ncs <= ~(1 << (adc_num + 1));
+                    state <= STATE_START;
+                end else begin
+                    adc_ncs <= ~0;
+                    done <= 1;
+                    state <= STATE_IDLE;
+                end
+            end
+        endcase
+    end
+end
+
+endmodule
+
+`endif
@@ -9,6 +9,7 @@
 `include "BLDC_Motor.v"
 `include "SPI_Slave.v"
 `include "SPI_Master.v"
+`include "Current_Sampler.v"
 `include "ClkDivide.v"
 
 `ifndef __SIMULATION__
@@ -63,6 +64,8 @@ integer j, k;
 // Derived parameters
 localparam ENCODER_COUNT_WIDTH          =   ( 16 );
 localparam HALL_COUNT_WIDTH             =   (  8 );
+localparam CURRENT_WIDTH                =   (  8 );
+localparam ENCODER_AGE_WIDTH            =   ( 16 );     // KEEP THIS AT 16 to make things easy for the SPI_Slave
 localparam DUTY_CYCLE_WIDTH             =   ( 10 );
 localparam STARTUP_DELAY_WIDTH          =   (  5 );
 localparam DRIBBLER_INDEX               =   ( NUM_MOTORS - 1 );
@@ -118,6 +121,10 @@ wire [ 1:0 ]                adc_ncs_o;
 wire                        spi_slave_miso_o,
                             spi_master_sck_o,
                             spi_master_mosi_o;
+// The current sampler has the SPI master pins while it's busy
+wire                        current_sampler_busy,
+                            current_sampler_sck_o,
+                            current_sampler_mosi_o;
 
 // Sync all of the output pins for the same reasons we sync all of the input pins - this time in reverse
 always @( posedge sysclk )
@@ -132,8 +139,8 @@ begin : SYNC_OUTPUTS
     // SPI Master outputs
     drv_ncs             <=  drv_ncs_o;
     adc_ncs             <=  adc_ncs_o;
-    spi_master_sck      <=  spi_master_sck_o;
-    spi_master_mosi     <=  spi_master_mosi_o;
+    spi_master_sck      <=  current_sampler_busy ? current_sampler_sck_o  : spi_master_sck_o;
+    spi_master_mosi     <=  current_sampler_busy ? current_sampler_mosi_o : spi_master_mosi_o;
 end
 
 // Small startup delay
@@ -147,6 +154,8 @@ assign spi_slave_miso = ( spi_slave_ncs_s == 1 ? 1'bZ : spi_slave_miso_o );
 // Internal logic declarations
 wire [ ENCODER_COUNT_WIDTH  - 1:0 ] enc_count        [ NUM_ENCODERS  - 1:0 ];
 wire [ HALL_COUNT_WIDTH     - 1:0 ] hall_count       [ NUM_HALL_SENS - 1:0 ];
+wire [ CURRENT_WIDTH        - 1:0 ] motor_current    [ NUM_MOTORS    - 1:0 ];
+wire [ ENCODER_AGE_WIDTH    - 1:0 ] enc_age          [ NUM_ENCODERS  - 1:0 ];
 wire [ NUM_HALL_SENS        - 1:0 ] motor_has_error;
 reg  [ DUTY_CYCLE_WIDTH     - 1:0 ] duty_cycle       [ NUM_MOTORS    - 1:0 ];
 reg  [ WATCHDOG_TIMER_WIDTH - 1:0 ] watchdog_timer   [1:0];
@@ -184,9 +193,10 @@ localparam CMD_GATE_DRV_STATUS  = CMD_RW_TYPE_BASE + 6;
 localparam CMD_STROBE_START         = CMD_RW_TYPE_BASE + 'h10;
 localparam CMD_TOGGLE_MOTOR_EN      = CMD_RW_TYPE_BASE + CMD_STROBE_START;
 // Response & request buffer sizes
-localparam SPI_SLAVE_RES_BUF_LEN = 12;
+localparam SPI_SLAVE_RES_BUF_LEN = 29;
 localparam SPI_SLAVE_REQ_BUF_LEN = SPI_SLAVE_RES_BUF_LEN;
-localparam SPI_SLAVE_COUNTER_WIDTH = `LOG2(SPI_SLAVE_RES_BUF_LEN);
+// One more bit so the byte count doesn't wrap after a full length transfer
+localparam SPI_SLAVE_COUNTER_WIDTH = `LOG2(SPI_SLAVE_RES_BUF_LEN) + 1;
 
 // These are for triggering the storage of values outside of the SPI's SCK domain
 reg                                     rx_vals_flag            = 0,
@@ -234,6 +244,40 @@ SPI_Master spi_master_module (
     .DATA_IN        ( spi_master_di         )
 );
 
+// The current sampler takes a turn on the SPI master pins after each round of
+// reading the DRV8303 status registers, then hands them back
+reg current_sweep_start = 0;
+wire current_sweep_done;
+wire [ NUM_MOTORS*CURRENT_WIDTH - 1:0 ] motor_currents_flat;
+
+Current_Sampler #(
+    .NUM_MOTORS     ( NUM_MOTORS                ) ,
+    .NUM_ADCS       ( 2                         ) ,
+    .CURRENT_WIDTH  ( CURRENT_WIDTH             )
+    ) current_sampler (
+    .clk            ( sysclk                    ) ,
+    .en             ( sys_rdy                   ) ,
+    .start          ( current_sweep_start       ) ,
+    .miso           ( spi_master_miso_s         ) ,
+    .sck            ( current_sampler_sck_o     ) ,
+    .mosi           ( current_sampler_mosi_o    ) ,
+    .adc_ncs        ( adc_ncs_o                 ) ,
+    .busy           ( current_sampler_busy      ) ,
+    .done           ( current_sweep_done        ) ,
+    .currents       ( motor_currents_flat       )
+);
+
+generate
+    for (i = 0; i < NUM_MOTORS; i = i + 1)
+    begin : UNPACK_CURRENTS
+        assign motor_current[i] = motor_currents_flat[CURRENT_WIDTH*(i+1)-1:CURRENT_WIDTH*i];
+    end
+endgenerate
+
+// Set when the gate drivers need to be configured while the current sampler
+// has the bus
+reg gate_drivers_config_pending = 0;
+
 // The DRV8303 config values we write to each driver
 reg [SPI_MASTER_DATA_WIDTH-1:0] spi_master_data_array_out [2:0];
 reg [11:0] spi_master_data_array_in  [NUM_MOTORS - 1:0];
@@ -298,12 +342,18 @@ wire gate_drivers_set_config;
 
 always @(posedge sysclk)
 begin : SPI_MASTER_COMM
+    // wait for the current sampler to give up the bus before configuring
+    if ( ( gate_drivers_set_config == 1 ) && ( current_sampler_busy == 1 ) ) begin
+        gate_drivers_config_pending <= 1;
+    end
+
     // if spi master transfer complete
     if ( sys_begin_startup == 1 ) begin
         // flag the system as ready for all of the other areas of the Verilog
         // ** this will start the initial gate driver configurations **
         sys_rdy <= 1;
-    end else if ( gate_drivers_set_config == 1 ) begin
+    end else if ( ( ( gate_drivers_set_config == 1 ) || ( gate_drivers_config_pending == 1 ) ) && ( current_sampler_busy == 0 ) ) begin
+        gate_drivers_config_pending <= 0;
         // start the first SPI master transfer out
         spi_master_start <= 1;
         // set the config values for each driver here
@@ -348,6 +398,11 @@ begin : SPI_MASTER_COMM
                             spi_master_data_array_out[1] <= (1 << 15) | (1 << 11);
                             // disable & exit the config state
                             spi_master_config_state <= 0;
+                        end else begin
+                            // hand the bus over to the current sampler for a sweep, and pick
+                            // back up once it's done
+                            spi_master_start <= 0;
+                            current_sweep_start <= 1;
                         end
                     end else begin
                         // select the next in line SPI device we will communicate with
@@ -367,8 +422,12 @@ begin : SPI_MASTER_COMM
             end
         end
 
+    end else if ( current_sweep_done == 1 ) begin
+        spi_master_start <= 1;
+
     end else begin
         spi_master_start <= 0;
+        current_sweep_start <= 0;
     end
 end
 
@@ -451,6 +510,21 @@ begin : SPI_SLAVE_LOAD_RESPONSE_BUFFER
                     // The latched watchdog timer count
                     spi_slave_res_buf[2*NUM_ENCODERS+1] <= watchdog_timer[1][WATCHDOG_TIMER_WIDTH - 1 : (WATCHDOG_TIMER_WIDTH - SPI_SLAVE_DATA_WIDTH )];
                     spi_slave_res_buf[2*NUM_ENCODERS+2] <= watchdog_timer[1][(WATCHDOG_TIMER_WIDTH - SPI_SLAVE_DATA_WIDTH - 1) : 0];
+                    // The hall counts and then the motor currents come after, for when the master clocks out extra bytes for them
+                    for (j = 0; j < NUM_HALL_SENS; j = j + 1)
+                    begin : LATCH_HALL_COUNTS_ON_UPDATE
+                        spi_slave_res_buf[2*NUM_ENCODERS+3+j]   <=  hall_count[j][HALL_COUNT_WIDTH-1:0];
+                    end
+                    for (j = 0; j < NUM_MOTORS; j = j + 1)
+                    begin : LATCH_CURRENTS_ON_UPDATE
+                        spi_slave_res_buf[2*NUM_ENCODERS+3+NUM_HALL_SENS+j] <=  motor_current[j];
+                    end
+                    // Then the time since each encoder's last edge, for velocity from the time between edges
+                    for (j = 0; j < NUM_ENCODERS; j = j + 1)
+                    begin : LATCH_ENC_AGES_ON_UPDATE
+                        spi_slave_res_buf[2*NUM_ENCODERS+3+NUM_HALL_SENS+NUM_MOTORS+2*j]    <=  enc_age[j][ENCODER_AGE_WIDTH-1:SPI_SLAVE_DATA_WIDTH];
+                        spi_slave_res_buf[2*NUM_ENCODERS+3+NUM_HALL_SENS+NUM_MOTORS+2*j+1]  <=  enc_age[j][SPI_SLAVE_DATA_WIDTH-1:0];
+                    end
                     motor_update_flag <= 1;
                 end
 
@@ -567,9 +641,11 @@ begin : SPI_SORT_REQUEST_BUFFER
                      * Only update the duty cycles if the transfer is what we
                      * expected. The results in the real world could end badly
                      * if the user flips the top and low bytes of the duty
-                     * cycle, so don't do that.
+                     * cycle, so don't do that. The hall counts, the motor
+                     * currents, and the encoder edge times can be read out
+                     * with extra bytes after the duty cycles.
                      */
-                    if ( spi_slave_byte_count == (2 * NUM_MOTORS) ) begin
+                    if ( ( spi_slave_byte_count == (2 * NUM_MOTORS) ) || ( spi_slave_byte_count == (2 * NUM_MOTORS + NUM_HALL_SENS) ) || ( spi_slave_byte_count == (3 * NUM_MOTORS + NUM_HALL_SENS) ) || ( spi_slave_byte_count == (3 * NUM_MOTORS + NUM_HALL_SENS + 2 * NUM_ENCODERS) ) ) begin
                         // Set the new duty_cycle values
                         for ( j = 0; j < NUM_MOTORS; j = j + 1 )
                         begin : UPDATE_DUTY_CYCLES
@@ -628,7 +704,8 @@ generate
         BLDC_Motor #(
             .MAX_DUTY_CYCLE         ( `MAX_VALUE( DUTY_CYCLE_WIDTH )) ,
             .ENCODER_COUNT_WIDTH    ( ENCODER_COUNT_WIDTH           ) ,
-            .HALL_COUNT_WIDTH       ( HALL_COUNT_WIDTH              )
+            .HALL_COUNT_WIDTH       ( HALL_COUNT_WIDTH              ) ,
+            .ENCODER_AGE_WIDTH      ( ENCODER_AGE_WIDTH             )
             ) motor (
             .clk                    ( sysclk                        ) ,
             .en                     ( motors_en & sys_rdy           ) ,
@@ -640,6 +717,7 @@ generate
             .phaseH                 ( phaseH_o[i]                   ) ,
             .phaseL                 ( phaseL_o[i]                   ) ,
             .enc_count              ( enc_count[i]                  ) ,
+            .enc_age                ( enc_age[i]                    ) ,
             .hall_count             ( hall_count[i]                 ) ,
             .has_error              ( motor_has_error[i]            )
         );
@@ -2,54 +2,23 @@
 
 #include <avr/interrupt.h>
 #include <avr/io.h>
-#include <util/delay.h>
+#include <avr/sleep.h>
 
 #include "kicker_commands.h"
+#include "kicker_control.h"
 #include "pins.h"
 
-#define NO_COMMAND 0
-
+// Timer 0 counts to this at 1 MHz / 8 for a 1 ms tick
 #define TIMING_CONSTANT 125
-#define VOLTAGE_READ_DELAY_MS 40
-#define VOLTAGE_CUTOFF 100
-
-// Used to time kick and chip durations
-volatile unsigned millis_left_ = 0;
 
 // Used to keep track of current button state
 /* volatile int kick_db_held_down_ = 0; */
 /* volatile int chip_db_down_ = 0; */
 /* volatile int charge_db_down_ = 0; */
 
-volatile uint8_t byte_cnt = 0;
-
-volatile uint8_t cur_command_ = NO_COMMAND;
-
-// always up-to-date voltage so we don't have to get_voltage() inside interupts
-volatile uint8_t last_voltage_ = 0;
-
-volatile bool charge_allowed_ = false;
-
-// executes a command coming from SPI
-uint8_t execute_cmd(uint8_t, uint8_t);
-
-/* Voltage Function */
-uint8_t get_voltage() {
-    // Start conversation by writing to start bit
-    ADCSRA |= _BV(ADSC);
-
-    // Wait for ADSC bit to clear
-    while (ADCSRA & _BV(ADSC))
-        ;
-
-    // ADHC will go from 0 to 255 corresponding to 0 through VCC
-    return ADCH;
-}
-
-/*
- * Returns true if charging is currently active
- */
-bool is_charging() { return PORTA & _BV(CHARGE_PIN); }
+// Only touched from interrupts, which don't nest, so none of the ISRs can see
+// it half updated
+kicker_state state_;
 
 /*
  * Returns true if the chip's SPI slave interface is currently
@@ -57,9 +26,23 @@ bool is_charging() { return PORTA & _BV(CHARGE_PIN); }
  */
 bool is_chip_selected() { return !(PINA & _BV(N_KICK_CS_PIN)); }
 
+/*
+ * Copies the kick, chip, and charge outputs from the control logic to their
+ * pins.
+ */
+void apply_outputs() {
+    uint8_t port = PORTA & ~(_BV(KICK_PIN) | _BV(CHIP_PIN) | _BV(CHARGE_PIN));
+    if (state_.outputs & KICKER_OUT_KICK) port |= _BV(KICK_PIN);
+    if (state_.outputs & KICKER_OUT_CHIP) port |= _BV(CHIP_PIN);
+    if (state_.outputs & KICKER_OUT_CHARGE) port |= _BV(CHARGE_PIN);
+    PORTA = port;
+}
+
 void main() {
+    kicker_init(&state_);
+
     // make sure we're not kicking/chipping right off the start
-    PORTA &= ~(_BV(KICK_PIN) | _BV(CHIP_PIN));
+    PORTA &= ~(_BV(KICK_PIN) | _BV(CHIP_PIN) | _BV(CHARGE_PIN));
 
     // ensure KICK_PIN, CHIP_PIN, and CHARGE_PIN are outputs
     DDRA |= _BV(KICK_PIN) | _BV(CHIP_PIN) |
@@ -104,76 +87,76 @@ void main() {
     // if we prescale by 8, then we need 125 on timer to get 1 ms exactly
     OCR0A = TIMING_CONSTANT;  // reset every millisecond
 
+    // the millisecond tick runs all the time, kicks line it up when they
+    // start.  /8 prescale.
+    TCCR0B |= _BV(CS01);
+
     // ADC Initialization
     PRR &= ~_BV(PRADC);    // disable power reduction - Pg. 133
-    ADCSRA |= _BV(ADEN);   // enable the ADC - Pg. 133
     ADCSRB |= _BV(ADLAR);  // present left adjusted
     // because we left adjusted and only need 8 bit precision,
     // we can now read ADCH directly
 
+    // Free running conversions (ADTS = 0) with an interrupt after each one.
+    // 1 MHz / 32 gives a 31.25 kHz ADC clock, and a conversion takes 13 of
+    // those, so there's a new sample every 416 us.  That leaves plenty of
+    // cycles between samples for the SPI and timer interrupts.
+    ADCSRB &= ~(_BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0));
+    ADCSRA = _BV(ADEN)      // enable the ADC - Pg. 133
+             | _BV(ADATE)   // auto trigger, free running
+             | _BV(ADIE)    // interrupt when a conversion completes
+             | _BV(ADPS2) | _BV(ADPS0);  // /32 prescale
+
+    // the first byte of every status block, ready for the first transfer
+    USIDR = kicker_spi_deselect(&state_);
+
     // enable global interrupts
     sei();
 
-    // needs to be int to force voltage_accum calculation to use ints
-    const int kalpha = 32;
+    // start the first conversion, the rest follow on their own
+    ADCSRA |= _BV(ADSC);
 
-    // We handle voltage readings here
+    // Everything happens in interrupts, the ADC keeps running while idle
+    set_sleep_mode(SLEEP_MODE_IDLE);
     while (true) {
-        // get a voltage reading by weighing in a new reading, same concept as
-        // TCP RTT estimates (exponentially weighted sum)
-        last_voltage_ = get_voltage();
-        int voltage_accum =
-            (255 - kalpha) * last_voltage_ + kalpha * get_voltage();
-        last_voltage_ = voltage_accum / 255;
-
-        if (charge_allowed_ && last_voltage_ < VOLTAGE_CUTOFF) {
-            PORTA |= _BV(CHARGE_PIN);
-        } else {
-            PORTA &= ~(_BV(CHARGE_PIN));
-        }
-
-        _delay_ms(VOLTAGE_READ_DELAY_MS);
+        sleep_mode();
     }
 }
 
 /*
- * SPI Start Interrupt, this should never get called when chip select is high.
+ * ADC conversion complete.  Filters the new voltage reading and cuts off the
+ * charger as soon as the filtered voltage hits the cutoff.
+ */
+ISR(ADC_vect) {
+    kicker_adc_sample(&state_, ADCH);
+    apply_outputs();
+}
+
+/*
+ * SPI byte complete.  The USI counter overflows after the 16 clock edges of a
+ * byte, so this only runs once the whole byte has been shifted in and never
+ * has to wait on the bus.
  *
- * NOTE: This is intentionally not done with an overflow interrupt,
- * as the software chip select interrupt will be triggered almost at
- * the same time as an SPI overflow, causing the SPI interrupt to not be
- * handled.
+ * The chip select interrupt has a higher priority, so if both are pending at
+ * the end of a transfer, the byte is handled after the transfer state has
+ * already been reset and its response is simply never clocked out.
  */
-ISR(USI_STR_vect, ISR_BLOCK) {
-    // wait for overflow flag to become 1
-    while (!(USISR & _BV(USIOIF)))
-        ;
-
-    // get data from USIDR
-    uint8_t recv_data = USIDR;
-
-    // clear the SPI start flag
-    USISR |= _BV(USISIF);
-    // clear the overflow flag
-    USISR |= _BV(USIOIF);
-
-    // increment our received byte count and take appropiate action
-    byte_cnt++;
-    if (byte_cnt == 1) {
-        // we don't have a command already, set the response
-        // buffer to the command we received to let the
-        // master confirm the given command if desired, top
-        // bit is set if currently charging
-        cur_command_ = recv_data;
-        USIDR = cur_command_;
-    } else if (byte_cnt == 2) {
-        // execute the currently set command with
-        // the newly given argument, set the response
-        // buffer to our return value
-        USIDR = execute_cmd(cur_command_, recv_data);
-    } else {
-        USIDR = 0x11;
+ISR(USI_OVF_vect) {
+    const uint8_t recv_data = USIBR;
+
+    // load the response for the next byte before the master starts clocking
+    USIDR = kicker_spi_byte(&state_, recv_data);
+
+    // clear the overflow flag, which also resets the counter
+    USISR = _BV(USIOIF);
+
+    if (state_.kick_started) {
+        // restart the millisecond tick so the kick lasts the full time
+        state_.kick_started = false;
+        TCNT0 = 0;
+        TIFR0 = _BV(OCF0A);
     }
+    apply_outputs();
 }
 
 /*
@@ -188,8 +171,8 @@ void clear_spi_state() {
  * Initializes the USICR for three wire SPI.
  */
 void turn_on_spi() {
-    USICR = (1 << USISIE)    // enable start condition interrupt enable
-            | (0 << USIOIE)  // disable overflow interrupt for now
+    USICR = (0 << USISIE)    // no start condition interrupt
+            | (1 << USIOIE)  // interrupt once a whole byte is in
             | (0 << USIWM1)  // set to three wire mode (normal SPI)
             | (1 << USIWM0) |
             (1 << USICS1)    // next three bits define how clock works
@@ -211,10 +194,9 @@ void turn_off_spi() { USICR = 0; }
  * ISR for PCINT0 - PCINT7
  */
 ISR(PCINT0_vect) {
-    cur_command_ = NO_COMMAND;
-    byte_cnt = 0;
-
     if (is_chip_selected()) {
+        kicker_spi_select(&state_);
+
         // set the slave data out pin as an output
         turn_on_spi();
         clear_spi_state();
@@ -224,11 +206,7 @@ ISR(PCINT0_vect) {
         turn_off_spi();
         DDRA &= ~_BV(KCKR_MISO_PIN);
 
-        if (is_charging()) {
-            USIDR = ISCHARGING;
-        } else {
-            USIDR = NOTCHARGING;
-        }
+        USIDR = kicker_spi_deselect(&state_);
     }
 }
 
@@ -252,18 +230,18 @@ ISR(PCINT0_vect) {
  */
 /*     // to be HIGH */
 /*     if (!kick_db_held_down_ && kick_db_pressed) */
-/*         execute_cmd(KICK_CMD, DB_KICK_TIME); */
+/*         kicker_execute(&state_, KICK_CMD, DB_KICK_TIME); */
 
-/*     if (!chip_db_down_ && chip_db_pressed) execute_cmd(CHIP_CMD, */
-/*     DB_CHIP_TIME); */
+/*     if (!chip_db_down_ && chip_db_pressed) */
+/*         kicker_execute(&state_, CHIP_CMD, DB_CHIP_TIME); */
 
 /*     // toggle charge */
 /*     if (!charge_db_down_ && charge_db_pressed) { */
 /*         // check if charge is on */
 /*         if (PINA & _BV(CHARGE_PIN)) { */
-/*             execute_cmd(SET_CHARGE_CMD, OFF_ARG); */
+/*             kicker_execute(&state_, SET_CHARGE_CMD, OFF_ARG); */
 /*         } else { */
-/*             execute_cmd(SET_CHARGE_CMD, ON_ARG); */
+/*             kicker_execute(&state_, SET_CHARGE_CMD, ON_ARG); */
 /*         } */
 /*     } */
 
@@ -274,72 +252,11 @@ ISR(PCINT0_vect) {
 /* } */
 
 /*
- * Timer interrupt for chipping/kicking - called every millisecond by timer
+ * Millisecond tick, times kicks and chips
  *
  * ISR for TIMER 0
  */
 ISR(TIM0_COMPA_vect) {
-    // decrement ms counter
-    millis_left_--;
-
-    // if the counter hits 0, clear the kick/chip pin state
-    if (!millis_left_) {
-        // could be kicking or chipping, clear both
-        PORTA &= ~(_BV(KICK_PIN) | _BV(CHIP_PIN));
-        // stop prescaled timer
-        TCCR0B &= ~_BV(CS01);
-    }
-}
-
-/*
- * Executes a command that can come from SPI or a debug button
- *
- * WARNING: This will be called from an interrupt service routines, keep it
- * short!
- */
-uint8_t execute_cmd(uint8_t cmd, uint8_t arg) {
-    // if we don't change ret_val by setting it to voltage or
-    // something, then we'll just return the command we got as
-    // an acknowledgement.
-    uint8_t ret_val = BLANK;
-
-    switch (cmd) {
-        case KICK_CMD:
-            millis_left_ = arg;
-            PORTA |= _BV(KICK_PIN);  // set KICK pin
-            TCCR0B |= _BV(CS01);     // start timer /8 prescale
-            break;
-
-        case CHIP_CMD:
-            millis_left_ = arg;
-            PORTA |= _BV(CHIP_PIN);  // set CHIP pin
-            TCCR0B |= _BV(CS01);     // start timer /8 prescale
-            break;
-
-        case SET_CHARGE_CMD:
-            // set state based on argument
-            if (arg == ON_ARG) {
-                charge_allowed_ = true;
-            } else if (arg == OFF_ARG) {
-                charge_allowed_ = false;
-            }
-            break;
-
-        case GET_VOLTAGE_CMD:
-            ret_val = last_voltage_;
-            break;
-
-        case PING_CMD:
-            // do nothing, ping is just a way to check if the kicker
-            // is connected by checking the returned command ack from
-            // earlier.
-            break;
-
-        default:
-            ret_val =
-                0xCC;  // return a weird value to show arg wasn't recognized
-            break;
-    }
-
-    return ret_val;
+    kicker_tick_ms(&state_);
+    apply_outputs();
 }